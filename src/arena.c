@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: ISC
+// SPDX-FileCopyrightText: 2014-19 Scott Vokes <vokes.s@gmail.com>
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "fuzz.h"
+#include "types_internal.h"
+
+// This is a bump allocator for instances generated during a trial.
+// It's reset back to empty after each trial, and back to a mark after
+// each rejected shrink candidate, so instances allocated from it never
+// need to be freed one at a time. Chunks are kept when it's reset, so
+// after the first few trials, generating doesn't call malloc at all.
+
+// Size of the first chunk, in bytes. Later chunks double in size, up
+// to (DEF_ARENA_CHUNK << MAX_ARENA_CHUNK_SHIFT).
+#define DEF_ARENA_CHUNK       (64 * 1024)
+#define MAX_ARENA_CHUNK_SHIFT 10
+
+// Default alignment, for ALIGN of 0.
+#define DEF_ARENA_ALIGN 16
+
+// How large should the array of chunks be, once one is added?
+#define DEF_ARENA_CHUNKS_CEIL 4
+
+#define LOG_ARENA 0
+
+struct arena_chunk {
+	size_t  size;
+	size_t  used;
+	uint8_t data[];
+};
+
+struct fuzz_arena {
+	size_t               current; // chunk being allocated from
+	size_t               count;
+	size_t               ceil;
+	struct arena_chunk** chunks;
+};
+
+static bool add_chunk(struct fuzz_arena* a, size_t at, size_t min_size);
+
+struct fuzz_arena*
+fuzz_arena_new(void)
+{
+	return calloc(1, sizeof(struct fuzz_arena));
+}
+
+void*
+fuzz_arena_alloc_from(struct fuzz_arena* a, size_t size, size_t align)
+{
+	if (align == 0) {
+		align = DEF_ARENA_ALIGN;
+	}
+	assert((align & (align - 1)) == 0); // must be a power of 2
+
+	for (size_t i = a->current; i <= a->count; i++) {
+		if (i == a->count || a->chunks[i]->size < size + align) {
+			// No chunk here, or too small to be sure to fit it.
+			if (i < a->count && a->chunks[i]->used > 0) {
+				continue;
+			}
+			if (!add_chunk(a, i, size + align)) {
+				return NULL;
+			}
+		}
+
+		struct arena_chunk* c   = a->chunks[i];
+		const uintptr_t     p   = (uintptr_t)&c->data[c->used];
+		const size_t        pad = (size_t)(-p & (align - 1));
+		if (c->used + pad + size <= c->size) {
+			a->current = i;
+			c->used += pad + size;
+			LOG(4 - LOG_ARENA, "%s: %zd bytes from chunk %zd\n",
+					__func__, size, i);
+			return &c->data[c->used - size];
+		}
+	}
+	assert(false); // add_chunk always makes room
+	return NULL;
+}
+
+// Put a new chunk of at least MIN_SIZE bytes at AT, either appending
+// it or replacing an unused chunk that is too small.
+static bool
+add_chunk(struct fuzz_arena* a, size_t at, size_t min_size)
+{
+	const size_t shift = (at < MAX_ARENA_CHUNK_SHIFT ? at
+							 : MAX_ARENA_CHUNK_SHIFT);
+	size_t       size  = (size_t)DEF_ARENA_CHUNK << shift;
+	if (size < min_size) {
+		size = min_size;
+	}
+
+	if (at == a->count && a->count == a->ceil) { // grow
+		const size_t nceil = (a->ceil == 0 ? DEF_ARENA_CHUNKS_CEIL
+						   : 2 * a->ceil);
+		struct arena_chunk** nchunks =
+				realloc(a->chunks, nceil * sizeof(*nchunks));
+		if (nchunks == NULL) {
+			return false;
+		}
+		a->chunks = nchunks;
+		a->ceil   = nceil;
+	}
+
+	struct arena_chunk* c = malloc(sizeof(*c) + size);
+	if (c == NULL) {
+		return false;
+	}
+	c->size = size;
+	c->used = 0;
+	LOG(3 - LOG_ARENA, "%s: chunk %zd, %zd bytes\n", __func__, at, size);
+
+	if (at == a->count) {
+		a->count++;
+	} else {
+		free(a->chunks[at]);
+	}
+	a->chunks[at] = c;
+	return true;
+}
+
+struct fuzz_arena_mark
+fuzz_arena_get_mark(const struct fuzz_arena* a)
+{
+	if (a == NULL || a->count == 0) {
+		return (struct fuzz_arena_mark){.chunk = 0};
+	}
+	return (struct fuzz_arena_mark){
+			.chunk = a->current,
+			.used  = a->chunks[a->current]->used,
+	};
+}
+
+void
+fuzz_arena_reset(struct fuzz_arena* a, struct fuzz_arena_mark mark)
+{
+	if (a == NULL || a->count == 0) {
+		return;
+	}
+	assert(mark.chunk <= a->current);
+	for (size_t i = mark.chunk + 1; i <= a->current; i++) {
+		a->chunks[i]->used = 0;
+	}
+	a->chunks[mark.chunk]->used = mark.used;
+	a->current                  = mark.chunk;
+}
+
+void
+fuzz_arena_free(struct fuzz_arena* a)
+{
+	for (size_t i = 0; i < a->count; i++) {
+		free(a->chunks[i]);
+	}
+	free(a->chunks);
+	free(a);
+}
+
+void*
+fuzz_arena_alloc(struct fuzz* t, size_t size, size_t align)
+{
+	if (t->arena == NULL) {
+		t->arena = fuzz_arena_new();
+		if (t->arena == NULL) {
+			return NULL;
+		}
+	}
+	return fuzz_arena_alloc_from(t->arena, size, align);
+}
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: ISC
+// SPDX-FileCopyrightText: 2014-19 Scott Vokes <vokes.s@gmail.com>
+#ifndef FUZZ_ARENA_H
+#define FUZZ_ARENA_H
+
+#include <stddef.h>
+
+// Opaque type for the arena that fuzz_arena_alloc allocates from.
+struct fuzz_arena;
+
+// A point in the arena to reset back to, freeing everything allocated
+// after it.
+struct fuzz_arena_mark {
+	size_t chunk; // chunk in use
+	size_t used;  // bytes used in that chunk
+};
+
+// Allocate an empty arena. Chunks are only allocated once needed.
+struct fuzz_arena* fuzz_arena_new(void);
+
+// Allocate SIZE bytes aligned to ALIGN from the arena, or return NULL.
+void* fuzz_arena_alloc_from(struct fuzz_arena* a, size_t size, size_t align);
+
+// Get the arena's current position. A is allowed to be NULL.
+struct fuzz_arena_mark fuzz_arena_get_mark(const struct fuzz_arena* a);
+
+// Reset the arena back to MARK. Its chunks are kept, to be reused by
+// later allocations. A is allowed to be NULL.
+void fuzz_arena_reset(struct fuzz_arena* a, struct fuzz_arena_mark mark);
+
+// Free the arena and all of its chunks.
+void fuzz_arena_free(struct fuzz_arena* a);
+
+#endif
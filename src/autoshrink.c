@@ -6,8 +6,10 @@
 
 #include "autoshrink.h"
 #include "fuzz.h"
+#include "polyfill.h"
 #include "random.h"
 #include "rng.h"
+#include "trial.h"
 #include "types_internal.h"
 
 #define GET_DEF(X, DEF) (X ? X : DEF)
@@ -16,12 +18,36 @@
 static struct autoshrink_bit_pool* alloc_bit_pool(
 		size_t size, size_t limit, size_t request_ceil);
 
-static int alloc_from_bit_pool(struct fuzz* t, struct autoshrink_env* env,
+static int alloc_from_bit_pool(struct fuzz* t, uint8_t arg_i,
 		struct autoshrink_bit_pool* bit_pool, void** output,
 		bool shrinking);
+static void free_pool_buffers(struct autoshrink_bit_pool* pool);
 
-static bool append_request(
-		struct autoshrink_bit_pool* pool, uint32_t bit_count);
+static bool append_request(struct autoshrink_bit_pool* pool,
+		uint32_t bit_count, uint8_t kind);
+static uint8_t request_kind(
+		const struct autoshrink_bit_pool* pool, size_t pos);
+static uint32_t request_size(
+		const struct autoshrink_bit_pool* pool, size_t pos);
+
+static void close_open_spans(struct autoshrink_bit_pool* pool);
+
+static size_t span_end(const struct autoshrink_bit_pool* pool, size_t si);
+
+static size_t span_end_at(
+		const struct autoshrink_bit_pool* pool, size_t pos);
+
+static bool next_sibling_span(const struct autoshrink_bit_pool* pool,
+		size_t si, size_t* sibling);
+
+static int compare_spans(const struct autoshrink_bit_pool* layout,
+		const struct autoshrink_bit_pool* pool, size_t a, size_t b);
+
+static bool rotate_bits(struct autoshrink_bit_pool* pool, size_t from,
+		size_t mid, size_t to);
+
+static bool swap_span_at(const struct autoshrink_bit_pool* orig,
+		struct autoshrink_bit_pool* pool, size_t pos);
 
 static void drop_from_bit_pool(struct fuzz* t, struct autoshrink_env* env,
 		const struct autoshrink_bit_pool* orig,
@@ -31,6 +57,17 @@ static void mutate_bit_pool(struct fuzz* t, struct autoshrink_env* env,
 		const struct autoshrink_bit_pool* orig,
 		struct autoshrink_bit_pool*       pool);
 
+static uint8_t chunk_bits(size_t remaining);
+
+static void reroll_request(struct fuzz* t, struct autoshrink_env* env,
+		const struct autoshrink_bit_pool* orig,
+		struct autoshrink_bit_pool*       copy);
+
+static void splice_bit_pools(struct fuzz* t, struct autoshrink_env* env,
+		const struct autoshrink_bit_pool* a,
+		const struct autoshrink_bit_pool* b,
+		struct autoshrink_bit_pool*       copy);
+
 static bool choose_and_mutate_request(struct fuzz* t,
 		struct autoshrink_env*             env,
 		const struct autoshrink_bit_pool*  orig,
@@ -52,7 +89,27 @@ static void write_bits_at_offset(struct autoshrink_bit_pool* pool,
 
 static void truncate_trailing_zero_bytes(struct autoshrink_bit_pool* pool);
 
-static void init_model(struct autoshrink_env* env);
+static void copy_bits_except(const struct autoshrink_bit_pool* orig,
+		struct autoshrink_bit_pool* copy, size_t skip_from,
+		size_t skip_to);
+
+static bool is_shortlex_smaller(const struct autoshrink_bit_pool* orig,
+		const struct autoshrink_bit_pool* copy);
+
+static bool get_joint_move(const struct autoshrink_bit_pool* a,
+		const struct autoshrink_bit_pool* b, uint32_t tactic,
+		struct joint_move* move);
+
+static struct autoshrink_bit_pool* copy_for_joint_move(
+		const struct autoshrink_env* env,
+		const struct autoshrink_bit_pool* orig, size_t from, size_t to,
+		uint32_t size, uint64_t value);
+
+static bool run_next_pass(struct autoshrink_env* env,
+		const struct autoshrink_bit_pool* orig,
+		struct autoshrink_bit_pool*       copy);
+
+static void init_model(struct fuzz* t, struct autoshrink_env* env);
 
 static enum mutation get_weighted_mutation(
 		struct fuzz* t, struct autoshrink_env* env);
@@ -63,6 +120,8 @@ static bool should_drop(struct fuzz* t, struct autoshrink_env* env,
 static void lazily_fill_bit_pool(struct fuzz* t,
 		struct autoshrink_bit_pool* pool, const uint32_t bit_count);
 
+static size_t update_pool_hint(size_t hint, size_t used);
+
 static void fill_buf(struct autoshrink_bit_pool* pool,
 		const uint32_t bit_count, uint64_t* buf);
 
@@ -104,7 +163,7 @@ fuzz_autoshrink_free_env(struct fuzz* t, struct autoshrink_env* env)
 void
 fuzz_autoshrink_bit_pool_random(struct fuzz* t,
 		struct autoshrink_bit_pool* pool, uint32_t bit_count,
-		bool save_request, uint64_t* buf)
+		uint8_t kind, bool save_request, uint64_t* buf)
 {
 	assert(pool);
 	if (bit_count == 0) {
@@ -124,9 +183,7 @@ fuzz_autoshrink_bit_pool_random(struct fuzz* t,
 				"%s: end of bit pool, yielding zeroes\n",
 				__func__);
 		memset(buf, 0x00,
-				(bit_count / 64) +
-						((bit_count % 64) == 0 ? 0
-								       : 1));
+				((bit_count + 63) / 64) * sizeof(uint64_t));
 		return;
 	}
 
@@ -135,7 +192,7 @@ fuzz_autoshrink_bit_pool_random(struct fuzz* t,
 		bit_count = (uint32_t)(pool->limit - pool->consumed);
 	}
 
-	if (save_request && !append_request(pool, bit_count)) {
+	if (save_request && !append_request(pool, bit_count, kind)) {
 		assert(false); // memory fail
 	}
 
@@ -146,15 +203,22 @@ static void
 lazily_fill_bit_pool(struct fuzz* t, struct autoshrink_bit_pool* pool,
 		const uint32_t bit_count)
 {
-	// Grow pool->bits as necessary
+	const size_t need = pool->consumed + bit_count;
+
+	// Grow pool->bits as necessary, doubling until it fits, but with
+	// one realloc. bits_ceil is in bits and always a multiple of 64.
 	LOG(3, "consumed %zd, bit_count %u, ceil %zd\n", pool->consumed,
 			bit_count, pool->bits_ceil);
-	while (pool->consumed + bit_count > pool->bits_ceil) {
-		size_t nceil = 2 * pool->bits_ceil;
+	if (need > pool->bits_ceil) {
+		size_t nceil = pool->bits_ceil;
+		while (need > nceil) {
+			nceil *= 2;
+		}
+		assert((nceil % 64) == 0);
 		LOG(1, "growing pool: from bits %p, ceil %zd, ",
 				(void*)pool->bits, pool->bits_ceil);
-		uint64_t* nbits = realloc(
-				pool->bits, nceil / (64 / sizeof(uint64_t)));
+		uint64_t* nbits = realloc(pool->bits,
+				(nceil / 64) * sizeof(uint64_t));
 		LOG(1, "nbits %p, nceil %zd\n", (void*)nbits, nceil);
 		if (nbits == NULL) {
 			assert(false); // alloc fail
@@ -164,17 +228,29 @@ lazily_fill_bit_pool(struct fuzz* t, struct autoshrink_bit_pool* pool,
 		pool->bits_ceil = nceil;
 	}
 
-	while (pool->consumed + bit_count > pool->bits_filled) {
-		uint64_t* bits64 = (uint64_t*)pool->bits;
-		size_t    offset = pool->bits_filled / 64;
-		assert(offset * 64 < pool->bits_ceil);
-		bits64[offset] = fuzz_rng_random(t->prng.rng);
-		LOG(3, "filling bit64[%zd]: 0x%016" PRIx64 "\n", offset,
-				bits64[offset]);
-		pool->bits_filled += 64;
+	// Fill all the words needed in one pass. Only fill as far as
+	// needed, so the PRNG stream matches filling on demand.
+	if (need > pool->bits_filled) {
+		uint64_t*    bits64 = (uint64_t*)pool->bits;
+		const size_t from   = pool->bits_filled / 64;
+		const size_t to     = (need + 63) / 64;
+		assert(to * 64 <= pool->bits_ceil);
+		for (size_t i = from; i < to; i++) {
+			bits64[i] = fuzz_rng_random(t->prng.rng);
+		}
+		LOG(3, "filled bit64[%zd] to [%zd]\n", from, to);
+		pool->bits_filled = to * 64;
 	}
 }
 
+// Decay a size hint, but not below what was just used.
+static size_t
+update_pool_hint(size_t hint, size_t used)
+{
+	hint -= hint >> POOL_HINT_DECAY2;
+	return (used > hint ? used : hint);
+}
+
 static void
 fill_buf(struct autoshrink_bit_pool* pool, const uint32_t bit_count,
 		uint64_t* dst)
@@ -256,9 +332,10 @@ get_aligned_size(size_t size, uint8_t alignment)
 static struct autoshrink_bit_pool*
 alloc_bit_pool(size_t size, size_t limit, size_t request_ceil)
 {
-	uint8_t*                    bits     = NULL;
-	uint32_t*                   requests = NULL;
-	struct autoshrink_bit_pool* res      = NULL;
+	uint8_t*                    bits          = NULL;
+	uint8_t*                    requests      = NULL;
+	uint8_t*                    request_kinds = NULL;
+	struct autoshrink_bit_pool* res           = NULL;
 
 	size_t alloc_size = get_aligned_size(size, 64);
 	assert((alloc_size % 64) == 0);
@@ -283,6 +360,11 @@ alloc_bit_pool(size_t size, size_t limit, size_t request_ceil)
 		goto fail;
 	}
 
+	request_kinds = calloc(request_ceil, sizeof(*request_kinds));
+	if (request_kinds == NULL) {
+		goto fail;
+	}
+
 	*res = (struct autoshrink_bit_pool){
 			.bits          = bits,
 			.bits_ceil     = alloc_size,
@@ -290,6 +372,8 @@ alloc_bit_pool(size_t size, size_t limit, size_t request_ceil)
 			.request_count = 0,
 			.request_ceil  = request_ceil,
 			.requests      = requests,
+			.request_kinds = request_kinds,
+			.open_span     = NO_SPAN,
 	};
 	return res;
 
@@ -303,6 +387,9 @@ fail:
 	if (requests) {
 		free(requests);
 	}
+	if (request_kinds) {
+		free(request_kinds);
+	}
 	return NULL;
 }
 
@@ -315,26 +402,41 @@ fuzz_autoshrink_free_bit_pool(struct fuzz* t, struct autoshrink_bit_pool* pool)
 	}
 	assert(pool);
 	assert(pool->bits);
+	free(pool->bits);
+	free_pool_buffers(pool);
+}
+
+// Free everything POOL owns except its bits, and POOL itself.
+static void
+free_pool_buffers(struct autoshrink_bit_pool* pool)
+{
 	if (pool->index) {
 		free(pool->index);
 	}
-	free(pool->bits);
 	free(pool->requests);
+	if (pool->request_kinds) {
+		free(pool->request_kinds);
+	}
+	if (pool->wide_requests) {
+		free(pool->wide_requests);
+	}
+	if (pool->spans) {
+		free(pool->spans);
+	}
 	free(pool);
 }
 
 static int
-alloc_from_bit_pool(struct fuzz* t, struct autoshrink_env* env,
+alloc_from_bit_pool(struct fuzz* t, uint8_t arg_i,
 		struct autoshrink_bit_pool* bit_pool, void** output,
 		bool shrinking)
 {
-	assert(env);
 	int ares;
 	bit_pool->shrinking = shrinking;
 	fuzz_random_inject_autoshrink_bit_pool(t, bit_pool);
-	struct fuzz_type_info* ti = t->prop.type_info[env->arg_i];
-	ares                      = ti->alloc(t, ti->env, output);
+	ares = fuzz_trial_alloc_instance(t, arg_i, output);
 	fuzz_random_stop_using_bit_pool(t);
+	close_open_spans(bit_pool);
 	return ares;
 }
 
@@ -343,26 +445,235 @@ fuzz_autoshrink_alloc(
 		struct fuzz* t, struct autoshrink_env* env, void** instance)
 {
 	assert(env);
-	const size_t pool_size  = GET_DEF(env->pool_size, DEF_POOL_SIZE);
 	const size_t pool_limit = GET_DEF(env->pool_limit, DEF_POOL_LIMIT);
+	size_t       pool_size  = GET_DEF(env->pool_size, DEF_POOL_SIZE);
 
-	struct autoshrink_bit_pool* pool = alloc_bit_pool(
-			pool_size, pool_limit, DEF_REQUESTS_CEIL);
+	// Size the pool for what earlier trials used, so generators that
+	// consume a lot of bits don't grow it again every trial.
+	const uint8_t arg_i = env->arg_i;
+	if (t->prng.pool_bits[arg_i] > pool_size) {
+		pool_size = t->prng.pool_bits[arg_i];
+	}
+	if (pool_size > pool_limit) {
+		pool_size = pool_limit;
+	}
+	size_t request_ceil = DEF_REQUESTS_CEIL;
+	while (request_ceil < t->prng.pool_requests[arg_i]) {
+		request_ceil *= 2;
+	}
+
+	struct autoshrink_bit_pool* pool =
+			alloc_bit_pool(pool_size, pool_limit, request_ceil);
 	if (pool == NULL) {
 		return FUZZ_RESULT_ERROR;
 	}
 	env->bit_pool = pool;
 
 	void* res  = NULL;
-	int   ares = alloc_from_bit_pool(t, env, pool, &res, false);
+	int   ares = alloc_from_bit_pool(t, env->arg_i, pool, &res, false);
 	if (ares != FUZZ_RESULT_OK) {
 		return ares;
 	}
 
+	t->prng.pool_bits[arg_i] = update_pool_hint(
+			t->prng.pool_bits[arg_i], pool->consumed);
+	t->prng.pool_requests[arg_i] = update_pool_hint(
+			t->prng.pool_requests[arg_i], pool->request_count);
+
 	*instance = res;
 	return FUZZ_RESULT_OK;
 }
 
+int
+fuzz_autoshrink_alloc_from_bits(struct fuzz* t, struct autoshrink_env* env,
+		const uint8_t* bits, size_t bit_count, void** instance)
+{
+	assert(env);
+	struct autoshrink_bit_pool* pool = alloc_bit_pool(
+			bit_count > 0 ? bit_count : 64, bit_count,
+			DEF_REQUESTS_CEIL);
+	if (pool == NULL) {
+		return FUZZ_RESULT_ERROR;
+	}
+	uint64_t* words = (uint64_t*)pool->bits;
+	for (size_t i = 0; i < (bit_count + 7) / 8; i++) {
+		words[i / 8] |= (uint64_t)bits[i] << (8 * (i % 8));
+	}
+	pool->bits_filled = bit_count;
+	env->bit_pool     = pool;
+
+	// Read it the way shrinking does, so it isn't filled from the PRNG.
+	return alloc_from_bit_pool(t, env->arg_i, pool, instance, true);
+}
+
+int
+fuzz_autoshrink_alloc_mutant(struct fuzz* t, struct autoshrink_env* env,
+		struct autoshrink_bit_pool* pool,
+		struct autoshrink_bit_pool* other, void** instance)
+{
+	assert(env);
+	if (!build_index(pool) || (other != NULL && !build_index(other))) {
+		return FUZZ_RESULT_ERROR;
+	}
+	size_t size = pool->bits_filled;
+	if (other != NULL) {
+		size += other->bits_filled;
+	}
+	struct autoshrink_bit_pool* copy =
+			alloc_bit_pool(size, pool->limit, pool->request_ceil);
+	if (copy == NULL) {
+		return FUZZ_RESULT_ERROR;
+	}
+	if (!env->model.ready) {
+		init_model(t, env);
+	}
+
+	// The shrinking mutations only make values smaller, so a quarter
+	// of the time replace a request with random bits instead, and
+	// another quarter splice two inputs together. Without another
+	// input to splice in, that quarter goes to random bits too.
+	autoshrink_prng_fun* prng = get_prng(t, env);
+	const uint64_t       op   = prng(2, env->udata);
+	if (op == 0 && other != NULL) {
+		splice_bit_pools(t, env, pool, other, copy);
+	} else if (op <= 1) {
+		reroll_request(t, env, pool, copy);
+	} else if (should_drop(t, env, pool->request_count)) {
+		drop_from_bit_pool(t, env, pool, copy);
+	} else {
+		mutate_bit_pool(t, env, pool, copy);
+	}
+
+	// Unlike a shrinking candidate, the mutant can grow: once its bits
+	// run out, more are filled in from the PRNG, a word at a time, so
+	// fill out its last word first.
+	copy->limit = pool->limit;
+	if ((copy->bits_filled % 64) != 0) {
+		const size_t filled = copy->bits_filled;
+		const size_t end    = get_aligned_size(filled, 64);
+		const uint8_t rest  = (uint8_t)(end - filled);
+		write_bits_at_offset(copy, filled, rest, prng(rest, env->udata));
+		copy->bits_filled = end;
+	}
+	env->bit_pool = copy;
+	return alloc_from_bit_pool(t, env->arg_i, copy, instance, false);
+}
+
+struct autoshrink_bit_pool*
+fuzz_autoshrink_replay_pool_new(size_t request_ceil)
+{
+	size_t ceil = DEF_REQUESTS_CEIL;
+	while (ceil < request_ceil) {
+		ceil *= 2;
+	}
+	struct autoshrink_bit_pool* pool = alloc_bit_pool(64, 0, ceil);
+	if (pool == NULL) {
+		return NULL;
+	}
+	free(pool->bits); // bits are borrowed from each record
+	pool->bits = NULL;
+	return pool;
+}
+
+void
+fuzz_autoshrink_replay_pool_free(struct autoshrink_bit_pool* pool)
+{
+	if (pool != NULL) {
+		free_pool_buffers(pool);
+	}
+}
+
+int
+fuzz_autoshrink_replay_alloc(struct fuzz* t, uint8_t arg_i,
+		struct autoshrink_bit_pool* pool, const uint64_t* bits,
+		size_t bit_count, void** instance)
+{
+	// Only read from while shrinking, so the bits are never written.
+	pool->bits          = (uint8_t*)(uintptr_t)bits;
+	pool->bits_filled   = bit_count;
+	pool->bits_ceil     = get_aligned_size(bit_count, 64);
+	pool->limit         = bit_count;
+	pool->consumed      = 0;
+	pool->request_count = 0;
+	pool->wide_count    = 0;
+	pool->span_count    = 0;
+	pool->open_span     = NO_SPAN;
+	pool->generation    = 0;
+	if (pool->index != NULL) {
+		free(pool->index); // built for the last record's requests
+		pool->index = NULL;
+	}
+	return alloc_from_bit_pool(t, arg_i, pool, instance, true);
+}
+
+size_t
+fuzz_autoshrink_request_count(const struct autoshrink_bit_pool* pool)
+{
+	return pool->request_count;
+}
+
+uint32_t
+fuzz_autoshrink_request_size(
+		const struct autoshrink_bit_pool* pool, size_t pos)
+{
+	return request_size(pool, pos);
+}
+
+struct autoshrink_bit_pool*
+fuzz_autoshrink_copy_bit_pool(const struct autoshrink_bit_pool* pool)
+{
+	struct autoshrink_bit_pool* copy = alloc_bit_pool(
+			pool->bits_filled, pool->limit, DEF_REQUESTS_CEIL);
+	if (copy == NULL) {
+		return NULL;
+	}
+	memcpy(copy->bits, pool->bits, (pool->bits_filled + 7) / 8);
+	copy->bits_filled = pool->bits_filled;
+	copy->generation  = pool->generation;
+	return copy;
+}
+
+int
+fuzz_autoshrink_alloc_copy(struct fuzz* t, struct autoshrink_env* env,
+		const struct autoshrink_bit_pool* pool, void** output,
+		struct autoshrink_bit_pool** output_pool)
+{
+	struct autoshrink_bit_pool* copy = fuzz_autoshrink_copy_bit_pool(pool);
+	if (copy == NULL) {
+		return FUZZ_RESULT_ERROR;
+	}
+
+	void* res  = NULL;
+	int   ares = alloc_from_bit_pool(t, env->arg_i, copy, &res, true);
+	if (ares != FUZZ_RESULT_OK) {
+		fuzz_autoshrink_free_bit_pool(t, copy);
+		return ares;
+	}
+
+	*output      = res;
+	*output_pool = copy;
+	return FUZZ_RESULT_OK;
+}
+
+int
+fuzz_autoshrink_restart(struct fuzz* t, struct autoshrink_env* env,
+		const struct autoshrink_bit_pool* pool, void** output,
+		struct autoshrink_bit_pool** output_pool)
+{
+	const int ares = fuzz_autoshrink_alloc_copy(
+			t, env, pool, output, output_pool);
+	if (ares != FUZZ_RESULT_OK) {
+		return ares;
+	}
+
+	env->passes = (struct autoshrink_passes){.pass = PASS_DONE};
+	if (env->model.next_action == 0x00) {
+		// Let init_model set the weights up again.
+		env->model = (struct autoshrink_model){.cur_tried = 0x00};
+	}
+	return FUZZ_RESULT_OK;
+}
+
 uint64_t
 fuzz_autoshrink_hash(struct fuzz* t, const void* instance,
 		struct autoshrink_env* env, void* type_env)
@@ -374,33 +685,36 @@ fuzz_autoshrink_hash(struct fuzz* t, const void* instance,
 	if (ti->hash != NULL) {
 		return ti->hash(instance, type_env);
 	} else {
-		struct autoshrink_bit_pool* pool = env->bit_pool;
-		assert(pool);
-		// Hash the consumed bits from the bit pool
-		uint64_t h = 0;
-		fuzz_hash_init(&h);
-		LOG(5 - LOG_AUTOSHRINK, "@@@ SINKING: [ ");
-		for (size_t i = 0; i < pool->consumed / 8; i++) {
-			LOG(5 - LOG_AUTOSHRINK, "%02x ", pool->bits[i]);
-		}
-		fuzz_hash_sink(&h, pool->bits, pool->consumed / 8);
-		const uint8_t rem_bits = pool->consumed % 8;
-		if (rem_bits > 0) {
-			const uint8_t last_byte =
-					pool->bits[pool->consumed / 8];
-			const uint8_t mask = ((1U << rem_bits) - 1);
-			uint8_t       rem  = last_byte & mask;
-			LOG(5 - LOG_AUTOSHRINK, "%02x/%d", rem, rem_bits);
-			fuzz_hash_sink(&h, &rem, 1);
-		}
-		LOG(5 - LOG_AUTOSHRINK, " ]\n");
-		uint64_t res = fuzz_hash_finish(&h);
-		LOG(2 - LOG_AUTOSHRINK, "%s: 0x%016" PRIx64 "\n", __func__,
-				res);
-		return res;
+		assert(env->bit_pool);
+		return fuzz_autoshrink_bit_pool_hash(env->bit_pool);
 	}
 }
 
+uint64_t
+fuzz_autoshrink_bit_pool_hash(const struct autoshrink_bit_pool* pool)
+{
+	// Hash the consumed bits from the bit pool
+	uint64_t h = 0;
+	fuzz_hash_init(&h);
+	LOG(5 - LOG_AUTOSHRINK, "@@@ SINKING: [ ");
+	for (size_t i = 0; i < pool->consumed / 8; i++) {
+		LOG(5 - LOG_AUTOSHRINK, "%02x ", pool->bits[i]);
+	}
+	fuzz_hash_sink(&h, pool->bits, pool->consumed / 8);
+	const uint8_t rem_bits = pool->consumed % 8;
+	if (rem_bits > 0) {
+		const uint8_t last_byte = pool->bits[pool->consumed / 8];
+		const uint8_t mask      = ((1U << rem_bits) - 1);
+		uint8_t       rem       = last_byte & mask;
+		LOG(5 - LOG_AUTOSHRINK, "%02x/%d", rem, rem_bits);
+		fuzz_hash_sink(&h, &rem, 1);
+	}
+	LOG(5 - LOG_AUTOSHRINK, " ]\n");
+	uint64_t res = fuzz_hash_finish(&h);
+	LOG(2 - LOG_AUTOSHRINK, "%s: 0x%016" PRIx64 "\n", __func__, res);
+	return res;
+}
+
 int
 fuzz_autoshrink_shrink(struct fuzz* t, struct autoshrink_env* env,
 		uint32_t tactic, void** output,
@@ -409,9 +723,22 @@ fuzz_autoshrink_shrink(struct fuzz* t, struct autoshrink_env* env,
 	struct autoshrink_bit_pool* orig = env->bit_pool;
 	assert(orig);
 
-	if (tactic >= GET_DEF(env->max_failed_shrinks,
-				      DEF_MAX_FAILED_SHRINKS)) {
-		return FUZZ_SHRINK_NO_MORE_TACTICS;
+	// The deterministic passes budget max_failed_shrinks per pass on
+	// their own (see run_next_pass), so they don't count towards the
+	// random phase's failures.
+	// Skip them when a test has an action scheduled.
+	const bool use_passes = env->model.next_action == 0x00 &&
+				env->passes.pass != PASS_DONE;
+	if (!use_passes) {
+		if (tactic < env->passes.tactic_base) {
+			// tactics restarted after a successful shrink
+			env->passes.tactic_base = 0;
+		}
+		if (tactic - env->passes.tactic_base >=
+				GET_DEF(env->max_failed_shrinks,
+						DEF_MAX_FAILED_SHRINKS)) {
+			return FUZZ_SHRINK_NO_MORE_TACTICS;
+		}
 	}
 
 	if (!build_index(orig)) {
@@ -427,7 +754,7 @@ fuzz_autoshrink_shrink(struct fuzz* t, struct autoshrink_env* env,
 	copy->generation      = orig->generation + 1;
 	size_t total_consumed = 0;
 	for (size_t i = 0; i < orig->request_count; i++) {
-		total_consumed += orig->requests[i];
+		total_consumed += request_size(orig, i);
 	}
 	assert(total_consumed == orig->consumed);
 	copy->limit = orig->limit;
@@ -441,11 +768,23 @@ fuzz_autoshrink_shrink(struct fuzz* t, struct autoshrink_env* env,
 				FUZZ_AUTOSHRINK_PRINT_ALL);
 	}
 
-	if (env->model.weights[WEIGHT_DROP] == 0) {
-		init_model(env);
+	if (!env->model.ready) {
+		init_model(t, env);
+	}
+
+	bool from_pass = false;
+	if (use_passes) {
+		from_pass = run_next_pass(env, orig, copy);
+		if (!from_pass) {
+			// Passes are done, count random attempts from here.
+			env->passes.tactic_base = tactic;
+		}
 	}
 
-	if (should_drop(t, env, orig->request_count)) {
+	if (from_pass) {
+		LOG(3 - LOG_AUTOSHRINK, "PASS %d, pos %zd\n", env->passes.pass,
+				env->passes.pos);
+	} else if (should_drop(t, env, orig->request_count)) {
 		env->model.cur_set |= ASA_DROP;
 		drop_from_bit_pool(t, env, orig, copy);
 	} else {
@@ -461,8 +800,19 @@ fuzz_autoshrink_shrink(struct fuzz* t, struct autoshrink_env* env,
 		truncate_trailing_zero_bytes(copy);
 	}
 
+	// Only a candidate that is strictly smaller than the original can
+	// make progress, so reject anything else before running the alloc
+	// callback or the property. Skip this when a test has an action
+	// scheduled, since it checks that action's exact result.
+	const bool check_order = env->model.next_action == 0x00;
+	if (check_order && !is_shortlex_smaller(orig, copy)) {
+		LOG(3 - LOG_AUTOSHRINK, "candidate is not smaller\n");
+		fuzz_autoshrink_free_bit_pool(t, copy);
+		return FUZZ_SHRINK_DEAD_END;
+	}
+
 	void* res  = NULL;
-	int   ares = alloc_from_bit_pool(t, env, copy, &res, true);
+	int   ares = alloc_from_bit_pool(t, env->arg_i, copy, &res, true);
 	if (ares == FUZZ_RESULT_SKIP) {
 		fuzz_autoshrink_free_bit_pool(t, copy);
 		return FUZZ_SHRINK_DEAD_END;
@@ -472,11 +822,233 @@ fuzz_autoshrink_shrink(struct fuzz* t, struct autoshrink_env* env,
 	}
 
 	assert(ares == FUZZ_RESULT_OK);
+	if (check_order && copy->consumed > orig->consumed) {
+		// The candidate's bits led the alloc callback to consume
+		// more than the original did, so it isn't simpler.
+		LOG(3 - LOG_AUTOSHRINK, "candidate consumed %zd > %zd\n",
+				copy->consumed, orig->consumed);
+		fuzz_trial_release_instance(t, env->arg_i, res);
+		fuzz_autoshrink_free_bit_pool(t, copy);
+		return FUZZ_SHRINK_DEAD_END;
+	}
+
 	*output          = res;
 	*output_bit_pool = copy;
 	return FUZZ_SHRINK_OK;
 }
 
+// Build a candidate for both arguments at once, using the move
+// numbered TACTIC. Moves are tried in order: dropping the N'th
+// top-level span from both bit pools, then, for each pair of requests
+// with the same non-zero value in both, zeroing, halving, and
+// decrementing that value in both.
+int
+fuzz_autoshrink_joint_shrink(struct fuzz* t, struct autoshrink_env* env_a,
+		struct autoshrink_env* env_b, uint32_t tactic,
+		void** output_a, struct autoshrink_bit_pool** output_pool_a,
+		void** output_b, struct autoshrink_bit_pool** output_pool_b)
+{
+	struct autoshrink_bit_pool* orig_a = env_a->bit_pool;
+	struct autoshrink_bit_pool* orig_b = env_b->bit_pool;
+	assert(orig_a && orig_b);
+	if (!build_index(orig_a) || !build_index(orig_b)) {
+		return FUZZ_SHRINK_ERROR;
+	}
+
+	// These candidates don't come from the model, so it shouldn't be
+	// adjusted based on their results.
+	env_a->model.cur_tried = env_a->model.cur_set = 0x00;
+	env_b->model.cur_tried = env_b->model.cur_set = 0x00;
+
+	struct joint_move move = {0};
+	if (!get_joint_move(orig_a, orig_b, tactic, &move)) {
+		return FUZZ_SHRINK_NO_MORE_TACTICS;
+	} else if (move.from_a == move.to_a && move.value == move.old_value) {
+		return FUZZ_SHRINK_DEAD_END; // e.g. halving 1
+	}
+	LOG(2 - LOG_AUTOSHRINK, "JOINT %u: bits %zd-%zd, %zd-%zd\n", tactic,
+			move.from_a, move.to_a, move.from_b, move.to_b);
+
+	struct autoshrink_bit_pool* copy_a = copy_for_joint_move(env_a, orig_a,
+			move.from_a, move.to_a, move.size_a, move.value);
+	struct autoshrink_bit_pool* copy_b = copy_for_joint_move(env_b, orig_b,
+			move.from_b, move.to_b, move.size_b, move.value);
+	if (copy_a == NULL || copy_b == NULL) {
+		if (copy_a) {
+			fuzz_autoshrink_free_bit_pool(t, copy_a);
+		}
+		if (copy_b) {
+			fuzz_autoshrink_free_bit_pool(t, copy_b);
+		}
+		return FUZZ_SHRINK_ERROR;
+	}
+
+	// As in fuzz_autoshrink_shrink, both pools must be strictly
+	// smaller before spending an alloc or a property call on them.
+	const bool check_order = env_a->model.next_action == 0x00 &&
+				 env_b->model.next_action == 0x00;
+	if (check_order && (!is_shortlex_smaller(orig_a, copy_a) ||
+				   !is_shortlex_smaller(orig_b, copy_b))) {
+		LOG(3 - LOG_AUTOSHRINK, "joint candidate is not smaller\n");
+		fuzz_autoshrink_free_bit_pool(t, copy_a);
+		fuzz_autoshrink_free_bit_pool(t, copy_b);
+		return FUZZ_SHRINK_DEAD_END;
+	}
+
+	void* res_a = NULL;
+	void* res_b = NULL;
+
+	int ares = alloc_from_bit_pool(
+			t, env_a->arg_i, copy_a, &res_a, true);
+	if (ares == FUZZ_RESULT_OK) {
+		ares = alloc_from_bit_pool(
+				t, env_b->arg_i, copy_b, &res_b, true);
+		if (ares != FUZZ_RESULT_OK) {
+			fuzz_trial_release_instance(t, env_a->arg_i, res_a);
+		}
+	}
+
+	// Each argument has to be at least as simple as before.
+	const bool longer = (copy_a->consumed > orig_a->consumed ||
+			     copy_b->consumed > orig_b->consumed);
+	if (ares == FUZZ_RESULT_OK && longer) {
+		fuzz_trial_release_instance(t, env_a->arg_i, res_a);
+		fuzz_trial_release_instance(t, env_b->arg_i, res_b);
+		ares = FUZZ_RESULT_SKIP;
+	}
+
+	if (ares != FUZZ_RESULT_OK) {
+		fuzz_autoshrink_free_bit_pool(t, copy_a);
+		fuzz_autoshrink_free_bit_pool(t, copy_b);
+		return (ares == FUZZ_RESULT_SKIP ? FUZZ_SHRINK_DEAD_END
+						 : FUZZ_SHRINK_ERROR);
+	}
+
+	*output_a      = res_a;
+	*output_pool_a = copy_a;
+	*output_b      = res_b;
+	*output_pool_b = copy_b;
+	return FUZZ_SHRINK_OK;
+}
+
+// Count the spans in POOL that aren't nested in another span. If
+// NTH_OUT is non-NULL, also find the index of the NTH one.
+static size_t
+top_level_spans(const struct autoshrink_bit_pool* pool, size_t nth,
+		size_t* nth_out)
+{
+	size_t count = 0;
+	for (size_t si = 0; si < pool->span_count; si++) {
+		if (pool->spans[si].parent != NO_SPAN ||
+				pool->spans[si].first >= span_end(pool, si)) {
+			continue;
+		}
+		if (nth_out != NULL && count == nth) {
+			*nth_out = si;
+		}
+		count++;
+	}
+	return count;
+}
+
+// Can this request's value be changed jointly?
+static bool
+is_joint_value(const struct autoshrink_bit_pool* pool, size_t pos,
+		uint64_t* value)
+{
+	const uint32_t size = request_size(pool, pos);
+	if (size > 64 || request_kind(pool, pos) == FUZZ_REQ_CHOICE) {
+		return false;
+	}
+	*value = read_bits_at_offset(pool, offset_of_pos(pool, pos),
+			(uint8_t)size);
+	return *value != 0;
+}
+
+static bool
+get_joint_move(const struct autoshrink_bit_pool* a,
+		const struct autoshrink_bit_pool* b, uint32_t tactic,
+		struct joint_move* move)
+{
+	const size_t top_a = top_level_spans(a, 0, NULL);
+	const size_t top_b = top_level_spans(b, 0, NULL);
+	const size_t spans = (top_a < top_b ? top_a : top_b);
+	if (tactic < spans) {
+		size_t si = 0;
+		size_t sj = 0;
+		top_level_spans(a, tactic, &si);
+		top_level_spans(b, tactic, &sj);
+		const size_t last_a = span_end(a, si) - 1;
+		const size_t last_b = span_end(b, sj) - 1;
+
+		move->from_a = offset_of_pos(a, a->spans[si].first);
+		move->to_a   = offset_of_pos(a, last_a) +
+			       request_size(a, last_a);
+		move->from_b = offset_of_pos(b, b->spans[sj].first);
+		move->to_b   = offset_of_pos(b, last_b) +
+			       request_size(b, last_b);
+		return true;
+	}
+
+	const uint32_t pair = (uint32_t)(tactic - spans) / JOINT_VALUE_MOVES;
+	const uint32_t op   = (uint32_t)(tactic - spans) % JOINT_VALUE_MOVES;
+	uint32_t       seen = 0;
+	for (size_t i = 0; i < a->request_count; i++) {
+		uint64_t va = 0;
+		if (!is_joint_value(a, i, &va)) {
+			continue;
+		}
+		for (size_t j = 0; j < b->request_count; j++) {
+			uint64_t vb = 0;
+			if (!is_joint_value(b, j, &vb) || va != vb) {
+				continue;
+			} else if (seen++ < pair) {
+				continue;
+			}
+
+			move->from_a    = offset_of_pos(a, i);
+			move->to_a      = move->from_a;
+			move->size_a    = request_size(a, i);
+			move->from_b    = offset_of_pos(b, j);
+			move->to_b      = move->from_b;
+			move->size_b    = request_size(b, j);
+			move->old_value = va;
+			move->value     = (op == 0   ? 0
+					   : op == 1 ? va / 2
+						     : va - 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+// Copy ORIG for a joint move: drop the bits in [from, to), or if they
+// are the same, write VALUE into the SIZE-bit request starting there.
+static struct autoshrink_bit_pool*
+copy_for_joint_move(const struct autoshrink_env* env,
+		const struct autoshrink_bit_pool* orig, size_t from, size_t to,
+		uint32_t size, uint64_t value)
+{
+	struct autoshrink_bit_pool* copy = alloc_bit_pool(
+			orig->bits_filled, orig->limit, orig->request_ceil);
+	if (copy == NULL) {
+		return NULL;
+	}
+	copy->generation = orig->generation + 1;
+
+	if (from < to) {
+		copy_bits_except(orig, copy, from, to);
+	} else {
+		copy_bits_except(orig, copy, orig->consumed, orig->consumed);
+		write_bits_at_offset(copy, from, (uint8_t)size, value);
+	}
+
+	if (!env->leave_trailing_zeroes) {
+		truncate_trailing_zero_bytes(copy);
+	}
+	return copy;
+}
+
 static void
 truncate_trailing_zero_bytes(struct autoshrink_bit_pool* pool)
 {
@@ -555,17 +1127,46 @@ drop_from_bit_pool(struct fuzz* t, struct autoshrink_env* env,
 		to_drop %= orig->request_count;
 	}
 
+	// If the pool has spans, always drop a whole span, and when
+	// dropping a request that starts a span, drop the rest of the span
+	// along with it.
+	size_t to_drop_end = 0;
+	if (to_drop != DO_NOT_DROP && orig->span_count > 0) {
+		const size_t si = prng(32, env->udata) % orig->span_count;
+		if (orig->spans[si].first < span_end(orig, si)) {
+			to_drop     = orig->spans[si].first;
+			to_drop_end = span_end(orig, si);
+		}
+	}
+
 	size_t drop_count = 0;
+	size_t drop_end   = 0; // drop every request before this
 
 	for (size_t ri = 0; ri < orig->request_count; ri++) {
-		const uint32_t req_size = orig->requests[ri];
-		if (ri == to_drop || prng(drop_bits, env->udata) <=
-						     drop_threshold) {
+		const uint32_t req_size = request_size(orig, ri);
+		bool           drop     = ri < drop_end;
+		if (!drop && (ri == to_drop || prng(drop_bits, env->udata) <=
+							     drop_threshold)) {
+			drop = true;
+			drop_count++;
+			size_t end = span_end_at(orig, ri);
+			if (ri == to_drop && to_drop_end > ri) {
+				end = to_drop_end;
+			}
+			if (end > ri + 1) {
+				LOG(2 - LOG_AUTOSHRINK,
+						"DROPPING SPAN: requests "
+						"%zd - %zd\n",
+						ri, end);
+				drop_end = end;
+			}
+		}
+
+		if (drop) {
 			LOG(2 - LOG_AUTOSHRINK, "DROPPING: %zd - %zd\n",
 					src_offset, src_offset + req_size);
-			drop_count++;
 
-			if (req_size > 64) { // drop subset
+			if (req_size > 64 && ri >= drop_end) { // drop subset
 				uint32_t drop_offset = prng(32, env->udata) %
 						       req_size;
 				uint32_t drop_size = prng(32, env->udata) %
@@ -636,6 +1237,11 @@ drop_from_bit_pool(struct fuzz* t, struct autoshrink_env* env,
 			orig->bits_filled, dst_offset, drop_count);
 	(void)drop_count;
 	copy->bits_filled = dst_offset;
+	// The alloc callback only gets zeroes past the bits copied, so
+	// limit the copy there, to make it clear it's shorter.
+	if (dst_offset < copy->limit) {
+		copy->limit = dst_offset;
+	}
 }
 
 static void
@@ -671,7 +1277,7 @@ mutate_bit_pool(struct fuzz* t, struct autoshrink_env* env,
 	if (change_count > orig->request_count) {
 		bool all_small = true;
 		for (size_t i = 0; i < orig->request_count; i++) {
-			if (orig->requests[i] > 64) {
+			if (request_size(orig, i) > 64) {
 				all_small = false;
 				break;
 			}
@@ -722,6 +1328,69 @@ mutate_bit_pool(struct fuzz* t, struct autoshrink_env* env,
 	pool->limit = nsize < pool->limit ? nsize : pool->limit;
 }
 
+// Copy ORIG, but with one request's bits replaced with random ones.
+static void
+reroll_request(struct fuzz* t, struct autoshrink_env* env,
+		const struct autoshrink_bit_pool* orig,
+		struct autoshrink_bit_pool*       copy)
+{
+	memcpy(copy->bits, orig->bits, (orig->bits_filled + 7) / 8);
+	copy->bits_filled = orig->bits_filled;
+	if (orig->request_count == 0) {
+		return;
+	}
+
+	autoshrink_prng_fun* prng = get_prng(t, env);
+	const size_t pos    = prng(64, env->udata) % orig->request_count;
+	const size_t offset = offset_of_pos(orig, pos);
+	const uint32_t size = request_size(orig, pos);
+	for (uint32_t done = 0; done < size;) {
+		const uint8_t bits = chunk_bits(size - done);
+		write_bits_at_offset(copy, offset + done, bits,
+				prng(bits, env->udata));
+		done += bits;
+	}
+}
+
+// Copy A's bits up to the start of a random request, followed by B's
+// bits from the start of a random request on, so the start of one input
+// is combined with the end of another.
+static void
+splice_bit_pools(struct fuzz* t, struct autoshrink_env* env,
+		const struct autoshrink_bit_pool* a,
+		const struct autoshrink_bit_pool* b,
+		struct autoshrink_bit_pool*       copy)
+{
+	autoshrink_prng_fun* prng   = get_prng(t, env);
+	size_t               from_a = 0;
+	size_t               from_b = b->consumed;
+	if (a->request_count > 0) {
+		from_a = offset_of_pos(
+				a, prng(64, env->udata) % a->request_count);
+	}
+	if (b->request_count > 0) {
+		from_b = offset_of_pos(
+				b, prng(64, env->udata) % b->request_count);
+	}
+
+	size_t dst = 0;
+	for (size_t src = 0; src < from_a;) {
+		const uint8_t size = chunk_bits(from_a - src);
+		write_bits_at_offset(copy, dst, size,
+				read_bits_at_offset(a, src, size));
+		src += size;
+		dst += size;
+	}
+	for (size_t src = from_b; src < b->consumed;) {
+		const uint8_t size = chunk_bits(b->consumed - src);
+		write_bits_at_offset(copy, dst, size,
+				read_bits_at_offset(b, src, size));
+		src += size;
+		dst += size;
+	}
+	copy->bits_filled = dst;
+}
+
 static bool
 choose_and_mutate_request(struct fuzz* t, struct autoshrink_env* env,
 		const struct autoshrink_bit_pool* orig,
@@ -740,8 +1409,12 @@ choose_and_mutate_request(struct fuzz* t, struct autoshrink_env* env,
 	// mod here biases it towards earlier requests.
 	const size_t pos =
 			prng(request_bits, env->udata) % orig->request_count;
+	if (request_kind(orig, pos) == FUZZ_REQ_CHOICE) {
+		return false; // choices are only dropped, not mutated
+	}
+
 	const size_t   bit_offset = offset_of_pos(orig, pos);
-	const uint32_t size       = orig->requests[pos];
+	const uint32_t size       = request_size(orig, pos);
 
 	switch (mtype) {
 	default:
@@ -825,6 +1498,10 @@ choose_and_mutate_request(struct fuzz* t, struct autoshrink_env* env,
 	case MUT_SWAP: {
 		env->model.cur_tried |= ASA_SWAP;
 		assert(size > 0);
+		if (swap_span_at(orig, pool, pos)) {
+			env->model.cur_set |= ASA_SWAP;
+			return true;
+		}
 		if (size > 64) {
 			// maybe swap two blocks non-overlapping within the
 			// request
@@ -874,7 +1551,7 @@ choose_and_mutate_request(struct fuzz* t, struct autoshrink_env* env,
 			// smaller, swap.
 			for (size_t i = pos + 1; i < orig->request_count;
 					i++) {
-				if (orig->requests[i] == size) {
+				if (request_size(orig, i) == size) {
 					const size_t other_offset =
 							offset_of_pos(orig, i);
 					const uint64_t other = read_bits_at_offset(
@@ -941,22 +1618,485 @@ choose_and_mutate_request(struct fuzz* t, struct autoshrink_env* env,
 	}
 }
 
-static bool
-build_index(struct autoshrink_bit_pool* pool)
+// How many of the REMAINING bits to read or write at once.
+static uint8_t
+chunk_bits(size_t remaining)
 {
-	if (pool->index == NULL) {
-		size_t* index = malloc(pool->request_count * sizeof(size_t));
-		if (index == NULL) {
-			return false;
-		}
+	return (remaining < 64 ? (uint8_t)remaining : 64);
+}
 
-		size_t total = 0;
-		for (size_t i = 0; i < pool->request_count; i++) {
-			index[i] = total;
-			total += pool->requests[i];
-		}
-		pool->index = index;
-	}
+// Read bits from POOL the way the alloc callback will get them while
+// shrinking: bits past the filled part of the pool are zero.
+static uint64_t
+read_filled_bits(const struct autoshrink_bit_pool* pool, size_t offset,
+		uint8_t size)
+{
+	if (offset >= pool->bits_filled) {
+		return 0;
+	} else if (pool->bits_filled - offset < size) {
+		size = (uint8_t)(pool->bits_filled - offset);
+	}
+	return read_bits_at_offset(pool, offset, size);
+}
+
+// Bit pools are ordered shortlex: a pool that consumes fewer bits is
+// smaller, and pools of the same length are compared one request at a
+// time, using ORIG's requests. Since the copy can't consume more bits
+// than its limit, a copy limited to fewer bits than ORIG consumed is
+// always smaller; otherwise its first bits must compare smaller, and
+// fuzz_autoshrink_shrink checks that it didn't consume more.
+static bool
+is_shortlex_smaller(const struct autoshrink_bit_pool* orig,
+		const struct autoshrink_bit_pool* copy)
+{
+	if (copy->limit < orig->consumed) {
+		return true;
+	}
+
+	size_t offset = 0;
+	for (size_t ri = 0; ri < orig->request_count; ri++) {
+		const uint32_t size = request_size(orig, ri);
+		for (uint32_t i = 0; i < size; i += 64) {
+			const uint8_t  chunk = chunk_bits(size - i);
+			const uint64_t a =
+					read_filled_bits(copy, offset, chunk);
+			const uint64_t b =
+					read_filled_bits(orig, offset, chunk);
+			if (a != b) {
+				return a < b;
+			}
+			offset += chunk;
+		}
+	}
+	return false;
+}
+
+bool
+fuzz_autoshrink_bit_pool_is_smaller(const struct autoshrink_bit_pool* a,
+		const struct autoshrink_bit_pool* b)
+{
+	if (a->consumed != b->consumed) {
+		return a->consumed < b->consumed;
+	}
+	return is_shortlex_smaller(b, a);
+}
+
+// Copy the consumed bits from ORIG to COPY, except for the bits in
+// [skip_from, skip_to). The copy is limited to the bits copied, so the
+// alloc callback will get zeroes after that.
+static void
+copy_bits_except(const struct autoshrink_bit_pool* orig,
+		struct autoshrink_bit_pool* copy, size_t skip_from,
+		size_t skip_to)
+{
+	size_t dst = 0;
+	size_t src = 0;
+	while (src < orig->consumed) {
+		if (src == skip_from) {
+			src = skip_to;
+			continue;
+		}
+		const size_t  end  = (src < skip_from ? skip_from
+						      : orig->consumed);
+		const uint8_t size = chunk_bits(end - src);
+		write_bits_at_offset(copy, dst, size,
+				read_bits_at_offset(orig, src, size));
+		src += size;
+		dst += size;
+	}
+	copy->bits_filled = dst;
+	copy->limit       = dst;
+}
+
+static bool
+request_is_zero(const struct autoshrink_bit_pool* pool, size_t offset,
+		uint32_t size)
+{
+	for (uint32_t i = 0; i < size; i += 64) {
+		const uint8_t chunk = chunk_bits(size - i);
+		if (read_bits_at_offset(pool, offset + i, chunk) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Try dropping each span of more than one request, in the order they
+// begin, so outer spans are tried before the spans nested inside them.
+static bool
+pass_drop_spans(struct autoshrink_passes* p,
+		const struct autoshrink_bit_pool* orig,
+		struct autoshrink_bit_pool*       copy)
+{
+	for (; p->pos < orig->span_count; p->pos++) {
+		const size_t first = orig->spans[p->pos].first;
+		const size_t end   = span_end(orig, p->pos);
+		if (first + 1 >= end) {
+			continue; // single requests were already tried
+		}
+
+		const size_t from = offset_of_pos(orig, first);
+		const size_t to   = offset_of_pos(orig, end - 1) +
+				  request_size(orig, end - 1);
+		LOG(2 - LOG_AUTOSHRINK,
+				"PASS DROP SPAN: %zd, requests %zd - %zd\n",
+				p->pos, first, end);
+		copy_bits_except(orig, copy, from, to);
+		return true;
+	}
+	return false;
+}
+
+// Try dropping chunks of consecutive requests, ddmin-style: start with
+// chunks of half the requests, and halve the chunk size each time the
+// end of the pool is reached.
+static bool
+pass_drop_chunks(struct autoshrink_passes* p,
+		const struct autoshrink_bit_pool* orig,
+		struct autoshrink_bit_pool*       copy)
+{
+	const size_t count = orig->request_count;
+	if (p->chunk == 0) {
+		p->chunk = (count + 1) / 2;
+	}
+
+	while (p->chunk > 0) {
+		if (p->pos < count) {
+			size_t end = p->pos + p->chunk;
+			if (end > count) {
+				end = count;
+			}
+			const size_t from = offset_of_pos(orig, p->pos);
+			const size_t to   = offset_of_pos(orig, end - 1) +
+					  request_size(orig, end - 1);
+			LOG(2 - LOG_AUTOSHRINK,
+					"PASS DROP: requests %zd - %zd "
+					"(bits %zd - %zd)\n",
+					p->pos, end, from, to);
+			copy_bits_except(orig, copy, from, to);
+			return true;
+		}
+		p->chunk /= 2;
+		p->pos = 0;
+	}
+	return false;
+}
+
+// Try replacing each non-zero request with all zero bits.
+static bool
+pass_zero(struct autoshrink_passes* p, const struct autoshrink_bit_pool* orig,
+		struct autoshrink_bit_pool* copy)
+{
+	for (; p->pos < orig->request_count; p->pos++) {
+		const size_t   offset = offset_of_pos(orig, p->pos);
+		const uint32_t size   = request_size(orig, p->pos);
+		if (request_kind(orig, p->pos) == FUZZ_REQ_CHOICE ||
+				request_is_zero(orig, offset, size)) {
+			continue;
+		}
+
+		LOG(2 - LOG_AUTOSHRINK, "PASS ZERO: request %zd\n", p->pos);
+		copy_bits_except(orig, copy, orig->consumed, orig->consumed);
+		for (uint32_t i = 0; i < size; i += 64) {
+			const uint8_t chunk = chunk_bits(size - i);
+			write_bits_at_offset(copy, offset + i, chunk, 0);
+		}
+		return true;
+	}
+	return false;
+}
+
+// If the request at POS is a length of HI elements, each marked as a
+// span right after it, find the first and last requests of the
+// elements from MID on, so they can be dropped along with a length
+// reduced to MID. Only the element spans are counted, so requests after
+// the elements aren't taken for part of them. Returns false if there
+// aren't HI sibling spans there.
+static bool
+elements_past(const struct autoshrink_bit_pool* pool, size_t pos,
+		uint64_t mid, uint64_t hi, size_t* first, size_t* last)
+{
+	size_t si = 0;
+	while (si < pool->span_count && pool->spans[si].first <= pos) {
+		si++;
+	}
+	if (si == pool->span_count || pool->spans[si].first != pos + 1 ||
+			span_end(pool, si) <= pos + 1) {
+		return false;
+	}
+	for (uint64_t i = 0; i < hi; i++) {
+		if (i == mid) {
+			*first = pool->spans[si].first;
+		}
+		if (i + 1 == hi) {
+			*last = span_end(pool, si) - 1;
+			return true;
+		}
+		if (!next_sibling_span(pool, si, &si)) {
+			return false;
+		}
+	}
+	return false;
+}
+
+// Binary search for the smallest value of each request that still
+// makes the property fail. Bulk requests are left to random mutation,
+// and choices are left alone. When a length is reduced, the requests
+// for the elements past the new length are dropped too, so the
+// requests after them stay aligned.
+static bool
+pass_minimize(struct autoshrink_passes* p,
+		const struct autoshrink_bit_pool* orig,
+		struct autoshrink_bit_pool*       copy)
+{
+	for (; p->pos < orig->request_count; p->pos++, p->lo = 0) {
+		const uint32_t size = request_size(orig, p->pos);
+		const uint8_t  kind = request_kind(orig, p->pos);
+		if (size > 64 || kind == FUZZ_REQ_CHOICE) {
+			continue;
+		}
+		const size_t   offset = offset_of_pos(orig, p->pos);
+		const uint64_t hi     = read_bits_at_offset(
+				orig, offset, (uint8_t)size);
+		if (p->lo >= hi) {
+			continue;
+		}
+
+		p->mid = p->lo + (hi - p->lo) / 2;
+		LOG(2 - LOG_AUTOSHRINK,
+				"PASS MINIMIZE: request %zd, %" PRIu64
+				" -> %" PRIu64 "\n",
+				p->pos, hi, p->mid);
+
+		size_t first = 0;
+		size_t last  = 0;
+		if (kind == FUZZ_REQ_LENGTH &&
+				elements_past(orig, p->pos, p->mid, hi, &first,
+						&last)) {
+			const size_t from = offset_of_pos(orig, first);
+			const size_t to   = offset_of_pos(orig, last) +
+					  request_size(orig, last);
+			LOG(2 - LOG_AUTOSHRINK,
+					"PASS MINIMIZE: dropping elements, "
+					"requests %zd - %zd\n",
+					first, last + 1);
+			copy_bits_except(orig, copy, from, to);
+		} else {
+			copy_bits_except(orig, copy, orig->consumed,
+					orig->consumed);
+		}
+		write_bits_at_offset(copy, offset, (uint8_t)size, p->mid);
+		return true;
+	}
+	return false;
+}
+
+// If a request is followed by a larger request with the same size and
+// kind, try swapping them, so smaller values come first.
+static bool
+pass_sort(struct autoshrink_passes* p, const struct autoshrink_bit_pool* orig,
+		struct autoshrink_bit_pool* copy)
+{
+	for (; p->pos < orig->request_count; p->pos++) {
+		const uint32_t size = request_size(orig, p->pos);
+		const uint8_t  kind = request_kind(orig, p->pos);
+		if (size > 64 || kind == FUZZ_REQ_CHOICE) {
+			continue;
+		}
+
+		size_t next = p->pos + 1;
+		while (next < orig->request_count &&
+				(request_size(orig, next) != size ||
+						request_kind(orig, next) !=
+								kind)) {
+			next++;
+		}
+		if (next == orig->request_count) {
+			continue;
+		}
+
+		const size_t   offset_a = offset_of_pos(orig, p->pos);
+		const size_t   offset_b = offset_of_pos(orig, next);
+		const uint64_t a        = read_bits_at_offset(
+				orig, offset_a, (uint8_t)size);
+		const uint64_t b        = read_bits_at_offset(
+				orig, offset_b, (uint8_t)size);
+		if (b >= a) {
+			continue;
+		}
+
+		LOG(2 - LOG_AUTOSHRINK, "PASS SORT: requests %zd <-> %zd\n",
+				p->pos, next);
+		copy_bits_except(orig, copy, orig->consumed, orig->consumed);
+		write_bits_at_offset(copy, offset_a, (uint8_t)size, b);
+		write_bits_at_offset(copy, offset_b, (uint8_t)size, a);
+		return true;
+	}
+	return false;
+}
+
+// If a span is followed by a sibling span that sorts before it, try
+// swapping them.
+static bool
+pass_sort_spans(struct autoshrink_passes* p,
+		const struct autoshrink_bit_pool* orig,
+		struct autoshrink_bit_pool*       copy)
+{
+	for (; p->pos < orig->span_count; p->pos++) {
+		size_t sibling = 0;
+		if (!next_sibling_span(orig, p->pos, &sibling) ||
+				compare_spans(orig, orig, p->pos, sibling) <=
+						0) {
+			continue;
+		}
+
+		const size_t first = orig->spans[p->pos].first;
+		const size_t last  = span_end(orig, sibling) - 1;
+		const size_t from  = offset_of_pos(orig, first);
+		const size_t mid   = offset_of_pos(
+				  orig, orig->spans[sibling].first);
+		const size_t to = offset_of_pos(orig, last) +
+				  request_size(orig, last);
+		LOG(2 - LOG_AUTOSHRINK, "PASS SORT SPANS: %zd <-> %zd\n",
+				p->pos, sibling);
+		copy_bits_except(orig, copy, orig->consumed, orig->consumed);
+		if (!rotate_bits(copy, from, mid, to)) {
+			continue;
+		}
+		return true;
+	}
+	return false;
+}
+
+// Update the pass state based on whether the last candidate it built
+// was accepted (the current pool is a newer generation), then build
+// the next candidate into COPY. Returns false once all passes are done.
+static bool
+run_next_pass(struct autoshrink_env* env,
+		const struct autoshrink_bit_pool* orig,
+		struct autoshrink_bit_pool*       copy)
+{
+	struct autoshrink_passes* p = &env->passes;
+	if (p->tried) {
+		const bool accepted = (orig->generation != p->generation);
+		if (accepted) {
+			p->progress = true;
+		} else {
+			p->failed++;
+			p->round_failed++;
+		}
+		switch (p->pass) {
+		case PASS_DROP_SPANS:
+			// If accepted, the next span is now at pos.
+			if (!accepted) {
+				p->pos++;
+			}
+			break;
+		case PASS_DROP_CHUNKS:
+			// If accepted, the next chunk is now at pos.
+			if (!accepted) {
+				p->pos += p->chunk;
+			}
+			break;
+		case PASS_MINIMIZE:
+			// If accepted, mid is the new upper bound.
+			if (!accepted) {
+				p->lo = p->mid + 1;
+			}
+			break;
+		default:
+			p->pos++;
+			break;
+		}
+		p->tried = false;
+	}
+
+	// Each pass gets up to max_failed_shrinks rejected candidates per
+	// round, so one pass (such as MINIMIZE on a large pool) can't spend
+	// far more calls than the random phase would.
+	const size_t budget = GET_DEF(
+			env->max_failed_shrinks, DEF_MAX_FAILED_SHRINKS);
+	for (;;) {
+		bool made = false;
+		if (p->pass == PASS_DONE) {
+			return false;
+		}
+		// Over budget counts as exhausted.
+		if (p->failed < budget) {
+			switch (p->pass) {
+			case PASS_DROP_SPANS:
+				made = pass_drop_spans(p, orig, copy);
+				break;
+			case PASS_DROP_CHUNKS:
+				made = pass_drop_chunks(p, orig, copy);
+				break;
+			case PASS_ZERO:
+				made = pass_zero(p, orig, copy);
+				break;
+			case PASS_MINIMIZE:
+				made = pass_minimize(p, orig, copy);
+				break;
+			case PASS_SORT:
+				made = pass_sort(p, orig, copy);
+				break;
+			case PASS_SORT_SPANS:
+				made = pass_sort_spans(p, orig, copy);
+				break;
+			default:
+			case PASS_DONE:
+				return false;
+			}
+		}
+
+		if (made) {
+			p->tried      = true;
+			p->generation = orig->generation;
+			return true;
+		}
+
+		// This pass is exhausted, move on to the next one. Repeat
+		// all of them while they're still making progress, unless
+		// the last round already spent a full budget on rejections.
+		if (p->pass + 1 == PASS_DONE) {
+			if (p->progress && p->round_failed < budget &&
+					p->rounds + 1 < DEF_MAX_PASS_ROUNDS) {
+				p->rounds++;
+				p->progress     = false;
+				p->round_failed = 0;
+				p->pass     = PASS_DROP_CHUNKS;
+			} else {
+				p->pass = PASS_DONE;
+			}
+		} else {
+			p->pass++;
+		}
+		p->pos    = 0;
+		p->chunk  = 0;
+		p->lo     = 0;
+		p->failed = 0;
+	}
+}
+
+static bool
+build_index(struct autoshrink_bit_pool* pool)
+{
+	if (pool->index == NULL) {
+		const size_t entries =
+				(pool->request_count >> INDEX_STRIDE2) + 1;
+		size_t* index = malloc(entries * sizeof(size_t));
+		if (index == NULL) {
+			return false;
+		}
+
+		size_t total = 0;
+		for (size_t i = 0; i < pool->request_count; i++) {
+			if ((i & (INDEX_STRIDE - 1)) == 0) {
+				index[i >> INDEX_STRIDE2] = total;
+			}
+			total += request_size(pool, i);
+		}
+		pool->index = index;
+	}
 	return true;
 }
 
@@ -964,7 +2104,12 @@ static size_t
 offset_of_pos(const struct autoshrink_bit_pool* orig, size_t pos)
 {
 	assert(orig->index);
-	return orig->index[pos];
+	assert(pos < orig->request_count);
+	size_t offset = orig->index[pos >> INDEX_STRIDE2];
+	for (size_t i = pos & ~(size_t)(INDEX_STRIDE - 1); i < pos; i++) {
+		offset += request_size(orig, i);
+	}
+	return offset;
 }
 
 static void
@@ -1022,6 +2167,21 @@ write_bits_at_offset(struct autoshrink_bit_pool* pool, size_t bit_offset,
 	}
 }
 
+static const char*
+request_kind_name(uint8_t kind)
+{
+	switch (kind) {
+	case FUZZ_REQ_INT:
+		return " (int)";
+	case FUZZ_REQ_LENGTH:
+		return " (length)";
+	case FUZZ_REQ_CHOICE:
+		return " (choice)";
+	default:
+		return "";
+	}
+}
+
 void
 fuzz_autoshrink_dump_bit_pool(FILE* f, size_t bit_count,
 		const struct autoshrink_bit_pool* pool, int print_mode)
@@ -1079,26 +2239,29 @@ fuzz_autoshrink_dump_bit_pool(FILE* f, size_t bit_count,
 			fprintf(f, "requests: (%zd)\n", pool->request_count);
 		}
 		for (size_t i = 0; i < pool->request_count; i++) {
-			uint32_t req_size = pool->requests[i];
+			uint32_t req_size = request_size(pool, i);
 			if (offset + req_size > pool->bits_filled) {
 				req_size = pool->bits_filled - offset;
 			}
+			const char* kind = request_kind_name(
+					request_kind(pool, i));
 			if (req_size <= 64) { // fits in a uint64_t
 				uint64_t bits = read_bits_at_offset(
 						pool, offset, req_size);
 				// Print as e.g. "3 -- 20 bits: 72 (0x48), "
+				// or "3 -- 20 bits (int): 72 (0x48)"
 				fprintf(f,
-						"%zd -- %u bits: %" PRIu64
+						"%zd -- %u bits%s: %" PRIu64
 						" (0x%" PRIx64 ")\n",
-						i, req_size, bits, bits);
+						i, req_size, kind, bits, bits);
 			} else { // bulk request
 				// Print as e.g. "4 -- 72 bits:
 				// [ a5 52 29 14 0a 05 82 c1 60 ]"
 				char   header[64];
 				size_t header_used = snprintf(header,
 						sizeof(header),
-						"%zd -- %u bits: [ ", i,
-						req_size);
+						"%zd -- %u bits%s: [ ", i,
+						req_size, kind);
 				assert(header_used < sizeof(header));
 				char* left_pad = calloc(header_used + 1, 1);
 				// TODO: don't assert here
@@ -1167,27 +2330,313 @@ fuzz_autoshrink_print(struct fuzz* t, FILE* f, struct autoshrink_env* env,
 }
 
 static bool
-append_request(struct autoshrink_bit_pool* pool, uint32_t bit_count)
+append_request(struct autoshrink_bit_pool* pool, uint32_t bit_count,
+		uint8_t kind)
 {
 	assert(pool);
 	if (pool->request_count == pool->request_ceil) { // grow
-		size_t    nceil     = pool->request_ceil * 2;
-		uint32_t* nrequests = realloc(
+		size_t   nceil     = pool->request_ceil * 2;
+		uint8_t* nrequests = realloc(
 				pool->requests, nceil * sizeof(*nrequests));
 		if (nrequests == NULL) {
 			return false;
 		}
-		pool->requests     = nrequests;
+		pool->requests = nrequests;
+
+		if (pool->request_kinds) {
+			uint8_t* nkinds = realloc(pool->request_kinds,
+					nceil * sizeof(*nkinds));
+			if (nkinds == NULL) {
+				return false;
+			}
+			pool->request_kinds = nkinds;
+		}
 		pool->request_ceil = nceil;
 	}
 
-	LOG(4, "appending request %zd for %u bits\n", pool->request_count,
-			bit_count);
-	pool->requests[pool->request_count] = bit_count;
+	if (bit_count >= WIDE_REQUEST) {
+		if (pool->wide_count == pool->wide_ceil) { // grow
+			size_t nceil = (pool->wide_ceil == 0
+							? DEF_WIDE_CEIL
+							: 2 * pool->wide_ceil);
+			struct wide_request* nwide = realloc(
+					pool->wide_requests,
+					nceil * sizeof(*nwide));
+			if (nwide == NULL) {
+				return false;
+			}
+			pool->wide_requests = nwide;
+			pool->wide_ceil     = nceil;
+		}
+		struct wide_request* wide =
+				&pool->wide_requests[pool->wide_count++];
+		wide->pos  = pool->request_count;
+		wide->size = bit_count;
+	}
+
+	LOG(4, "appending request %zd for %u bits (kind %u)\n",
+			pool->request_count, bit_count, kind);
+	pool->requests[pool->request_count] =
+			(bit_count >= WIDE_REQUEST ? WIDE_REQUEST
+						   : (uint8_t)bit_count);
+	if (pool->request_kinds) {
+		pool->request_kinds[pool->request_count] = kind;
+	}
 	pool->request_count++;
 	return true;
 }
 
+// Get the kind of a request, or FUZZ_REQ_UNKNOWN if the pool doesn't
+// track them.
+static uint8_t
+request_kind(const struct autoshrink_bit_pool* pool, size_t pos)
+{
+	assert(pos < pool->request_count);
+	return (pool->request_kinds ? pool->request_kinds[pos]
+				    : FUZZ_REQ_UNKNOWN);
+}
+
+// Get the size of a request, in bits.
+static uint32_t
+request_size(const struct autoshrink_bit_pool* pool, size_t pos)
+{
+	assert(pos < pool->request_count);
+	const uint8_t size = pool->requests[pos];
+	if (size != WIDE_REQUEST) {
+		return size;
+	}
+
+	// Binary search the wide requests, which are sorted by position.
+	size_t lo = 0;
+	size_t hi = pool->wide_count;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (pool->wide_requests[mid].pos < pos) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	assert(lo < pool->wide_count && pool->wide_requests[lo].pos == pos);
+	return pool->wide_requests[lo].size;
+}
+
+void
+fuzz_autoshrink_span_begin(struct fuzz* t)
+{
+	struct autoshrink_bit_pool* pool = t->prng.bit_pool;
+	if (pool == NULL) {
+		return; // not autoshrinking
+	}
+
+	if (pool->span_count == pool->span_ceil) { // grow
+		size_t nceil = (pool->span_ceil == 0 ? DEF_SPANS_CEIL
+						     : 2 * pool->span_ceil);
+		struct autoshrink_span* nspans =
+				realloc(pool->spans, nceil * sizeof(*nspans));
+		if (nspans == NULL) {
+			assert(false); // memory fail
+			return;
+		}
+		pool->spans     = nspans;
+		pool->span_ceil = nceil;
+	}
+
+	LOG(4, "beginning span %zd at request %zd\n", pool->span_count,
+			pool->request_count);
+	pool->spans[pool->span_count] = (struct autoshrink_span){
+			.first  = pool->request_count,
+			.end    = NO_SPAN,
+			.parent = pool->open_span,
+	};
+	pool->open_span = pool->span_count;
+	pool->span_count++;
+}
+
+void
+fuzz_autoshrink_span_end(struct fuzz* t)
+{
+	struct autoshrink_bit_pool* pool = t->prng.bit_pool;
+	if (pool == NULL || pool->open_span == NO_SPAN) {
+		return; // not autoshrinking, or unbalanced
+	}
+
+	struct autoshrink_span* span = &pool->spans[pool->open_span];
+	LOG(4, "ending span %zd at request %zd\n", pool->open_span,
+			pool->request_count);
+	span->end       = pool->request_count;
+	pool->open_span = span->parent;
+}
+
+static void
+close_open_spans(struct autoshrink_bit_pool* pool)
+{
+	while (pool->open_span != NO_SPAN) {
+		struct autoshrink_span* span = &pool->spans[pool->open_span];
+		span->end                    = pool->request_count;
+		pool->open_span              = span->parent;
+	}
+}
+
+// Get the end of span SI, limited to the requests that were recorded.
+static size_t
+span_end(const struct autoshrink_bit_pool* pool, size_t si)
+{
+	const size_t end = pool->spans[si].end;
+	return (end > pool->request_count ? pool->request_count : end);
+}
+
+// Get the end of the innermost non-empty span starting at request POS,
+// or 0 if no span starts there.
+static size_t
+span_end_at(const struct autoshrink_bit_pool* pool, size_t pos)
+{
+	size_t res = 0;
+	for (size_t si = 0; si < pool->span_count; si++) {
+		if (pool->spans[si].first > pos) {
+			break;
+		} else if (pool->spans[si].first == pos &&
+				span_end(pool, si) > pos) {
+			res = span_end(pool, si);
+		}
+	}
+	return res;
+}
+
+// Find the non-empty span that directly follows span SI and has the
+// same parent, if any.
+static bool
+next_sibling_span(const struct autoshrink_bit_pool* pool, size_t si,
+		size_t* sibling)
+{
+	const size_t end = span_end(pool, si);
+	if (pool->spans[si].first >= end) {
+		return false;
+	}
+
+	for (size_t sj = si + 1; sj < pool->span_count; sj++) {
+		const struct autoshrink_span* other = &pool->spans[sj];
+		if (other->first > end) {
+			break;
+		} else if (other->first == end &&
+				other->parent == pool->spans[si].parent &&
+				span_end(pool, sj) > end) {
+			*sibling = sj;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Compare the values of the requests in spans A and B, using LAYOUT
+// for the spans and request sizes, and POOL for the bits. A span that
+// is a prefix of the other sorts first.
+static int
+compare_spans(const struct autoshrink_bit_pool* layout,
+		const struct autoshrink_bit_pool* pool, size_t a, size_t b)
+{
+	const size_t first_a = layout->spans[a].first;
+	const size_t first_b = layout->spans[b].first;
+	const size_t count_a = span_end(layout, a) - first_a;
+	const size_t count_b = span_end(layout, b) - first_b;
+
+	for (size_t i = 0; i < count_a && i < count_b; i++) {
+		const uint32_t size_a = request_size(layout, first_a + i);
+		const uint32_t size_b = request_size(layout, first_b + i);
+		if (size_a != size_b) {
+			return (size_a < size_b ? -1 : 1);
+		}
+
+		const uint8_t  size = (size_a > 64 ? 64 : (uint8_t)size_a);
+		const uint64_t va   = read_bits_at_offset(pool,
+				  offset_of_pos(layout, first_a + i), size);
+		const uint64_t vb   = read_bits_at_offset(pool,
+				  offset_of_pos(layout, first_b + i), size);
+		if (va != vb) {
+			return (va < vb ? -1 : 1);
+		}
+	}
+
+	if (count_a == count_b) {
+		return 0;
+	}
+	return (count_a < count_b ? -1 : 1);
+}
+
+// Move the bits in [mid, to) in front of the bits in [from, mid).
+static bool
+rotate_bits(struct autoshrink_bit_pool* pool, size_t from, size_t mid,
+		size_t to)
+{
+	assert(from <= mid && mid <= to);
+	const size_t bit_count = to - from;
+	uint64_t*    buf = calloc((bit_count / 64) + 1, sizeof(uint64_t));
+	if (buf == NULL) {
+		return false;
+	}
+	struct autoshrink_bit_pool tmp = {.bits = (uint8_t*)buf};
+
+	size_t dst = 0;
+	for (size_t src = mid; src < to;) {
+		const uint8_t size = chunk_bits(to - src);
+		write_bits_at_offset(&tmp, dst, size,
+				read_bits_at_offset(pool, src, size));
+		src += size;
+		dst += size;
+	}
+	for (size_t src = from; src < mid;) {
+		const uint8_t size = chunk_bits(mid - src);
+		write_bits_at_offset(&tmp, dst, size,
+				read_bits_at_offset(pool, src, size));
+		src += size;
+		dst += size;
+	}
+
+	for (size_t i = 0; i < bit_count;) {
+		const uint8_t size = chunk_bits(bit_count - i);
+		write_bits_at_offset(pool, from + i, size,
+				read_bits_at_offset(&tmp, i, size));
+		i += size;
+	}
+
+	free(buf);
+	return true;
+}
+
+// If a span starting at request POS is followed by a sibling span that
+// sorts before it, swap them in POOL. Outer spans are tried first.
+static bool
+swap_span_at(const struct autoshrink_bit_pool* orig,
+		struct autoshrink_bit_pool* pool, size_t pos)
+{
+	for (size_t si = 0; si < orig->span_count; si++) {
+		if (orig->spans[si].first > pos) {
+			break;
+		} else if (orig->spans[si].first < pos) {
+			continue;
+		}
+
+		size_t sibling = 0;
+		if (!next_sibling_span(orig, si, &sibling) ||
+				compare_spans(orig, pool, si, sibling) <= 0) {
+			continue;
+		}
+
+		const size_t last = span_end(orig, sibling) - 1;
+		const size_t from = offset_of_pos(orig, pos);
+		const size_t mid  = offset_of_pos(
+				 orig, orig->spans[sibling].first);
+		const size_t to = offset_of_pos(orig, last) +
+				  request_size(orig, last);
+		if (rotate_bits(pool, from, mid, to)) {
+			LOG(2 - LOG_AUTOSHRINK, "SWAPPING spans %zd <-> %zd\n",
+					si, sibling);
+			return true;
+		}
+	}
+	return false;
+}
+
 static uint64_t
 def_autoshrink_prng(uint8_t bits, void* udata)
 {
@@ -1207,12 +2656,22 @@ get_prng(struct fuzz* t, struct autoshrink_env* env)
 }
 
 static void
-init_model(struct autoshrink_env* env)
+init_model(struct fuzz* t, struct autoshrink_env* env)
 {
 	if (env->model.next_action != 0x00) {
 		return; // a test has an action scheduled
 	}
+	if (t->shrink.model_set[env->arg_i]) {
+		// Start from the weights learned by earlier shrinks.
+		assert(sizeof(env->model.weights) ==
+				sizeof(t->shrink.model_weights[env->arg_i]));
+		env->model = (struct autoshrink_model){.ready = true};
+		memcpy(env->model.weights, t->shrink.model_weights[env->arg_i],
+				sizeof(env->model.weights));
+		return;
+	}
 	env->model = (struct autoshrink_model){
+			.ready = true,
 			.weights =
 					{
 							[WEIGHT_DROP] = TWO_EVENLY,
@@ -1367,6 +2826,198 @@ fuzz_autoshrink_update_model(
 			env->model.weights[WEIGHT_MASK],
 			env->model.weights[WEIGHT_SWAP],
 			env->model.weights[WEIGHT_SUB]);
+
+	if (env->model.next_action == 0x00) {
+		// Keep the weights for later shrinks of this argument.
+		memcpy(t->shrink.model_weights[arg_id], env->model.weights,
+				sizeof(env->model.weights));
+		t->shrink.model_set[arg_id] = true;
+	}
+}
+
+// Saved weights are stored one argument per line, as the argument
+// number and its weights (in enum autoshrink_weight order) in hex,
+// followed by the property name.
+#define MODEL_LINE_MAX 1024
+
+static bool
+parse_model_line(const char* line, unsigned* arg_i,
+		uint8_t weights[AUTOSHRINK_WEIGHT_COUNT], const char** name)
+{
+	int offset = 0;
+	if (sscanf(line, "%u%n", arg_i, &offset) != 1) {
+		return false;
+	}
+	for (size_t i = 0; i < AUTOSHRINK_WEIGHT_COUNT; i++) {
+		unsigned   w    = 0;
+		int        used = 0;
+		const bool drop = (i == WEIGHT_DROP);
+		if (sscanf(&line[offset], " %x%n", &w, &used) != 1 ||
+				w < (drop ? DROPS_MIN : MODEL_MIN) ||
+				w > (drop ? DROPS_MAX : MODEL_MAX)) {
+			return false;
+		}
+		weights[i] = (uint8_t)w;
+		offset += used;
+	}
+	int space = 0;
+	(void)sscanf(&line[offset], " %n", &space);
+	if (space == 0) {
+		return false;
+	}
+	*name = &line[offset + space];
+	return true;
+}
+
+// Does the name at the end of a saved model line match NAME?
+static bool
+model_name_matches(const char* line_name, const char* name)
+{
+	const size_t len = strlen(name);
+	return strncmp(line_name, name, len) == 0 &&
+	       (line_name[len] == '\n' || line_name[len] == '\0');
+}
+
+// Can weights for this run's property be saved? The name is used as
+// the key, so it has to be set and fit on one line.
+static bool
+can_save_model(const struct fuzz* t)
+{
+	return t->shrink.model_path != NULL && t->prop.name != NULL &&
+	       strchr(t->prop.name, '\n') == NULL &&
+	       strlen(t->prop.name) < MODEL_LINE_MAX / 2;
+}
+
+void
+fuzz_autoshrink_load_model(struct fuzz* t)
+{
+	if (!can_save_model(t)) {
+		return;
+	}
+	FILE* f = fopen(t->shrink.model_path, "r");
+	if (f == NULL) {
+		return; // nothing saved yet
+	}
+
+	char line[MODEL_LINE_MAX];
+	while (fgets(line, sizeof(line), f) != NULL) {
+		unsigned    arg_i = 0;
+		uint8_t     weights[AUTOSHRINK_WEIGHT_COUNT];
+		const char* name = NULL;
+		if (!parse_model_line(line, &arg_i, weights, &name) ||
+				arg_i >= t->prop.arity ||
+				!model_name_matches(name, t->prop.name)) {
+			continue;
+		}
+		LOG(2 - LOG_AUTOSHRINK, "%s: loaded weights for arg %u\n",
+				__func__, arg_i);
+		memcpy(t->shrink.model_weights[arg_i], weights,
+				sizeof(weights));
+		t->shrink.model_set[arg_i] = true;
+	}
+	fclose(f);
+}
+
+bool
+fuzz_autoshrink_save_model(struct fuzz* t)
+{
+	if (!can_save_model(t)) {
+		return true;
+	}
+	bool any_set = false;
+	for (size_t i = 0; i < t->prop.arity; i++) {
+		any_set |= t->shrink.model_set[i];
+	}
+	if (!any_set) {
+		return true; // nothing learned
+	}
+
+	// Keep the lines saved for other properties.
+	char*  kept      = NULL;
+	size_t kept_size = 0;
+	FILE*  f         = fopen(t->shrink.model_path, "r");
+	if (f != NULL) {
+		char line[MODEL_LINE_MAX];
+		while (fgets(line, sizeof(line), f) != NULL) {
+			unsigned    arg_i = 0;
+			uint8_t     weights[AUTOSHRINK_WEIGHT_COUNT];
+			const char* name = NULL;
+			if (!parse_model_line(line, &arg_i, weights, &name) ||
+					model_name_matches(
+							name, t->prop.name)) {
+				continue;
+			}
+			const size_t len = strlen(line);
+			char* nkept = realloc(kept, kept_size + len + 1);
+			if (nkept == NULL) {
+				free(kept);
+				fclose(f);
+				return false;
+			}
+			kept = nkept;
+			memcpy(&kept[kept_size], line, len + 1);
+			kept_size += len;
+		}
+		fclose(f);
+	}
+
+	// Write it under a temporary name in the same directory, and then
+	// rename it over the old file, so a process loading the model at
+	// the same time never sees part of it. The temporary name is made
+	// from this run and the time, so another process saving at once
+	// doesn't write to the same one.
+	const size_t tmp_len  = strlen(t->shrink.model_path) + 22;
+	char*        tmp_path = malloc(tmp_len);
+	if (tmp_path == NULL) {
+		free(kept);
+		return false;
+	}
+	uint64_t h;
+	fuzz_hash_init(&h);
+	const uint64_t now = fuzz_monotonic_msec();
+	const void*    run = t;
+	fuzz_hash_sink(&h, (const uint8_t*)&now, sizeof(now));
+	fuzz_hash_sink(&h, (const uint8_t*)&run, sizeof(run));
+	snprintf(tmp_path, tmp_len, "%s.%016" PRIx64 ".tmp",
+			t->shrink.model_path, fuzz_hash_finish(&h));
+
+	f = fopen(tmp_path, "w");
+	if (f == NULL) {
+		free(tmp_path);
+		free(kept);
+		return false;
+	}
+	bool ok = (kept_size == 0 || fputs(kept, f) >= 0);
+	if (ok && kept_size > 0 && kept[kept_size - 1] != '\n') {
+		ok = fputc('\n', f) != EOF;
+	}
+	free(kept);
+	for (size_t i = 0; ok && i < t->prop.arity; i++) {
+		if (!t->shrink.model_set[i]) {
+			continue;
+		}
+		const uint8_t* w = t->shrink.model_weights[i];
+		ok = fprintf(f, "%zu", i) > 0;
+		for (size_t wi = 0; ok && wi < AUTOSHRINK_WEIGHT_COUNT; wi++) {
+			ok = fprintf(f, " %02x", w[wi]) > 0;
+		}
+		ok = ok && fprintf(f, " %s\n", t->prop.name) > 0;
+	}
+	if (fclose(f) != 0) {
+		ok = false;
+	}
+#if defined(_WIN32)
+	// rename() won't replace an existing file on Windows.
+	if (ok) {
+		remove(t->shrink.model_path);
+	}
+#endif
+	ok = ok && rename(tmp_path, t->shrink.model_path) == 0;
+	if (!ok) {
+		remove(tmp_path);
+	}
+	free(tmp_path);
+	return ok;
 }
 
 void
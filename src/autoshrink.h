@@ -14,6 +14,26 @@ struct fuzz_type_info;
 #define AUTOSHRINK_ENV_TAG      0xa5
 #define AUTOSHRINK_BIT_POOL_TAG 'B'
 
+// A group of consecutive requests that make up one structural unit of
+// the generated instance, such as a list element, marked with
+// `fuzz_autoshrink_span_begin` and `fuzz_autoshrink_span_end`. Spans
+// are stored in the order they begin, so a span's children follow it.
+struct autoshrink_span {
+	size_t first;  // first request in the span
+	size_t end;    // one past the last request, or NO_SPAN while open
+	size_t parent; // enclosing span, or NO_SPAN
+};
+#define NO_SPAN ((size_t)-1)
+
+// A request too large to store its size in a byte, such as from
+// fuzz_random_bits_bulk. Its size is kept in the pool's wide_requests,
+// in order of position.
+struct wide_request {
+	size_t   pos;
+	uint32_t size;
+};
+#define WIDE_REQUEST 0xFF
+
 struct autoshrink_bit_pool {
 	// Bits will always be rounded up to a multiple of 64 bits,
 	// and be aligned as a uint64_t.
@@ -23,12 +43,27 @@ struct autoshrink_bit_pool {
 	size_t   bits_ceil;   // ceiling for bit buffer
 	size_t   limit;       // after limit bytes, return 0
 
-	size_t    consumed;
-	size_t    request_count;
-	size_t    request_ceil;
-	uint32_t* requests;
-
-	size_t  generation;
+	size_t consumed;
+	size_t request_count;
+	size_t request_ceil;
+	// Size of each request in bits, or WIDE_REQUEST for sizes that
+	// don't fit in a byte. Generators often draw huge numbers of tiny
+	// requests, so this costs a byte per request rather than a word.
+	uint8_t* requests;
+	// enum fuzz_request_kind for each request, or NULL if unknown.
+	uint8_t* request_kinds;
+
+	size_t               wide_count;
+	size_t               wide_ceil;
+	struct wide_request* wide_requests;
+
+	size_t                  span_count;
+	size_t                  span_ceil;
+	struct autoshrink_span* spans;
+	size_t                  open_span; // innermost open span, or NO_SPAN
+
+	size_t generation;
+	// Bit offset of every INDEX_STRIDE'th request, built lazily.
 	size_t* index;
 };
 
@@ -38,10 +73,27 @@ struct autoshrink_bit_pool {
 // reallocs in quick succession.
 #define DEF_POOL_SIZE (64 * 8 * sizeof(uint64_t))
 
+// How much of a bit pool size hint should decay after each trial,
+// as a shift: the hint loses 1/(1 << POOL_HINT_DECAY2) of itself, so
+// one outlier doesn't size every later pool.
+#define POOL_HINT_DECAY2 3
+
 // How large should the buffer for request sizes be by default?
 #define DEF_REQUESTS_CEIL2 4 // constrain to a power of 2
 #define DEF_REQUESTS_CEIL  (1 << DEF_REQUESTS_CEIL2)
 
+// How many requests apart should the offsets in a bit pool's index be?
+// Finding a request's offset sums the sizes of at most this many
+// requests before it, so this trades lookup time for memory.
+#define INDEX_STRIDE2 4 // constrain to a power of 2
+#define INDEX_STRIDE  (1 << INDEX_STRIDE2)
+
+// How large should the buffer for wide requests be, once one is added?
+#define DEF_WIDE_CEIL 4
+
+// How large should the buffer for spans be, once one is added?
+#define DEF_SPANS_CEIL 8
+
 // Default: Decide we've reached a local minimum after
 // this many unsuccessful shrinks in a row.
 #define DEF_MAX_FAILED_SHRINKS 100
@@ -89,9 +141,46 @@ struct autoshrink_model {
 	enum autoshrink_action cur_tried;
 	enum autoshrink_action cur_set;
 	enum autoshrink_action next_action;
+	bool                   ready; // has init_model set the weights?
 	uint8_t                weights[5];
 };
 
+// How many weights the autoshrink mutation model has, one for each
+// enum autoshrink_weight. Each weight is a byte.
+#define AUTOSHRINK_WEIGHT_COUNT                                               \
+	(sizeof(((struct autoshrink_model*)NULL)->weights))
+
+// Deterministic passes over the bit pool's requests, which are tried
+// in order before falling back on random mutation.
+enum autoshrink_pass {
+	PASS_DROP_CHUNKS, // drop chunks of requests, halving chunk size
+	PASS_DROP_SPANS,  // drop whole spans, outermost first
+	PASS_ZERO,        // zero out whole requests
+	PASS_MINIMIZE,    // binary search each request's value downward
+	PASS_SORT,        // swap adjacent same-size requests into order
+	PASS_SORT_SPANS,  // swap adjacent sibling spans into order
+	PASS_DONE,
+};
+
+// Max number of times to repeat all the passes while they are still
+// making progress.
+#define DEF_MAX_PASS_ROUNDS 4
+
+struct autoshrink_passes {
+	enum autoshrink_pass pass;
+	size_t               pos;   // current request
+	size_t               chunk; // requests per chunk, for PASS_DROP_CHUNKS
+	uint64_t             lo;    // lower bound, for PASS_MINIMIZE
+	uint64_t             mid;   // last value tried, for PASS_MINIMIZE
+	size_t               generation; // generation of pool last tried
+	bool                 tried;      // was a candidate made from it?
+	bool                 progress;   // any progress this round?
+	size_t               failed;     // rejected in this pass, this round
+	size_t               round_failed; // rejected in any pass, this round
+	uint8_t              rounds;
+	uint32_t             tactic_base; // first tactic for random phase
+};
+
 struct autoshrink_env {
 	// config
 	uint8_t  arg_i;
@@ -102,6 +191,7 @@ struct autoshrink_env {
 	uint64_t drop_threshold;
 	uint8_t  drop_bits;
 
+	struct autoshrink_passes    passes;
 	struct autoshrink_model     model;
 	struct autoshrink_bit_pool* bit_pool;
 
@@ -120,6 +210,24 @@ enum mutation {
 #define LAST_MUTATION      MUT_SUB
 #define MUTATION_TYPE_BITS 2
 
+// A change to two arguments' bit pools at once. Either drop the bits
+// in [from, to) from each, or if from == to, replace the value of the
+// request starting at bit offset from in each with VALUE.
+struct joint_move {
+	size_t   from_a;
+	size_t   to_a;
+	size_t   from_b;
+	size_t   to_b;
+	uint32_t size_a;
+	uint32_t size_b;
+	uint64_t old_value;
+	uint64_t value;
+};
+
+// How many joint moves to try for each pair of matching values:
+// zeroing, halving, and decrementing them.
+#define JOINT_VALUE_MOVES 3
+
 struct change_info {
 	enum mutation t;
 	size_t        pos;
@@ -152,7 +260,7 @@ void fuzz_autoshrink_free_bit_pool(
 
 void fuzz_autoshrink_bit_pool_random(struct fuzz* t,
 		struct autoshrink_bit_pool* pool, uint32_t bit_count,
-		bool save_request, uint64_t* buf);
+		uint8_t kind, bool save_request, uint64_t* buf);
 
 void fuzz_autoshrink_get_real_args(struct fuzz* t, void** dst, void** src);
 
@@ -166,6 +274,9 @@ int fuzz_autoshrink_alloc(
 uint64_t fuzz_autoshrink_hash(struct fuzz* t, const void* instance,
 		struct autoshrink_env* env, void* type_env);
 
+// Hash the bits consumed from a bit pool.
+uint64_t fuzz_autoshrink_bit_pool_hash(const struct autoshrink_bit_pool* pool);
+
 void fuzz_autoshrink_print(struct fuzz* t, FILE* f, struct autoshrink_env* env,
 		const void* instance, void* type_env);
 
@@ -173,10 +284,94 @@ int fuzz_autoshrink_shrink(struct fuzz* t, struct autoshrink_env* env,
 		uint32_t tactic, void** output,
 		struct autoshrink_bit_pool** output_bit_pool);
 
+// Allocate an instance from BIT_COUNT bits saved from an earlier bit
+// pool, such as a failure saved in a corpus, and keep them as the env's
+// bit pool so the instance can be shrunk. BITS are in little-endian
+// byte order, and bits past BIT_COUNT read as 0.
+int fuzz_autoshrink_alloc_from_bits(struct fuzz* t, struct autoshrink_env* env,
+		const uint8_t* bits, size_t bit_count, void** instance);
+
+// Allocate an instance for coverage-guided generation from a mutant of
+// POOL, which is kept as the env's bit pool. The mutant either has
+// requests dropped or changed the ways shrinking does, has a request's
+// bits replaced with random ones, or if OTHER is non-NULL, can be a
+// splice of the start of POOL and the end of OTHER. Both must have
+// already been passed to the alloc callback. Once the mutant's bits
+// run out, more are drawn from the PRNG.
+int fuzz_autoshrink_alloc_mutant(struct fuzz* t, struct autoshrink_env* env,
+		struct autoshrink_bit_pool* pool,
+		struct autoshrink_bit_pool* other, void** instance);
+
+// Allocate a bit pool for replaying saved bits without copying them.
+// Its request buffers start with room for REQUEST_CEIL requests, and
+// are kept from one replay to the next.
+struct autoshrink_bit_pool* fuzz_autoshrink_replay_pool_new(
+		size_t request_ceil);
+
+// Free a replay pool. Its bits are borrowed, so they aren't freed.
+void fuzz_autoshrink_replay_pool_free(struct autoshrink_bit_pool* pool);
+
+// Allocate argument ARG_I's instance from BIT_COUNT bits in BITS, which
+// are 64-bit words in host byte order, using POOL. POOL borrows BITS
+// until its next replay, and bits past BIT_COUNT read as 0.
+int fuzz_autoshrink_replay_alloc(struct fuzz* t, uint8_t arg_i,
+		struct autoshrink_bit_pool* pool, const uint64_t* bits,
+		size_t bit_count, void** instance);
+
+// Get how many requests were made of POOL, and the size in bits of the
+// request at POS, such as to save a record of them.
+size_t   fuzz_autoshrink_request_count(const struct autoshrink_bit_pool* pool);
+uint32_t fuzz_autoshrink_request_size(
+		const struct autoshrink_bit_pool* pool, size_t pos);
+
+// Copy a bit pool's bits, to restart shrinking from it later. Its
+// requests aren't copied; they are recorded again when the copy is
+// passed to the alloc callback.
+struct autoshrink_bit_pool* fuzz_autoshrink_copy_bit_pool(
+		const struct autoshrink_bit_pool* pool);
+
+// Allocate a new instance and bit pool from a copy of the bits in POOL,
+// without changing the env's passes or model.
+int fuzz_autoshrink_alloc_copy(struct fuzz* t, struct autoshrink_env* env,
+		const struct autoshrink_bit_pool* pool, void** output,
+		struct autoshrink_bit_pool** output_pool);
+
+// Restart shrinking from the bits in POOL: allocate a new instance and
+// bit pool from a copy of them, and reset the env's passes and model.
+// The deterministic passes are skipped, since they would only repeat
+// the first run, so only random mutations from the current PRNG stream
+// are tried.
+int fuzz_autoshrink_restart(struct fuzz* t, struct autoshrink_env* env,
+		const struct autoshrink_bit_pool* pool, void** output,
+		struct autoshrink_bit_pool** output_pool);
+
+// Is pool A shortlex-smaller than pool B? Both must have already been
+// passed to the alloc callback.
+bool fuzz_autoshrink_bit_pool_is_smaller(const struct autoshrink_bit_pool* a,
+		const struct autoshrink_bit_pool* b);
+
+// Shrink two autoshrinking arguments together, for arguments that can't
+// be shrunk one at a time because they depend on each other, such as a
+// key and a map containing it. Returns the same results as
+// fuzz_autoshrink_shrink.
+int fuzz_autoshrink_joint_shrink(struct fuzz* t, struct autoshrink_env* env_a,
+		struct autoshrink_env* env_b, uint32_t tactic,
+		void** output_a, struct autoshrink_bit_pool** output_pool_a,
+		void** output_b, struct autoshrink_bit_pool** output_pool_b);
+
 // This is only exported for testing.
 void fuzz_autoshrink_dump_bit_pool(FILE* f, size_t bit_count,
 		const struct autoshrink_bit_pool* pool, int print_mode);
 
+// Load the autoshrink mutation weights saved for this property from
+// the run's model path, if any. A missing file is not an error.
+void fuzz_autoshrink_load_model(struct fuzz* t);
+
+// Save the autoshrink mutation weights learned during this run to the
+// run's model path, replacing any saved before for this property.
+// Returns false if the file couldn't be written.
+bool fuzz_autoshrink_save_model(struct fuzz* t);
+
 // Set the next action the model will deliver. (This is a hook for testing.)
 void fuzz_autoshrink_model_set_next(
 		struct autoshrink_env* env, enum autoshrink_action action);
@@ -161,6 +161,9 @@ fuzz_print_counterexample(
 			info->prop_name ? info->prop_name : "");
 	fprintf(t->out, "    Trial %zd, Seed 0x%016" PRIx64 "\n",
 			info->trial_id, (uint64_t)info->trial_seed);
+	if (info->incomplete) {
+		fprintf(t->out, "    (Not fully shrunk: hit shrink limit)\n");
+	}
 	for (int i = 0; i < arity; i++) {
 		struct fuzz_type_info* ti = info->type_info[i];
 		if (ti->print) {
@@ -177,8 +180,14 @@ fuzz_print_pre_run_info(FILE* f, const struct fuzz_pre_run_info* info)
 {
 	const char* prop_name =
 			info->prop_name ? info->prop_name : def_prop_name;
-	fprintf(f, "\n== PROP '%s': %zd trials, seed 0x%016" PRIx64 "\n",
-			prop_name, info->total_trials, info->run_seed);
+	fprintf(f, "\n== PROP '%s': ", prop_name);
+	if (info->total_trials != SIZE_MAX) {
+		fprintf(f, "%zd trials, ", info->total_trials);
+	}
+	if (info->max_duration_ms > 0) {
+		fprintf(f, "up to %" PRIu64 " msec, ", info->max_duration_ms);
+	}
+	fprintf(f, "seed 0x%016" PRIx64 "\n", info->run_seed);
 }
 
 int
@@ -195,9 +204,13 @@ fuzz_print_post_run_info(FILE* f, const struct fuzz_post_run_info* info)
 	const struct fuzz_run_report* r = &info->report;
 	const char*                   prop_name =
                         info->prop_name ? info->prop_name : def_prop_name;
-	fprintf(f, "\n== %s '%s': pass %zd, fail %zd, skip %zd, dup %zd\n",
+	fprintf(f, "\n== %s '%s': pass %zd, fail %zd, skip %zd, dup %zd",
 			r->fail > 0 ? "FAIL" : "PASS", prop_name, r->pass,
 			r->fail, r->skip, r->dup);
+	if (r->trials_per_sec > 0) {
+		fprintf(f, " (%zd trials/sec)", r->trials_per_sec);
+	}
+	fprintf(f, "\n");
 }
 
 int
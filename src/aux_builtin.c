@@ -15,102 +15,141 @@ struct type_info_row {
 	struct fuzz_type_info       value;
 };
 
-static int
-bool_alloc(struct fuzz* t, void* env, void** instance)
-{
-	(void)env;
-	bool* res = malloc(sizeof(*res));
-	if (res == NULL) {
-		return FUZZ_RESULT_ERROR;
-	}
-	*res      = (bool)fuzz_random_bits(t, 1);
-	*instance = res;
-	return FUZZ_RESULT_OK;
-}
+struct inline_type_info_row {
+	enum fuzz_builtin_type_info key;
+	size_t                      size; // must fit in a void*
+	struct fuzz_type_info       value;
+};
 
 #define BITS_USE_SPECIAL (3)
 
-#define ALLOC_USCALAR(NAME, TYPE, BITS, ...)                                  \
+// Tag the builtins' random requests, so autoshrinking leaves the choice
+// of special values alone and minimizes the rest as integers.
+#define RANDOM_CHOICE(T, BITS)                                                \
+	fuzz_random_bits_tagged(T, BITS, FUZZ_REQ_CHOICE)
+#define RANDOM_INT(T, BITS) fuzz_random_bits_tagged(T, BITS, FUZZ_REQ_INT)
+#define RANDOM_LENGTH(T, BITS)                                                \
+	fuzz_random_bits_tagged(T, BITS, FUZZ_REQ_LENGTH)
+
+// Define NAME_alloc, which allocates each instance, and NAME_alloc_inline,
+// which stores the value in the instance pointer itself, from the random
+// value generator NAME_random.
+#define SCALAR_ALLOCS(NAME, TYPE)                                             \
 	static int NAME##_alloc(struct fuzz* t, void* env, void** instance)   \
 	{                                                                     \
 		TYPE* res = malloc(sizeof(*res));                             \
 		if (res == NULL) {                                            \
 			return FUZZ_RESULT_ERROR;                             \
 		}                                                             \
-		if (((1LU << BITS_USE_SPECIAL) - 1) ==                        \
-				fuzz_random_bits(t, BITS_USE_SPECIAL)) {      \
+		*res      = NAME##_random(t, env);                            \
+		*instance = res;                                              \
+		return FUZZ_RESULT_OK;                                        \
+	}                                                                     \
+	static int NAME##_alloc_inline(                                       \
+			struct fuzz* t, void* env, void** instance)           \
+	{                                                                     \
+		*instance = FUZZ_INLINE_ARG(TYPE, NAME##_random(t, env));     \
+		return FUZZ_RESULT_OK;                                        \
+	}
+
+static bool
+bool_random(struct fuzz* t, void* env)
+{
+	(void)env;
+	return (bool)fuzz_random_bits(t, 1);
+}
+
+SCALAR_ALLOCS(bool, bool)
+
+// Define NAME_random, which returns a value from the run's comparison
+// dictionary, one of the special values, or random bits.
+#define ALLOC_USCALAR(NAME, TYPE, BITS, ...)                                  \
+	static TYPE NAME##_random(struct fuzz* t, void* env)                  \
+	{                                                                     \
+		TYPE     res;                                                 \
+		uint64_t dict;                                                \
+		if (fuzz_random_dictionary_value(t, &dict)) {                 \
+			res = (TYPE)dict;                                     \
+		} else if (((1LU << BITS_USE_SPECIAL) - 1) ==                 \
+				RANDOM_CHOICE(t, BITS_USE_SPECIAL)) {         \
 			const TYPE special[] = {__VA_ARGS__};                 \
-			size_t     idx       = fuzz_random_bits(t, 8) %       \
+			size_t     idx       = RANDOM_INT(t, 8) %             \
 				     (sizeof(special) / sizeof(special[0]));  \
-			*res = special[idx];                                  \
+			res = special[idx];                                   \
 		} else {                                                      \
-			*res = (TYPE)fuzz_random_bits(t, BITS);               \
+			res = (TYPE)RANDOM_INT(t, BITS);                      \
 		}                                                             \
 		if (env != NULL) {                                            \
 			TYPE limit = *(TYPE*)env;                             \
 			assert(limit != 0);                                   \
-			(*res) %= limit;                                      \
+			res %= limit;                                         \
 		}                                                             \
-		*instance = res;                                              \
-		return FUZZ_RESULT_OK;                                        \
-	}
+		return res;                                                   \
+	}                                                                     \
+	SCALAR_ALLOCS(NAME, TYPE)
 
 #define ALLOC_SSCALAR(NAME, TYPE, BITS, ...)                                  \
-	static int NAME##_alloc(struct fuzz* t, void* env, void** instance)   \
+	static TYPE NAME##_random(struct fuzz* t, void* env)                  \
 	{                                                                     \
-		TYPE* res = malloc(sizeof(*res));                             \
-		if (res == NULL) {                                            \
-			return FUZZ_RESULT_ERROR;                             \
-		}                                                             \
-		if (((1LU << BITS_USE_SPECIAL) - 1) ==                        \
-				fuzz_random_bits(t, BITS_USE_SPECIAL)) {      \
+		TYPE     res;                                                 \
+		uint64_t dict;                                                \
+		if (fuzz_random_dictionary_value(t, &dict)) {                 \
+			res = (TYPE)dict;                                     \
+		} else if (((1LU << BITS_USE_SPECIAL) - 1) ==                 \
+				RANDOM_CHOICE(t, BITS_USE_SPECIAL)) {         \
 			const TYPE special[] = {__VA_ARGS__};                 \
-			size_t     idx       = fuzz_random_bits(t, 8) %       \
+			size_t     idx       = RANDOM_INT(t, 8) %             \
 				     (sizeof(special) / sizeof(special[0]));  \
-			*res = special[idx];                                  \
+			res = special[idx];                                   \
 		} else {                                                      \
-			*res = (TYPE)fuzz_random_bits(t, BITS);               \
+			res = (TYPE)RANDOM_INT(t, BITS);                      \
 		}                                                             \
 		if (env != NULL) {                                            \
 			TYPE limit = *(TYPE*)env;                             \
 			assert(limit > 0); /* -limit <= res < limit */        \
-			if (*res < (-limit)) {                                \
-				*res %= (-limit);                             \
-			} else if (*res >= limit) {                           \
-				(*res) %= limit;                              \
+			if (res < (-limit)) {                                 \
+				res %= (-limit);                              \
+			} else if (res >= limit) {                            \
+				res %= limit;                                 \
 			}                                                     \
 		}                                                             \
-		*instance = res;                                              \
-		return FUZZ_RESULT_OK;                                        \
-	}
+		return res;                                                   \
+	}                                                                     \
+	SCALAR_ALLOCS(NAME, TYPE)
 
 #define ALLOC_FSCALAR(NAME, TYPE, MOD, BITS, ...)                             \
-	static int NAME##_alloc(struct fuzz* t, void* env, void** instance)   \
+	static TYPE NAME##_random(struct fuzz* t, void* env)                  \
 	{                                                                     \
-		TYPE* res = malloc(sizeof(*res));                             \
-		if (res == NULL) {                                            \
-			return FUZZ_RESULT_ERROR;                             \
-		}                                                             \
+		TYPE res;                                                     \
 		if (((1LU << BITS_USE_SPECIAL) - 1) ==                        \
-				fuzz_random_bits(t, BITS_USE_SPECIAL)) {      \
+				RANDOM_CHOICE(t, BITS_USE_SPECIAL)) {         \
 			const TYPE special[] = {__VA_ARGS__};                 \
-			size_t     idx       = fuzz_random_bits(t, 8) %       \
+			size_t     idx       = RANDOM_INT(t, 8) %             \
 				     (sizeof(special) / sizeof(special[0]));  \
-			*res = special[idx];                                  \
+			res = special[idx];                                   \
 		} else {                                                      \
-			*res = (TYPE)fuzz_random_bits(t, BITS);               \
+			res = (TYPE)RANDOM_INT(t, BITS);                      \
 		}                                                             \
 		if (env != NULL) {                                            \
 			TYPE limit = *(TYPE*)env;                             \
 			assert(limit > 0); /* -limit <= res < limit */        \
-			if (*res < (-limit)) {                                \
-				*res = MOD(*res, -limit);                     \
+			if (res < (-limit)) {                                 \
+				res = MOD(res, -limit);                       \
 			} else {                                              \
-				*res = MOD(*res, limit);                      \
+				res = MOD(res, limit);                        \
 			}                                                     \
 		}                                                             \
-		*instance = res;                                              \
-		return FUZZ_RESULT_OK;                                        \
+		return res;                                                   \
+	}                                                                     \
+	SCALAR_ALLOCS(NAME, TYPE)
+
+// Print a value stored by NAME_alloc_inline.
+#define PRINT_INLINE(NAME, TYPE)                                              \
+	static void NAME##_print_inline(                                      \
+			FILE* f, const void* instance, void* env)             \
+	{                                                                     \
+		TYPE value = FUZZ_INLINE_VALUE(TYPE, instance);               \
+		NAME##_print(f, &value, env);                                 \
 	}
 
 #define PRINT_SCALAR(NAME, TYPE, FORMAT)                                      \
@@ -118,6 +157,12 @@ bool_alloc(struct fuzz* t, void* env, void** instance)
 	{                                                                     \
 		(void)env;                                                    \
 		fprintf(f, FORMAT, *(TYPE*)instance);                         \
+	}                                                                     \
+	static void NAME##_print_inline(                                      \
+			FILE* f, const void* instance, void* env)             \
+	{                                                                     \
+		TYPE value = FUZZ_INLINE_VALUE(TYPE, instance);               \
+		NAME##_print(f, &value, env);                                 \
 	}
 
 ALLOC_USCALAR(uint, unsigned int, 8 * sizeof(unsigned int), 0, 1, 2, 3, 4, 5,
@@ -199,6 +244,9 @@ double_print(FILE* f, const void* instance, void* env)
 	fprintf(f, "%g (0x%016" PRIx64 ")", d, u64);
 }
 
+PRINT_INLINE(float, float)
+PRINT_INLINE(double, double)
+
 #endif
 
 #define SCALAR_ROW(NAME)                                                        \
@@ -215,44 +263,68 @@ double_print(FILE* f, const void* instance, void* env)
 		},                                                              \
 	}
 
-#define DEF_BYTE_ARRAY_CEIL 8
+#define INLINE_SCALAR_ROW(NAME, TYPE)                                           \
+	{                                                                       \
+		.key   = FUZZ_BUILTIN_##NAME,                                   \
+		.size  = sizeof(TYPE),                                          \
+		.value = {                                                      \
+				.alloc = NAME##_alloc_inline,                   \
+				.print = NAME##_print_inline,                   \
+				.autoshrink_config =                            \
+						{                               \
+								.enable = true, \
+						},                              \
+		},                                                              \
+	}
+
+// Bits in each draw of a byte array's length, when there's no max length.
+// A draw of all 1 bits adds another draw, so lengths are unbounded, but
+// each extra 255 bytes is 256 times less likely.
+#define BYTE_ARRAY_LENGTH_BITS 8
+#define BYTE_ARRAY_LENGTH_MORE ((1LLU << BYTE_ARRAY_LENGTH_BITS) - 1)
+
+// Bits needed for a length below MAX_LENGTH: ceil(log2(MAX_LENGTH)).
+static uint8_t
+byte_array_length_bits(size_t max_length)
+{
+	uint8_t bits = 1;
+	while (bits < 64 && ((uint64_t)max_length - 1) >> bits != 0) {
+		bits++;
+	}
+	return bits;
+}
+
+// Generate the length first, and then each byte as a span, so reducing
+// the length drops the bytes past it. Bytes are never 0, since the
+// array is NUL-terminated.
 static int
 char_ARRAY_alloc(struct fuzz* t, void* env, void** instance)
 {
-	(void)env;
-	size_t  ceil       = DEF_BYTE_ARRAY_CEIL;
-	size_t  size       = 0;
-	size_t* max_length = NULL;
+	size_t length = 0;
 	if (env != NULL) {
-		max_length = (size_t*)env;
-		assert(*max_length > 0);
+		const size_t max_length = *(size_t*)env;
+		assert(max_length > 0);
+		length = (size_t)RANDOM_LENGTH(
+				t, byte_array_length_bits(max_length));
+		length %= max_length;
+	} else {
+		uint64_t draw;
+		do {
+			draw = RANDOM_LENGTH(t, BYTE_ARRAY_LENGTH_BITS);
+			length += (size_t)draw;
+		} while (draw == BYTE_ARRAY_LENGTH_MORE);
 	}
 
-	char* res = malloc(ceil * sizeof(char));
+	char* res = malloc((length + 1) * sizeof(char));
 	if (res == NULL) {
 		return FUZZ_RESULT_ERROR;
 	}
-	while (true) {
-		if (max_length != NULL && size + 1 == *max_length) {
-			res[size] = 0;
-			break;
-		} else if (size == ceil) {
-			const size_t nceil = 2 * ceil;
-			char*        nres = realloc(res, nceil * sizeof(char));
-			if (nres == NULL) {
-				free(res);
-				return FUZZ_RESULT_ERROR;
-			}
-			res  = nres;
-			ceil = nceil;
-		}
-		char byte = fuzz_random_bits(t, 8);
-		res[size] = byte;
-		if (byte == 0x00) {
-			break;
-		}
-		size++;
+	for (size_t i = 0; i < length; i++) {
+		fuzz_autoshrink_span_begin(t);
+		res[i] = (char)(1 + RANDOM_INT(t, 8) % 255);
+		fuzz_autoshrink_span_end(t);
 	}
+	res[length] = 0x00;
 
 	*instance = res;
 	return FUZZ_RESULT_OK;
@@ -362,3 +434,37 @@ fuzz_get_builtin_type_info(enum fuzz_builtin_type_info type)
 	assert(false);
 	return NULL;
 }
+
+static struct inline_type_info_row inline_rows[] = {
+		INLINE_SCALAR_ROW(bool, bool),
+		INLINE_SCALAR_ROW(uint, unsigned int),
+		INLINE_SCALAR_ROW(uint8_t, uint8_t),
+		INLINE_SCALAR_ROW(uint16_t, uint16_t),
+		INLINE_SCALAR_ROW(uint32_t, uint32_t),
+		INLINE_SCALAR_ROW(uint64_t, uint64_t),
+		INLINE_SCALAR_ROW(size_t, size_t),
+
+		INLINE_SCALAR_ROW(int, int),
+		INLINE_SCALAR_ROW(int8_t, int8_t),
+		INLINE_SCALAR_ROW(int16_t, int16_t),
+		INLINE_SCALAR_ROW(int32_t, int32_t),
+		INLINE_SCALAR_ROW(int64_t, int64_t),
+
+#if FUZZ_USE_FLOATING_POINT
+		INLINE_SCALAR_ROW(float, float),
+		INLINE_SCALAR_ROW(double, double),
+#endif
+};
+
+const struct fuzz_type_info*
+fuzz_get_builtin_inline_type_info(enum fuzz_builtin_type_info type)
+{
+	for (size_t i = 0; i < sizeof(inline_rows) / sizeof(inline_rows[0]);
+			i++) {
+		const struct inline_type_info_row* row = &inline_rows[i];
+		if (row->key == type) {
+			return row->size <= sizeof(void*) ? &row->value : NULL;
+		}
+	}
+	return NULL;
+}
@@ -236,6 +236,28 @@ fuzz_bloom_check(struct fuzz_bloom* b, uint8_t* data, size_t data_size)
 	return false; // there wasn't any block with all checked bits set
 }
 
+// Clear the bloom filter. The front filter of each block is kept and
+// zeroed, so the next run can reuse it.
+void
+fuzz_bloom_reset(struct fuzz_bloom* b)
+{
+	const size_t top_block_count = (1LLU << b->top_block2);
+	for (size_t i = 0; i < top_block_count; i++) {
+		struct bloom_filter* bf = b->blocks[i];
+		if (bf == NULL) {
+			continue;
+		}
+		struct bloom_filter* next = bf->next;
+		while (next != NULL) {
+			struct bloom_filter* after = next->next;
+			free(next);
+			next = after;
+		}
+		bf->next = NULL;
+		memset(bf->bits, 0x00, (1LLU << bf->size2) / 8);
+	}
+}
+
 // Free the bloom filter.
 void
 fuzz_bloom_free(struct fuzz_bloom* b)
@@ -24,6 +24,9 @@ bool fuzz_bloom_mark(struct fuzz_bloom* b, uint8_t* data, size_t data_size);
 // Check whether the data's hash is in the bloom filter.
 bool fuzz_bloom_check(struct fuzz_bloom* b, uint8_t* data, size_t data_size);
 
+// Clear the bloom filter, keeping some of its memory to reuse.
+void fuzz_bloom_reset(struct fuzz_bloom* b);
+
 // Free the bloom filter.
 void fuzz_bloom_free(struct fuzz_bloom* b);
 
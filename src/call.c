@@ -24,14 +24,22 @@
 #include "autoshrink.h"
 #include "bloom.h"
 #include "call.h"
+#include "coverage.h"
+#include "dictionary.h"
 #include "fuzz.h"
 #include "polyfill.h"
 #include "types_internal.h"
 
 static int fuzz_call_inner(struct fuzz* t, void** args);
+static int call_property(struct fuzz* t, void** args);
 
-static int parent_handle_child_call(
-		struct fuzz* t, pid_t pid, struct worker_info* worker);
+static bool spawn_worker(
+		struct fuzz* t, struct worker_info* worker, void** args);
+
+static int parent_handle_child_call(struct fuzz* t, pid_t pid,
+		struct worker_info* worker, size_t timeout);
+
+static size_t elapsed_msec(const struct timeval* since);
 
 // Returns one of:
 // FUZZ_HOOK_RUN_ERROR
@@ -61,12 +69,89 @@ fuzz_call(struct fuzz* t, void** args)
 	// We should've bailed if we don't have fork a long time ago.
 	assert(FUZZ_POLYFILL_HAVE_FORK);
 
-	struct timespec tv = {.tv_nsec = 1};
-	if (-1 == pipe(t->workers[0].fds)) {
+	struct worker_info* worker = &t->workers[0];
+	if (!spawn_worker(t, worker, args)) {
 		return FUZZ_RESULT_ERROR;
 	}
 
-	int   res = FUZZ_RESULT_ERROR;
+	const int res = parent_handle_child_call(
+			t, worker->pid, worker, t->fork.timeout);
+	close(worker->fds[0]);
+	worker->state = WS_INACTIVE;
+
+	if (!step_waitpid(t)) {
+		return FUZZ_RESULT_ERROR;
+	}
+	return res;
+}
+
+int
+fuzz_call_in_process(struct fuzz* t, void** args)
+{
+	return fuzz_call_inner(t, args);
+}
+
+// Call the property function with each of COUNT sets of arguments,
+// running them all at once in forked workers, and save each call's
+// result in RESULTS. Forking must be enabled and supported.
+// Returns false if a worker could not be started.
+bool
+fuzz_call_batch(struct fuzz* t, size_t count, void** args[], int* results)
+{
+	assert(t->fork.enable);
+	assert(FUZZ_POLYFILL_HAVE_FORK);
+	assert(count <= FUZZ_MAX_WORKERS);
+
+	struct timeval start = {0, 0};
+	gettimeofday(&start, NULL);
+
+	size_t started = 0;
+	bool   ok      = true;
+	for (; started < count; started++) {
+		if (!spawn_worker(t, &t->workers[started], args[started])) {
+			ok = false;
+			break;
+		}
+	}
+
+	// The workers all started at about the same time, so each one's
+	// timeout counts from the start of the batch, not from when the
+	// ones before it finished.
+	const size_t timeout = t->fork.timeout;
+	for (size_t i = 0; i < started; i++) {
+		struct worker_info* worker    = &t->workers[i];
+		size_t              remaining = 0;
+		if (timeout != 0) {
+			const size_t elapsed = elapsed_msec(&start);
+			remaining = (elapsed < timeout ? timeout - elapsed
+						       : 1);
+		}
+
+		results[i] = parent_handle_child_call(
+				t, worker->pid, worker, remaining);
+		close(worker->fds[0]);
+		worker->state = WS_INACTIVE;
+	}
+	for (size_t i = started; i < count; i++) {
+		results[i] = FUZZ_RESULT_ERROR;
+	}
+
+	if (!step_waitpid(t)) {
+		return false;
+	}
+	return ok;
+}
+
+// Fork a worker process to call the property function with ARGS. The
+// worker writes its result to the worker's pipe and exits.
+static bool
+spawn_worker(struct fuzz* t, struct worker_info* worker, void** args)
+{
+	struct timespec tv = {.tv_nsec = 1};
+	if (-1 == pipe(worker->fds)) {
+		return false;
+	}
+
 	pid_t pid = -1;
 	for (;;) {
 		pid = fork();
@@ -76,7 +161,7 @@ fuzz_call(struct fuzz* t, void** args)
 
 		if (errno != EAGAIN) {
 			perror("fork");
-			return FUZZ_RESULT_ERROR;
+			break;
 		}
 
 		// If we get EAGAIN, then wait for terminated child processes a
@@ -84,18 +169,18 @@ fuzz_call(struct fuzz* t, void** args)
 		// RLIMIT_NPROC.
 		const int fork_errno = errno;
 		if (!step_waitpid(t)) {
-			return FUZZ_RESULT_ERROR;
+			break;
 		}
 
 		if (-1 == nanosleep(&tv, NULL)) {
 			perror("nanosleep");
-			return FUZZ_RESULT_ERROR;
+			break;
 		}
 
 		if (tv.tv_nsec >= (1L << MAX_FORK_RETRIES)) {
 			errno = fork_errno;
 			perror("fork");
-			return FUZZ_RESULT_ERROR;
+			break;
 		}
 
 		errno = 0;
@@ -104,14 +189,14 @@ fuzz_call(struct fuzz* t, void** args)
 	}
 
 	if (pid == -1) {
-		close(t->workers[0].fds[0]);
-		close(t->workers[0].fds[1]);
-		return FUZZ_RESULT_ERROR;
+		close(worker->fds[0]);
+		close(worker->fds[1]);
+		return false;
 	}
 
 	if (pid == 0) { // child
-		close(t->workers[0].fds[0]);
-		int out_fd = t->workers[0].fds[1];
+		close(worker->fds[0]);
+		int out_fd = worker->fds[1];
 		if (run_fork_post_hook(t, args) == FUZZ_HOOK_RUN_ERROR) {
 			uint8_t byte = (uint8_t)FUZZ_RESULT_ERROR;
 			ssize_t wr   = write(out_fd, (const void*)&byte,
@@ -119,7 +204,7 @@ fuzz_call(struct fuzz* t, void** args)
 			(void)wr;
 			exit(EXIT_FAILURE);
 		}
-		res          = fuzz_call_inner(t, args);
+		int     res  = fuzz_call_inner(t, args);
 		uint8_t byte = (uint8_t)res;
 		ssize_t wr   = write(out_fd, (const void*)&byte, sizeof(byte));
 		exit(wr == 1 && res == FUZZ_RESULT_OK ? EXIT_SUCCESS
@@ -127,41 +212,39 @@ fuzz_call(struct fuzz* t, void** args)
 	}
 
 	// parent
-	close(t->workers[0].fds[1]);
-	t->workers[0].pid = pid;
-
-	t->workers[0].state = WS_ACTIVE;
-	res                 = parent_handle_child_call(t, pid, &t->workers[0]);
-	close(t->workers[0].fds[0]);
-	t->workers[0].state = WS_INACTIVE;
+	close(worker->fds[1]);
+	worker->pid   = pid;
+	worker->state = WS_ACTIVE;
+	return true;
+}
 
-	if (!step_waitpid(t)) {
-		return FUZZ_RESULT_ERROR;
-	}
-	return res;
+// How many milliseconds have passed since SINCE.
+static size_t
+elapsed_msec(const struct timeval* since)
+{
+	struct timeval now = {0, 0};
+	gettimeofday(&now, NULL);
+	return 1000 * now.tv_sec - 1000 * since->tv_sec +
+	       ((now.tv_usec / 1000) - (since->tv_usec / 1000));
 }
 
+// Wait up to TIMEOUT msec. (or forever, if 0) for the worker's result.
 static int
-parent_handle_child_call(struct fuzz* t, pid_t pid, struct worker_info* worker)
+parent_handle_child_call(struct fuzz* t, pid_t pid,
+		struct worker_info* worker, size_t timeout)
 {
 	const int     fd     = worker->fds[0];
 	struct pollfd pfd[1] = {
 			{.fd = fd, .events = POLLIN},
 	};
-	assert(t->fork.timeout <= INT_MAX);
-	const size_t timeout = t->fork.timeout;
-	int          res     = 0;
+	assert(timeout <= INT_MAX);
+	int res = 0;
 	for (;;) {
 		struct timeval tv_pre = {0, 0};
 		gettimeofday(&tv_pre, NULL);
 		res = poll(pfd, 1, (timeout == 0 ? -1 : (int)timeout));
-		struct timeval tv_post = {0, 0};
-		gettimeofday(&tv_post, NULL);
 
-		const size_t delta = 1000 * tv_post.tv_sec -
-				     1000 * tv_pre.tv_sec +
-				     ((tv_post.tv_usec / 1000) -
-						     (tv_pre.tv_usec / 1000));
+		const size_t delta = elapsed_msec(&tv_pre);
 		LOG(3 - LOG_CALL, "%s: POLL res %d, elapsed %zd\n", __func__,
 				res, delta);
 		(void)delta;
@@ -275,9 +358,12 @@ step_waitpid(struct fuzz* t)
 		} else if (res == 0) {
 			break; // no children have changed state
 		} else {
-			if (res == t->workers[0].pid) {
-				t->workers[0].state   = WS_STOPPED;
-				t->workers[0].wstatus = wstatus;
+			for (size_t i = 0; i < FUZZ_MAX_WORKERS; i++) {
+				struct worker_info* w = &t->workers[i];
+				if (res == w->pid) {
+					w->state   = WS_STOPPED;
+					w->wstatus = wstatus;
+				}
 			}
 		}
 	}
@@ -328,6 +414,28 @@ wait_for_exit(struct fuzz* t, struct worker_info* worker, size_t timeout,
 
 static int
 fuzz_call_inner(struct fuzz* t, void** args)
+{
+	if (t->coverage == NULL && t->dictionary == NULL) {
+		return call_property(t, args);
+	}
+	if (t->coverage != NULL) {
+		fuzz_coverage_begin(t->coverage);
+	}
+	if (t->dictionary != NULL) {
+		fuzz_dictionary_begin(t->dictionary);
+	}
+	const int res = call_property(t, args);
+	if (t->dictionary != NULL) {
+		fuzz_dictionary_end(t->dictionary);
+	}
+	if (t->coverage != NULL) {
+		fuzz_coverage_end(t->coverage);
+	}
+	return res;
+}
+
+static int
+call_property(struct fuzz* t, void** args)
 {
 	switch (t->prop.arity) {
 	case 1:
@@ -4,6 +4,7 @@
 #define FUZZ_CALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 struct fuzz;
 
@@ -11,6 +12,16 @@ struct fuzz;
 // in ARGS.
 int fuzz_call(struct fuzz* t, void** args);
 
+// Call the property function in this process, even if forking is
+// enabled, such as from a process that was already forked.
+int fuzz_call_in_process(struct fuzz* t, void** args);
+
+// Call the property function with each of COUNT sets of arguments, in
+// parallel forked workers, and save the results in RESULTS. Forking must
+// be enabled. Returns false if the workers could not be started.
+bool fuzz_call_batch(
+		struct fuzz* t, size_t count, void** args[], int* results);
+
 // Check if this combination of argument instances has been called.
 bool fuzz_call_check_called(struct fuzz* t);
 
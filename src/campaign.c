@@ -0,0 +1,443 @@
+// SPDX-License-Identifier: ISC
+// SPDX-FileCopyrightText: 2014-19 Scott Vokes <vokes.s@gmail.com>
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuzz.h"
+#include "polyfill.h"
+#include "rng.h"
+#include "run.h"
+#include "types_internal.h"
+
+// Scheduler for spending a time budget on a table of properties. Each
+// slice goes to the property with the highest upper confidence bound
+// on its score (UCB1), where the score is a decaying average of each
+// slice's reward:
+//
+//     reward = 1, if the slice found a failure, or
+//              NOVELTY_WEIGHT * (new trials/sec) / (best new trials/sec)
+//
+// Properties that have never had a slice go first.
+
+// How much a slice's reward moves the score.
+#define SCORE_DECAY 0.25
+
+// Most a slice without failures can be rewarded.
+#define NOVELTY_WEIGHT 0.5
+
+// Longest line in a stats file.
+#define STATS_LINE_MAX 1024
+
+#define LOG_CAMPAIGN 0
+
+enum campaign_state {
+	CAMPAIGN_READY,
+	CAMPAIGN_FAILED,  // retired for the rest of the campaign
+	CAMPAIGN_SKIPPED, // likewise
+	CAMPAIGN_ERROR,   // likewise
+};
+
+struct campaign_entry {
+	struct fuzz_campaign_stats stats;
+	enum campaign_state        state;
+	uint64_t                   slices_now; // slices this campaign
+};
+
+static bool parse_stats_line(
+		char* line, struct fuzz_campaign_stats* s, const char** name);
+static size_t find_property(const struct fuzz_run_config* props,
+		size_t prop_count, const char* name);
+static void load_stats(const char* path,
+		const struct fuzz_run_config* props, size_t prop_count,
+		struct campaign_entry* entries);
+static bool save_stats(const char* path,
+		const struct fuzz_run_config* props, size_t prop_count,
+		const struct campaign_entry* entries);
+static const char* state_str(enum campaign_state state);
+static double best_rate(const struct campaign_entry* entries, size_t count);
+static size_t choose_property(
+		const struct campaign_entry* entries, size_t count);
+static void update_stats(struct campaign_entry* e,
+		const struct fuzz_run_report* report, uint64_t elapsed_ms,
+		double rate_ceil);
+
+int
+fuzz_campaign_run(const struct fuzz_campaign_config* cfg)
+{
+	if (cfg == NULL || cfg->props == NULL || cfg->prop_count == 0) {
+		return FUZZ_RESULT_ERROR;
+	}
+	for (size_t i = 0; i < cfg->prop_count; i++) {
+		if (cfg->props[i].name == NULL) {
+			return FUZZ_RESULT_ERROR;
+		}
+	}
+
+	const size_t           count   = cfg->prop_count;
+	struct campaign_entry* entries = calloc(count, sizeof(*entries));
+	struct fuzz_rng*       rng     = fuzz_rng_init(
+			cfg->seed ? cfg->seed : DEFAULT_uint64_t);
+	struct fuzz_runner* runner = fuzz_runner_new();
+	if (entries == NULL || rng == NULL) {
+		free(entries);
+		fuzz_rng_free(rng);
+		fuzz_runner_free(runner);
+		return FUZZ_RESULT_ERROR_MEMORY;
+	}
+	if (cfg->stats_path != NULL) {
+		load_stats(cfg->stats_path, cfg->props, count, entries);
+	}
+
+	const uint64_t slice_ms = (cfg->slice_ms != 0
+						? cfg->slice_ms
+						: FUZZ_DEF_CAMPAIGN_SLICE_MSEC);
+	const uint64_t start_ms = fuzz_monotonic_msec();
+	uint64_t       spent    = 0;
+	while (spent < cfg->budget_ms) {
+		const size_t i = choose_property(entries, count);
+		if (i == count) {
+			break; // every property failed or had an error
+		}
+		struct campaign_entry* e = &entries[i];
+
+		// Trials are only bounded by time, and each slice gets a
+		// new seed so it doesn't repeat the last one's inputs.
+		struct fuzz_run_config run_cfg = cfg->props[i];
+		run_cfg.trials                 = 0;
+		run_cfg.max_duration_ms        = slice_ms;
+		if (cfg->budget_ms - spent < slice_ms) {
+			run_cfg.max_duration_ms = cfg->budget_ms - spent;
+		}
+		run_cfg.seed = fuzz_rng_random(rng);
+
+		LOG(2 - LOG_CAMPAIGN, "%s: slice for %s, score %g\n",
+				__func__, run_cfg.name, e->stats.score);
+		struct fuzz_run_report report = {.pass = 0};
+		const uint64_t         slice_start = fuzz_monotonic_msec();
+		const int              res         = fuzz_run_reporting(
+				runner, &run_cfg, &report);
+		const uint64_t elapsed_ms =
+				fuzz_monotonic_msec() - slice_start;
+
+		// A slice that found a failure counts as one, however it
+		// ended.
+		if (res == FUZZ_RESULT_FAIL && report.fail == 0) {
+			report.fail = 1;
+		}
+		update_stats(e, &report, elapsed_ms,
+				best_rate(entries, count));
+		if (res == FUZZ_RESULT_FAIL) {
+			e->state = CAMPAIGN_FAILED;
+		} else if (res == FUZZ_RESULT_SKIP) {
+			e->state = CAMPAIGN_SKIPPED;
+		} else if (res != FUZZ_RESULT_OK) {
+			e->state = CAMPAIGN_ERROR;
+		}
+		spent = fuzz_monotonic_msec() - start_ms;
+	}
+
+	int    res    = FUZZ_RESULT_OK;
+	size_t failed = 0;
+	printf("\n== CAMPAIGN: %zd properties in %" PRIu64 " msec\n", count,
+			spent);
+	for (size_t i = 0; i < count; i++) {
+		const struct campaign_entry* e = &entries[i];
+		printf(" -- %s: %" PRIu64 " slices, score %.3f%s\n",
+				cfg->props[i].name, e->slices_now,
+				e->stats.score,
+				state_str(e->state));
+		if (e->state == CAMPAIGN_FAILED) {
+			failed++;
+		} else if (e->state == CAMPAIGN_ERROR &&
+				res == FUZZ_RESULT_OK) {
+			res = FUZZ_RESULT_ERROR;
+		}
+		if (cfg->stats != NULL) {
+			cfg->stats[i] = e->stats;
+		}
+	}
+	if (failed > 0) {
+		res = FUZZ_RESULT_FAIL;
+	}
+
+	if (cfg->stats_path != NULL &&
+			!save_stats(cfg->stats_path, cfg->props, count,
+					entries)) {
+		fprintf(stderr, "failed to save campaign stats to %s\n",
+				cfg->stats_path);
+	}
+
+	fuzz_runner_free(runner);
+	fuzz_rng_free(rng);
+	free(entries);
+	return res;
+}
+
+static const char*
+state_str(enum campaign_state state)
+{
+	switch (state) {
+	case CAMPAIGN_FAILED:
+		return ", FAIL";
+	case CAMPAIGN_SKIPPED:
+		return ", SKIP";
+	case CAMPAIGN_ERROR:
+		return ", ERROR";
+	default:
+		return "";
+	}
+}
+
+// New trials per second, over everything the property has run.
+static double
+unique_rate(const struct fuzz_campaign_stats* stats)
+{
+	if (stats->elapsed_ms == 0) {
+		return 0;
+	}
+	return 1000.0 * (double)stats->unique / (double)stats->elapsed_ms;
+}
+
+static double
+best_rate(const struct campaign_entry* entries, size_t count)
+{
+	double best = 0;
+	for (size_t i = 0; i < count; i++) {
+		const double rate = unique_rate(&entries[i].stats);
+		if (rate > best) {
+			best = rate;
+		}
+	}
+	return best;
+}
+
+// Pick the ready property with the highest upper confidence bound on
+// its score, or return COUNT if none are ready.
+static size_t
+choose_property(const struct campaign_entry* entries, size_t count)
+{
+	uint64_t total = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (entries[i].state != CAMPAIGN_READY) {
+			continue;
+		}
+		if (entries[i].stats.slices == 0) {
+			return i; // try everything at least once
+		}
+		total += entries[i].stats.slices;
+	}
+
+	size_t best_i     = count;
+	double best_bound = 0;
+	for (size_t i = 0; i < count; i++) {
+		const struct campaign_entry* e = &entries[i];
+		if (e->state != CAMPAIGN_READY) {
+			continue;
+		}
+		const double bound = e->stats.score +
+				     sqrt(2.0 * log((double)total) /
+						     (double)e->stats.slices);
+		if (best_i == count || bound > best_bound) {
+			best_i     = i;
+			best_bound = bound;
+		}
+	}
+	return best_i;
+}
+
+// Add a slice's counts to E's stats, and move its score toward the
+// slice's reward. RATE_CEIL is the best rate of new trials any
+// property has had, which the slice's own rate is scaled by.
+static void
+update_stats(struct campaign_entry* e, const struct fuzz_run_report* report,
+		uint64_t elapsed_ms, double rate_ceil)
+{
+	struct fuzz_campaign_stats* s = &e->stats;
+	const uint64_t unique = report->pass + report->fail + report->skip;
+	const uint64_t trials = unique + report->dup;
+
+	double reward = 0;
+	if (report->fail > 0) {
+		reward = 1;
+	} else if (elapsed_ms > 0) {
+		const double rate = 1000.0 * (double)unique /
+				    (double)elapsed_ms;
+		if (rate > 0 && rate >= rate_ceil) {
+			reward = NOVELTY_WEIGHT;
+		} else if (rate_ceil <= 0) {
+			reward = 0; // no new inputs, and no rate to compare to
+		} else {
+			reward = NOVELTY_WEIGHT * rate / rate_ceil;
+		}
+	}
+
+	s->score = (s->slices == 0 ? reward
+				   : s->score + SCORE_DECAY *
+							(reward - s->score));
+	s->slices++;
+	s->elapsed_ms += elapsed_ms;
+	s->trials += trials;
+	s->unique += unique;
+	s->failures += (report->fail > 0);
+	e->slices_now++;
+}
+
+// Parse a line of a stats file:
+//
+//     SLICES ELAPSED_MS TRIALS UNIQUE FAILURES SCORE NAME
+//
+// The newline is cut off LINE, so *NAME points into it.
+static bool
+parse_stats_line(char* line, struct fuzz_campaign_stats* s, const char** name)
+{
+	int name_at = 0;
+	*s          = (struct fuzz_campaign_stats){.slices = 0};
+	if (sscanf(line,
+			    "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+			    " %" SCNu64 " %lf %n",
+			    &s->slices, &s->elapsed_ms, &s->trials, &s->unique,
+			    &s->failures, &s->score, &name_at) != 6 ||
+			name_at == 0) {
+		return false;
+	}
+	if (!(s->score >= 0 && s->score <= 1)) {
+		s->score = 0;
+	}
+	line[strcspn(line, "\n")] = '\0';
+	*name                      = &line[name_at];
+	return true;
+}
+
+// Find the property named NAME, or return PROP_COUNT.
+static size_t
+find_property(const struct fuzz_run_config* props, size_t prop_count,
+		const char* name)
+{
+	for (size_t i = 0; i < prop_count; i++) {
+		if (0 == strcmp(props[i].name, name)) {
+			return i;
+		}
+	}
+	return prop_count;
+}
+
+// Read the stats saved in PATH, one line per property. A missing or
+// malformed file just means starting over.
+static void
+load_stats(const char* path, const struct fuzz_run_config* props,
+		size_t prop_count, struct campaign_entry* entries)
+{
+	FILE* f = fopen(path, "r");
+	if (f == NULL) {
+		return;
+	}
+
+	char line[STATS_LINE_MAX];
+	while (fgets(line, sizeof(line), f) != NULL) {
+		struct fuzz_campaign_stats s;
+		const char*                name = NULL;
+		if (!parse_stats_line(line, &s, &name)) {
+			continue;
+		}
+		const size_t i = find_property(props, prop_count, name);
+		if (i < prop_count) {
+			entries[i].stats = s;
+		}
+	}
+	fclose(f);
+}
+
+// Save the stats for each property that has had a slice to PATH. Lines
+// for properties that aren't in this table are kept, so several
+// campaigns can share a file.
+static bool
+save_stats(const char* path, const struct fuzz_run_config* props,
+		size_t prop_count, const struct campaign_entry* entries)
+{
+	char*  kept      = NULL;
+	size_t kept_size = 0;
+	FILE*  f         = fopen(path, "r");
+	if (f != NULL) {
+		char line[STATS_LINE_MAX];
+		while (fgets(line, sizeof(line), f) != NULL) {
+			struct fuzz_campaign_stats s;
+			const char*                name = NULL;
+			if (!parse_stats_line(line, &s, &name) ||
+					find_property(props, prop_count,
+							name) < prop_count) {
+				continue;
+			}
+			const size_t len   = strlen(line);
+			char*        nkept = realloc(kept, kept_size + len + 2);
+			if (nkept == NULL) {
+				free(kept);
+				fclose(f);
+				return false;
+			}
+			kept = nkept;
+			memcpy(&kept[kept_size], line, len);
+			kept_size += len;
+			kept[kept_size++] = '\n';
+			kept[kept_size]   = '\0';
+		}
+		fclose(f);
+	}
+
+	// Write it under a temporary name in the same directory, and then
+	// rename it over the old file, so a process loading the stats at
+	// the same time never sees part of it.
+	const size_t tmp_len  = strlen(path) + 22;
+	char*        tmp_path = malloc(tmp_len);
+	if (tmp_path == NULL) {
+		free(kept);
+		return false;
+	}
+	uint64_t h;
+	fuzz_hash_init(&h);
+	const uint64_t now      = fuzz_monotonic_msec();
+	const void*    campaign = entries;
+	fuzz_hash_sink(&h, (const uint8_t*)&now, sizeof(now));
+	fuzz_hash_sink(&h, (const uint8_t*)&campaign, sizeof(campaign));
+	snprintf(tmp_path, tmp_len, "%s.%016" PRIx64 ".tmp", path,
+			fuzz_hash_finish(&h));
+
+	f = fopen(tmp_path, "w");
+	if (f == NULL) {
+		free(tmp_path);
+		free(kept);
+		return false;
+	}
+	bool ok = (kept_size == 0 || fputs(kept, f) >= 0);
+	free(kept);
+	for (size_t i = 0; i < prop_count && ok; i++) {
+		const struct fuzz_campaign_stats* s = &entries[i].stats;
+		if (s->slices > 0 &&
+				fprintf(f,
+						"%" PRIu64 " %" PRIu64
+						" %" PRIu64 " %" PRIu64
+						" %" PRIu64 " %.6f %s\n",
+						s->slices, s->elapsed_ms,
+						s->trials, s->unique,
+						s->failures, s->score,
+						props[i].name) < 0) {
+			ok = false;
+		}
+	}
+	if (fclose(f) != 0) {
+		ok = false;
+	}
+#if defined(_WIN32)
+	// rename() won't replace an existing file on Windows.
+	if (ok) {
+		remove(path);
+	}
+#endif
+	ok = ok && rename(tmp_path, path) == 0;
+	if (!ok) {
+		remove(tmp_path);
+	}
+	free(tmp_path);
+	return ok;
+}
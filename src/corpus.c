@@ -0,0 +1,424 @@
+// SPDX-License-Identifier: ISC
+// SPDX-FileCopyrightText: 2014-19 Scott Vokes <vokes.s@gmail.com>
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#undef WIN32_LEAN_AND_MEAN
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#include "autoshrink.h"
+#include "corpus.h"
+#include "fuzz.h"
+#include "types_internal.h"
+
+// Each saved failure is a file named by the hash of its contents, with
+// a ".fail" extension, so the same failure is only saved once. The file
+// is little-endian:
+//
+//     "FZCF"        magic
+//     u8            format version
+//     u8            arity
+//     u8            flags: CORPUS_HAS_POOLS
+//     u8            (reserved, 0)
+//     u64           trial seed
+//
+// followed, if CORPUS_HAS_POOLS is set, by each argument's bit pool:
+//
+//     u64           bit count
+//     bytes         (bit count + 7) / 8 bytes of bits, first bit in the
+//                   low bit of the first byte
+
+#define CORPUS_MAGIC       "FZCF"
+#define CORPUS_VERSION     1
+#define CORPUS_HEADER_SIZE 16
+#define CORPUS_HAS_POOLS   0x01
+#define CORPUS_EXT         ".fail"
+
+// Largest record file that will be loaded.
+#define CORPUS_MAX_FILE_SIZE (64LU * 1024 * 1024)
+
+#define LOG_CORPUS 0
+
+static bool    add_name(struct corpus_iter* iter, size_t* ceil,
+		   const char* name);
+static bool    has_extension(const char* name, const char* ext);
+static int     cmp_names(const void* a, const void* b);
+static char*   join_path(const char* dir, const char* name);
+static uint8_t* load_file(const char* path, size_t* size);
+static bool parse_record(const struct fuzz* t, const uint8_t* buf,
+		size_t size, struct corpus_record* rec);
+static void put_u64(uint8_t* dst, uint64_t x);
+static uint64_t get_u64(const uint8_t* src);
+
+bool
+fuzz_corpus_open(struct fuzz* t, struct corpus_iter* iter)
+{
+	*iter       = (struct corpus_iter){.names = NULL};
+	size_t ceil = 0;
+#if !defined(_WIN32)
+	DIR* dir = opendir(t->seeds.corpus_dir);
+	if (dir == NULL) {
+		LOG(2 - LOG_CORPUS, "%s: no corpus at %s\n", __func__,
+				t->seeds.corpus_dir);
+		return true; // nothing saved yet
+	}
+
+	struct dirent* de = NULL;
+	while ((de = readdir(dir)) != NULL) {
+		if (!add_name(iter, &ceil, de->d_name)) {
+			closedir(dir);
+			fuzz_corpus_close(iter);
+			return false;
+		}
+	}
+	closedir(dir);
+#else
+	char* pattern = join_path(t->seeds.corpus_dir, "*" CORPUS_EXT);
+	if (pattern == NULL) {
+		return false;
+	}
+	WIN32_FIND_DATAA fd;
+	HANDLE           find = FindFirstFileA(pattern, &fd);
+	free(pattern);
+	if (find == INVALID_HANDLE_VALUE) {
+		LOG(2 - LOG_CORPUS, "%s: no corpus at %s\n", __func__,
+				t->seeds.corpus_dir);
+		return true; // nothing saved yet
+	}
+
+	do {
+		if ((fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 &&
+				!add_name(iter, &ceil, fd.cFileName)) {
+			FindClose(find);
+			fuzz_corpus_close(iter);
+			return false;
+		}
+	} while (FindNextFileA(find, &fd));
+	FindClose(find);
+#endif
+
+	// Replay in the same order every time.
+	qsort(iter->names, iter->count, sizeof(char*), cmp_names);
+	return true;
+}
+
+bool
+fuzz_corpus_next(struct fuzz* t, struct corpus_iter* iter,
+		struct corpus_record* rec)
+{
+	while (iter->next < iter->count) {
+		free(iter->buf);
+		iter->buf = NULL;
+
+		const char* name = iter->names[iter->next++];
+		char*       path = join_path(t->seeds.corpus_dir, name);
+		if (path == NULL) {
+			return false;
+		}
+		size_t size = 0;
+		iter->buf   = load_file(path, &size);
+		free(path);
+		if (iter->buf != NULL &&
+				parse_record(t, iter->buf, size, rec)) {
+			LOG(2 - LOG_CORPUS, "%s: replaying %s\n", __func__,
+					name);
+			return true;
+		}
+		LOG(1 - LOG_CORPUS, "%s: skipping unusable record %s\n",
+				__func__, name);
+	}
+	return false;
+}
+
+void
+fuzz_corpus_close(struct corpus_iter* iter)
+{
+	for (size_t i = 0; i < iter->count; i++) {
+		free(iter->names[i]);
+	}
+	free(iter->names);
+	free(iter->buf);
+	*iter = (struct corpus_iter){.names = NULL};
+}
+
+bool
+fuzz_corpus_save(struct fuzz* t)
+{
+	const uint8_t arity     = t->prop.arity;
+	const bool    has_pools = fuzz_corpus_every_arg_autoshrinks(t);
+
+	size_t size = CORPUS_HEADER_SIZE;
+	for (uint8_t i = 0; has_pools && i < arity; i++) {
+		const struct autoshrink_bit_pool* pool =
+				t->trial.args[i].u.as.env->bit_pool;
+		size += 8 + (pool->consumed + 7) / 8;
+	}
+	uint8_t* buf = malloc(size);
+	if (buf == NULL) {
+		return false;
+	}
+
+	memcpy(buf, CORPUS_MAGIC, 4);
+	buf[4] = CORPUS_VERSION;
+	buf[5] = arity;
+	buf[6] = has_pools ? CORPUS_HAS_POOLS : 0;
+	buf[7] = 0;
+	put_u64(&buf[8], t->trial.seed);
+	size_t offset = CORPUS_HEADER_SIZE;
+	for (uint8_t i = 0; has_pools && i < arity; i++) {
+		const struct autoshrink_bit_pool* pool =
+				t->trial.args[i].u.as.env->bit_pool;
+		const uint64_t* words = (const uint64_t*)pool->bits;
+		const size_t    bytes = (pool->consumed + 7) / 8;
+		put_u64(&buf[offset], pool->consumed);
+		offset += 8;
+		for (size_t b = 0; b < bytes; b++) {
+			buf[offset + b] = (uint8_t)(words[b / 8] >>
+						    (8 * (b % 8)));
+		}
+		if ((pool->consumed & 0x07) != 0) {
+			// Clear unused bits, so they don't change the name.
+			buf[offset + bytes - 1] &= (uint8_t)(
+					(1U << (pool->consumed & 0x07)) - 1);
+		}
+		offset += bytes;
+	}
+	assert(offset == size);
+
+	// Bit pools are replayed without the seed, so leave it out of the
+	// name, and the same failure found from different seeds is kept
+	// once.
+	uint64_t h = 0;
+	fuzz_hash_init(&h);
+	fuzz_hash_sink(&h, buf, 8);
+	if (has_pools) {
+		fuzz_hash_sink(&h, &buf[CORPUS_HEADER_SIZE],
+				size - CORPUS_HEADER_SIZE);
+	} else {
+		fuzz_hash_sink(&h, &buf[8], 8);
+	}
+	const uint64_t hash = fuzz_hash_finish(&h);
+	char           name[32];
+	char           tmp_name[32];
+	snprintf(name, sizeof(name), "%016" PRIx64 CORPUS_EXT, hash);
+	snprintf(tmp_name, sizeof(tmp_name), "%016" PRIx64 ".tmp", hash);
+
+	bool  ok       = false;
+	char* path     = join_path(t->seeds.corpus_dir, name);
+	char* tmp_path = join_path(t->seeds.corpus_dir, tmp_name);
+	FILE* f        = NULL;
+	if (path == NULL || tmp_path == NULL) {
+		goto cleanup;
+	}
+	if ((f = fopen(path, "rb")) != NULL) {
+		LOG(2 - LOG_CORPUS, "%s: already saved as %s\n", __func__,
+				name);
+		ok = true;
+		goto cleanup;
+	}
+
+	if (!fuzz_corpus_make_dir(t->seeds.corpus_dir)) {
+		goto cleanup;
+	}
+
+	// Write it under a temporary name first, so a process replaying the
+	// corpus at the same time never sees part of a record.
+	f = fopen(tmp_path, "wb");
+	if (f == NULL) {
+		goto cleanup;
+	}
+	ok = fwrite(buf, 1, size, f) == size;
+	if (fclose(f) != 0) {
+		ok = false;
+	}
+	f  = NULL;
+	ok = ok && rename(tmp_path, path) == 0;
+	if (!ok) {
+		remove(tmp_path);
+	}
+	LOG(2 - LOG_CORPUS, "%s: saved %s: %d\n", __func__, name, ok);
+
+cleanup:
+	if (f != NULL) {
+		fclose(f);
+	}
+	free(path);
+	free(tmp_path);
+	free(buf);
+	return ok;
+}
+
+bool
+fuzz_corpus_make_dir(const char* path)
+{
+#if defined(_WIN32)
+	const int res = _mkdir(path);
+#else
+	const int res = mkdir(path, 0777);
+#endif
+	return res == 0 || errno == EEXIST;
+}
+
+bool
+fuzz_corpus_every_arg_autoshrinks(const struct fuzz* t)
+{
+	for (uint8_t i = 0; i < t->prop.arity; i++) {
+		if (!t->prop.type_info[i]->autoshrink_config.enable) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Add a copy of NAME to ITER's names if it's a saved failure, growing
+// them as needed. Returns false on alloc failure.
+static bool
+add_name(struct corpus_iter* iter, size_t* ceil, const char* name)
+{
+	if (!has_extension(name, CORPUS_EXT)) {
+		return true;
+	}
+	if (iter->count == *ceil) {
+		const size_t nceil  = (*ceil == 0 ? 16 : 2 * *ceil);
+		char**       nnames =
+				realloc(iter->names, nceil * sizeof(char*));
+		if (nnames == NULL) {
+			return false;
+		}
+		iter->names = nnames;
+		*ceil       = nceil;
+	}
+	const size_t len  = strlen(name);
+	char*        copy = malloc(len + 1);
+	if (copy == NULL) {
+		return false;
+	}
+	memcpy(copy, name, len + 1);
+	iter->names[iter->count++] = copy;
+	return true;
+}
+
+static bool
+has_extension(const char* name, const char* ext)
+{
+	const size_t len     = strlen(name);
+	const size_t ext_len = strlen(ext);
+	return len > ext_len && 0 == strcmp(&name[len - ext_len], ext);
+}
+
+static int
+cmp_names(const void* a, const void* b)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static char*
+join_path(const char* dir, const char* name)
+{
+	const size_t dir_len  = strlen(dir);
+	const size_t name_len = strlen(name);
+	char*        path     = malloc(dir_len + name_len + 2);
+	if (path == NULL) {
+		return NULL;
+	}
+	memcpy(path, dir, dir_len);
+	path[dir_len] = '/';
+	memcpy(&path[dir_len + 1], name, name_len + 1);
+	return path;
+}
+
+static uint8_t*
+load_file(const char* path, size_t* size)
+{
+	FILE* f = fopen(path, "rb");
+	if (f == NULL) {
+		return NULL;
+	}
+	uint8_t* buf = NULL;
+	long     len = -1;
+	if (fseek(f, 0, SEEK_END) == 0) {
+		len = ftell(f);
+	}
+	if (len < CORPUS_HEADER_SIZE || (unsigned long)len >
+						CORPUS_MAX_FILE_SIZE ||
+			fseek(f, 0, SEEK_SET) != 0) {
+		goto cleanup;
+	}
+	buf = malloc((size_t)len);
+	if (buf != NULL && fread(buf, 1, (size_t)len, f) != (size_t)len) {
+		free(buf);
+		buf = NULL;
+	}
+	*size = (size_t)len;
+
+cleanup:
+	fclose(f);
+	return buf;
+}
+
+// Check that the record in BUF is well-formed and matches T's property,
+// and point REC's bits into it.
+static bool
+parse_record(const struct fuzz* t, const uint8_t* buf, size_t size,
+		struct corpus_record* rec)
+{
+	if (0 != memcmp(buf, CORPUS_MAGIC, 4) || buf[4] != CORPUS_VERSION ||
+			buf[5] != t->prop.arity) {
+		return false;
+	}
+	*rec = (struct corpus_record){
+			.seed      = get_u64(&buf[8]),
+			.has_pools = (buf[6] & CORPUS_HAS_POOLS) != 0,
+	};
+	if (!rec->has_pools) {
+		return size == CORPUS_HEADER_SIZE;
+	} else if (!fuzz_corpus_every_arg_autoshrinks(t)) {
+		return false;
+	}
+
+	size_t offset = CORPUS_HEADER_SIZE;
+	for (uint8_t i = 0; i < t->prop.arity; i++) {
+		if (size - offset < 8) {
+			return false;
+		}
+		const uint64_t bits = get_u64(&buf[offset]);
+		offset += 8;
+		if (bits / 8 > size - offset ||
+				(bits + 7) / 8 > size - offset) {
+			return false;
+		}
+		rec->bit_counts[i] = (size_t)bits;
+		rec->bits[i]       = &buf[offset];
+		offset += (size_t)((bits + 7) / 8);
+	}
+	return offset == size;
+}
+
+static void
+put_u64(uint8_t* dst, uint64_t x)
+{
+	for (size_t i = 0; i < 8; i++) {
+		dst[i] = (uint8_t)(x >> (8 * i));
+	}
+}
+
+static uint64_t
+get_u64(const uint8_t* src)
+{
+	uint64_t x = 0;
+	for (size_t i = 0; i < 8; i++) {
+		x |= (uint64_t)src[i] << (8 * i);
+	}
+	return x;
+}
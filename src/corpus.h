@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: ISC
+// SPDX-FileCopyrightText: 2014-19 Scott Vokes <vokes.s@gmail.com>
+#ifndef FUZZ_CORPUS_H
+#define FUZZ_CORPUS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fuzz.h"
+
+struct fuzz;
+
+// A failure saved in a corpus directory. If every argument autoshrinks,
+// it has each argument's shrunk bit pool, which are replayed directly.
+// Otherwise it only has the trial's seed, which is replayed the same
+// way as an always_seeds entry.
+struct corpus_record {
+	uint64_t seed;
+	bool     has_pools;
+	// Bits for each argument, pointing into the loaded file.
+	size_t         bit_counts[FUZZ_MAX_ARITY];
+	const uint8_t* bits[FUZZ_MAX_ARITY];
+};
+
+// Iterator over the failures saved in a corpus directory, in order of
+// file name. Records that don't match the property, such as ones saved
+// before an argument was changed, are skipped.
+struct corpus_iter {
+	char**   names;
+	size_t   count;
+	size_t   next;
+	uint8_t* buf; // contents of the current record's file
+};
+
+// Start iterating over T's corpus directory, which may not exist yet.
+// Returns false on allocation failure.
+bool fuzz_corpus_open(struct fuzz* t, struct corpus_iter* iter);
+
+// Load the next usable record into REC, which stays valid until the
+// next call. Returns false once there are no more.
+bool fuzz_corpus_next(struct fuzz* t, struct corpus_iter* iter,
+		struct corpus_record* rec);
+
+void fuzz_corpus_close(struct corpus_iter* iter);
+
+// Save the current trial's (shrunk) failing arguments to T's corpus
+// directory, unless an identical record is already there.
+bool fuzz_corpus_save(struct fuzz* t);
+
+// Create the directory at PATH, unless it already exists. Returns
+// false if it can't be created.
+bool fuzz_corpus_make_dir(const char* path);
+
+// Does every one of T's arguments autoshrink, so its failures can be
+// saved as bit pools?
+bool fuzz_corpus_every_arg_autoshrinks(const struct fuzz* t);
+
+#endif
@@ -0,0 +1,329 @@
+// SPDX-License-Identifier: ISC
+// SPDX-FileCopyrightText: 2014-19 Scott Vokes <vokes.s@gmail.com>
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "autoshrink.h"
+#include "coverage.h"
+#include "fuzz.h"
+#include "types_internal.h"
+
+// Coverage-guided generation, using the edge counters clang adds for
+// `-fsanitize-coverage=inline-8bit-counters`. Each instrumented module
+// registers its counters at startup, by calling
+// __sanitizer_cov_8bit_counters_init. They are cleared before each
+// property call and copied to the trace after it, and a trial reached
+// new coverage if any counter's hit count falls in a class (1, 2, 3,
+// 4-7, 8-15, 16-31, 32-127, 128+) it hadn't before, the same as AFL.
+
+// Most instrumented modules whose counters are tracked.
+#define MAX_COUNTER_REGIONS 64
+
+// Odds of mutating a corpus entry rather than starting from random
+// bits, out of 1 << MUTATE_ODDS_BITS, and of splicing in another entry.
+#define MUTATE_ODDS      3
+#define MUTATE_ODDS_BITS 2
+#define SPLICE_ODDS_BITS 2
+
+#define LOG_COVERAGE 0
+
+struct counter_region {
+	uint8_t* start;
+	uint8_t* end;
+};
+
+static struct counter_region counter_regions[MAX_COUNTER_REGIONS];
+static size_t                counter_region_count;
+
+static size_t  total_counters(void);
+static uint8_t count_class(uint8_t count);
+static bool    find_new_coverage(struct fuzz_coverage* c);
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(_WIN32)
+// Called by each module's constructor when built with inline 8-bit
+// counters. It's weak, so a fuzzing engine that defines it too (such as
+// libFuzzer) gets the counters instead.
+void __sanitizer_cov_8bit_counters_init(char* start, char* end);
+
+__attribute__((weak)) void
+__sanitizer_cov_8bit_counters_init(char* start, char* end)
+{
+	if (start == end) {
+		return;
+	}
+	for (size_t i = 0; i < counter_region_count; i++) {
+		if (counter_regions[i].start == (uint8_t*)start) {
+			return; // already registered
+		}
+	}
+	if (counter_region_count == MAX_COUNTER_REGIONS) {
+		LOG(1 - LOG_COVERAGE, "%s: too many modules, ignoring %p\n",
+				__func__, (void*)start);
+		return;
+	}
+	counter_regions[counter_region_count++] = (struct counter_region){
+			.start = (uint8_t*)start,
+			.end   = (uint8_t*)end,
+	};
+}
+#endif
+
+bool
+fuzz_coverage_init(struct fuzz* t, const struct fuzz_run_config* cfg)
+{
+	t->coverage = NULL;
+	if (!cfg->coverage.enable) {
+		return true;
+	}
+	for (uint8_t i = 0; i < t->prop.arity; i++) {
+		if (!t->prop.type_info[i]->autoshrink_config.enable) {
+			LOG(1 - LOG_COVERAGE,
+					"%s: arg %u doesn't autoshrink, "
+					"generating randomly\n",
+					__func__, i);
+			return true;
+		}
+	}
+	const size_t count = total_counters();
+	if (count == 0) {
+		LOG(1 - LOG_COVERAGE,
+				"%s: no coverage counters, generating "
+				"randomly\n",
+				__func__);
+		return true;
+	}
+
+	struct fuzz_coverage* c = calloc(1, sizeof(*c));
+	if (c == NULL) {
+		return false;
+	}
+	c->counter_count = count;
+	c->entry_limit   = (cfg->coverage.max_inputs != 0
+					   ? cfg->coverage.max_inputs
+					   : FUZZ_DEF_COVERAGE_INPUTS);
+	c->seen          = calloc(count, sizeof(uint8_t));
+	c->entries       = calloc(c->entry_limit, sizeof(*c->entries));
+	t->coverage      = c;
+	if (c->seen == NULL || c->entries == NULL) {
+		fuzz_coverage_free(t);
+		return false;
+	}
+
+	// Forked workers can't write to the parent's memory, so give them
+	// a shared mapping to copy their counters into.
+	c->shared = t->fork.enable;
+	c->trace  = fuzz_coverage_alloc_trace(count, c->shared);
+	if (c->trace == NULL) {
+		fuzz_coverage_free(t);
+		return false;
+	}
+	return true;
+}
+
+void
+fuzz_coverage_free(struct fuzz* t)
+{
+	struct fuzz_coverage* c = t->coverage;
+	if (c == NULL) {
+		return;
+	}
+	LOG(2 - LOG_COVERAGE, "%s: %zd edges, %zd inputs\n", __func__,
+			c->edges, c->entry_count);
+	for (size_t e = 0; e < c->entry_count; e++) {
+		for (uint8_t i = 0; i < t->prop.arity; i++) {
+			fuzz_autoshrink_free_bit_pool(
+					t, c->entries[e].pools[i]);
+		}
+	}
+	fuzz_coverage_free_trace(c->trace, c->counter_count, c->shared);
+	free(c->entries);
+	free(c->seen);
+	free(c);
+	t->coverage = NULL;
+}
+
+void
+fuzz_coverage_begin(struct fuzz_coverage* c)
+{
+	// Clear the trace too, so a worker that crashes before copying
+	// its counters leaves nothing behind.
+	memset(c->trace, 0x00, c->counter_count);
+	for (size_t r = 0; r < counter_region_count; r++) {
+		const struct counter_region* region = &counter_regions[r];
+		memset(region->start, 0x00,
+				(size_t)(region->end - region->start));
+	}
+}
+
+void
+fuzz_coverage_end(struct fuzz_coverage* c)
+{
+	size_t offset = 0;
+	for (size_t r = 0; r < counter_region_count; r++) {
+		const struct counter_region* region = &counter_regions[r];
+		const size_t size = (size_t)(region->end - region->start);
+		if (offset + size > c->counter_count) {
+			break; // registered after the run started
+		}
+		memcpy(&c->trace[offset], region->start, size);
+		offset += size;
+	}
+}
+
+void*
+fuzz_coverage_alloc_trace(size_t size, bool shared)
+{
+#if !defined(_WIN32)
+	if (shared) {
+		void* trace = NULL;
+		FILE* f     = tmpfile();
+		if (f != NULL && ftruncate(fileno(f), (off_t)size) == 0) {
+			trace = mmap(NULL, size, PROT_READ | PROT_WRITE,
+					MAP_SHARED, fileno(f), 0);
+		}
+		if (f != NULL) {
+			fclose(f); // the mapping keeps the file
+		}
+		return (trace == MAP_FAILED ? NULL : trace);
+	}
+#else
+	(void)shared;
+#endif
+	return calloc(size, 1);
+}
+
+void
+fuzz_coverage_free_trace(void* trace, size_t size, bool shared)
+{
+	if (trace == NULL) {
+		return;
+	}
+#if !defined(_WIN32)
+	if (shared) {
+		munmap(trace, size);
+		return;
+	}
+#else
+	(void)shared;
+#endif
+	(void)size;
+	free(trace);
+}
+
+struct coverage_entry*
+fuzz_coverage_choose(struct fuzz* t, struct coverage_entry** other)
+{
+	struct fuzz_coverage* c = t->coverage;
+	*other                  = NULL;
+	if (c->entry_count == 0 ||
+			fuzz_random_bits(t, MUTATE_ODDS_BITS) >= MUTATE_ODDS) {
+		return NULL;
+	}
+	struct coverage_entry* e =
+			&c->entries[fuzz_random_bits(t, 64) % c->entry_count];
+	if (c->entry_count > 1 &&
+			fuzz_random_bits(t, SPLICE_ODDS_BITS) == 0) {
+		const size_t o = fuzz_random_bits(t, 64) % c->entry_count;
+		*other         = &c->entries[o];
+	}
+	return e;
+}
+
+void
+fuzz_coverage_update(struct fuzz* t)
+{
+	struct fuzz_coverage* c = t->coverage;
+	if (!find_new_coverage(c)) {
+		return;
+	}
+
+	// Once the corpus is full, replace the oldest entries first.
+	struct coverage_entry* e = NULL;
+	if (c->entry_count < c->entry_limit) {
+		e = &c->entries[c->entry_count++];
+	} else {
+		e = &c->entries[c->next_replaced];
+		c->next_replaced = (c->next_replaced + 1) % c->entry_limit;
+		for (uint8_t i = 0; i < t->prop.arity; i++) {
+			fuzz_autoshrink_free_bit_pool(t, e->pools[i]);
+		}
+	}
+
+	// Take the trial's bit pools rather than copying them, since the
+	// trial is done with them.
+	for (uint8_t i = 0; i < t->prop.arity; i++) {
+		struct autoshrink_env* env = t->trial.args[i].u.as.env;
+		e->pools[i]                = env->bit_pool;
+		env->bit_pool              = NULL;
+	}
+	LOG(2 - LOG_COVERAGE, "%s: trial %d reached new coverage, %zd edges\n",
+			__func__, t->trial.trial, c->edges);
+}
+
+static size_t
+total_counters(void)
+{
+	size_t count = 0;
+	for (size_t r = 0; r < counter_region_count; r++) {
+		count += (size_t)(counter_regions[r].end -
+				  counter_regions[r].start);
+	}
+	return count;
+}
+
+// Bucket a hit count, so a loop running a few more times doesn't count
+// as new coverage, but running a different order of magnitude does.
+static uint8_t
+count_class(uint8_t count)
+{
+	assert(count > 0);
+	if (count <= 3) {
+		return (uint8_t)(1U << (count - 1));
+	} else if (count <= 7) {
+		return 0x08;
+	} else if (count <= 15) {
+		return 0x10;
+	} else if (count <= 31) {
+		return 0x20;
+	} else if (count <= 127) {
+		return 0x40;
+	}
+	return 0x80;
+}
+
+static bool
+find_new_coverage(struct fuzz_coverage* c)
+{
+	bool         found = false;
+	const size_t count = c->counter_count;
+	for (size_t i = 0; i < count; i++) {
+		// Most counters are zero, so skip them a word at a time.
+		if ((i % 8) == 0 && count - i >= 8) {
+			uint64_t word;
+			memcpy(&word, &c->trace[i], sizeof(word));
+			if (word == 0) {
+				i += 7;
+				continue;
+			}
+		}
+		if (c->trace[i] == 0) {
+			continue;
+		}
+		const uint8_t bucket = count_class(c->trace[i]);
+		if ((c->seen[i] & bucket) == 0) {
+			if (c->seen[i] == 0) {
+				c->edges++;
+			}
+			c->seen[i] |= bucket;
+			found = true;
+		}
+	}
+	return found;
+}
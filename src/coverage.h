@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: ISC
+// SPDX-FileCopyrightText: 2014-19 Scott Vokes <vokes.s@gmail.com>
+#ifndef FUZZ_COVERAGE_H
+#define FUZZ_COVERAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fuzz.h"
+
+struct fuzz;
+struct autoshrink_bit_pool;
+
+// The bit pools of a trial that reached new coverage.
+struct coverage_entry {
+	struct autoshrink_bit_pool* pools[FUZZ_MAX_ARITY];
+};
+
+// State for coverage-guided generation.
+struct fuzz_coverage {
+	size_t   counter_count; // counters in every registered region
+	uint8_t* trace;         // counters from the last property call
+	bool     shared;        // is the trace mapped for forked workers?
+	uint8_t* seen;          // hit count classes seen for each counter
+	size_t   edges;         // counters hit so far
+
+	struct coverage_entry* entries;
+	size_t                 entry_count;
+	size_t                 entry_limit;
+	size_t                 next_replaced; // once the corpus is full
+};
+
+// Set up coverage-guided generation for T, if CFG enables it, every
+// argument autoshrinks, and counters were registered. Otherwise
+// t->coverage is left NULL. Returns false on allocation failure.
+bool fuzz_coverage_init(struct fuzz* t, const struct fuzz_run_config* cfg);
+
+void fuzz_coverage_free(struct fuzz* t);
+
+// Clear the counters before calling the property, and copy them to the
+// trace after it returns. In a forked worker, the trace is shared with
+// the parent.
+void fuzz_coverage_begin(struct fuzz_coverage* c);
+void fuzz_coverage_end(struct fuzz_coverage* c);
+
+// Allocate SIZE zeroed bytes for a trace. If SHARED, they're mapped so
+// forked workers' writes are seen by the parent. Returns NULL on
+// failure.
+void* fuzz_coverage_alloc_trace(size_t size, bool shared);
+void  fuzz_coverage_free_trace(void* trace, size_t size, bool shared);
+
+// Choose a corpus entry to mutate for the current trial, and maybe
+// another to splice it with, or return NULL to generate the trial's
+// arguments from random bits.
+struct coverage_entry* fuzz_coverage_choose(
+		struct fuzz* t, struct coverage_entry** other);
+
+// After a passing trial, check whether it reached new coverage, and if
+// so, take its bit pools into the corpus.
+void fuzz_coverage_update(struct fuzz* t);
+
+#endif
@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: ISC
+// SPDX-FileCopyrightText: 2014-19 Scott Vokes <vokes.s@gmail.com>
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coverage.h"
+#include "dictionary.h"
+#include "fuzz.h"
+#include "types_internal.h"
+
+// A dictionary of values the property compares against, using the hooks
+// clang calls for `-fsanitize-coverage=trace-cmp`. While the property
+// runs, the constant of each comparison against one, and each switch's
+// case values, are added to a trace. Comparisons between two variables
+// are left out, since their operands are mostly the input itself. After
+// a trial that won't be shrunk, they're added to the dictionary, which
+// generators draw from with fuzz_random_dictionary_value. This finds
+// magic numbers, such as tags and checksums, that random bits rarely do.
+
+#define LOG_DICTIONARY 0
+
+// Keep the hooks (and what they call) from being instrumented
+// themselves, in case this is built with trace-cmp too.
+#if defined(__has_attribute)
+#if __has_attribute(no_sanitize_coverage)
+#define NO_SANITIZE_COVERAGE __attribute__((no_sanitize_coverage))
+#elif __has_attribute(no_sanitize)
+#define NO_SANITIZE_COVERAGE __attribute__((no_sanitize("coverage")))
+#endif
+#endif
+#if !defined(NO_SANITIZE_COVERAGE)
+#define NO_SANITIZE_COVERAGE
+#endif
+
+// The trace being recorded, while calling the property.
+static struct cmp_trace* tracing;
+
+static bool set_insert(uint64_t* slots, size_t slot_mask, uint64_t value);
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(_WIN32)
+NO_SANITIZE_COVERAGE static void trace_value(uint64_t value);
+
+// These are weak, so a fuzzing engine that defines them too (such as
+// libFuzzer) gets the comparisons instead. Comparisons between two
+// variables are ignored, but still need a hook to link.
+#define TRACE_CMP(NAME, TYPE)                                                 \
+	void __sanitizer_cov_trace_##NAME(TYPE a, TYPE b);                    \
+	NO_SANITIZE_COVERAGE __attribute__((weak)) void                       \
+	__sanitizer_cov_trace_##NAME(TYPE a, TYPE b)                          \
+	{                                                                     \
+		(void)a;                                                      \
+		(void)b;                                                      \
+	}
+
+// The first argument is the constant.
+#define TRACE_CONST_CMP(NAME, TYPE)                                           \
+	void __sanitizer_cov_trace_##NAME(TYPE a, TYPE b);                    \
+	NO_SANITIZE_COVERAGE __attribute__((weak)) void                       \
+	__sanitizer_cov_trace_##NAME(TYPE a, TYPE b)                          \
+	{                                                                     \
+		(void)b;                                                      \
+		trace_value(a);                                               \
+	}
+
+TRACE_CMP(cmp1, uint8_t)
+TRACE_CMP(cmp2, uint16_t)
+TRACE_CMP(cmp4, uint32_t)
+TRACE_CMP(cmp8, uint64_t)
+TRACE_CONST_CMP(const_cmp1, uint8_t)
+TRACE_CONST_CMP(const_cmp2, uint16_t)
+TRACE_CONST_CMP(const_cmp4, uint32_t)
+TRACE_CONST_CMP(const_cmp8, uint64_t)
+
+// CASES is the number of cases, the value's size in bits, and then
+// each case's value.
+void __sanitizer_cov_trace_switch(uint64_t value, uint64_t* cases);
+
+NO_SANITIZE_COVERAGE __attribute__((weak)) void
+__sanitizer_cov_trace_switch(uint64_t value, uint64_t* cases)
+{
+	(void)value;
+	for (uint64_t i = 0; i < cases[0]; i++) {
+		trace_value(cases[2 + i]);
+	}
+}
+
+NO_SANITIZE_COVERAGE static void
+trace_value(uint64_t value)
+{
+	struct cmp_trace* trace = tracing;
+	// 0 and 1 are already common, and 0 marks an empty slot.
+	if (trace == NULL || value <= 1 ||
+			trace->count == CMP_TRACE_MAX_VALUES) {
+		return;
+	}
+	if (set_insert(trace->slots, CMP_TRACE_SLOTS - 1, value)) {
+		trace->count++;
+	}
+}
+#endif
+
+bool
+fuzz_dictionary_init(struct fuzz* t, const struct fuzz_run_config* cfg)
+{
+	t->dictionary = NULL;
+	if (!cfg->dictionary.enable) {
+		return true;
+	}
+
+	struct fuzz_dictionary* d = calloc(1, sizeof(*d));
+	if (d == NULL) {
+		return false;
+	}
+	t->dictionary = d;
+	d->limit      = (cfg->dictionary.max_values != 0
+					 ? cfg->dictionary.max_values
+					 : FUZZ_DEF_DICTIONARY_VALUES);
+	d->odds       = (cfg->dictionary.odds != 0 ? cfg->dictionary.odds
+						   : FUZZ_DEF_DICTIONARY_ODDS);
+
+	// Keep the set at most half full, so probes stay short.
+	size_t slot_count = 16;
+	while (slot_count < 2 * d->limit) {
+		slot_count *= 2;
+	}
+	d->slot_mask = slot_count - 1;
+	d->slots     = calloc(slot_count, sizeof(uint64_t));
+	d->values    = calloc(d->limit, sizeof(uint64_t));
+	d->shared    = t->fork.enable;
+	d->trace     = fuzz_coverage_alloc_trace(
+			    sizeof(struct cmp_trace), d->shared);
+	if (d->slots == NULL || d->values == NULL || d->trace == NULL) {
+		fuzz_dictionary_free(t);
+		return false;
+	}
+	return true;
+}
+
+void
+fuzz_dictionary_free(struct fuzz* t)
+{
+	struct fuzz_dictionary* d = t->dictionary;
+	if (d == NULL) {
+		return;
+	}
+	LOG(2 - LOG_DICTIONARY, "%s: %zd values\n", __func__, d->count);
+	fuzz_coverage_free_trace(d->trace, sizeof(struct cmp_trace), d->shared);
+	free(d->values);
+	free(d->slots);
+	free(d);
+	t->dictionary = NULL;
+}
+
+void
+fuzz_dictionary_begin(struct fuzz_dictionary* d)
+{
+	memset(d->trace, 0x00, sizeof(*d->trace));
+	tracing = d->trace;
+}
+
+void
+fuzz_dictionary_end(struct fuzz_dictionary* d)
+{
+	(void)d;
+	tracing = NULL;
+}
+
+void
+fuzz_dictionary_update(struct fuzz* t)
+{
+	struct fuzz_dictionary* d     = t->dictionary;
+	const size_t            start = d->count;
+	for (size_t i = 0; i < CMP_TRACE_SLOTS && d->count < d->limit; i++) {
+		const uint64_t value = d->trace->slots[i];
+		if (value != 0 && set_insert(d->slots, d->slot_mask, value)) {
+			d->values[d->count++] = value;
+		}
+	}
+	if (d->count > start) {
+		LOG(2 - LOG_DICTIONARY,
+				"%s: trial %d added %zd values, %zd total\n",
+				__func__, t->trial.trial, d->count - start,
+				d->count);
+	}
+}
+
+bool
+fuzz_random_dictionary_value(struct fuzz* t, uint64_t* value)
+{
+	const struct fuzz_dictionary* d = t->dictionary;
+	if (d == NULL) {
+		return false;
+	}
+	// Use the dictionary when the choice is high, so a choice shrunk to
+	// 0 leaves it out. The same bits are used whether or not it has
+	// values yet, so what earlier trials added doesn't change the rest
+	// of a trial's random bits.
+	if (fuzz_random_bits_tagged(t, 8, FUZZ_REQ_CHOICE) < 256U - d->odds) {
+		return false;
+	}
+	const uint64_t idx = fuzz_random_bits_tagged(t, 32, FUZZ_REQ_CHOICE);
+	if (d->count == 0) {
+		return false;
+	}
+	*value = d->values[idx % d->count];
+	return true;
+}
+
+// Add VALUE (not 0) to an open-addressed set of SLOT_MASK + 1 slots,
+// which must have an empty one. Returns whether it wasn't there yet.
+NO_SANITIZE_COVERAGE static bool
+set_insert(uint64_t* slots, size_t slot_mask, uint64_t value)
+{
+	assert(value != 0);
+	size_t i = (size_t)((value * 0x9e3779b97f4a7c15LLU) >> 32) & slot_mask;
+	for (;;) {
+		if (slots[i] == value) {
+			return false;
+		} else if (slots[i] == 0) {
+			slots[i] = value;
+			return true;
+		}
+		i = (i + 1) & slot_mask;
+	}
+}
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: ISC
+// SPDX-FileCopyrightText: 2014-19 Scott Vokes <vokes.s@gmail.com>
+#ifndef FUZZ_DICTIONARY_H
+#define FUZZ_DICTIONARY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fuzz.h"
+
+struct fuzz;
+
+// Most distinct values traced during one property call.
+#define CMP_TRACE_MAX_VALUES 256
+#define CMP_TRACE_SLOTS      (2 * CMP_TRACE_MAX_VALUES)
+
+// Constants compared against during one property call, as an
+// open-addressed set where 0 marks an empty slot. In a forked worker,
+// it's shared with the parent.
+struct cmp_trace {
+	size_t   count;
+	uint64_t slots[CMP_TRACE_SLOTS];
+};
+
+// Values the property has compared its input against, for generators
+// to draw from.
+struct fuzz_dictionary {
+	struct cmp_trace* trace;
+	bool              shared; // is the trace mapped for forked workers?
+	uint8_t           odds;   // out of 256
+
+	uint64_t* values; // in the order they were first seen
+	size_t    count;
+	size_t    limit;
+	uint64_t* slots; // set of values, to skip ones already kept
+	size_t    slot_mask;
+};
+
+// Set up the dictionary for T, if CFG enables it. Otherwise
+// t->dictionary is left NULL. Returns false on allocation failure.
+bool fuzz_dictionary_init(struct fuzz* t, const struct fuzz_run_config* cfg);
+
+void fuzz_dictionary_free(struct fuzz* t);
+
+// Start and stop tracing comparisons, around calling the property.
+void fuzz_dictionary_begin(struct fuzz_dictionary* d);
+void fuzz_dictionary_end(struct fuzz_dictionary* d);
+
+// Add the values traced during the last property call to the
+// dictionary, until it's full.
+void fuzz_dictionary_update(struct fuzz* t);
+
+#endif
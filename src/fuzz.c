@@ -1,10 +1,14 @@
 // SPDX-License-Identifier: ISC
 // SPDX-FileCopyrightText: 2014-19 Scott Vokes <vokes.s@gmail.com>
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
+#include "bloom.h"
 #include "fuzz.h"
 #include "polyfill.h"
+#include "rng.h"
 #include "run.h"
 #include "types_internal.h"
 
@@ -27,31 +31,40 @@ fuzz_set_output_stream(struct fuzz* t, FILE* out)
 int
 fuzz_run(const struct fuzz_run_config* cfg)
 {
-	if (cfg == NULL) {
-		return FUZZ_RESULT_ERROR;
-	}
-
-	if (cfg->fork.enable && !FUZZ_POLYFILL_HAVE_FORK) {
-		return FUZZ_RESULT_SKIP;
-	}
+	return fuzz_run_reporting(NULL, cfg, NULL);
+}
 
-	struct fuzz* t = NULL;
+struct fuzz_runner*
+fuzz_runner_new(void)
+{
+	return calloc(1, sizeof(struct fuzz_runner));
+}
 
-	enum fuzz_run_init_res init_res = fuzz_run_init(cfg, &t);
-	switch (init_res) {
-	case FUZZ_RUN_INIT_ERROR_MEMORY:
-		return FUZZ_RESULT_ERROR_MEMORY;
-	default:
-		assert(false);
-	case FUZZ_RUN_INIT_ERROR_BAD_ARGS:
+int
+fuzz_runner_run(struct fuzz_runner* runner, const struct fuzz_run_config* cfg)
+{
+	if (runner == NULL) {
 		return FUZZ_RESULT_ERROR;
-	case FUZZ_RUN_INIT_OK:
-		break; // continue below
 	}
+	return fuzz_run_reporting(runner, cfg, NULL);
+}
 
-	int res = fuzz_run_trials(t);
-	fuzz_run_free(t);
-	return res;
+void
+fuzz_runner_free(struct fuzz_runner* runner)
+{
+	if (runner == NULL) {
+		return;
+	}
+	if (runner->bloom != NULL) {
+		fuzz_bloom_free(runner->bloom);
+	}
+	if (runner->arena != NULL) {
+		fuzz_arena_free(runner->arena);
+	}
+	fuzz_rng_free(runner->rng);
+	free(runner->print_env);
+	free(runner->t);
+	free(runner);
 }
 
 int
@@ -111,6 +124,48 @@ cleanup:
 	return res;
 }
 
+int
+fuzz_run_reporting(struct fuzz_runner* runner,
+		const struct fuzz_run_config* cfg, struct fuzz_run_report* report)
+{
+	if (cfg == NULL) {
+		return FUZZ_RESULT_ERROR;
+	}
+
+	if (cfg->fork.enable && !FUZZ_POLYFILL_HAVE_FORK) {
+		return FUZZ_RESULT_SKIP;
+	}
+
+	struct fuzz* t = NULL;
+
+	enum fuzz_run_init_res init_res =
+			fuzz_run_init_reusing(runner, cfg, &t);
+	switch (init_res) {
+	case FUZZ_RUN_INIT_ERROR_MEMORY:
+		return FUZZ_RESULT_ERROR_MEMORY;
+	default:
+		assert(false);
+	case FUZZ_RUN_INIT_ERROR_BAD_ARGS:
+		return FUZZ_RESULT_ERROR;
+	case FUZZ_RUN_INIT_OK:
+		break; // continue below
+	}
+
+	int res = fuzz_run_trials(t);
+	if (report != NULL) {
+		*report = (struct fuzz_run_report){
+				.pass = t->counters.pass,
+				.fail = t->counters.fail,
+				.skip = t->counters.skip,
+				.dup  = t->counters.dup,
+				.elapsed_ms     = t->counters.elapsed_ms,
+				.trials_per_sec = t->counters.trials_per_sec,
+		};
+	}
+	fuzz_run_free_reusing(t, runner);
+	return res;
+}
+
 static int
 should_not_run(struct fuzz* t, void* arg1)
 {
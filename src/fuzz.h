@@ -24,12 +24,15 @@
 // Opaque handle struct for a fuzz property-test runner.
 struct fuzz;
 
-// Overall trial pass/fail/skip/duplicate counts after a run.
+// Overall trial pass/fail/skip/duplicate counts after a run, and how
+// fast trials ran.
 struct fuzz_run_report {
-	size_t pass;
-	size_t fail;
-	size_t skip;
-	size_t dup;
+	size_t   pass;
+	size_t   fail;
+	size_t   skip;
+	size_t   dup;
+	uint64_t elapsed_ms;     // time taken by the whole run
+	size_t   trials_per_sec; // or 0, if it took under 1 msec
 };
 
 #define FUZZ_RESULT_OK        (0) // No failure
@@ -54,6 +57,20 @@ struct fuzz_run_report {
 // be given to terminate and exit before sending kill(pid, SIGKILL).
 #define FUZZ_DEF_EXIT_TIMEOUT_MSEC 100
 
+// Default length of each time slice a campaign gives a property.
+#define FUZZ_DEF_CAMPAIGN_SLICE_MSEC 250
+
+// Default number of inputs coverage-guided generation keeps.
+#define FUZZ_DEF_COVERAGE_INPUTS 1024
+
+// Default number of values a comparison dictionary keeps, and odds (out
+// of 256) of fuzz_random_dictionary_value using one.
+#define FUZZ_DEF_DICTIONARY_VALUES 256
+#define FUZZ_DEF_DICTIONARY_ODDS   64
+
+// At most this many forked workers can evaluate shrink candidates at once.
+#define FUZZ_MAX_WORKERS 16
+
 // This struct contains callbacks used to specify how to allocate, free, hash,
 // print, and/or shrink the property test input.
 //
@@ -112,8 +129,9 @@ struct fuzz_autoshrink_config {
 	enum fuzz_autoshrink_print_mode print_mode;
 
 	// How many unsuccessful shrinking attempts to try in a row before
-	// deciding a local minimum has been reached.
-	// Default: DEF_MAX_FAILED_SHRINKS.
+	// deciding a local minimum has been reached. This is also the
+	// number of rejected candidates each deterministic pass may try
+	// per round. Default: DEF_MAX_FAILED_SHRINKS.
 	size_t max_failed_shrinks;
 };
 
@@ -147,9 +165,22 @@ struct fuzz_type_info {
 
 	struct fuzz_autoshrink_config autoshrink_config;
 
-	// Optional environment, passed to the callbacks above. This is
+	// Optional environment, passed to the callbacks. This is
 	// completely opaque to fuzz.
 	void* env;
+
+	// Optional: like alloc, but may rebuild PREVIOUS, an instance of
+	// this type that fuzz no longer needs, in place rather than
+	// allocating a new one. This is worth providing when allocating
+	// an instance costs much more than filling it in.
+	//
+	// Write the instance into *output, the same as alloc. PREVIOUS is
+	// always the callback's: it can be written into *output (resized
+	// with realloc, even if that moves it), or freed, but fuzz doesn't
+	// use it again either way, even if the result isn't FUZZ_RESULT_OK.
+	// Instances kept for this are freed at the end of the run.
+	int (*realloc_into)(struct fuzz* t, void* env, void* previous,
+			void** output);
 };
 
 // Much of fuzz's runtime behavior can be customized using hooks. The
@@ -170,8 +201,9 @@ struct fuzz_type_info {
 //         FUZZ_HOOK_RUN_CONTINUE if the trial may continue.
 struct fuzz_pre_run_info {
 	const char* prop_name;
-	size_t      total_trials; // total number of trials
+	size_t      total_trials; // total number of trials, or SIZE_MAX
 	uint64_t    run_seed;
+	uint64_t    max_duration_ms; // time limit, or 0 for none
 };
 
 // The default pre-run hook. Calls `fuzz_print_pre_run_info` and returns
@@ -281,6 +313,9 @@ struct fuzz_counterexample_info {
 	uint8_t                 arity;
 	struct fuzz_type_info** type_info;
 	void**                  args;
+	// Did shrinking stop early, because it reached a limit from
+	// `fuzz_run_config.shrink`?
+	bool incomplete;
 };
 
 // Print a property counter-example that caused a failing trial. This is the
@@ -399,9 +434,28 @@ struct fuzz_run_config {
 	size_t    always_seed_count; // number of seeds
 	uint64_t* always_seeds;      // seeds to always run
 
-	// Number of trials to run. Defaults to FUZZ_DEF_TRIALS.
+	// Directory to keep this property's failures in, which is created
+	// if needed. Each failure is saved there once it has been shrunk,
+	// and every failure saved there is replayed before the random
+	// trials (and before any time limit starts), so known regressions
+	// are caught right away. If every argument autoshrinks, the shrunk
+	// bit pools are saved and replayed, so a failure is still found
+	// after changes to the seeds the generator gets. Otherwise only the
+	// trial's seed is saved, the same as an always_seeds entry.
+	const char* corpus_dir;
+
+	// Number of trials to run. Defaults to FUZZ_DEF_TRIALS, unless
+	// max_duration_ms is set.
 	size_t trials;
 
+	// Stop starting new trials once this many milliseconds have passed,
+	// on a monotonic clock. If `trials` is also set, the run stops at
+	// whichever comes first, otherwise trials run until the time is up.
+	// A trial that is still running when the time is up (including
+	// shrinking any failure) is finished first. The post-run report has
+	// the trials per second, to help choose a time limit.
+	uint64_t max_duration_ms;
+
 	// Seed for the random number generator.
 	uint64_t seed;
 
@@ -420,8 +474,80 @@ struct fuzz_run_config {
 		// wait for them to actually exit (in msec). Defaults to
 		// FUZZ_DEF_EXIT_TIMEOUT_MSEC.
 		size_t exit_timeout;
+		// While shrinking, build this many candidates at a time and
+		// run them at once, each in its own worker. Defaults to 1,
+		// and can be at most FUZZ_MAX_WORKERS.
+		size_t workers;
 	} fork;
 
+	// Coverage-guided generation, for programs built with clang's
+	// `-fsanitize-coverage=inline-8bit-counters`. After each passing
+	// trial, the property's edge counters are checked, and if it reached
+	// new coverage, its arguments' bit pools are kept in an in-memory
+	// corpus of up to max_inputs (default FUZZ_DEF_COVERAGE_INPUTS).
+	// Three in four later trials then start from a mutant of one of
+	// them, made by rerolling one of its requests, by the ways autoshrink
+	// changes bit pools, or by splicing two together, rather than from
+	// random bits. With fork enabled, the counters are passed back
+	// through shared memory.
+	//
+	// Every argument must autoshrink. If one doesn't, or the program
+	// has no counters, trials are random as usual. The trials that
+	// aren't mutants generate the same arguments from their seeds as
+	// without coverage. A failure found from a mutant can't be
+	// reproduced from its seed alone, so set corpus_dir to keep it.
+	struct {
+		bool   enable;
+		size_t max_inputs;
+	} coverage;
+
+	// A dictionary of values the property compares against, for
+	// programs built with clang's `-fsanitize-coverage=trace-cmp`. The
+	// constants the property compares against, and its switches' case
+	// values, are recorded while calling it, and after each trial that
+	// passes or is skipped, new ones are added to the dictionary, up to
+	// max_values (default FUZZ_DEF_DICTIONARY_VALUES).
+	// The builtin integer types, and generators that call
+	// fuzz_random_dictionary_value, then use a value from it with odds
+	// of `odds` out of 256 (default FUZZ_DEF_DICTIONARY_ODDS). With fork
+	// enabled, the values are passed back through shared memory.
+	//
+	// Every generated integer takes extra random bits to choose whether
+	// to use the dictionary, so enabling it changes what every seed
+	// generates. Those bits don't depend on what's in the dictionary,
+	// so a trial that didn't use a value from it can be reproduced from
+	// its seed with the dictionary enabled. One that did can't, since
+	// the value depends on what earlier trials added, so set corpus_dir
+	// to keep failures.
+	struct {
+		bool    enable;
+		size_t  max_values;
+		uint8_t odds;
+	} dictionary;
+
+	// Limits on how long to spend shrinking each failure. When one is
+	// reached, shrinking stops and the smallest failing arguments found
+	// so far are reported, marked as not fully shrunk. 0 means no limit.
+	// Calls made by autoshrink's deterministic passes count too.
+	//
+	// If every argument autoshrinks, shrinking can also start over from
+	// the original failure `restarts` more times, each time with a
+	// different random stream, and report the smallest result. With
+	// forking enabled, up to `fork.workers` restarts run at once in
+	// forked workers, alongside the first run; otherwise they run one
+	// after another.
+	//
+	// The weights autoshrink learns for choosing mutations are kept
+	// for the whole run. If `model_path` and the property name are
+	// both set, they are also loaded from and saved to that file, so
+	// later runs start from them.
+	struct {
+		size_t      max_time_ms; // elapsed time, in milliseconds
+		size_t      max_calls;   // property function calls
+		size_t      restarts;    // extra runs from original failure
+		const char* model_path;  // file to keep autoshrink weights in
+	} shrink;
+
 	// These functions are called in several contexts to report on
 	// progress, halt shrinking early, repeat trials with different
 	// logging, etc.
@@ -460,6 +586,191 @@ struct fuzz_run_config {
 FUZZ_PUBLIC
 int fuzz_run(const struct fuzz_run_config* cfg);
 
+// Opaque type for a runner, which keeps the memory fuzz_run allocates
+// for each property (the random number generator, bloom filter, arena,
+// and progress output state) and resets it for the next one, rather
+// than freeing it. This saves setup time when running many properties.
+struct fuzz_runner;
+
+// Allocate a runner, or return NULL.
+FUZZ_PUBLIC
+struct fuzz_runner* fuzz_runner_new(void);
+
+// Same as fuzz_run, but reuse RUNNER's memory from earlier runs. A
+// runner can only be used by one run at a time.
+FUZZ_PUBLIC
+int fuzz_runner_run(
+		struct fuzz_runner* runner, const struct fuzz_run_config* cfg);
+
+// Free the runner, and everything it kept between runs.
+FUZZ_PUBLIC
+void fuzz_runner_free(struct fuzz_runner* runner);
+
+// Run a suite of properties from main(), with ARGV selecting which ones
+// and how. PROPS is a table of PROP_COUNT property configs, which must
+// each have a name. For example:
+//
+//     static struct fuzz_run_config props[] = {
+//         {.name = "sum", .prop2 = prop_sum, .type_info = {&a, &b}},
+//         {.name = "sort", .prop1 = prop_sort, .type_info = {&list}},
+//     };
+//
+//     int main(int argc, char** argv) {
+//         return fuzz_suite_main(argc, argv, props,
+//                 sizeof(props) / sizeof(props[0]));
+//     }
+//
+// Options:
+//     -l          list the selected properties, instead of running them
+//     -p PATTERN  only run properties whose name matches PATTERN, where
+//                 '*' matches any characters and '?' matches one (can
+//                 be given more than once)
+//     -j JOBS     run up to JOBS properties at once (default: the number
+//                 of CPUs), each in its own process
+//     -t TIMINGS  load and save how long each property took in the file
+//                 TIMINGS, and run the longest ones first
+//
+// Properties run in separate processes only where fork is available,
+// and each one's output is printed once it finishes. A summary follows.
+// Returns 0 if all properties passed or were skipped, 1 if any failed
+// or had errors, and 2 for invalid options.
+FUZZ_PUBLIC
+int fuzz_suite_main(int argc, char** argv,
+		const struct fuzz_run_config* props, size_t prop_count);
+
+// Statistics a campaign keeps for each property.
+struct fuzz_campaign_stats {
+	uint64_t slices;     // time slices the property was given
+	uint64_t elapsed_ms; // total time spent running it
+	uint64_t trials;     // trials run, including duplicates
+	uint64_t unique;     // trials that weren't duplicates in their slice
+	uint64_t failures;   // slices that found a failure
+	double   score;      // recent yield, from 0 to 1
+};
+
+struct fuzz_campaign_config {
+	// Table of PROP_COUNT property configs, which must each have a
+	// name. Their trial counts and time limits are ignored.
+	const struct fuzz_run_config* props;
+	size_t                        prop_count;
+
+	// Total time to spend, and how long each slice is. The slice length
+	// defaults to FUZZ_DEF_CAMPAIGN_SLICE_MSEC.
+	uint64_t budget_ms;
+	uint64_t slice_ms;
+
+	// Seed for choosing each slice's seed.
+	uint64_t seed;
+
+	// If non-NULL, statistics are loaded from this file before the
+	// campaign and saved to it afterward, so the next campaign starts
+	// from what this one learned.
+	const char* stats_path;
+
+	// If non-NULL, an array of PROP_COUNT stats, which are set to
+	// each property's statistics afterward.
+	struct fuzz_campaign_stats* stats;
+};
+
+// Spend a time budget fuzzing a table of properties, giving more of it
+// to the properties that have been finding the most, rather than the
+// same amount to each.
+//
+// Time is handed out in slices. Each slice runs one property, with a
+// fresh seed, until the slice is up. Properties are chosen by a bandit
+// policy (UCB1) on their score: a slice that finds a failure scores 1,
+// and otherwise it scores up to 0.5 for how many new (non-duplicate)
+// trials it ran per second, relative to the best rate of any property.
+// Since slices are timed, slower trials mean fewer new inputs per slice.
+// The score decays, so recent slices count for more than old ones.
+//
+// A property that fails or has an error isn't run again in the same
+// campaign, since it would most likely find the same failure again.
+// Neither is one whose whole run is skipped, such as by its pre-run
+// hook.
+// Each slice prints its usual output, which can be changed with the
+// properties' hooks, and a summary is printed at the end.
+//
+// Returns FUZZ_RESULT_FAIL if any property failed, FUZZ_RESULT_ERROR
+// if any had an error (or the config was invalid), and FUZZ_RESULT_OK
+// otherwise.
+FUZZ_PUBLIC
+int fuzz_campaign_run(const struct fuzz_campaign_config* cfg);
+
+// Add the failures saved in CFG's corpus_dir to the packed corpus file
+// at PATH, which is created if needed, so a large corpus can be
+// replayed quickly with fuzz_corpus_replay_packed. Only failures with
+// bit pools (see corpus_dir) are packed, and only if their arguments
+// can still be generated from them. Failures already in the file are
+// left out, so if there are no new ones, the file isn't changed. The
+// corpus directory is left as it was.
+//
+// Returns FUZZ_RESULT_OK, or FUZZ_RESULT_ERROR if not every argument
+// autoshrinks, the file isn't a packed corpus for CFG's property, or
+// writing it fails.
+FUZZ_PUBLIC
+int fuzz_corpus_pack(const struct fuzz_run_config* cfg, const char* path);
+
+// Replay every failure in the packed corpus file at PATH against CFG's
+// property. The file is mapped into memory, and each record's bits are
+// fed straight to the alloc callbacks, so replaying a record only
+// allocates its instances, and nothing is printed unless it fails. A
+// record that fails is run again as a normal trial, which shrinks and
+// reports it.
+//
+// With fork enabled, the records are split between fork.workers forked
+// workers (or one, if unset), each running many records. If a worker
+// crashes or goes past fork.timeout, the records it didn't finish are
+// run again as normal trials, each in its own process. Hooks are only
+// called for records run as normal trials, and if one halts, the replay
+// stops there. On Windows, the file is read instead of mapped.
+//
+// If REPORT is non-NULL, the counts are saved to it. Returns
+// FUZZ_RESULT_FAIL if any record failed, FUZZ_RESULT_ERROR on errors
+// (including a file that isn't a packed corpus for CFG's property), and
+// FUZZ_RESULT_OK otherwise. A missing file is an empty corpus.
+FUZZ_PUBLIC
+int fuzz_corpus_replay_packed(const struct fuzz_run_config* cfg,
+		const char* path, struct fuzz_run_report* report);
+
+// Run CFG's property once on DATA, from a byte-oriented fuzzing engine
+// such as libFuzzer or AFL++:
+//
+//     int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+//     {
+//         return fuzz_libfuzzer_adapter(&cfg, data, size);
+//     }
+//
+// Every argument must autoshrink. DATA is split evenly between the
+// arguments, and each is generated from its part as if it were a saved
+// bit pool, with the first bit in the low bit of the first byte and
+// zeroes past the end. The property is called in this process, without
+// hooks, shrinking, or checking for duplicates.
+//
+// Returns 0, or -1 if the property skipped the input, so libFuzzer
+// doesn't add it to its corpus. If the property fails, the input is run
+// again as a full trial, which shrinks and reports it (and saves it, if
+// corpus_dir is set), and then the process aborts so the engine keeps
+// the input. If generating the arguments or calling the property has an
+// error instead, such as a failed allocation, it's printed and the
+// process aborts without running it again or saving it. State is kept
+// between calls with the same CFG, so it should be static.
+FUZZ_PUBLIC
+int fuzz_libfuzzer_adapter(const struct fuzz_run_config* cfg,
+		const uint8_t* data, size_t size);
+
+// Free the state fuzz_libfuzzer_adapter keeps between calls.
+FUZZ_PUBLIC
+void fuzz_libfuzzer_adapter_reset(void);
+
+// Write each failure saved in CFG's corpus_dir to DIR, as an input for
+// fuzz_libfuzzer_adapter that generates the same arguments, so an
+// engine's corpus can start from them. Each file is named by the hash
+// of its contents. Returns FUZZ_RESULT_OK, or FUZZ_RESULT_ERROR (or
+// FUZZ_RESULT_ERROR_MEMORY) if they couldn't all be written.
+FUZZ_PUBLIC
+int fuzz_libfuzzer_export(const struct fuzz_run_config* cfg, const char* dir);
+
 // Generate the instance based on a given seed, print it to F, and then free
 // it. If print or free callbacks are NULL, they will be skipped.
 FUZZ_PUBLIC
@@ -480,6 +791,53 @@ uint64_t fuzz_random_bits(struct fuzz* t, uint8_t bits);
 FUZZ_PUBLIC
 void fuzz_random_bits_bulk(struct fuzz* t, uint32_t bits, uint64_t* buf);
 
+// Hints about what a group of random bits will be used for. When
+// autoshrinking, these are saved along with each request's size, so
+// the shrinker can use strategies that fit the kind of value.
+enum fuzz_request_kind {
+	FUZZ_REQ_UNKNOWN = 0, // no hint (the default)
+	// An integer value: shrinks towards 0.
+	FUZZ_REQ_INT,
+	// A length or count of the elements generated right after it,
+	// each marked as a span. When the length is reduced, the trailing
+	// elements' spans are dropped along with it.
+	FUZZ_REQ_LENGTH,
+	// Bits that select between alternatives, where smaller values are
+	// not necessarily simpler. These are left alone, other than being
+	// dropped.
+	FUZZ_REQ_CHOICE,
+};
+
+// Same as `fuzz_random_bits`, but with a hint for autoshrinking about
+// what kind of value the bits are for.
+FUZZ_PUBLIC
+uint64_t fuzz_random_bits_tagged(
+		struct fuzz* t, uint8_t bits, enum fuzz_request_kind kind);
+
+// If the run has a dictionary of values the property compared against
+// (see the `dictionary` field of struct fuzz_run_config), then with its
+// configured odds, put one of them in *VALUE and return true. Otherwise
+// return false. No random bits are used if the dictionary is disabled,
+// and the same ones are used whether or not it has values yet. Values
+// are zero-extended from the size they were compared at, so cast them
+// to the type being generated.
+FUZZ_PUBLIC
+bool fuzz_random_dictionary_value(struct fuzz* t, uint64_t* value);
+
+// Mark the start and end of a span of random bit requests that make up
+// one structural unit of the instance being generated, such as one
+// element of a list or one field of a struct. Spans can nest, and must
+// be ended in the reverse order they were begun; any spans still open
+// when the alloc callback returns are ended then.
+//
+// When autoshrinking, spans are dropped and reordered as a whole, so
+// shrinking doesn't waste time on candidates where only part of an
+// element was removed. When not autoshrinking, these do nothing.
+FUZZ_PUBLIC
+void fuzz_autoshrink_span_begin(struct fuzz* t);
+FUZZ_PUBLIC
+void fuzz_autoshrink_span_end(struct fuzz* t);
+
 #if FUZZ_USE_FLOATING_POINT
 // Get a random double from the test runner's PRNG.
 FUZZ_PUBLIC
@@ -499,6 +857,17 @@ uint64_t fuzz_random_range(
 		struct fuzz* f, const uint64_t min, const uint64_t max);
 #endif
 
+// Allocate SIZE bytes, aligned to ALIGN (a power of 2, or 0 for a
+// default suitable for any scalar type), from an arena owned by the
+// test runner. Returns NULL if memory can't be allocated.
+//
+// Memory from the arena is released all at once: after each trial, and
+// after each shrink candidate that isn't kept. Types that only allocate
+// from the arena don't need a `free` callback, and should not use
+// `realloc_into`, since their instances don't outlive the trial.
+FUZZ_PUBLIC
+void* fuzz_arena_alloc(struct fuzz* t, size_t size, size_t align);
+
 // Hash a buffer in one pass. (Wraps the below functions.)
 FUZZ_PUBLIC uint64_t fuzz_hash_onepass(const uint8_t* data, size_t bytes);
 
@@ -630,7 +999,8 @@ enum fuzz_builtin_type_info {
 
 	// Built-in array types.
 	// If env is non-NULL, it will be cast to a `size_t *` and deferenced
-	// for a max length.
+	// for a max length. Otherwise, lengths are usually under 255, but
+	// longer ones are possible.
 	// These are always terminated by a 0 byte, and do not generate 0 bytes
 	// as part of the array.
 	FUZZ_BUILTIN_char_ARRAY,
@@ -645,4 +1015,27 @@ FUZZ_PUBLIC
 const struct fuzz_type_info* fuzz_get_builtin_type_info(
 		enum fuzz_builtin_type_info type);
 
+// Get built-in type_info callbacks for the scalar TYPE that store each
+// value directly in the argument's `void*`, rather than allocating it,
+// so generating and shrinking them never calls malloc or free. Read the
+// value with FUZZ_INLINE_VALUE:
+//
+//     uint32_t x = FUZZ_INLINE_VALUE(uint32_t, arg1);
+//
+// Returns NULL for the array types, and for types larger than a pointer
+// on this platform (such as uint64_t on 32-bit platforms). The env
+// field works the same way as above.
+FUZZ_PUBLIC
+const struct fuzz_type_info* fuzz_get_builtin_inline_type_info(
+		enum fuzz_builtin_type_info type);
+
+// Read a value of TYPE stored in the `void*` ARG, or make a `void*`
+// that stores VALUE. TYPE must be no larger than a pointer. Custom
+// `alloc` callbacks can use FUZZ_INLINE_ARG for small types, and then
+// don't need a `free` callback.
+#define FUZZ_INLINE_VALUE(TYPE, ARG)                                          \
+	(((union { void* p; TYPE v; }){.p = (void*)(ARG)}).v)
+#define FUZZ_INLINE_ARG(TYPE, VALUE)                                          \
+	(((union { void* p; TYPE v; }){.v = (VALUE)}).p)
+
 #endif
@@ -0,0 +1,291 @@
+// SPDX-License-Identifier: ISC
+// SPDX-FileCopyrightText: 2014-19 Scott Vokes <vokes.s@gmail.com>
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "autoshrink.h"
+#include "call.h"
+#include "corpus.h"
+#include "fuzz.h"
+#include "run.h"
+#include "trial.h"
+#include "types_internal.h"
+
+// Running properties under a byte-oriented fuzzing engine, such as
+// libFuzzer or AFL++. The engine's input is split evenly between the
+// property's arguments, and each argument is generated from its part as
+// if it were a saved bit pool, so the engine's mutations change the
+// random bits the generators see directly. Saved failures are exported
+// the same way, each argument's bits padded to the same number of
+// bytes, so they split back into the same bit pools.
+
+#define LOG_LIBFUZZER 0
+
+// State kept between calls to fuzz_libfuzzer_adapter, so each call only
+// allocates its instances.
+struct libfuzzer_adapter {
+	const struct fuzz_run_config* cfg;
+	struct fuzz*                  t;
+	struct autoshrink_bit_pool*   pools[FUZZ_MAX_ARITY];
+	uint64_t*                     words; // one argument's bits
+	size_t                        word_ceil;
+	size_t                        calls;
+};
+
+static struct libfuzzer_adapter adapter;
+
+static bool adapter_setup(const struct fuzz_run_config* cfg);
+static void get_slice(size_t size, uint8_t arity, uint8_t arg_i,
+		size_t* offset, size_t* length);
+static void bytes_to_words(
+		const uint8_t* bytes, size_t length, uint64_t* words);
+static bool export_record(struct fuzz* t, const char* dir,
+		const struct corpus_record* rec, uint8_t** buf);
+
+int
+fuzz_libfuzzer_adapter(const struct fuzz_run_config* cfg,
+		const uint8_t* data, size_t size)
+{
+	if (!adapter_setup(cfg)) {
+		fprintf(stderr,
+				"%s: can't set up the property (every "
+				"argument must autoshrink)\n",
+				__func__);
+		abort();
+	}
+	struct fuzz*  t     = adapter.t;
+	const uint8_t arity = t->prop.arity;
+
+	const size_t words = (size / arity + 1) / 8 + 1;
+	if (words > adapter.word_ceil) {
+		uint64_t* nwords = realloc(
+				adapter.words, words * sizeof(uint64_t));
+		if (nwords == NULL) {
+			fprintf(stderr, "%s: out of memory\n", __func__);
+			abort();
+		}
+		adapter.words     = nwords;
+		adapter.word_ceil = words;
+	}
+
+	void* args[FUZZ_MAX_ARITY] = {NULL};
+	int   res                  = FUZZ_RESULT_OK;
+	for (uint8_t a = 0; a < arity; a++) {
+		size_t offset = 0;
+		size_t length = 0;
+		get_slice(size, arity, a, &offset, &length);
+		bytes_to_words(&data[offset], length, adapter.words);
+		res = fuzz_autoshrink_replay_alloc(t, a, adapter.pools[a],
+				adapter.words, 8 * length, &args[a]);
+		if (res != FUZZ_RESULT_OK) {
+			break;
+		}
+	}
+	if (res == FUZZ_RESULT_OK) {
+		res = fuzz_call_in_process(t, args);
+	}
+	for (uint8_t a = 0; a < arity; a++) {
+		fuzz_trial_release_instance(t, a, args[a]);
+	}
+	fuzz_arena_reset(t->arena, (struct fuzz_arena_mark){.chunk = 0});
+	adapter.calls++;
+
+	if (res == FUZZ_RESULT_OK) {
+		return 0;
+	} else if (res == FUZZ_RESULT_SKIP) {
+		return -1; // don't add it to the engine's corpus
+	} else if (res != FUZZ_RESULT_FAIL) {
+		// An error, such as a failed allocation, isn't a failure to
+		// shrink or save, but still stop so it's noticed.
+		fprintf(stderr, "%s: error %d generating arguments or calling "
+				"the property\n",
+				__func__, res);
+		fflush(NULL);
+		abort();
+	}
+
+	// Run it again as a full trial, which shrinks, reports, and saves
+	// it, and then crash so the engine keeps the input.
+	struct corpus_record rec = {.seed = adapter.calls, .has_pools = true};
+	for (uint8_t a = 0; a < arity; a++) {
+		size_t offset = 0;
+		size_t length = 0;
+		get_slice(size, arity, a, &offset, &length);
+		rec.bit_counts[a] = 8 * length;
+		rec.bits[a]       = &data[offset];
+	}
+	if (fuzz_run_replay(t, adapter.calls, &rec) == FUZZ_RUN_REPLAY_ERROR) {
+		fprintf(stderr, "%s: error replaying the input\n", __func__);
+	}
+	fflush(NULL);
+	abort();
+}
+
+void
+fuzz_libfuzzer_adapter_reset(void)
+{
+	for (uint8_t a = 0; a < FUZZ_MAX_ARITY; a++) {
+		fuzz_autoshrink_replay_pool_free(adapter.pools[a]);
+	}
+	free(adapter.words);
+	if (adapter.t != NULL) {
+		fuzz_run_free(adapter.t);
+	}
+	adapter = (struct libfuzzer_adapter){.cfg = NULL};
+}
+
+int
+fuzz_libfuzzer_export(const struct fuzz_run_config* cfg, const char* dir)
+{
+	if (cfg == NULL || dir == NULL || cfg->corpus_dir == NULL) {
+		return FUZZ_RESULT_ERROR;
+	}
+
+	struct fuzz*           t        = NULL;
+	enum fuzz_run_init_res init_res = fuzz_run_init(cfg, &t);
+	switch (init_res) {
+	case FUZZ_RUN_INIT_ERROR_MEMORY:
+		return FUZZ_RESULT_ERROR_MEMORY;
+	default:
+		assert(false);
+	case FUZZ_RUN_INIT_ERROR_BAD_ARGS:
+		return FUZZ_RESULT_ERROR;
+	case FUZZ_RUN_INIT_OK:
+		break; // continue below
+	}
+
+	int                res  = FUZZ_RESULT_ERROR;
+	struct corpus_iter iter = {.names = NULL};
+	uint8_t*           buf  = NULL;
+	if (!fuzz_corpus_every_arg_autoshrinks(t)) {
+		goto cleanup;
+	}
+	if (!fuzz_corpus_make_dir(dir)) {
+		goto cleanup;
+	}
+	if (!fuzz_corpus_open(t, &iter)) {
+		res = FUZZ_RESULT_ERROR_MEMORY;
+		goto cleanup;
+	}
+
+	struct corpus_record rec;
+	size_t               exported = 0;
+	while (fuzz_corpus_next(t, &iter, &rec)) {
+		if (!rec.has_pools) {
+			continue; // only bit pools map onto bytes
+		}
+		if (!export_record(t, dir, &rec, &buf)) {
+			goto cleanup;
+		}
+		exported++;
+	}
+	LOG(2 - LOG_LIBFUZZER, "%s: exported %zd records to %s\n", __func__,
+			exported, dir);
+	res = FUZZ_RESULT_OK;
+
+cleanup:
+	free(buf);
+	fuzz_corpus_close(&iter);
+	fuzz_run_free(t);
+	return res;
+}
+
+static bool
+adapter_setup(const struct fuzz_run_config* cfg)
+{
+	if (adapter.t != NULL && adapter.cfg == cfg) {
+		return true;
+	}
+	fuzz_libfuzzer_adapter_reset();
+	if (cfg == NULL ||
+			fuzz_run_init(cfg, &adapter.t) != FUZZ_RUN_INIT_OK) {
+		adapter.t = NULL;
+		return false;
+	}
+	adapter.cfg = cfg;
+	if (!fuzz_corpus_every_arg_autoshrinks(adapter.t)) {
+		fuzz_libfuzzer_adapter_reset();
+		return false;
+	}
+	for (uint8_t a = 0; a < adapter.t->prop.arity; a++) {
+		adapter.pools[a] = fuzz_autoshrink_replay_pool_new(0);
+		if (adapter.pools[a] == NULL) {
+			fuzz_libfuzzer_adapter_reset();
+			return false;
+		}
+	}
+	return true;
+}
+
+// Get the part of SIZE bytes of input that ARG_I is generated from. The
+// first (SIZE % ARITY) arguments get one extra byte.
+static void
+get_slice(size_t size, uint8_t arity, uint8_t arg_i, size_t* offset,
+		size_t* length)
+{
+	const size_t base  = size / arity;
+	const size_t extra = size % arity;
+	*offset            = arg_i * base + (arg_i < extra ? arg_i : extra);
+	*length            = base + (arg_i < extra ? 1 : 0);
+}
+
+// Copy LENGTH bytes into WORDS, which has room for LENGTH / 8 + 1, with
+// the first bit in the low bit of the first byte and the rest cleared.
+static void
+bytes_to_words(const uint8_t* bytes, size_t length, uint64_t* words)
+{
+	memset(words, 0x00, (length / 8 + 1) * sizeof(uint64_t));
+	for (size_t b = 0; b < length; b++) {
+		words[b / 8] |= (uint64_t)bytes[b] << (8 * (b % 8));
+	}
+}
+
+// Write REC's bit pools to DIR, each padded to as many bytes as the
+// longest, in a file named by the hash of its contents. *BUF is grown
+// as needed.
+static bool
+export_record(struct fuzz* t, const char* dir,
+		const struct corpus_record* rec, uint8_t** buf)
+{
+	const uint8_t arity = t->prop.arity;
+	size_t        chunk = 0;
+	for (uint8_t a = 0; a < arity; a++) {
+		const size_t bytes = (rec->bit_counts[a] + 7) / 8;
+		if (bytes > chunk) {
+			chunk = bytes;
+		}
+	}
+	const size_t size = chunk * arity;
+	uint8_t*     nbuf = realloc(*buf, size + 1);
+	if (nbuf == NULL) {
+		return false;
+	}
+	*buf = nbuf;
+	memset(nbuf, 0x00, size);
+	for (uint8_t a = 0; a < arity; a++) {
+		memcpy(&nbuf[a * chunk], rec->bits[a],
+				(rec->bit_counts[a] + 7) / 8);
+	}
+
+	const uint64_t hash = fuzz_hash_onepass(nbuf, size);
+	const size_t   len  = strlen(dir) + 18;
+	char*          path = malloc(len);
+	if (path == NULL) {
+		return false;
+	}
+	snprintf(path, len, "%s/%016" PRIx64, dir, hash);
+	FILE* f  = fopen(path, "wb");
+	bool  ok = (f != NULL);
+	if (f != NULL) {
+		ok = fwrite(nbuf, 1, size, f) == size;
+		if (fclose(f) != 0) {
+			ok = false;
+		}
+	}
+	LOG(2 - LOG_LIBFUZZER, "%s: wrote %s: %d\n", __func__, path, ok);
+	free(path);
+	return ok;
+}
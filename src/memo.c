@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: ISC
+// SPDX-FileCopyrightText: 2014-19 Scott Vokes <vokes.s@gmail.com>
+#include <assert.h>
+#include <stdlib.h>
+
+#include "fuzz.h"
+#include "memo.h"
+#include "types_internal.h"
+
+// This is an open addressing hash table with linear probing, which
+// records the property result for every candidate tried while
+// shrinking. Unlike the bloom filter, it has no false positives (short
+// of a 64-bit hash collision on candidates with the same size), and it
+// doesn't depend on the user's hash callbacks.
+
+// Default number of entries, as a power of 2.
+#define DEF_MEMO_CEIL2 6
+
+#define LOG_MEMO 0
+
+struct memo_entry {
+	struct fuzz_memo_key key;
+	int8_t               result;
+	bool                 used;
+};
+
+struct fuzz_memo {
+	uint8_t            ceil2;
+	size_t             count;
+	struct memo_entry* entries;
+};
+
+static bool grow_memo(struct fuzz_memo* m);
+
+static size_t find_slot(const struct memo_entry* entries, uint8_t ceil2,
+		const struct fuzz_memo_key* key);
+
+struct fuzz_memo*
+fuzz_memo_new(void)
+{
+	struct fuzz_memo* res = malloc(sizeof(*res));
+	if (res == NULL) {
+		return NULL;
+	}
+
+	struct memo_entry* entries =
+			calloc(1LLU << DEF_MEMO_CEIL2, sizeof(*entries));
+	if (entries == NULL) {
+		free(res);
+		return NULL;
+	}
+
+	*res = (struct fuzz_memo){
+			.ceil2   = DEF_MEMO_CEIL2,
+			.entries = entries,
+	};
+	return res;
+}
+
+bool
+fuzz_memo_get(const struct fuzz_memo* m, const struct fuzz_memo_key* key,
+		int* result)
+{
+	const size_t slot = find_slot(m->entries, m->ceil2, key);
+	if (!m->entries[slot].used) {
+		return false;
+	}
+	LOG(3 - LOG_MEMO, "%s: hit for 0x%016" PRIx64 " (%zd bits)\n",
+			__func__, key->hash, key->size);
+	if (result != NULL) {
+		*result = m->entries[slot].result;
+	}
+	return true;
+}
+
+bool
+fuzz_memo_put(struct fuzz_memo* m, const struct fuzz_memo_key* key,
+		int result)
+{
+	// Keep the load factor under 3/4.
+	if (4 * (m->count + 1) > 3 * (1LLU << m->ceil2)) {
+		if (!grow_memo(m)) {
+			return false;
+		}
+	}
+
+	const size_t       slot = find_slot(m->entries, m->ceil2, key);
+	struct memo_entry* e    = &m->entries[slot];
+	if (!e->used) {
+		m->count++;
+	}
+	*e = (struct memo_entry){
+			.key    = *key,
+			.result = (int8_t)result,
+			.used   = true,
+	};
+	return true;
+}
+
+void
+fuzz_memo_free(struct fuzz_memo* m)
+{
+	if (m == NULL) {
+		return;
+	}
+	free(m->entries);
+	free(m);
+}
+
+static bool
+key_eq(const struct fuzz_memo_key* a, const struct fuzz_memo_key* b)
+{
+	return a->hash == b->hash && a->size == b->size &&
+	       a->context == b->context && a->arg_i == b->arg_i;
+}
+
+// Find the slot for KEY, or the empty slot where it would go.
+static size_t
+find_slot(const struct memo_entry* entries, uint8_t ceil2,
+		const struct fuzz_memo_key* key)
+{
+	const size_t mask = (1LLU << ceil2) - 1;
+	// Mix the context and argument into the hash, so the same
+	// content for different arguments/contexts doesn't collide.
+	uint64_t h = key->hash ^ ((uint64_t)key->context << 8) ^ key->arg_i;
+	h *= UINT64_C(0x9e3779b97f4a7c15);
+	size_t slot = (size_t)(h >> 32) & mask;
+
+	while (entries[slot].used && !key_eq(&entries[slot].key, key)) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+static bool
+grow_memo(struct fuzz_memo* m)
+{
+	const uint8_t      nceil2 = m->ceil2 + 1;
+	struct memo_entry* nentries =
+			calloc(1LLU << nceil2, sizeof(*nentries));
+	if (nentries == NULL) {
+		return false;
+	}
+
+	for (size_t i = 0; i < (1LLU << m->ceil2); i++) {
+		const struct memo_entry* e = &m->entries[i];
+		if (e->used) {
+			nentries[find_slot(nentries, nceil2, &e->key)] = *e;
+		}
+	}
+	LOG(3 - LOG_MEMO, "%s: %u -> %u\n", __func__, m->ceil2, nceil2);
+
+	free(m->entries);
+	m->entries = nentries;
+	m->ceil2   = nceil2;
+	return true;
+}
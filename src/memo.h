@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: ISC
+// SPDX-FileCopyrightText: 2014-19 Scott Vokes <vokes.s@gmail.com>
+#ifndef FUZZ_MEMO_H
+#define FUZZ_MEMO_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Opaque type for the shrinking memo table.
+struct fuzz_memo;
+
+// Identifies one shrinking candidate: the hash and size of an argument's
+// content (such as an autoshrink bit pool's consumed bits), which
+// argument it is, and a context that changes whenever the other
+// arguments do.
+struct fuzz_memo_key {
+	uint64_t hash;
+	size_t   size;
+	uint32_t context;
+	uint8_t  arg_i;
+};
+
+// Allocate an empty memo table.
+struct fuzz_memo* fuzz_memo_new(void);
+
+// If the key has been seen before, write its recorded property result
+// into *result (unless it's NULL) and return true.
+bool fuzz_memo_get(const struct fuzz_memo* m, const struct fuzz_memo_key* key,
+		int* result);
+
+// Record the property result for a key. Returns false on alloc failure.
+bool fuzz_memo_put(struct fuzz_memo* m, const struct fuzz_memo_key* key,
+		int result);
+
+// Free the memo table.
+void fuzz_memo_free(struct fuzz_memo* m);
+
+#endif
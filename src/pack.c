@@ -0,0 +1,943 @@
+// SPDX-License-Identifier: ISC
+// SPDX-FileCopyrightText: 2014-19 Scott Vokes <vokes.s@gmail.com>
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#endif
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "autoshrink.h"
+#include "call.h"
+#include "corpus.h"
+#include "fuzz.h"
+#include "polyfill.h"
+#include "run.h"
+#include "trial.h"
+#include "types_internal.h"
+
+// A packed corpus holds many saved failures in one file, so a large
+// corpus can be replayed without opening a file or setting up a run per
+// failure. It is little-endian:
+//
+//     "FZCP"        magic
+//     u8            format version
+//     u8            arity
+//     u16           (reserved, 0)
+//     u64           record count
+//     u64           offset of the index
+//     u64           most bits any argument has
+//     u64           most requests any argument has
+//     u64           (reserved, 0)
+//
+// followed by the records, and then the index, which has a u64 offset
+// and a u64 hash for each record. Each record has, for every argument:
+//
+//     u64           bit count
+//     u64           request count
+//     u64[]         (bit count + 63) / 64 words of bits
+//     u32[]         each request's size in bits, padded with zeroes to
+//                   a multiple of 8 bytes
+//
+// Everything is 8-byte aligned, so the bits can be used in place. New
+// records are appended after the index, followed by a new index, and
+// only then is the header updated, so the file stays usable if packing
+// is interrupted.
+
+#define PACK_MAGIC       "FZCP"
+#define PACK_VERSION     1
+#define PACK_HEADER_SIZE 48
+#define PACK_INDEX_ENTRY 16
+
+// Messages from forked replay workers: each is a record's index, shifted
+// left by MSG_SHIFT, with the record's result in the low bits. Records
+// that fail or have an error are run again by the parent, which shrinks
+// and reports them.
+#define MSG_SHIFT 2
+#define MSG_PASS  0
+#define MSG_SKIP  1
+#define MSG_AGAIN 2
+
+// How many results a worker sends at once.
+#define MSG_BATCH 64
+
+#define LOG_PACK 0
+
+struct pack_header {
+	uint8_t  arity;
+	uint64_t record_count;
+	uint64_t index_offset;
+	uint64_t max_bits;
+	uint64_t max_requests;
+};
+
+// A packed corpus file, mapped into memory (or on Windows, read in).
+struct pack_file {
+	const uint8_t*     data;
+	size_t             size;
+	bool               mapped;
+	struct pack_header header;
+};
+
+// One record's arguments, pointing into the file.
+struct pack_record {
+	size_t         bit_counts[FUZZ_MAX_ARITY];
+	const uint8_t* bits[FUZZ_MAX_ARITY];
+	size_t         request_counts[FUZZ_MAX_ARITY];
+	const uint8_t* request_sizes[FUZZ_MAX_ARITY];
+};
+
+// State for replaying records, kept from one record to the next so
+// replaying one only allocates its instances.
+struct pack_replay {
+	struct fuzz*                t;
+	const struct pack_file*     file;
+	struct autoshrink_bit_pool* pools[FUZZ_MAX_ARITY];
+	uint64_t*                   words; // byte-swapped bits, if needed
+};
+
+struct pack_worker {
+	pid_t    pid;
+	int      fd;
+	bool     live;
+	size_t   next;    // index of the next result expected
+	uint64_t last_ms; // when it last sent results
+	size_t   partial; // bytes of an incomplete message in buf
+	uint8_t  buf[MSG_BATCH * sizeof(uint64_t)];
+};
+
+static bool open_pack(const char* path, struct pack_file* file);
+static void close_pack(struct pack_file* file);
+static bool get_record(const struct pack_file* file, size_t i,
+		struct pack_record* rec);
+static int  replay_record(struct pack_replay* r, size_t i);
+static enum fuzz_run_replay_res replay_fully(
+		struct pack_replay* r, size_t i);
+static bool replay_in_process(struct pack_replay* r);
+static bool replay_forked(struct pack_replay* r);
+static bool start_worker(struct pack_replay* r, struct pack_worker* w,
+		size_t first, size_t stride);
+static bool read_results(struct pack_replay* r, struct pack_worker* w,
+		size_t stride, bool* again);
+static bool write_all(int fd, const void* buf, size_t size);
+static bool pack_corpus_record(struct fuzz* t,
+		struct autoshrink_bit_pool*  pool,
+		const struct corpus_record* rec, uint8_t** buf, size_t* size,
+		struct pack_header* header);
+static int  cmp_hashes(const void* a, const void* b);
+static bool host_is_little_endian(void);
+static void write_le64(uint8_t* dst, uint64_t x);
+static uint64_t read_le64(const uint8_t* src);
+
+int
+fuzz_corpus_pack(const struct fuzz_run_config* cfg, const char* path)
+{
+	if (cfg == NULL || path == NULL || cfg->corpus_dir == NULL) {
+		return FUZZ_RESULT_ERROR;
+	}
+
+	struct fuzz*           t        = NULL;
+	enum fuzz_run_init_res init_res = fuzz_run_init(cfg, &t);
+	switch (init_res) {
+	case FUZZ_RUN_INIT_ERROR_MEMORY:
+		return FUZZ_RESULT_ERROR_MEMORY;
+	default:
+		assert(false);
+	case FUZZ_RUN_INIT_ERROR_BAD_ARGS:
+		return FUZZ_RESULT_ERROR;
+	case FUZZ_RUN_INIT_OK:
+		break; // continue below
+	}
+
+	int                         res    = FUZZ_RESULT_ERROR;
+	struct pack_file            file   = {.data = NULL};
+	struct corpus_iter          iter   = {.names = NULL};
+	struct autoshrink_bit_pool* pool   = NULL;
+	uint8_t*                    index  = NULL;
+	uint64_t*                   hashes = NULL;
+	uint8_t*                    buf    = NULL;
+	FILE*                       f      = NULL;
+	if (!fuzz_corpus_every_arg_autoshrinks(t) ||
+			!open_pack(path, &file) ||
+			(file.header.record_count > 0 &&
+					file.header.arity != t->prop.arity)) {
+		goto cleanup;
+	}
+
+	// Keep the old index, to copy into the new one, and its hashes,
+	// so records that are already packed are left out.
+	struct pack_header header     = file.header;
+	size_t             count      = (size_t)header.record_count;
+	size_t             index_ceil = (count == 0 ? 16 : 2 * count);
+	const size_t       old_count  = count;
+	index  = malloc(index_ceil * PACK_INDEX_ENTRY);
+	hashes = malloc((old_count + 1) * sizeof(uint64_t));
+	pool   = fuzz_autoshrink_replay_pool_new((size_t)header.max_requests);
+	if (index == NULL || hashes == NULL || pool == NULL) {
+		res = FUZZ_RESULT_ERROR_MEMORY;
+		goto cleanup;
+	}
+	if (count > 0) {
+		memcpy(index, &file.data[header.index_offset],
+				count * PACK_INDEX_ENTRY);
+	}
+	for (size_t i = 0; i < old_count; i++) {
+		hashes[i] = read_le64(&index[i * PACK_INDEX_ENTRY + 8]);
+	}
+	qsort(hashes, old_count, sizeof(uint64_t), cmp_hashes);
+	const bool is_new = (file.size == 0);
+	close_pack(&file);
+
+	f = fopen(path, is_new ? "w+b" : "r+b");
+	if (f == NULL) {
+		goto cleanup;
+	}
+	uint8_t head[PACK_HEADER_SIZE] = {0};
+	if (is_new && fwrite(head, 1, sizeof(head), f) != sizeof(head)) {
+		goto cleanup;
+	}
+	if (fseek(f, 0, SEEK_END) != 0) {
+		goto cleanup;
+	}
+	long end = ftell(f);
+	if (end < PACK_HEADER_SIZE || (end & 0x07) != 0) {
+		goto cleanup;
+	}
+
+	if (!fuzz_corpus_open(t, &iter)) {
+		res = FUZZ_RESULT_ERROR_MEMORY;
+		goto cleanup;
+	}
+	struct corpus_record rec;
+	size_t               added = 0;
+	while (fuzz_corpus_next(t, &iter, &rec)) {
+		size_t size = 0;
+		if (!rec.has_pools) {
+			continue; // only bit pools can be packed
+		}
+		if (!pack_corpus_record(t, pool, &rec, &buf, &size,
+				    &header)) {
+			continue; // stale, it doesn't generate anymore
+		}
+		uint64_t h = 0;
+		fuzz_hash_init(&h);
+		fuzz_hash_sink(&h, buf, size);
+		const uint64_t hash = fuzz_hash_finish(&h);
+		if (bsearch(&hash, hashes, old_count, sizeof(uint64_t),
+				    cmp_hashes) != NULL) {
+			continue; // already packed
+		}
+
+		if (count == index_ceil) {
+			const size_t nceil  = 2 * index_ceil;
+			uint8_t*     nindex = realloc(
+					index, nceil * PACK_INDEX_ENTRY);
+			if (nindex == NULL) {
+				res = FUZZ_RESULT_ERROR_MEMORY;
+				goto cleanup;
+			}
+			index      = nindex;
+			index_ceil = nceil;
+		}
+		write_le64(&index[count * PACK_INDEX_ENTRY], (uint64_t)end);
+		write_le64(&index[count * PACK_INDEX_ENTRY + 8], hash);
+		if (fwrite(buf, 1, size, f) != size) {
+			goto cleanup;
+		}
+		end += (long)size;
+		count++;
+		added++;
+	}
+
+	if (added == 0 && !is_new) {
+		LOG(2 - LOG_PACK, "%s: nothing new to pack into %s\n",
+				__func__, path);
+		res = FUZZ_RESULT_OK; // leave the file as it was
+		goto cleanup;
+	}
+
+	// Write the new index after the records, then point the header at
+	// it.
+	if (fwrite(index, PACK_INDEX_ENTRY, count, f) != count) {
+		goto cleanup;
+	}
+	memcpy(head, PACK_MAGIC, 4);
+	head[4] = PACK_VERSION;
+	head[5] = t->prop.arity;
+	write_le64(&head[8], count);
+	write_le64(&head[16], (uint64_t)end);
+	write_le64(&head[24], header.max_bits);
+	write_le64(&head[32], header.max_requests);
+	if (fflush(f) != 0 || fseek(f, 0, SEEK_SET) != 0 ||
+			fwrite(head, 1, sizeof(head), f) != sizeof(head)) {
+		goto cleanup;
+	}
+	LOG(2 - LOG_PACK, "%s: packed %zd new records into %s, %zd total\n",
+			__func__, added, path, count);
+	res = FUZZ_RESULT_OK;
+
+cleanup:
+	if (f != NULL && fclose(f) != 0) {
+		res = FUZZ_RESULT_ERROR;
+	}
+	free(buf);
+	free(hashes);
+	free(index);
+	fuzz_autoshrink_replay_pool_free(pool);
+	fuzz_corpus_close(&iter);
+	close_pack(&file);
+	fuzz_run_free(t);
+	return res;
+}
+
+int
+fuzz_corpus_replay_packed(const struct fuzz_run_config* cfg, const char* path,
+		struct fuzz_run_report* report)
+{
+	if (cfg == NULL || path == NULL) {
+		return FUZZ_RESULT_ERROR;
+	}
+
+	if (cfg->fork.enable && !FUZZ_POLYFILL_HAVE_FORK) {
+		return FUZZ_RESULT_SKIP;
+	}
+
+	struct fuzz*           t        = NULL;
+	enum fuzz_run_init_res init_res = fuzz_run_init(cfg, &t);
+	switch (init_res) {
+	case FUZZ_RUN_INIT_ERROR_MEMORY:
+		return FUZZ_RESULT_ERROR_MEMORY;
+	default:
+		assert(false);
+	case FUZZ_RUN_INIT_ERROR_BAD_ARGS:
+		return FUZZ_RESULT_ERROR;
+	case FUZZ_RUN_INIT_OK:
+		break; // continue below
+	}
+
+	int                res  = FUZZ_RESULT_ERROR;
+	struct pack_file   file = {.data = NULL};
+	struct pack_replay r    = {.t = t, .file = &file};
+	if (!fuzz_corpus_every_arg_autoshrinks(t) ||
+			!open_pack(path, &file) ||
+			(file.header.record_count > 0 &&
+					file.header.arity != t->prop.arity)) {
+		goto cleanup;
+	}
+	for (uint8_t i = 0; i < t->prop.arity; i++) {
+		r.pools[i] = fuzz_autoshrink_replay_pool_new(
+				(size_t)file.header.max_requests);
+		if (r.pools[i] == NULL) {
+			res = FUZZ_RESULT_ERROR_MEMORY;
+			goto cleanup;
+		}
+	}
+	if (!host_is_little_endian()) {
+		r.words = malloc(((size_t)file.header.max_bits + 63) / 64 *
+				 sizeof(uint64_t));
+		if (r.words == NULL) {
+			res = FUZZ_RESULT_ERROR_MEMORY;
+			goto cleanup;
+		}
+	}
+
+	const uint64_t start_ms = fuzz_monotonic_msec();
+	const bool     ok       = (t->fork.enable ? replay_forked(&r)
+						      : replay_in_process(&r));
+	if (!ok) {
+		res = FUZZ_RESULT_ERROR;
+	} else if (t->counters.fail > 0) {
+		res = FUZZ_RESULT_FAIL;
+	} else {
+		res = FUZZ_RESULT_OK;
+	}
+	if (report != NULL) {
+		const uint64_t elapsed_ms = fuzz_monotonic_msec() - start_ms;
+		const uint64_t records    = file.header.record_count;
+		const uint64_t per_sec    = (elapsed_ms == 0
+							 ? 0
+							 : 1000 * records / elapsed_ms);
+		*report = (struct fuzz_run_report){
+				.pass           = t->counters.pass,
+				.fail           = t->counters.fail,
+				.skip           = t->counters.skip,
+				.dup            = t->counters.dup,
+				.elapsed_ms     = elapsed_ms,
+				.trials_per_sec = (size_t)per_sec,
+		};
+	}
+
+cleanup:
+	for (uint8_t i = 0; i < FUZZ_MAX_ARITY; i++) {
+		fuzz_autoshrink_replay_pool_free(r.pools[i]);
+	}
+	free(r.words);
+	close_pack(&file);
+	fuzz_run_free(t);
+	return res;
+}
+
+// Map the packed corpus at PATH into FILE, and check its header and
+// index. A missing file is an empty corpus.
+static bool
+open_pack(const char* path, struct pack_file* file)
+{
+	*file = (struct pack_file){.data = NULL};
+#if !defined(_WIN32)
+	const int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return errno == ENOENT;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < PACK_HEADER_SIZE) {
+		close(fd);
+		return false;
+	}
+	void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+			fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	file->data   = data;
+	file->size   = (size_t)st.st_size;
+	file->mapped = true;
+#else
+	FILE* f = fopen(path, "rb");
+	if (f == NULL) {
+		return errno == ENOENT;
+	}
+	long len = -1;
+	if (fseek(f, 0, SEEK_END) == 0) {
+		len = ftell(f);
+	}
+	uint8_t* data = NULL;
+	if (len >= PACK_HEADER_SIZE && fseek(f, 0, SEEK_SET) == 0) {
+		data = malloc((size_t)len);
+	}
+	if (data == NULL || fread(data, 1, (size_t)len, f) != (size_t)len) {
+		free(data);
+		fclose(f);
+		return false;
+	}
+	fclose(f);
+	file->data = data;
+	file->size = (size_t)len;
+#endif
+
+	const uint8_t*      d = file->data;
+	struct pack_header* h = &file->header;
+	*h                    = (struct pack_header){
+			.arity        = d[5],
+			.record_count = read_le64(&d[8]),
+			.index_offset = read_le64(&d[16]),
+			.max_bits     = read_le64(&d[24]),
+			.max_requests = read_le64(&d[32]),
+	};
+	if (0 != memcmp(d, PACK_MAGIC, 4) || d[4] != PACK_VERSION ||
+			h->index_offset < PACK_HEADER_SIZE ||
+			h->index_offset > file->size ||
+			h->record_count > (file->size - h->index_offset) /
+							  PACK_INDEX_ENTRY ||
+			h->max_bits > file->size * 8) {
+		LOG(1 - LOG_PACK, "%s: bad packed corpus %s\n", __func__,
+				path);
+		close_pack(file);
+		return false;
+	}
+	return true;
+}
+
+static void
+close_pack(struct pack_file* file)
+{
+	if (file->data != NULL) {
+#if !defined(_WIN32)
+		if (file->mapped) {
+			munmap((void*)(uintptr_t)file->data, file->size);
+		}
+#else
+		free((void*)(uintptr_t)file->data);
+#endif
+	}
+	*file = (struct pack_file){.data = NULL};
+}
+
+// Point REC at the Ith record in FILE, checking that it's in bounds.
+static bool
+get_record(const struct pack_file* file, size_t i, struct pack_record* rec)
+{
+	const struct pack_header* h   = &file->header;
+	const uint64_t            end = h->index_offset;
+	uint64_t offset = read_le64(&file->data[end + i * PACK_INDEX_ENTRY]);
+	if (offset < PACK_HEADER_SIZE || (offset & 0x07) != 0) {
+		return false;
+	}
+	for (uint8_t a = 0; a < h->arity; a++) {
+		if (offset > end || end - offset < 16) {
+			return false;
+		}
+		const uint64_t bits     = read_le64(&file->data[offset]);
+		const uint64_t requests = read_le64(&file->data[offset + 8]);
+		offset += 16;
+		if (bits > h->max_bits || requests > h->max_requests) {
+			return false;
+		}
+		const uint64_t words   = (bits + 63) / 64;
+		const uint64_t padding = (requests * 4 + 7) & ~(uint64_t)7;
+		if (words * 8 + padding > end - offset) {
+			return false;
+		}
+		rec->bit_counts[a]     = (size_t)bits;
+		rec->bits[a]           = &file->data[offset];
+		rec->request_counts[a] = (size_t)requests;
+		rec->request_sizes[a]  = &file->data[offset + words * 8];
+		offset += words * 8 + padding;
+	}
+	return true;
+}
+
+// Replay the Ith record by allocating its instances from the packed bits
+// and calling the property directly, without hooks, shrinking, or
+// checking for duplicates.
+static int
+replay_record(struct pack_replay* r, size_t i)
+{
+	struct fuzz*       t = r->t;
+	struct pack_record rec;
+	if (!get_record(r->file, i, &rec)) {
+		LOG(1 - LOG_PACK, "%s: bad record %zd\n", __func__, i);
+		return FUZZ_RESULT_ERROR;
+	}
+
+	void* args[FUZZ_MAX_ARITY] = {NULL};
+	int   res                  = FUZZ_RESULT_OK;
+	for (uint8_t a = 0; a < t->prop.arity; a++) {
+		const size_t    bit_count = rec.bit_counts[a];
+		const uint64_t* bits      = (const uint64_t*)(uintptr_t)
+							    rec.bits[a];
+		if (r->words != NULL) {
+			const size_t words = (bit_count + 63) / 64;
+			for (size_t w = 0; w < words; w++) {
+				r->words[w] = read_le64(&rec.bits[a][8 * w]);
+			}
+			bits = r->words;
+		}
+		res = fuzz_autoshrink_replay_alloc(
+				t, a, r->pools[a], bits, bit_count, &args[a]);
+		if (res != FUZZ_RESULT_OK) {
+			break;
+		}
+
+		// The sizes of the requests are kept to notice when the
+		// generator has changed, since the record may not find the
+		// same failure anymore.
+		const struct autoshrink_bit_pool* pool = r->pools[a];
+		bool stale = (fuzz_autoshrink_request_count(pool) !=
+				     rec.request_counts[a]);
+		for (size_t q = 0; !stale && q < rec.request_counts[a]; q++) {
+			const uint8_t* s = &rec.request_sizes[a][4 * q];
+			const uint32_t size = (uint32_t)s[0] |
+					      (uint32_t)s[1] << 8 |
+					      (uint32_t)s[2] << 16 |
+					      (uint32_t)s[3] << 24;
+			stale = (fuzz_autoshrink_request_size(pool, q) != size);
+		}
+		if (stale) {
+			LOG(1 - LOG_PACK,
+					"%s: record %zd, arg %u generated "
+					"differently than when it was packed\n",
+					__func__, i, a);
+		}
+	}
+
+	if (res == FUZZ_RESULT_OK) {
+		res = fuzz_call_in_process(t, args);
+	}
+	for (uint8_t b = 0; b < t->prop.arity; b++) {
+		fuzz_trial_release_instance(t, b, args[b]);
+	}
+	fuzz_arena_reset(t->arena, (struct fuzz_arena_mark){.chunk = 0});
+	return res;
+}
+
+// Run the Ith record again as a full trial, which shrinks and reports
+// it if it fails.
+static enum fuzz_run_replay_res
+replay_fully(struct pack_replay* r, size_t i)
+{
+	struct pack_record rec;
+	if (!get_record(r->file, i, &rec)) {
+		return FUZZ_RUN_REPLAY_ERROR;
+	}
+	struct corpus_record crec = {.seed = i, .has_pools = true};
+	for (uint8_t a = 0; a < r->t->prop.arity; a++) {
+		crec.bit_counts[a] = rec.bit_counts[a];
+		crec.bits[a]       = rec.bits[a];
+	}
+	return fuzz_run_replay(r->t, i, &crec);
+}
+
+static bool
+replay_in_process(struct pack_replay* r)
+{
+	struct fuzz* t = r->t;
+	for (size_t i = 0; i < r->file->header.record_count; i++) {
+		const int res = replay_record(r, i);
+		if (res == FUZZ_RESULT_OK) {
+			t->counters.pass++;
+		} else if (res == FUZZ_RESULT_SKIP) {
+			t->counters.skip++;
+		} else {
+			const enum fuzz_run_replay_res rres =
+					replay_fully(r, i);
+			if (rres == FUZZ_RUN_REPLAY_HALT) {
+				break; // a hook asked to stop
+			} else if (rres != FUZZ_RUN_REPLAY_OK) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Replay the records in up to fork.workers forked workers, each taking
+// every Nth record. Records that fail, and any a worker didn't finish
+// because it crashed or timed out, are run again by this process.
+static bool
+replay_forked(struct pack_replay* r)
+{
+	assert(FUZZ_POLYFILL_HAVE_FORK);
+	struct fuzz* t     = r->t;
+	const size_t count = (size_t)r->file->header.record_count;
+	if (count == 0) {
+		return true;
+	}
+	size_t stride = (t->fork.workers == 0 ? 1 : t->fork.workers);
+	if (stride > count) {
+		stride = count;
+	}
+
+	bool* again = calloc(count, sizeof(bool));
+	if (again == NULL) {
+		return false;
+	}
+	struct pack_worker workers[FUZZ_MAX_WORKERS];
+	size_t             live = 0;
+	for (size_t w = 0; w < stride; w++) {
+		if (start_worker(r, &workers[w], w, stride)) {
+			live++;
+		}
+	}
+
+	struct pollfd pfds[FUZZ_MAX_WORKERS];
+	size_t        polled[FUZZ_MAX_WORKERS];
+	while (live > 0) {
+		nfds_t n = 0;
+		for (size_t w = 0; w < stride; w++) {
+			if (workers[w].live) {
+				pfds[n] = (struct pollfd){
+						.fd     = workers[w].fd,
+						.events = POLLIN,
+				};
+				polled[n++] = w;
+			}
+		}
+		const int timeout = (t->fork.timeout == 0
+						     ? -1
+						     : (int)t->fork.timeout);
+		if (poll(pfds, n, timeout) == -1 && errno != EINTR) {
+			perror("poll");
+			break;
+		}
+		const uint64_t now = fuzz_monotonic_msec();
+		for (nfds_t p = 0; p < n; p++) {
+			struct pack_worker* w = &workers[polled[p]];
+			if (pfds[p].revents != 0) {
+				if (!read_results(r, w, stride, again)) {
+					live--;
+				}
+			} else if (t->fork.timeout != 0 &&
+					now - w->last_ms > t->fork.timeout) {
+				// Its current record will time out again
+				// when this process runs it.
+				LOG(2 - LOG_PACK, "%s: worker %d timed out\n",
+						__func__, w->pid);
+				kill(w->pid, SIGKILL);
+			}
+		}
+	}
+
+	// Any workers left were cut off by an error, so let them go.
+	for (size_t w = 0; w < stride; w++) {
+		const struct pack_worker* wk = &workers[w];
+		if (wk->live) {
+			kill(wk->pid, SIGKILL);
+			close(wk->fd);
+			waitpid(wk->pid, NULL, 0);
+			for (size_t i = wk->next; i < count; i += stride) {
+				again[i] = true;
+			}
+		}
+	}
+
+	bool ok = (live == 0);
+	for (size_t i = 0; ok && i < count; i++) {
+		if (!again[i]) {
+			continue;
+		}
+		const enum fuzz_run_replay_res rres = replay_fully(r, i);
+		if (rres == FUZZ_RUN_REPLAY_HALT) {
+			break; // a hook asked to stop
+		} else if (rres != FUZZ_RUN_REPLAY_OK) {
+			ok = false;
+		}
+	}
+	free(again);
+	return ok;
+}
+
+// Fork a worker to replay every STRIDE'th record from FIRST. If it
+// can't be started, all of its records are left for this process.
+static bool
+start_worker(struct pack_replay* r, struct pack_worker* w, size_t first,
+		size_t stride)
+{
+	*w = (struct pack_worker){.next = first, .fd = -1};
+	int fds[2];
+	if (pipe(fds) == -1) {
+		perror("pipe");
+		return false;
+	}
+	fflush(r->t->out);
+	const pid_t pid = fork();
+	if (pid == -1) {
+		perror("fork");
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	} else if (pid == 0) {
+		close(fds[0]);
+		uint64_t     msgs[MSG_BATCH];
+		size_t       n     = 0;
+		const size_t count = (size_t)r->file->header.record_count;
+		for (size_t i = first; i < count; i += stride) {
+			const int res  = replay_record(r, i);
+			uint64_t  code = MSG_AGAIN;
+			if (res == FUZZ_RESULT_OK) {
+				code = MSG_PASS;
+			} else if (res == FUZZ_RESULT_SKIP) {
+				code = MSG_SKIP;
+			}
+			msgs[n++] = (uint64_t)i << MSG_SHIFT | code;
+			// With a timeout, report every record, so the
+			// parent can tell a slow record from a stuck one.
+			if (n == MSG_BATCH || r->t->fork.timeout != 0) {
+				if (!write_all(fds[1], msgs,
+						    n * sizeof(uint64_t))) {
+					_exit(EXIT_FAILURE);
+				}
+				n = 0;
+			}
+		}
+		const bool ok = write_all(fds[1], msgs, n * sizeof(uint64_t));
+		_exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	close(fds[1]);
+	w->pid     = pid;
+	w->fd      = fds[0];
+	w->live    = true;
+	w->last_ms = fuzz_monotonic_msec();
+	return true;
+}
+
+// Read the results worker W has sent. Once it's done, wait for it, mark
+// any records it didn't finish to be run again, and return false.
+static bool
+read_results(struct pack_replay* r, struct pack_worker* w, size_t stride,
+		bool* again)
+{
+	struct fuzz*  t     = r->t;
+	const size_t  count = (size_t)r->file->header.record_count;
+	const ssize_t rd    = read(w->fd, &w->buf[w->partial],
+			   sizeof(w->buf) - w->partial);
+	if (rd == -1 && errno == EINTR) {
+		return true;
+	}
+	if (rd > 0) {
+		const size_t avail = w->partial + (size_t)rd;
+		const size_t whole = avail - avail % sizeof(uint64_t);
+		for (size_t o = 0; o < whole; o += sizeof(uint64_t)) {
+			uint64_t msg;
+			memcpy(&msg, &w->buf[o], sizeof(msg));
+			const size_t i = (size_t)(msg >> MSG_SHIFT);
+			if (i != w->next) {
+				break; // garbled; treat the rest as lost
+			}
+			switch (msg & ((1U << MSG_SHIFT) - 1)) {
+			case MSG_PASS:
+				t->counters.pass++;
+				break;
+			case MSG_SKIP:
+				t->counters.skip++;
+				break;
+			default:
+				again[i] = true;
+				break;
+			}
+			w->next += stride;
+		}
+		w->partial = avail - whole;
+		memmove(w->buf, &w->buf[whole], w->partial);
+		w->last_ms = fuzz_monotonic_msec();
+		return true;
+	}
+
+	close(w->fd);
+	int wstatus = 0;
+	waitpid(w->pid, &wstatus, 0);
+	if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != EXIT_SUCCESS) {
+		LOG(2 - LOG_PACK, "%s: worker %d stopped at record %zd\n",
+				__func__, w->pid, w->next);
+	}
+	for (size_t i = w->next; i < count; i += stride) {
+		again[i] = true;
+	}
+	w->live = false;
+	return false;
+}
+
+static bool
+write_all(int fd, const void* buf, size_t size)
+{
+	const uint8_t* b = buf;
+	while (size > 0) {
+		const ssize_t wr = write(fd, b, size);
+		if (wr == -1 && errno == EINTR) {
+			continue;
+		} else if (wr <= 0) {
+			return false;
+		}
+		b += wr;
+		size -= (size_t)wr;
+	}
+	return true;
+}
+
+// Generate a record's instances from its bits, to record the requests
+// they make, and serialize it to *BUF, growing it as needed. Returns
+// false if they can't be generated anymore.
+static bool
+pack_corpus_record(struct fuzz* t, struct autoshrink_bit_pool* pool,
+		const struct corpus_record* rec, uint8_t** buf, size_t* size,
+		struct pack_header* header)
+{
+	size_t offset = 0;
+	for (uint8_t a = 0; a < t->prop.arity; a++) {
+		const size_t bit_count = rec->bit_counts[a];
+		const size_t words     = (bit_count + 63) / 64;
+		uint64_t*    bits      = calloc(words + 1, sizeof(uint64_t));
+		if (bits == NULL) {
+			return false;
+		}
+		const uint8_t* bytes = rec->bits[a];
+		for (size_t b = 0; b < (bit_count + 7) / 8; b++) {
+			bits[b / 8] |= (uint64_t)bytes[b] << (8 * (b % 8));
+		}
+
+		void*     instance = NULL;
+		const int res      = fuzz_autoshrink_replay_alloc(
+				t, a, pool, bits, bit_count, &instance);
+		fuzz_trial_release_instance(t, a, instance);
+		fuzz_arena_reset(t->arena,
+				(struct fuzz_arena_mark){.chunk = 0});
+		if (res != FUZZ_RESULT_OK) {
+			free(bits);
+			return false;
+		}
+
+		const size_t requests = fuzz_autoshrink_request_count(pool);
+		const size_t padded   = (requests * 4 + 7) & ~(size_t)7;
+		const size_t needed   = offset + 16 + words * 8 + padded;
+		uint8_t*     nbuf     = realloc(*buf, needed);
+		if (nbuf == NULL) {
+			free(bits);
+			return false;
+		}
+		*buf = nbuf;
+		memset(&nbuf[offset], 0x00, needed - offset);
+		write_le64(&nbuf[offset], bit_count);
+		write_le64(&nbuf[offset + 8], requests);
+		offset += 16;
+		for (size_t w = 0; w < words; w++) {
+			write_le64(&nbuf[offset + 8 * w], bits[w]);
+		}
+		offset += words * 8;
+		for (size_t q = 0; q < requests; q++) {
+			const uint32_t s =
+					fuzz_autoshrink_request_size(pool, q);
+			uint8_t* dst = &nbuf[offset + 4 * q];
+			for (size_t j = 0; j < 4; j++) {
+				dst[j] = (uint8_t)(s >> (8 * j));
+			}
+		}
+		offset += padded;
+		free(bits);
+
+		if (bit_count > header->max_bits) {
+			header->max_bits = bit_count;
+		}
+		if (requests > header->max_requests) {
+			header->max_requests = requests;
+		}
+	}
+	*size = offset;
+	return true;
+}
+
+static int
+cmp_hashes(const void* a, const void* b)
+{
+	const uint64_t x = *(const uint64_t*)a;
+	const uint64_t y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+static bool
+host_is_little_endian(void)
+{
+	const uint16_t one = 1;
+	return *(const uint8_t*)&one == 1;
+}
+
+static void
+write_le64(uint8_t* dst, uint64_t x)
+{
+	for (size_t i = 0; i < 8; i++) {
+		dst[i] = (uint8_t)(x >> (8 * i));
+	}
+}
+
+static uint64_t
+read_le64(const uint8_t* src)
+{
+	uint64_t x = 0;
+	for (size_t i = 0; i < 8; i++) {
+		x |= (uint64_t)src[i] << (8 * i);
+	}
+	return x;
+}
@@ -3,20 +3,24 @@
 
 extern int errno;
 
+#include <time.h>
+
 #if defined(_WIN32)
 #include <fcntl.h>
 #include <io.h>
 #include <stdint.h>
 #include <stdio.h>
-#include <time.h>
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <winsock2.h>
 #undef WIN32_LEAN_AND_MEAN
 
 #include "poll_windows.h"
+#endif
+
 #include "polyfill.h"
 
+#if defined(_WIN32)
 int
 pipe(int pipefd[2])
 {
@@ -117,6 +121,23 @@ gettimeofday(struct timeval* tp, struct timezone* tzp)
 	return 0;
 }
 
+int
+clock_gettime(clockid_t clk_id, struct timespec* tp)
+{
+	(void)clk_id;
+	LARGE_INTEGER count = {0};
+	LARGE_INTEGER freq  = {0};
+	if (!QueryPerformanceFrequency(&freq) ||
+			!QueryPerformanceCounter(&count)) {
+		return -1;
+	}
+
+	tp->tv_sec  = (time_t)(count.QuadPart / freq.QuadPart);
+	tp->tv_nsec = (long)(((count.QuadPart % freq.QuadPart) * 1000000000) /
+			     freq.QuadPart);
+	return 0;
+}
+
 // Public domain
 //
 // poll(2) emulation for Windows from LibreSSL
@@ -421,3 +442,13 @@ poll(struct pollfd* pfds, nfds_t nfds, int timeout_ms)
 }
 
 #endif
+
+uint64_t
+fuzz_monotonic_msec(void)
+{
+	struct timespec ts = {0, 0};
+	if (-1 == clock_gettime(CLOCK_MONOTONIC, &ts)) {
+		return 0;
+	}
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
@@ -25,6 +25,9 @@ struct timezone {
 
 typedef int pid_t;
 
+typedef int clockid_t;
+#define CLOCK_MONOTONIC 1
+
 // Not actually used. Here to silence "incomplete type" warnings.
 struct sigaction {
 	void (*sa_handler)(int);
@@ -58,6 +61,9 @@ int fork();
 
 int gettimeofday(struct timeval* tp, struct timezone* tzp);
 
+// POSIX clock_gettime(2). Only CLOCK_MONOTONIC is supported.
+int clock_gettime(clockid_t clk_id, struct timespec* tp);
+
 // When POLYFILL_HAVE_FORK is false, these do nothing and are never called.
 // They only exist to prevent linker errors.
 int wait(int* status);
@@ -71,4 +77,8 @@ int setrlimit(int resource, const struct rlimit* rlim);
 int getrlimit(int resource, struct rlimit* rlim);
 #endif
 
+// Get the current time in milliseconds, on a monotonic clock so it isn't
+// thrown off by changes to the system time. Returns 0 on error.
+uint64_t fuzz_monotonic_msec(void);
+
 #endif // FUZZ_POLYFILL_H
@@ -45,10 +45,20 @@ fuzz_random_stop_using_bit_pool(struct fuzz* t)
 	t->prng.bit_pool = NULL;
 }
 
+static void random_bits_of_kind(struct fuzz* t, uint32_t bit_count,
+		uint8_t kind, uint64_t* buf);
+
 // Get BITS random bits from the test runner's PRNG.
 // Bits can be retrieved at most 64 at a time.
 uint64_t
 fuzz_random_bits(struct fuzz* t, uint8_t bit_count)
+{
+	return fuzz_random_bits_tagged(t, bit_count, FUZZ_REQ_UNKNOWN);
+}
+
+uint64_t
+fuzz_random_bits_tagged(
+		struct fuzz* t, uint8_t bit_count, enum fuzz_request_kind kind)
 {
 	assert(bit_count <= 64);
 	LOG(4,
@@ -57,18 +67,25 @@ fuzz_random_bits(struct fuzz* t, uint8_t bit_count)
 			t->prng.bits_available, bit_count, t->prng.buf);
 
 	uint64_t res = 0;
-	fuzz_random_bits_bulk(t, bit_count, &res);
+	random_bits_of_kind(t, bit_count, (uint8_t)kind, &res);
 	return res;
 }
 
 void
 fuzz_random_bits_bulk(struct fuzz* t, uint32_t bit_count, uint64_t* buf)
+{
+	random_bits_of_kind(t, bit_count, FUZZ_REQ_UNKNOWN, buf);
+}
+
+static void
+random_bits_of_kind(struct fuzz* t, uint32_t bit_count, uint8_t kind,
+		uint64_t* buf)
 {
 	LOG(5, "%s: bit_count %u\n", __func__, bit_count);
 	assert(buf);
 	if (t->prng.bit_pool) {
-		fuzz_autoshrink_bit_pool_random(
-				t, t->prng.bit_pool, bit_count, true, buf);
+		fuzz_autoshrink_bit_pool_random(t, t->prng.bit_pool,
+				bit_count, kind, true, buf);
 		return;
 	}
 
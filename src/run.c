@@ -4,9 +4,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "autoshrink.h"
 #include "bloom.h"
 #include "call.h"
+#include "corpus.h"
+#include "coverage.h"
+#include "dictionary.h"
 #include "fuzz.h"
 #include "polyfill.h"
 #include "random.h"
@@ -23,8 +27,9 @@ enum run_step_res {
 	RUN_STEP_GEN_ERROR,
 	RUN_STEP_TRIAL_ERROR,
 };
-static enum run_step_res run_step(
-		struct fuzz* t, size_t trial, uint64_t* seed);
+static enum run_step_res run_step(struct fuzz* t, size_t trial,
+		uint64_t* seed, const struct corpus_record* replay);
+static enum run_step_res replay_corpus(struct fuzz* t);
 
 static bool copy_propfun_for_arity(
 		const struct fuzz_run_config* cfg, struct prop_info* prop);
@@ -43,25 +48,45 @@ static bool init_arg_info(struct fuzz* t, struct trial_info* trial_info);
 
 static enum all_gen_res gen_all_args(struct fuzz* t);
 
-static void free_print_trial_result_env(struct fuzz* t);
-
 #define LOG_RUN 0
 
 enum fuzz_run_init_res
 fuzz_run_init(const struct fuzz_run_config* cfg, struct fuzz** output)
+{
+	return fuzz_run_init_reusing(NULL, cfg, output);
+}
+
+enum fuzz_run_init_res
+fuzz_run_init_reusing(struct fuzz_runner* runner,
+		const struct fuzz_run_config* cfg, struct fuzz** output)
 {
 	enum fuzz_run_init_res res = FUZZ_RUN_INIT_OK;
-	struct fuzz*           t   = malloc(sizeof(*t));
-	if (t == NULL) {
-		return FUZZ_RUN_INIT_ERROR_MEMORY;
+	struct fuzz*           t   = NULL;
+	if (runner != NULL && runner->t != NULL) {
+		t         = runner->t;
+		runner->t = NULL;
+	} else {
+		t = malloc(sizeof(*t));
+		if (t == NULL) {
+			return FUZZ_RUN_INIT_ERROR_MEMORY;
+		}
 	}
 	memset(t, 0, sizeof(*t));
 
-	t->out      = stdout;
-	t->prng.rng = fuzz_rng_init(DEFAULT_uint64_t);
+	// The RNG is seeded below, so a kept one doesn't need a reset.
+	t->out = stdout;
+	if (runner != NULL) {
+		t->prng.rng   = runner->rng;
+		t->arena      = runner->arena;
+		runner->rng   = NULL;
+		runner->arena = NULL;
+	}
 	if (t->prng.rng == NULL) {
-		free(t);
-		return FUZZ_RUN_INIT_ERROR_MEMORY;
+		t->prng.rng = fuzz_rng_init(DEFAULT_uint64_t);
+		if (t->prng.rng == NULL) {
+			res = FUZZ_RUN_INIT_ERROR_MEMORY;
+			goto cleanup;
+		}
 	}
 
 	const uint8_t arity = infer_arity(cfg);
@@ -76,12 +101,18 @@ fuzz_run_init(const struct fuzz_run_config* cfg, struct fuzz** output)
 		goto cleanup;
 	}
 
+	if (cfg->fork.workers > FUZZ_MAX_WORKERS) {
+		res = FUZZ_RUN_INIT_ERROR_BAD_ARGS;
+		goto cleanup;
+	}
+
 	struct seed_info seeds = {
 			.run_seed = cfg->seed ? cfg->seed : DEFAULT_uint64_t,
 			.always_seed_count = (cfg->always_seeds == NULL
 							      ? 0
 							      : cfg->always_seed_count),
 			.always_seeds      = cfg->always_seeds,
+			.corpus_dir        = cfg->corpus_dir,
 	};
 	memcpy(&t->seeds, &seeds, sizeof(seeds));
 
@@ -90,14 +121,29 @@ fuzz_run_init(const struct fuzz_run_config* cfg, struct fuzz** output)
 			.timeout = cfg->fork.timeout,
 			.signal  = cfg->fork.signal,
 			.exit_timeout = cfg->fork.exit_timeout,
+			.workers      = cfg->fork.workers,
 	};
 	memcpy(&t->fork, &fork, sizeof(fork));
 
+	struct shrink_info shrink = {
+			.max_time_ms = cfg->shrink.max_time_ms,
+			.max_calls   = cfg->shrink.max_calls,
+			.restarts    = cfg->shrink.restarts,
+			.model_path  = cfg->shrink.model_path,
+	};
+	memcpy(&t->shrink, &shrink, sizeof(shrink));
+
+	size_t trial_count = cfg->trials;
+	if (trial_count == 0) {
+		trial_count = (cfg->max_duration_ms > 0 ? SIZE_MAX
+							: FUZZ_DEF_TRIALS);
+	}
+
 	struct prop_info prop = {
 			.name        = cfg->name,
 			.arity       = arity,
-			.trial_count = cfg->trials == 0 ? FUZZ_DEF_TRIALS
-							: cfg->trials,
+			.trial_count     = trial_count,
+			.max_duration_ms = cfg->max_duration_ms,
 			// .type_info is memcpy'd below
 	};
 	if (!copy_propfun_for_arity(cfg, &prop)) {
@@ -106,6 +152,12 @@ fuzz_run_init(const struct fuzz_run_config* cfg, struct fuzz** output)
 	}
 	memcpy(&prop.type_info, cfg->type_info, sizeof(prop.type_info));
 	memcpy(&t->prop, &prop, sizeof(prop));
+	fuzz_autoshrink_load_model(t);
+
+	if (!fuzz_coverage_init(t, cfg) || !fuzz_dictionary_init(t, cfg)) {
+		res = FUZZ_RUN_INIT_ERROR_MEMORY;
+		goto cleanup;
+	}
 
 	struct hook_info hooks = {
 			.pre_run      = (cfg->hooks.pre_run != NULL
@@ -138,16 +190,27 @@ fuzz_run_init(const struct fuzz_run_config* cfg, struct fuzz** output)
 	// If all arguments are hashable, then attempt to use
 	// a bloom filter to avoid redundant checking.
 	if (all_hashable) {
-		t->bloom = fuzz_bloom_init(NULL);
+		if (runner != NULL && runner->bloom != NULL) {
+			t->bloom      = runner->bloom;
+			runner->bloom = NULL;
+		} else {
+			t->bloom = fuzz_bloom_init(NULL);
+		}
 	}
 
 	// If using the default trial_post callback, allocate its
 	// environment, with info relating to printing progress.
 	if (t->hooks.trial_post == fuzz_hook_trial_post_print_result) {
-		t->print_trial_result_env =
-				calloc(1, sizeof(*t->print_trial_result_env));
-		if (t->print_trial_result_env == NULL) {
-			return FUZZ_RUN_INIT_ERROR_MEMORY;
+		if (runner != NULL && runner->print_env != NULL) {
+			t->print_trial_result_env = runner->print_env;
+			runner->print_env         = NULL;
+		} else {
+			t->print_trial_result_env = calloc(
+					1, sizeof(*t->print_trial_result_env));
+			if (t->print_trial_result_env == NULL) {
+				res = FUZZ_RUN_INIT_ERROR_MEMORY;
+				goto cleanup;
+			}
 		}
 		t->print_trial_result_env->tag =
 				FUZZ_PRINT_TRIAL_RESULT_ENV_TAG;
@@ -157,25 +220,63 @@ fuzz_run_init(const struct fuzz_run_config* cfg, struct fuzz** output)
 	return res;
 
 cleanup:
-	fuzz_rng_free(t->prng.rng);
-	free(t);
+	fuzz_run_free_reusing(t, runner);
 	return res;
 }
 
 void
 fuzz_run_free(struct fuzz* t)
 {
+	fuzz_run_free_reusing(t, NULL);
+}
+
+void
+fuzz_run_free_reusing(struct fuzz* t, struct fuzz_runner* runner)
+{
+	// Spare instances belong to this run's types, so aren't kept.
+	fuzz_trial_free_spares(t);
+	fuzz_coverage_free(t);
+	fuzz_dictionary_free(t);
+
+	if (runner != NULL) {
+		if (runner->rng == NULL) {
+			runner->rng = t->prng.rng;
+			t->prng.rng = NULL;
+		}
+		if (runner->bloom == NULL && t->bloom != NULL) {
+			fuzz_bloom_reset(t->bloom);
+			runner->bloom = t->bloom;
+			t->bloom      = NULL;
+		}
+		if (runner->arena == NULL && t->arena != NULL) {
+			fuzz_arena_reset(t->arena,
+					(struct fuzz_arena_mark){.chunk = 0});
+			runner->arena = t->arena;
+			t->arena      = NULL;
+		}
+		if (runner->print_env == NULL &&
+				t->print_trial_result_env != NULL) {
+			memset(t->print_trial_result_env, 0x00,
+					sizeof(*t->print_trial_result_env));
+			runner->print_env         = t->print_trial_result_env;
+			t->print_trial_result_env = NULL;
+		}
+	}
+
 	if (t->bloom) {
 		fuzz_bloom_free(t->bloom);
-		t->bloom = NULL;
 	}
 	fuzz_rng_free(t->prng.rng);
-
-	if (t->print_trial_result_env != NULL) {
-		free(t->print_trial_result_env);
+	if (t->arena) {
+		fuzz_arena_free(t->arena);
 	}
+	free(t->print_trial_result_env);
 
-	free(t);
+	if (runner != NULL && runner->t == NULL) {
+		runner->t = t; // cleared by the next run's init
+	} else {
+		free(t);
+	}
 }
 
 // Actually run the trials, with all arguments made explicit.
@@ -184,9 +285,10 @@ fuzz_run_trials(struct fuzz* t)
 {
 	if (t->hooks.pre_run != NULL) {
 		struct fuzz_pre_run_info hook_info = {
-				.prop_name    = t->prop.name,
-				.total_trials = t->prop.trial_count,
-				.run_seed     = t->seeds.run_seed,
+				.prop_name       = t->prop.name,
+				.total_trials    = t->prop.trial_count,
+				.run_seed        = t->seeds.run_seed,
+				.max_duration_ms = t->prop.max_duration_ms,
 		};
 		int res = t->hooks.pre_run(&hook_info, t->hooks.env);
 		if (res != FUZZ_HOOK_RUN_CONTINUE) {
@@ -194,11 +296,35 @@ fuzz_run_trials(struct fuzz* t)
 		}
 	}
 
-	size_t   limit = t->prop.trial_count;
-	uint64_t seed  = t->seeds.run_seed;
+	size_t limit = t->prop.trial_count;
+	if (t->seeds.corpus_dir != NULL) {
+		switch (replay_corpus(t)) {
+		case RUN_STEP_OK:
+			break;
+		case RUN_STEP_HALT:
+			limit = 0;
+			break;
+		default:
+			goto cleanup;
+		}
+	}
+
+	// Replayed failures don't count toward the time limit or rate.
+	uint64_t       seed     = t->seeds.run_seed;
+	const uint64_t start_ms = fuzz_monotonic_msec();
+	const size_t   replayed = t->counters.pass + t->counters.fail +
+				t->counters.skip + t->counters.dup;
 
 	for (size_t trial = 0; trial < limit; trial++) {
-		enum run_step_res res = run_step(t, trial, &seed);
+		if (t->prop.max_duration_ms > 0 && trial > 0 &&
+				fuzz_monotonic_msec() - start_ms >=
+						t->prop.max_duration_ms) {
+			LOG(2 - LOG_RUN, "%s: out of time after %zd trials\n",
+					__func__, trial);
+			break;
+		}
+
+		enum run_step_res res = run_step(t, trial, &seed, NULL);
 		memset(&t->trial, 0x00, sizeof(t->trial));
 
 		LOG(3 - LOG_RUN,
@@ -219,6 +345,22 @@ fuzz_run_trials(struct fuzz* t)
 		}
 	}
 
+	if (!fuzz_autoshrink_save_model(t)) {
+		LOG(1 - LOG_RUN, "%s: failed to save autoshrink model to %s\n",
+				__func__, t->shrink.model_path);
+	}
+
+	// Trials per second, for budgeting time per property.
+	const uint64_t elapsed_ms = fuzz_monotonic_msec() - start_ms;
+	const size_t   run        = t->counters.pass + t->counters.fail +
+			     t->counters.skip + t->counters.dup - replayed;
+	const size_t   per_sec    = (elapsed_ms == 0
+						 ? 0
+						 : (size_t)(run * 1000 /
+								 elapsed_ms));
+	t->counters.elapsed_ms     = elapsed_ms;
+	t->counters.trials_per_sec = per_sec;
+
 	fuzz_post_run_hook_cb* post_run = t->hooks.post_run;
 	if (post_run != NULL) {
 		struct fuzz_post_run_info hook_info = {
@@ -231,6 +373,10 @@ fuzz_run_trials(struct fuzz* t)
 								.fail = t->counters.fail,
 								.skip = t->counters.skip,
 								.dup = t->counters.dup,
+								.elapsed_ms =
+										elapsed_ms,
+								.trials_per_sec =
+										per_sec,
 						},
 		};
 
@@ -240,8 +386,6 @@ fuzz_run_trials(struct fuzz* t)
 		}
 	}
 
-	free_print_trial_result_env(t);
-
 	if (t->counters.fail > 0) {
 		return FUZZ_RESULT_FAIL;
 	} else if (t->counters.pass > 0) {
@@ -251,25 +395,66 @@ fuzz_run_trials(struct fuzz* t)
 	}
 
 cleanup:
-	free_print_trial_result_env(t);
 	return FUZZ_RESULT_ERROR;
 }
 
+// Run each failure saved in the corpus directory as a trial.
 static enum run_step_res
-run_step(struct fuzz* t, size_t trial, uint64_t* seed)
+replay_corpus(struct fuzz* t)
+{
+	struct corpus_iter iter;
+	if (!fuzz_corpus_open(t, &iter)) {
+		return RUN_STEP_GEN_ERROR;
+	}
+
+	enum run_step_res    res = RUN_STEP_OK;
+	struct corpus_record rec;
+	for (size_t i = 0; res == RUN_STEP_OK &&
+			   fuzz_corpus_next(t, &iter, &rec);
+			i++) {
+		uint64_t seed = rec.seed;
+		res           = run_step(t, i, &seed, &rec);
+		memset(&t->trial, 0x00, sizeof(t->trial));
+	}
+	fuzz_corpus_close(&iter);
+	return res;
+}
+
+enum fuzz_run_replay_res
+fuzz_run_replay(struct fuzz* t, size_t trial, const struct corpus_record* rec)
+{
+	uint64_t                seed = rec->seed;
+	const enum run_step_res res  = run_step(t, trial, &seed, rec);
+	memset(&t->trial, 0x00, sizeof(t->trial));
+	switch (res) {
+	case RUN_STEP_OK:
+		return FUZZ_RUN_REPLAY_OK;
+	case RUN_STEP_HALT:
+		return FUZZ_RUN_REPLAY_HALT;
+	default:
+		return FUZZ_RUN_REPLAY_ERROR;
+	}
+}
+
+static enum run_step_res
+run_step(struct fuzz* t, size_t trial, uint64_t* seed,
+		const struct corpus_record* replay)
 {
 	// If any seeds to always run were specified, use those before
-	// reverting to the specified starting seed.
+	// reverting to the specified starting seed. A replayed failure
+	// brings its own seed.
 	const size_t always_seeds = t->seeds.always_seed_count;
-	if (trial < always_seeds) {
+	if (replay == NULL && trial < always_seeds) {
 		*seed = t->seeds.always_seeds[trial];
-	} else if ((always_seeds > 0) && (trial == always_seeds)) {
+	} else if (replay == NULL && (always_seeds > 0) &&
+			(trial == always_seeds)) {
 		*seed = t->seeds.run_seed;
 	}
 
 	struct trial_info trial_info = {
-			.trial = trial,
-			.seed  = *seed,
+			.trial  = trial,
+			.seed   = *seed,
+			.replay = replay,
 	};
 	if (!init_arg_info(t, &trial_info)) {
 		return RUN_STEP_GEN_ERROR;
@@ -395,6 +580,7 @@ run_step(struct fuzz* t, size_t trial, uint64_t* seed)
 			*seed);
 cleanup:
 	fuzz_trial_free_args(t);
+	fuzz_arena_reset(t->arena, (struct fuzz_arena_mark){.chunk = 0});
 	return res;
 }
 
@@ -484,17 +670,44 @@ init_arg_info(struct fuzz* t, struct trial_info* trial_info)
 static enum all_gen_res
 gen_all_args(struct fuzz* t)
 {
+	// With coverage, most trials mutate an input that reached new
+	// coverage, rather than using the trial's seed. Seeds to always
+	// run and replayed failures are still used as they are.
+	struct coverage_entry* mutant = NULL;
+	struct coverage_entry* other  = NULL;
+	if (t->coverage != NULL && t->trial.replay == NULL &&
+			(size_t)t->trial.trial >= t->seeds.always_seed_count) {
+		mutant = fuzz_coverage_choose(t, &other);
+		// Start the trial's seed over, so a trial that isn't a
+		// mutant generates the same arguments as without coverage,
+		// and can be reproduced from its seed.
+		fuzz_random_set_seed(t, t->trial.seed);
+	}
+
 	for (uint8_t i = 0; i < t->prop.arity; i++) {
 		struct fuzz_type_info* ti = t->prop.type_info[i];
 		void*                  p  = NULL;
 
-		int res = (ti->autoshrink_config.enable
-						? fuzz_autoshrink_alloc(t,
-								  t->trial.args[i].u
-										  .as
-										  .env,
-								  &p)
-						: ti->alloc(t, ti->env, &p));
+		const struct corpus_record* replay = t->trial.replay;
+
+		int res;
+		if (!ti->autoshrink_config.enable) {
+			res = fuzz_trial_alloc_instance(t, i, &p);
+		} else if (replay != NULL && replay->has_pools) {
+			res = fuzz_autoshrink_alloc_from_bits(t,
+					t->trial.args[i].u.as.env,
+					replay->bits[i], replay->bit_counts[i],
+					&p);
+		} else if (mutant != NULL) {
+			res = fuzz_autoshrink_alloc_mutant(t,
+					t->trial.args[i].u.as.env,
+					mutant->pools[i],
+					(other != NULL ? other->pools[i] : NULL),
+					&p);
+		} else {
+			res = fuzz_autoshrink_alloc(
+					t, t->trial.args[i].u.as.env, &p);
+		}
 
 		if (res == FUZZ_RESULT_SKIP) {
 			return ALL_GEN_SKIP;
@@ -513,13 +726,3 @@ gen_all_args(struct fuzz* t)
 
 	return ALL_GEN_OK;
 }
-
-static void
-free_print_trial_result_env(struct fuzz* t)
-{
-	if (t->hooks.trial_post == fuzz_hook_trial_post_print_result &&
-			t->print_trial_result_env != NULL) {
-		free(t->print_trial_result_env);
-		t->print_trial_result_env = NULL;
-	}
-}
@@ -5,6 +5,9 @@
 
 struct fuzz;
 struct fuzz_run_config;
+struct fuzz_run_report;
+struct fuzz_runner;
+struct corpus_record;
 
 enum fuzz_run_init_res {
 	FUZZ_RUN_INIT_OK,
@@ -14,9 +17,35 @@ enum fuzz_run_init_res {
 enum fuzz_run_init_res fuzz_run_init(
 		const struct fuzz_run_config* cfg, struct fuzz** output);
 
+// Same as fuzz_run_init, but take any resources RUNNER kept from an
+// earlier run rather than allocating them. RUNNER can be NULL.
+enum fuzz_run_init_res fuzz_run_init_reusing(struct fuzz_runner* runner,
+		const struct fuzz_run_config* cfg, struct fuzz** output);
+
 // Actually run the trials, with all arguments made explicit.
 int fuzz_run_trials(struct fuzz* t);
 
+enum fuzz_run_replay_res {
+	FUZZ_RUN_REPLAY_OK,
+	FUZZ_RUN_REPLAY_HALT,  // a hook halted the run
+	FUZZ_RUN_REPLAY_ERROR, // an error, including one from a hook
+};
+
+// Run the saved failure REC as trial number TRIAL, shrinking and
+// reporting it if it still fails.
+enum fuzz_run_replay_res fuzz_run_replay(
+		struct fuzz* t, size_t trial, const struct corpus_record* rec);
+
 void fuzz_run_free(struct fuzz* t);
 
+// Same as fuzz_run_free, but reset resources that can be reused and
+// keep them in RUNNER for the next run. RUNNER can be NULL.
+void fuzz_run_free_reusing(struct fuzz* t, struct fuzz_runner* runner);
+
+// Run CFG's trials, reusing RUNNER's resources if it isn't NULL, and
+// save the trial counts and timing in REPORT if it isn't NULL. (In
+// fuzz.c.)
+int fuzz_run_reporting(struct fuzz_runner* runner,
+		const struct fuzz_run_config* cfg, struct fuzz_run_report* report);
+
 #endif
@@ -1,10 +1,28 @@
 // SPDX-License-Identifier: ISC
 // SPDX-FileCopyrightText: 2014-19 Scott Vokes <vokes.s@gmail.com>
 #include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#if defined(_WIN32)
+#include <io.h>
+#endif
+
+#if !defined(_WIN32)
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "arena.h"
 #include "autoshrink.h"
 #include "call.h"
 #include "fuzz.h"
+#include "memo.h"
+#include "polyfill.h"
+#include "random.h"
 #include "shrink.h"
 #include "trial.h"
 #include "types_internal.h"
@@ -16,8 +34,124 @@ enum shrink_res {
 	SHRINK_HALT,     // don't shrink any further
 };
 
+// A shrink candidate waiting to be run with others, in its own worker.
+struct candidate {
+	uint32_t                    tactic;
+	void*                       instance;
+	struct autoshrink_bit_pool* bit_pool;
+	enum autoshrink_action      tried; // autoshrink model state
+	enum autoshrink_action      set;
+	bool                        use_memo;
+	struct fuzz_memo_key        memo_key;
+	void*                       args[FUZZ_MAX_ARITY];
+};
+
+// The smallest arguments any restart has ended with so far.
+struct restart_best {
+	void*                       instances[FUZZ_MAX_ARITY];
+	struct autoshrink_bit_pool* pools[FUZZ_MAX_ARITY];
+	bool                        have;
+};
+
+// A restart running in a forked worker.
+struct restart_worker {
+	size_t run;
+	pid_t  pid;
+	int    fd;
+};
+
+// A restart worker's result starts with how much its trial's
+// shrink_count, successful_shrinks, failed_shrinks, and shrink_calls
+// grew, and these flags.
+#define RESTART_HEADER_WORDS 5
+#define RESTART_INCOMPLETE   0x01
+#define RESTART_HALT         0x02
+
+static enum shrink_res shrink_args(struct fuzz* t);
+
+static bool shrink_with_restarts(struct fuzz* t);
+
+static bool restart_in_turn(struct fuzz* t,
+		struct autoshrink_bit_pool* const* start,
+		struct restart_best*               best);
+
+static bool restart_in_workers(struct fuzz* t,
+		struct autoshrink_bit_pool* const* start,
+		struct restart_best*               best);
+
+static void keep_smallest(
+		struct fuzz* t, struct restart_best* best, size_t run);
+
+static bool restart_from(struct fuzz* t, size_t run,
+		struct autoshrink_bit_pool* const* start);
+
+static bool start_restart_worker(struct fuzz* t, size_t run,
+		struct autoshrink_bit_pool* const* start,
+		struct restart_worker*             w);
+
+static bool write_restart_pool(
+		int fd, const struct autoshrink_bit_pool* pool);
+
+static bool write_restart_bytes(int fd, const void* buf, size_t size);
+
+static bool finish_restart_worker(struct fuzz* t, struct restart_worker* w,
+		bool use, struct restart_best* best, bool* halt);
+
+static bool read_restart_result(
+		struct restart_worker* w, uint8_t** buf, size_t* size);
+
+static bool all_args_autoshrink(const struct fuzz* t);
+
+static bool is_smaller_result(uint8_t arity,
+		struct autoshrink_bit_pool* const* pools,
+		struct autoshrink_bit_pool* const* best_pools);
+
+static void invalidate_memo_contexts(struct fuzz* t, uint8_t changed);
+
 static enum shrink_res attempt_to_shrink_arg(struct fuzz* t, uint8_t arg_i);
 
+static enum shrink_res shrink_pairs(struct fuzz* t);
+
+static enum shrink_res attempt_to_shrink_pair(
+		struct fuzz* t, uint8_t arg_a, uint8_t arg_b);
+
+static bool use_speculation(struct fuzz* t, uint8_t arg_i);
+
+static enum shrink_res attempt_to_shrink_arg_speculatively(
+		struct fuzz* t, uint8_t arg_i);
+
+static void free_candidate(
+		struct fuzz* t, uint8_t arg_i, struct candidate* c);
+
+static bool batch_has_key(const struct candidate* batch, size_t count,
+		const struct fuzz_memo_key* key);
+
+static void free_instance(struct fuzz* t, uint8_t arg_i, void* instance,
+		struct autoshrink_bit_pool* bit_pool);
+
+static bool rebuild_candidate(struct fuzz* t, uint8_t arg_i, void* current,
+		struct candidate* c);
+
+static bool call_candidate(struct fuzz* t, uint8_t arg_i, uint32_t tactic,
+		bool called, int* result);
+
+static struct tactic_order* get_first_tactics(struct fuzz* t, uint8_t arg_i,
+		uint32_t* first, uint8_t* first_count);
+
+static bool get_memo_key(
+		struct fuzz* t, uint8_t arg_i, struct fuzz_memo_key* key);
+
+static struct tactic_order* get_tactic_order(
+		struct fuzz* t, const struct fuzz_type_info* ti);
+
+static uint32_t choose_tactic(const uint32_t* first, uint8_t first_count,
+		uint32_t step, uint32_t* next_tactic);
+
+static void update_tactic_order(
+		struct tactic_order* order, uint32_t tactic, bool success);
+
+static bool reached_shrink_limit(struct fuzz* t);
+
 static int shrink_pre_hook(
 		struct fuzz* t, uint8_t arg_index, void* arg, uint32_t tactic);
 
@@ -30,9 +164,39 @@ static int shrink_trial_post_hook(struct fuzz* t, uint8_t arg_index,
 #define LOG_SHRINK 0
 
 // Attempt to simplify all arguments, breadth first. Continue as long as
-// progress is made, i.e., until a local minimum is reached.
+// progress is made, i.e., until a local minimum is reached. Once no
+// argument can be simplified on its own, try simplifying pairs of
+// autoshrinking arguments together.
 bool
 fuzz_shrink(struct fuzz* t)
+{
+	// Without the memo table, candidates are still shrunk, they just
+	// may be tried more than once.
+	t->trial.memo = fuzz_memo_new();
+	if (t->trial.memo == NULL) {
+		LOG(1 - LOG_SHRINK, "%s: memo alloc failure\n", __func__);
+	}
+	t->trial.shrink_calls      = 0;
+	t->trial.shrink_incomplete = false;
+	if (t->shrink.max_time_ms != 0) {
+		t->trial.shrink_start_ms = fuzz_monotonic_msec();
+	}
+
+	bool res = false;
+	if (t->shrink.restarts > 0 && all_args_autoshrink(t)) {
+		res = shrink_with_restarts(t);
+	} else {
+		res = shrink_args(t) != SHRINK_ERROR;
+	}
+	fuzz_memo_free(t->trial.memo);
+	t->trial.memo = NULL;
+	return res;
+}
+
+// Returns SHRINK_DEAD_END once no argument can be simplified further,
+// SHRINK_HALT if shrinking was stopped early, or SHRINK_ERROR.
+static enum shrink_res
+shrink_args(struct fuzz* t)
 {
 	bool progress = false;
 	assert(t->prop.arity > 0);
@@ -62,7 +226,7 @@ fuzz_shrink(struct fuzz* t)
 				case SHRINK_HALT:
 					LOG(3 - LOG_SHRINK, "%s %u: HALT\n",
 							__func__, arg_i);
-					return true;
+					return SHRINK_HALT;
 				case SHRINK_DEAD_END:
 					LOG(3 - LOG_SHRINK,
 							"%s %u: DEAD END\n",
@@ -72,20 +236,471 @@ fuzz_shrink(struct fuzz* t)
 				case SHRINK_ERROR:
 					LOG(1 - LOG_SHRINK, "%s %u: ERROR\n",
 							__func__, arg_i);
-					return false;
+					return SHRINK_ERROR;
 				}
 			}
 		}
+
+		if (!progress) {
+			// Each argument is at a local minimum on its own,
+			// but arguments that depend on each other may still
+			// shrink together.
+			switch (shrink_pairs(t)) {
+			case SHRINK_OK:
+				progress = true;
+				break;
+			case SHRINK_HALT:
+				return SHRINK_HALT;
+			case SHRINK_DEAD_END:
+				break;
+			default:
+			case SHRINK_ERROR:
+				return SHRINK_ERROR;
+			}
+		}
 	} while (progress);
+	return SHRINK_DEAD_END;
+}
+
+// Try shrinking each pair of autoshrinking arguments together, until
+// one of them makes progress.
+static enum shrink_res
+shrink_pairs(struct fuzz* t)
+{
+	for (uint8_t a = 0; a < t->prop.arity; a++) {
+		if (t->trial.args[a].type != ARG_AUTOSHRINK) {
+			continue;
+		}
+		for (uint8_t b = a + 1; b < t->prop.arity; b++) {
+			if (t->trial.args[b].type != ARG_AUTOSHRINK) {
+				continue;
+			}
+
+			enum shrink_res res = attempt_to_shrink_pair(t, a, b);
+			if (res == SHRINK_OK) {
+				// Keep shrinking this pair, then go back to
+				// shrinking each argument on its own.
+				while (res == SHRINK_OK) {
+					res = attempt_to_shrink_pair(t, a, b);
+				}
+				return (res == SHRINK_DEAD_END ? SHRINK_OK
+							       : res);
+			} else if (res != SHRINK_DEAD_END) {
+				return res;
+			}
+		}
+	}
+	return SHRINK_DEAD_END;
+}
+
+// Shrink from the same failing arguments t->shrink.restarts more times,
+// each with its own random stream, and keep the shortlex-smallest
+// result. Later runs skip autoshrink's deterministic passes, which
+// would only repeat the first run.
+static bool
+shrink_with_restarts(struct fuzz* t)
+{
+	const uint8_t               arity = t->prop.arity;
+	struct autoshrink_bit_pool* start[FUZZ_MAX_ARITY] = {NULL};
+	struct restart_best         best                  = {.have = false};
+	bool                        ok                    = false;
+
+	for (uint8_t i = 0; i < arity; i++) {
+		struct autoshrink_env* env = t->trial.args[i].u.as.env;
+		start[i] = fuzz_autoshrink_copy_bit_pool(env->bit_pool);
+		if (start[i] == NULL) {
+			goto cleanup;
+		}
+	}
+
+	ok = (t->fork.enable ? restart_in_workers(t, start, &best)
+			     : restart_in_turn(t, start, &best));
+
+cleanup:
+	for (uint8_t i = 0; i < arity; i++) {
+		struct arg_info* arg = &t->trial.args[i];
+		if (best.have) {
+			// Put the best arguments back, in place of any left
+			// over from a run that stopped with an error.
+			free_instance(t, i, arg->instance,
+					arg->u.as.env->bit_pool);
+			arg->instance           = best.instances[i];
+			arg->u.as.env->bit_pool = best.pools[i];
+		}
+		if (start[i]) {
+			fuzz_autoshrink_free_bit_pool(t, start[i]);
+		}
+	}
+	return ok;
+}
+
+// Run the restarts one after another. They share the memo table, so
+// candidates that one run already tried are skipped by the later ones.
+static bool
+restart_in_turn(struct fuzz* t, struct autoshrink_bit_pool* const* start,
+		struct restart_best* best)
+{
+	uint32_t contexts[FUZZ_MAX_ARITY];
+	memcpy(contexts, t->trial.memo_context, sizeof(contexts));
+
+	for (size_t run = 0;; run++) {
+		const enum shrink_res res = shrink_args(t);
+		if (res == SHRINK_ERROR) {
+			return false;
+		}
+		keep_smallest(t, best, run);
+		if (res == SHRINK_HALT || run == t->shrink.restarts) {
+			return true;
+		}
+
+		if (!restart_from(t, run + 1, start)) {
+			return false;
+		}
+		memcpy(t->trial.memo_context, contexts, sizeof(contexts));
+	}
+}
+
+// Run up to fork.workers restarts at once, each in its own forked
+// worker, while the first run shrinks the original arguments in this
+// process. Each worker has its own copy of the memo table, and counts
+// its own calls towards shrink.max_calls.
+static bool
+restart_in_workers(struct fuzz* t, struct autoshrink_bit_pool* const* start,
+		struct restart_best* best)
+{
+	assert(FUZZ_POLYFILL_HAVE_FORK);
+	const size_t width = (t->fork.workers == 0 ? 1 : t->fork.workers);
+	size_t       next  = 1;
+	bool         ok    = true;
+	bool         halt  = false;
+	do {
+		struct restart_worker workers[FUZZ_MAX_WORKERS];
+		size_t                started = 0;
+		for (; started < width && next + started <= t->shrink.restarts;
+				started++) {
+			if (!start_restart_worker(t, next + started, start,
+					    &workers[started])) {
+				ok = false;
+				break;
+			}
+		}
+
+		if (next == 1 && ok) {
+			const enum shrink_res res = shrink_args(t);
+			if (res == SHRINK_ERROR) {
+				ok = false;
+			} else {
+				keep_smallest(t, best, 0);
+				halt = (res == SHRINK_HALT);
+			}
+		}
+
+		// Wait for every worker, even once there's been an error.
+		for (size_t w = 0; w < started; w++) {
+			if (!finish_restart_worker(t, &workers[w], ok, best,
+					    &halt)) {
+				ok = false;
+			}
+		}
+		next += started;
+	} while (ok && !halt && next <= t->shrink.restarts);
+	return ok;
+}
+
+// Take the arguments a run ended with, and keep them in BEST if they're
+// the smallest so far.
+static void
+keep_smallest(struct fuzz* t, struct restart_best* best, size_t run)
+{
+	const uint8_t               arity = t->prop.arity;
+	struct autoshrink_bit_pool* pools[FUZZ_MAX_ARITY];
+	for (uint8_t i = 0; i < arity; i++) {
+		pools[i] = t->trial.args[i].u.as.env->bit_pool;
+	}
+	const bool keep = !best->have ||
+			  is_smaller_result(arity, pools, best->pools);
+	LOG(2 - LOG_SHRINK, "%s: run %zd done, keep? %d\n", __func__, run,
+			keep);
+	for (uint8_t i = 0; i < arity; i++) {
+		struct arg_info* arg = &t->trial.args[i];
+		if (keep) {
+			free_instance(t, i, best->instances[i], best->pools[i]);
+			best->instances[i] = arg->instance;
+			best->pools[i]     = pools[i];
+		} else {
+			free_instance(t, i, arg->instance, pools[i]);
+		}
+		arg->instance           = NULL;
+		arg->u.as.env->bit_pool = NULL;
+	}
+	best->have = true;
+}
+
+// Start over from the bit pools in START, with the random stream for
+// RUN, in place of the current arguments.
+static bool
+restart_from(struct fuzz* t, size_t run,
+		struct autoshrink_bit_pool* const* start)
+{
+	fuzz_random_set_seed(t, t->trial.seed + run);
+	for (uint8_t i = 0; i < t->prop.arity; i++) {
+		struct arg_info*       arg = &t->trial.args[i];
+		struct autoshrink_env* env = arg->u.as.env;
+		free_instance(t, i, arg->instance, env->bit_pool);
+		arg->instance = NULL;
+		env->bit_pool = NULL;
+		if (fuzz_autoshrink_restart(t, env, start[i], &arg->instance,
+				    &env->bit_pool) != FUZZ_RESULT_OK) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Fork a worker to shrink from the bit pools in START, with the random
+// stream for RUN. It sends back its counters, then the consumed bits of
+// each argument it ended with.
+static bool
+start_restart_worker(struct fuzz* t, size_t run,
+		struct autoshrink_bit_pool* const* start,
+		struct restart_worker* w)
+{
+	*w = (struct restart_worker){.run = run, .fd = -1};
+	int fds[2];
+	if (pipe(fds) == -1) {
+		perror("pipe");
+		return false;
+	}
+	fflush(t->out);
+	const pid_t pid = fork();
+	if (pid == -1) {
+		perror("fork");
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	} else if (pid == 0) {
+		close(fds[0]);
+		const struct trial_info before = t->trial;
+		enum shrink_res         res    = SHRINK_ERROR;
+		if (restart_from(t, run, start)) {
+			res = shrink_args(t);
+		}
+		if (res == SHRINK_ERROR) {
+			_exit(EXIT_FAILURE);
+		}
+
+		uint64_t flags = 0;
+		if (t->trial.shrink_incomplete) {
+			flags |= RESTART_INCOMPLETE;
+		}
+		if (res == SHRINK_HALT) {
+			flags |= RESTART_HALT;
+		}
+		const uint64_t header[RESTART_HEADER_WORDS] = {
+				t->trial.shrink_count - before.shrink_count,
+				t->trial.successful_shrinks -
+						before.successful_shrinks,
+				t->trial.failed_shrinks - before.failed_shrinks,
+				t->trial.shrink_calls - before.shrink_calls,
+				flags,
+		};
+		bool ok = write_restart_bytes(fds[1], header, sizeof(header));
+		for (uint8_t i = 0; ok && i < t->prop.arity; i++) {
+			ok = write_restart_pool(fds[1],
+					t->trial.args[i].u.as.env->bit_pool);
+		}
+		_exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	close(fds[1]);
+	w->pid = pid;
+	w->fd  = fds[0];
+	return true;
+}
+
+// Send POOL's consumed bit count, then its consumed bits, in the
+// little-endian byte order fuzz_autoshrink_alloc_from_bits expects.
+static bool
+write_restart_pool(int fd, const struct autoshrink_bit_pool* pool)
+{
+	const uint64_t  consumed = pool->consumed;
+	const uint64_t* words    = (const uint64_t*)pool->bits;
+	const size_t    bytes    = (pool->consumed + 7) / 8;
+	uint8_t*        buf      = malloc(bytes > 0 ? bytes : 1);
+	if (buf == NULL) {
+		return false;
+	}
+	for (size_t b = 0; b < bytes; b++) {
+		buf[b] = (uint8_t)(words[b / 8] >> (8 * (b % 8)));
+	}
+	const bool ok = write_restart_bytes(fd, &consumed, sizeof(consumed)) &&
+			write_restart_bytes(fd, buf, bytes);
+	free(buf);
+	return ok;
+}
+
+static bool
+write_restart_bytes(int fd, const void* buf, size_t size)
+{
+	const uint8_t* b = buf;
+	while (size > 0) {
+		const ssize_t wr = write(fd, b, size);
+		if (wr == -1 && errno == EINTR) {
+			continue;
+		} else if (wr <= 0) {
+			return false;
+		}
+		b += wr;
+		size -= (size_t)wr;
+	}
+	return true;
+}
+
+// Wait for restart worker W to finish. If USE is set, rebuild the
+// arguments it ended with, keep them in BEST if they're the smallest
+// so far, and add its counters to this trial's. Sets *HALT if the
+// worker stopped shrinking early.
+static bool
+finish_restart_worker(struct fuzz* t, struct restart_worker* w, bool use,
+		struct restart_best* best, bool* halt)
+{
+	uint8_t* buf  = NULL;
+	size_t   size = 0;
+	bool     ok   = read_restart_result(w, &buf, &size);
+	if (!ok || !use) {
+		free(buf);
+		return ok;
+	}
+
+	uint64_t header[RESTART_HEADER_WORDS];
+	size_t   offset = sizeof(header);
+	ok              = (size >= offset);
+	if (ok) {
+		memcpy(header, buf, sizeof(header));
+	}
+	for (uint8_t i = 0; ok && i < t->prop.arity; i++) {
+		struct arg_info* arg      = &t->trial.args[i];
+		uint64_t         consumed = 0;
+		if (size - offset < sizeof(consumed)) {
+			ok = false;
+			break;
+		}
+		memcpy(&consumed, &buf[offset], sizeof(consumed));
+		offset += sizeof(consumed);
+		if ((size - offset) * 8 < consumed) {
+			ok = false;
+			break;
+		}
+		ok = fuzz_autoshrink_alloc_from_bits(t, arg->u.as.env,
+				     &buf[offset], (size_t)consumed,
+				     &arg->instance) == FUZZ_RESULT_OK;
+		offset += (size_t)(consumed + 7) / 8;
+	}
+	free(buf);
+	if (!ok || offset != size) {
+		LOG(1 - LOG_SHRINK, "%s: bad result from restart %zd\n",
+				__func__, w->run);
+		return false;
+	}
+
+	t->trial.shrink_count += (size_t)header[0];
+	t->trial.successful_shrinks += (size_t)header[1];
+	t->trial.failed_shrinks += (size_t)header[2];
+	t->trial.shrink_calls += (size_t)header[3];
+	if (header[4] & RESTART_INCOMPLETE) {
+		t->trial.shrink_incomplete = true;
+	}
+	if (header[4] & RESTART_HALT) {
+		*halt = true;
+	}
+	keep_smallest(t, best, w->run);
+	return true;
+}
+
+// Read everything restart worker W sends into a new buffer, then wait
+// for it to exit. Returns false if it failed, or crashed.
+static bool
+read_restart_result(struct restart_worker* w, uint8_t** buf, size_t* size)
+{
+	uint8_t* b    = NULL;
+	size_t   cap  = 0;
+	size_t   used = 0;
+	bool     ok   = true;
+	for (;;) {
+		if (used == cap) {
+			const size_t nsize = (cap == 0 ? 4096 : 2 * cap);
+			uint8_t*     nb    = realloc(b, nsize);
+			if (nb == NULL) {
+				ok = false;
+				break;
+			}
+			b   = nb;
+			cap = nsize;
+		}
+		const ssize_t rd = read(w->fd, &b[used], cap - used);
+		if (rd == -1 && errno == EINTR) {
+			continue;
+		} else if (rd <= 0) {
+			ok = (rd == 0);
+			break;
+		}
+		used += (size_t)rd;
+	}
+	close(w->fd);
+
+	// It may already have been waited for along with the property's
+	// workers, so only a status that was actually collected counts.
+	int wstatus = 0;
+	if (waitpid(w->pid, &wstatus, 0) == w->pid &&
+			(!WIFEXITED(wstatus) ||
+					WEXITSTATUS(wstatus) != EXIT_SUCCESS)) {
+		ok = false;
+	}
+	*buf  = b;
+	*size = used;
+	return ok;
+}
+
+static bool
+all_args_autoshrink(const struct fuzz* t)
+{
+	for (uint8_t i = 0; i < t->prop.arity; i++) {
+		if (t->trial.args[i].type != ARG_AUTOSHRINK) {
+			return false;
+		}
+	}
 	return true;
 }
 
+// Are POOLS, the bit pools for each argument, shortlex-smaller than
+// BEST_POOLS? Earlier arguments are compared first.
+static bool
+is_smaller_result(uint8_t arity, struct autoshrink_bit_pool* const* pools,
+		struct autoshrink_bit_pool* const* best_pools)
+{
+	for (uint8_t i = 0; i < arity; i++) {
+		const struct autoshrink_bit_pool* a = pools[i];
+		const struct autoshrink_bit_pool* b = best_pools[i];
+		if (fuzz_autoshrink_bit_pool_is_smaller(a, b)) {
+			return true;
+		} else if (fuzz_autoshrink_bit_pool_is_smaller(b, a)) {
+			return false;
+		}
+	}
+	return false;
+}
+
 // Simplify an argument by trying all of its simplification tactics, in
 // order, and checking whether the property still fails. If it passes,
 // then revert the simplification and try another tactic.
 //
-// If the bloom filter is being used (i.e., if all arguments have hash
-// callbacks defined), then use it to skip over areas of the state
+// For shrink callbacks, tactics that have made progress recently are
+// tried first, then the rest of them in order, so every tactic is still
+// tried before reaching a dead end.
+//
+// Candidates that were already tried are skipped, using the memo table
+// (for autoshrinking arguments, or arguments with a hash callback). If
+// the bloom filter is being used (i.e., if all arguments have hash
+// callbacks defined), then also use it to skip over areas of the state
 // space that have probably already been tried.
 static enum shrink_res
 attempt_to_shrink_arg(struct fuzz* t, uint8_t arg_i)
@@ -93,9 +708,36 @@ attempt_to_shrink_arg(struct fuzz* t, uint8_t arg_i)
 	struct fuzz_type_info* ti             = t->prop.type_info[arg_i];
 	const bool             use_autoshrink = ti->autoshrink_config.enable;
 
-	for (uint32_t tactic = 0; tactic < FUZZ_MAX_TACTICS; tactic++) {
+	// The current instance is known to fail, so don't try it again.
+	struct fuzz_memo_key memo_key;
+	if (get_memo_key(t, arg_i, &memo_key)) {
+		(void)fuzz_memo_put(
+				t->trial.memo, &memo_key, FUZZ_RESULT_FAIL);
+	}
+
+	uint32_t             first[TACTIC_ORDER_CEIL];
+	uint8_t              first_count = 0;
+	struct tactic_order* order       = get_first_tactics(
+			t, arg_i, first, &first_count);
+
+	uint32_t next_tactic = 0;
+	for (uint32_t step = 0; step < FUZZ_MAX_TACTICS; step++) {
+		if (use_speculation(t, arg_i)) {
+			return attempt_to_shrink_arg_speculatively(t, arg_i);
+		}
+
+		const uint32_t tactic = choose_tactic(
+				first, first_count, step, &next_tactic);
 		LOG(2 - LOG_SHRINK, "SHRINKING arg %u, tactic %u\n", arg_i,
 				tactic);
+		if (reached_shrink_limit(t)) {
+			// Stop here, and report the current arguments, which
+			// are the smallest known to fail.
+			LOG(2 - LOG_SHRINK, "%s: reached shrink limit\n",
+					__func__);
+			t->trial.shrink_incomplete = true;
+			return SHRINK_HALT;
+		}
 		void* current   = t->trial.args[arg_i].instance;
 		void* candidate = NULL;
 
@@ -107,6 +749,11 @@ attempt_to_shrink_arg(struct fuzz* t, uint8_t arg_i)
 			return SHRINK_ERROR;
 		}
 
+		// Anything the candidate allocates from the arena is
+		// released again unless it's kept.
+		const struct fuzz_arena_mark mark =
+				fuzz_arena_get_mark(t->arena);
+
 		struct autoshrink_env*      as_env             = NULL;
 		struct autoshrink_bit_pool* current_bit_pool   = NULL;
 		struct autoshrink_bit_pool* candidate_bit_pool = NULL;
@@ -135,9 +782,7 @@ attempt_to_shrink_arg(struct fuzz* t, uint8_t arg_i)
 				sres == FUZZ_SHRINK_OK ? candidate : current,
 				tactic, sres);
 		if (shrink_post_res != FUZZ_HOOK_RUN_CONTINUE) {
-			if (ti->free) {
-				ti->free(candidate, ti->env);
-			}
+			fuzz_trial_release_instance(t, arg_i, candidate);
 			if (candidate_bit_pool) {
 				fuzz_autoshrink_free_bit_pool(
 						t, candidate_bit_pool);
@@ -149,8 +794,13 @@ attempt_to_shrink_arg(struct fuzz* t, uint8_t arg_i)
 		case FUZZ_SHRINK_OK:
 			break;
 		case FUZZ_SHRINK_DEAD_END:
+			fuzz_arena_reset(t->arena, mark);
 			continue; // try next tactic
 		case FUZZ_SHRINK_NO_MORE_TACTICS:
+			fuzz_arena_reset(t->arena, mark);
+			if (step < first_count) {
+				continue; // not out of tactics in order yet
+			}
 			return SHRINK_DEAD_END;
 		case FUZZ_SHRINK_ERROR:
 		default:
@@ -162,73 +812,47 @@ attempt_to_shrink_arg(struct fuzz* t, uint8_t arg_i)
 			as_env->bit_pool = candidate_bit_pool;
 		}
 
-		if (t->bloom) {
-			if (fuzz_call_check_called(t)) {
-				LOG(3 - LOG_SHRINK,
-						"%s: already called, "
-						"skipping\n",
-						__func__);
-				if (ti->free) {
-					ti->free(candidate, ti->env);
-				}
-				if (use_autoshrink) {
-					as_env->bit_pool = current_bit_pool;
-					fuzz_autoshrink_free_bit_pool(
-							t, candidate_bit_pool);
-				}
-				t->trial.args[arg_i].instance = current;
-				continue;
-			} else {
-				fuzz_call_mark_called(t);
+		const bool use_memo = get_memo_key(t, arg_i, &memo_key);
+		if ((use_memo && fuzz_memo_get(t->trial.memo, &memo_key,
+						 NULL)) ||
+				(t->bloom && fuzz_call_check_called(t))) {
+			LOG(3 - LOG_SHRINK, "%s: already called, skipping\n",
+					__func__);
+			fuzz_trial_release_instance(t, arg_i, candidate);
+			if (use_autoshrink) {
+				as_env->bit_pool = current_bit_pool;
+				fuzz_autoshrink_free_bit_pool(
+						t, candidate_bit_pool);
 			}
+			t->trial.args[arg_i].instance = current;
+			fuzz_arena_reset(t->arena, mark);
+			continue;
+		} else if (t->bloom) {
+			fuzz_call_mark_called(t);
 		}
 
-		int  res;
-		bool repeated = false;
-		for (;;) {
-			void* args[FUZZ_MAX_ARITY];
-			fuzz_trial_get_args(t, args);
-
-			res = fuzz_call(t, args);
-			LOG(3 - LOG_SHRINK, "%s: call -> res %d\n", __func__,
-					res);
-
-			if (!repeated) {
-				if (res == FUZZ_RESULT_FAIL) {
-					t->trial.successful_shrinks++;
-					fuzz_autoshrink_update_model(
-							t, arg_i, res, 3);
-				} else {
-					t->trial.failed_shrinks++;
-				}
+		int res;
+		if (!call_candidate(t, arg_i, tactic, false, &res)) {
+			fuzz_trial_release_instance(t, arg_i, current);
+			if (use_autoshrink && current_bit_pool) {
+				fuzz_autoshrink_free_bit_pool(
+						t, current_bit_pool);
 			}
+			return SHRINK_ERROR;
+		}
 
-			int stpres;
-			stpres = shrink_trial_post_hook(
-					t, arg_i, args, tactic, res);
-			if (stpres == FUZZ_HOOK_RUN_REPEAT ||
-					(stpres == FUZZ_HOOK_RUN_REPEAT_ONCE &&
-							!repeated)) {
-				repeated = true;
-				continue; // loop and run again
-			} else if (stpres == FUZZ_HOOK_RUN_REPEAT_ONCE &&
-					repeated) {
-				break;
-			} else if (stpres == FUZZ_HOOK_RUN_CONTINUE) {
-				break;
-			} else {
-				if (ti->free) {
-					ti->free(current, ti->env);
-				}
-				if (use_autoshrink && current_bit_pool) {
-					fuzz_autoshrink_free_bit_pool(
-							t, current_bit_pool);
-				}
-				return SHRINK_ERROR;
+		if (use_memo) {
+			if (!fuzz_memo_put(t->trial.memo, &memo_key, res)) {
+				LOG(1 - LOG_SHRINK, "%s: memo alloc failure\n",
+						__func__);
 			}
 		}
 
 		fuzz_autoshrink_update_model(t, arg_i, res, 8);
+		if (order != NULL && res != FUZZ_RESULT_ERROR) {
+			const bool progress = (res == FUZZ_RESULT_FAIL);
+			update_tactic_order(order, tactic, progress);
+		}
 
 		switch (res) {
 		case FUZZ_RESULT_OK:
@@ -248,9 +872,8 @@ attempt_to_shrink_arg(struct fuzz* t, uint8_t arg_i)
 				t->trial.args[arg_i].u.as.env->bit_pool =
 						current_bit_pool;
 			}
-			if (ti->free) {
-				ti->free(candidate, ti->env);
-			}
+			fuzz_trial_release_instance(t, arg_i, candidate);
+			fuzz_arena_reset(t->arena, mark);
 			break;
 		case FUZZ_RESULT_FAIL:
 			LOG(2 - LOG_SHRINK,
@@ -268,15 +891,14 @@ attempt_to_shrink_arg(struct fuzz* t, uint8_t arg_i)
 						t, current_bit_pool);
 			}
 			assert(t->trial.args[arg_i].instance == candidate);
-			if (ti->free) {
-				ti->free(current, ti->env);
-			}
+			fuzz_trial_release_instance(t, arg_i, current);
+			// Results memoized for the other arguments were
+			// with this argument's old value.
+			invalidate_memo_contexts(t, arg_i);
 			return SHRINK_OK;
 		default:
 		case FUZZ_RESULT_ERROR:
-			if (ti->free) {
-				ti->free(current, ti->env);
-			}
+			fuzz_trial_release_instance(t, arg_i, current);
 			if (use_autoshrink) {
 				fuzz_autoshrink_free_bit_pool(
 						t, current_bit_pool);
@@ -288,6 +910,687 @@ attempt_to_shrink_arg(struct fuzz* t, uint8_t arg_i)
 	return SHRINK_DEAD_END;
 }
 
+// Should candidates for this argument be built several at a time and
+// run at once, in separate workers?
+static bool
+use_speculation(struct fuzz* t, uint8_t arg_i)
+{
+	if (!t->fork.enable || t->fork.workers < 2) {
+		return false;
+	}
+	if (t->trial.args[arg_i].type == ARG_AUTOSHRINK) {
+		// Each deterministic pass's next candidate depends on
+		// whether the last one was accepted, so only the random
+		// mutations after them can be built ahead of time.
+		const struct autoshrink_env* env =
+				t->trial.args[arg_i].u.as.env;
+		return env->passes.pass == PASS_DONE &&
+		       env->model.next_action == 0x00;
+	}
+	return true;
+}
+
+// Like attempt_to_shrink_arg, but build up to t->fork.workers candidates
+// from the current instance, then run them all at once in forked
+// workers. Each candidate's result is recorded as if they had been run
+// one at a time, then the smallest one that still fails is kept: the
+// first in tactic order, or the shortlex-smallest bit pool when
+// autoshrinking. Since which candidates are built doesn't depend on
+// timing, shrinking is still deterministic for a given seed.
+static enum shrink_res
+attempt_to_shrink_arg_speculatively(struct fuzz* t, uint8_t arg_i)
+{
+	struct fuzz_type_info* ti             = t->prop.type_info[arg_i];
+	const bool             use_autoshrink = ti->autoshrink_config.enable;
+	void* const            current        = t->trial.args[arg_i].instance;
+	struct autoshrink_env* as_env         = NULL;
+	struct autoshrink_bit_pool* current_bit_pool = NULL;
+	if (use_autoshrink) {
+		as_env           = t->trial.args[arg_i].u.as.env;
+		current_bit_pool = as_env->bit_pool;
+	}
+
+	uint32_t             first[TACTIC_ORDER_CEIL];
+	uint8_t              first_count = 0;
+	struct tactic_order* order       = get_first_tactics(
+			t, arg_i, first, &first_count);
+
+	struct candidate batch[FUZZ_MAX_WORKERS];
+	size_t           count          = 0;
+	enum shrink_res  res            = SHRINK_DEAD_END;
+	uint32_t         next_tactic    = 0;
+	uint32_t         step           = 0;
+	bool             out_of_tactics = false;
+	while (!out_of_tactics) {
+		const struct fuzz_arena_mark mark =
+				fuzz_arena_get_mark(t->arena);
+
+		// Don't build more candidates than the call limit allows.
+		size_t width = t->fork.workers;
+		if (t->shrink.max_calls != 0 &&
+				t->trial.shrink_calls < t->shrink.max_calls &&
+				t->shrink.max_calls - t->trial.shrink_calls <
+						width) {
+			width = t->shrink.max_calls - t->trial.shrink_calls;
+		}
+
+		for (; count < width && !out_of_tactics; step++) {
+			if (step == FUZZ_MAX_TACTICS) {
+				out_of_tactics = true;
+				break;
+			}
+			const uint32_t tactic = choose_tactic(first,
+					first_count, step, &next_tactic);
+			if (reached_shrink_limit(t)) {
+				t->trial.shrink_incomplete = true;
+				res                        = SHRINK_HALT;
+				goto cleanup;
+			}
+
+			int shrink_pre_res;
+			shrink_pre_res = shrink_pre_hook(
+					t, arg_i, current, tactic);
+			if (shrink_pre_res == FUZZ_HOOK_RUN_HALT) {
+				res = SHRINK_HALT;
+				goto cleanup;
+			} else if (shrink_pre_res != FUZZ_HOOK_RUN_CONTINUE) {
+				res = SHRINK_ERROR;
+				goto cleanup;
+			}
+
+			struct candidate* c = &batch[count];
+			c->tactic           = tactic;
+			c->instance         = NULL;
+			c->bit_pool         = NULL;
+
+			int sres;
+			if (use_autoshrink) {
+				sres = fuzz_autoshrink_shrink(t, as_env,
+						tactic, &c->instance,
+						&c->bit_pool);
+			} else {
+				sres = ti->shrink(t, current, tactic, ti->env,
+						&c->instance);
+			}
+			t->trial.shrink_count++;
+
+			void* shrunk = (sres == FUZZ_SHRINK_OK ? c->instance
+							       : current);
+			int   shrink_post_res;
+			shrink_post_res = shrink_post_hook(
+					t, arg_i, shrunk, tactic, sres);
+			if (shrink_post_res != FUZZ_HOOK_RUN_CONTINUE) {
+				if (sres == FUZZ_SHRINK_OK) {
+					free_candidate(t, arg_i, c);
+				}
+				res = SHRINK_ERROR;
+				goto cleanup;
+			}
+
+			switch (sres) {
+			case FUZZ_SHRINK_OK:
+				break;
+			case FUZZ_SHRINK_DEAD_END:
+				continue; // try next tactic
+			case FUZZ_SHRINK_NO_MORE_TACTICS:
+				if (step >= first_count) {
+					out_of_tactics = true;
+				}
+				continue;
+			case FUZZ_SHRINK_ERROR:
+			default:
+				res = SHRINK_ERROR;
+				goto cleanup;
+			}
+
+			// Skip candidates that were already tried, or that
+			// are already in this batch.
+			t->trial.args[arg_i].instance = c->instance;
+			if (use_autoshrink) {
+				as_env->bit_pool = c->bit_pool;
+				c->tried         = as_env->model.cur_tried;
+				c->set           = as_env->model.cur_set;
+			}
+			c->use_memo = get_memo_key(t, arg_i, &c->memo_key);
+			bool seen   = false;
+			if (c->use_memo) {
+				seen = fuzz_memo_get(t->trial.memo,
+						       &c->memo_key, NULL) ||
+				       batch_has_key(batch, count,
+						       &c->memo_key);
+			}
+			if (!seen && t->bloom) {
+				seen = fuzz_call_check_called(t);
+			}
+			if (!seen) {
+				if (t->bloom) {
+					fuzz_call_mark_called(t);
+				}
+				fuzz_trial_get_args(t, c->args);
+			}
+			t->trial.args[arg_i].instance = current;
+			if (use_autoshrink) {
+				as_env->bit_pool = current_bit_pool;
+			}
+
+			if (seen) {
+				LOG(3 - LOG_SHRINK, "%s: already tried\n",
+						__func__);
+				free_candidate(t, arg_i, c);
+			} else {
+				count++;
+			}
+		}
+
+		if (count == 0) {
+			continue;
+		}
+
+		void** args[FUZZ_MAX_WORKERS];
+		int    results[FUZZ_MAX_WORKERS];
+		for (size_t i = 0; i < count; i++) {
+			args[i] = batch[i].args;
+		}
+		LOG(2 - LOG_SHRINK, "SHRINKING arg %u, %zd at once\n", arg_i,
+				count);
+		if (!fuzz_call_batch(t, count, args, results)) {
+			res = SHRINK_ERROR;
+			goto cleanup;
+		}
+		t->trial.shrink_calls += count;
+
+		// Record each result in order, the same way as if the
+		// candidates had been run one at a time.
+		size_t best = count;
+		for (size_t i = 0; i < count; i++) {
+			struct candidate* c = &batch[i];
+			t->trial.args[arg_i].instance = c->instance;
+			if (use_autoshrink) {
+				as_env->bit_pool        = c->bit_pool;
+				as_env->model.cur_tried = c->tried;
+				as_env->model.cur_set   = c->set;
+			}
+
+			int        cres = results[i];
+			const bool ok   = call_candidate(
+					t, arg_i, c->tactic, true, &cres);
+			t->trial.args[arg_i].instance = current;
+			if (use_autoshrink) {
+				as_env->bit_pool = current_bit_pool;
+			}
+			if (!ok) {
+				res = SHRINK_ERROR;
+				goto cleanup;
+			}
+
+			if (c->use_memo) {
+				if (!fuzz_memo_put(t->trial.memo, &c->memo_key,
+						    cres)) {
+					LOG(1 - LOG_SHRINK,
+							"%s: memo alloc "
+							"failure\n",
+							__func__);
+				}
+			}
+			fuzz_autoshrink_update_model(t, arg_i, cres, 8);
+			if (order != NULL && cres != FUZZ_RESULT_ERROR) {
+				update_tactic_order(order, c->tactic,
+						cres == FUZZ_RESULT_FAIL);
+			}
+
+			if (cres == FUZZ_RESULT_OK ||
+					cres == FUZZ_RESULT_SKIP) {
+				continue;
+			} else if (cres != FUZZ_RESULT_FAIL) {
+				res = SHRINK_ERROR;
+				goto cleanup;
+			}
+
+			if (best == count) {
+				best = i;
+			} else if (use_autoshrink) {
+				const struct candidate* b = &batch[best];
+				if (fuzz_autoshrink_bit_pool_is_smaller(
+						    c->bit_pool,
+						    b->bit_pool)) {
+					best = i;
+				}
+			}
+		}
+
+		if (best < count) {
+			struct candidate* c = &batch[best];
+			LOG(2 - LOG_SHRINK, "FAIL: COMMITTING %u: tactic %u\n",
+					arg_i, c->tactic);
+
+			// The other candidates may have allocated from the
+			// arena after this one, so release the whole batch
+			// and build this one again from the mark.
+			for (size_t i = 0; i < count; i++) {
+				if (i != best) {
+					free_candidate(t, arg_i, &batch[i]);
+				}
+			}
+			batch[0] = *c;
+			c        = &batch[0];
+			count    = 1;
+			fuzz_trial_release_instance(t, arg_i, c->instance);
+			c->instance = NULL;
+			fuzz_arena_reset(t->arena, mark);
+			if (!rebuild_candidate(t, arg_i, current, c)) {
+				res = SHRINK_ERROR;
+				goto cleanup;
+			}
+
+			t->trial.args[arg_i].instance = c->instance;
+			if (use_autoshrink) {
+				as_env->bit_pool = c->bit_pool;
+				fuzz_autoshrink_free_bit_pool(
+						t, current_bit_pool);
+			}
+			fuzz_trial_release_instance(t, arg_i, current);
+			c->instance = NULL;
+			c->bit_pool = NULL;
+
+			// Results memoized for the other arguments were
+			// with this argument's old value.
+			invalidate_memo_contexts(t, arg_i);
+			res = SHRINK_OK;
+			goto cleanup;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			free_candidate(t, arg_i, &batch[i]);
+		}
+		count = 0;
+		fuzz_arena_reset(t->arena, mark);
+	}
+
+cleanup:
+	for (size_t i = 0; i < count; i++) {
+		free_candidate(t, arg_i, &batch[i]);
+	}
+	return res;
+}
+
+// Build the instance for candidate C again, after the arena was reset
+// to before it was first built. An autoshrink candidate gets a new bit
+// pool too, since allocating records the requests again.
+static bool
+rebuild_candidate(struct fuzz* t, uint8_t arg_i, void* current,
+		struct candidate* c)
+{
+	struct fuzz_type_info* ti = t->prop.type_info[arg_i];
+	if (!ti->autoshrink_config.enable) {
+		return ti->shrink(t, current, c->tactic, ti->env,
+				       &c->instance) == FUZZ_SHRINK_OK;
+	}
+
+	struct autoshrink_env*      env  = t->trial.args[arg_i].u.as.env;
+	struct autoshrink_bit_pool* pool = NULL;
+	const int ares = fuzz_autoshrink_alloc_copy(
+			t, env, c->bit_pool, &c->instance, &pool);
+	fuzz_autoshrink_free_bit_pool(t, c->bit_pool);
+	c->bit_pool = pool;
+	return ares == FUZZ_RESULT_OK;
+}
+
+static void
+free_candidate(struct fuzz* t, uint8_t arg_i, struct candidate* c)
+{
+	free_instance(t, arg_i, c->instance, c->bit_pool);
+	c->instance = NULL;
+	c->bit_pool = NULL;
+}
+
+// Is a candidate with memo key KEY among the first COUNT in BATCH?
+static bool
+batch_has_key(const struct candidate* batch, size_t count,
+		const struct fuzz_memo_key* key)
+{
+	for (size_t i = 0; i < count; i++) {
+		const struct fuzz_memo_key* other = &batch[i].memo_key;
+		if (batch[i].use_memo && other->hash == key->hash &&
+				other->size == key->size &&
+				other->context == key->context &&
+				other->arg_i == key->arg_i) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Free an argument instance and its bit pool, either of which can be
+// NULL.
+static void
+free_instance(struct fuzz* t, uint8_t arg_i, void* instance,
+		struct autoshrink_bit_pool* bit_pool)
+{
+	fuzz_trial_release_instance(t, arg_i, instance);
+	if (bit_pool) {
+		fuzz_autoshrink_free_bit_pool(t, bit_pool);
+	}
+}
+
+// Simplify two autoshrinking arguments at once, trying each of the
+// joint moves from fuzz_autoshrink_joint_shrink until one keeps the
+// property failing. The shrink hooks are called with ARG_A.
+static enum shrink_res
+attempt_to_shrink_pair(struct fuzz* t, uint8_t arg_a, uint8_t arg_b)
+{
+	struct autoshrink_env* env_a = t->trial.args[arg_a].u.as.env;
+	struct autoshrink_env* env_b = t->trial.args[arg_b].u.as.env;
+
+	for (uint32_t tactic = 0; tactic < FUZZ_MAX_TACTICS; tactic++) {
+		LOG(2 - LOG_SHRINK, "SHRINKING args %u and %u, tactic %u\n",
+				arg_a, arg_b, tactic);
+		if (reached_shrink_limit(t)) {
+			t->trial.shrink_incomplete = true;
+			return SHRINK_HALT;
+		}
+
+		void* current_a = t->trial.args[arg_a].instance;
+		void* current_b = t->trial.args[arg_b].instance;
+		struct autoshrink_bit_pool* current_pool_a = env_a->bit_pool;
+		struct autoshrink_bit_pool* current_pool_b = env_b->bit_pool;
+
+		int shrink_pre_res;
+		shrink_pre_res = shrink_pre_hook(t, arg_a, current_a, tactic);
+		if (shrink_pre_res == FUZZ_HOOK_RUN_HALT) {
+			return SHRINK_HALT;
+		} else if (shrink_pre_res != FUZZ_HOOK_RUN_CONTINUE) {
+			return SHRINK_ERROR;
+		}
+
+		const struct fuzz_arena_mark mark =
+				fuzz_arena_get_mark(t->arena);
+		void*                       candidate_a = NULL;
+		void*                       candidate_b = NULL;
+		struct autoshrink_bit_pool* pool_a      = NULL;
+		struct autoshrink_bit_pool* pool_b      = NULL;
+		int sres = fuzz_autoshrink_joint_shrink(t, env_a, env_b,
+				tactic, &candidate_a, &pool_a, &candidate_b,
+				&pool_b);
+		t->trial.shrink_count++;
+
+		int shrink_post_res;
+		void* shrunk = (sres == FUZZ_SHRINK_OK ? candidate_a
+						       : current_a);
+		shrink_post_res = shrink_post_hook(
+				t, arg_a, shrunk, tactic, sres);
+		if (shrink_post_res != FUZZ_HOOK_RUN_CONTINUE) {
+			sres = FUZZ_SHRINK_ERROR;
+		}
+
+		switch (sres) {
+		case FUZZ_SHRINK_OK:
+			break;
+		case FUZZ_SHRINK_DEAD_END:
+			fuzz_arena_reset(t->arena, mark);
+			continue; // try next tactic
+		case FUZZ_SHRINK_NO_MORE_TACTICS:
+			fuzz_arena_reset(t->arena, mark);
+			return SHRINK_DEAD_END;
+		case FUZZ_SHRINK_ERROR:
+		default:
+			if (pool_a) {
+				fuzz_trial_release_instance(
+						t, arg_a, candidate_a);
+				fuzz_trial_release_instance(
+						t, arg_b, candidate_b);
+				fuzz_autoshrink_free_bit_pool(t, pool_a);
+				fuzz_autoshrink_free_bit_pool(t, pool_b);
+			}
+			return SHRINK_ERROR;
+		}
+
+		t->trial.args[arg_a].instance = candidate_a;
+		t->trial.args[arg_b].instance = candidate_b;
+		env_a->bit_pool               = pool_a;
+		env_b->bit_pool               = pool_b;
+
+		int res = FUZZ_RESULT_SKIP;
+		if (t->bloom && fuzz_call_check_called(t)) {
+			LOG(3 - LOG_SHRINK, "%s: already called, skipping\n",
+					__func__);
+		} else {
+			if (t->bloom) {
+				fuzz_call_mark_called(t);
+			}
+			if (!call_candidate(t, arg_a, tactic, false, &res)) {
+				res = FUZZ_RESULT_ERROR;
+			}
+		}
+
+		if (res == FUZZ_RESULT_FAIL) {
+			// Commit both, and drop all memoized results, since
+			// they were with the old values.
+			fuzz_trial_release_instance(t, arg_a, current_a);
+			fuzz_trial_release_instance(t, arg_b, current_b);
+			fuzz_autoshrink_free_bit_pool(t, current_pool_a);
+			fuzz_autoshrink_free_bit_pool(t, current_pool_b);
+			invalidate_memo_contexts(t, FUZZ_MAX_ARITY);
+			return SHRINK_OK;
+		}
+
+		t->trial.args[arg_a].instance = current_a;
+		t->trial.args[arg_b].instance = current_b;
+		env_a->bit_pool               = current_pool_a;
+		env_b->bit_pool               = current_pool_b;
+		fuzz_trial_release_instance(t, arg_a, candidate_a);
+		fuzz_trial_release_instance(t, arg_b, candidate_b);
+		fuzz_autoshrink_free_bit_pool(t, pool_a);
+		fuzz_autoshrink_free_bit_pool(t, pool_b);
+		fuzz_arena_reset(t->arena, mark);
+		if (res == FUZZ_RESULT_ERROR) {
+			return SHRINK_ERROR;
+		}
+	}
+	return SHRINK_DEAD_END;
+}
+
+// Run the property with the current arguments, repeating it if the
+// post-shrink-trial hook asks to. If CALLED, the first call has already
+// been made and its result is in *RESULT. Returns false if the hook
+// failed.
+static bool
+call_candidate(struct fuzz* t, uint8_t arg_i, uint32_t tactic, bool called,
+		int* result)
+{
+	bool repeated = false;
+	for (;;) {
+		void* args[FUZZ_MAX_ARITY];
+		fuzz_trial_get_args(t, args);
+
+		if (!called || repeated) {
+			*result = fuzz_call(t, args);
+			t->trial.shrink_calls++;
+		}
+		const int res = *result;
+		LOG(3 - LOG_SHRINK, "%s: call -> res %d\n", __func__, res);
+
+		if (!repeated) {
+			if (res == FUZZ_RESULT_FAIL) {
+				t->trial.successful_shrinks++;
+				fuzz_autoshrink_update_model(t, arg_i, res, 3);
+			} else {
+				t->trial.failed_shrinks++;
+			}
+		}
+
+		int stpres;
+		stpres = shrink_trial_post_hook(t, arg_i, args, tactic, res);
+		if (stpres == FUZZ_HOOK_RUN_REPEAT ||
+				(stpres == FUZZ_HOOK_RUN_REPEAT_ONCE &&
+						!repeated)) {
+			repeated = true;
+			continue; // loop and run again
+		} else if (stpres == FUZZ_HOOK_RUN_REPEAT_ONCE && repeated) {
+			return true;
+		} else if (stpres == FUZZ_HOOK_RUN_CONTINUE) {
+			return true;
+		} else {
+			return false;
+		}
+	}
+}
+
+// Give every argument except CHANGED a new memo context, so results
+// memoized with CHANGED's old value aren't used. Contexts are never
+// reused, even when shrinking restarts from the original arguments.
+static void
+invalidate_memo_contexts(struct fuzz* t, uint8_t changed)
+{
+	for (uint8_t i = 0; i < t->prop.arity; i++) {
+		if (i != changed) {
+			t->trial.memo_context[i] = ++t->trial.memo_contexts;
+		}
+	}
+}
+
+// Get the tactics to try first for ARG_I, and their tactic order.
+// Autoshrinking uses the tactic as an attempt counter, so it always
+// goes in order, and this returns NULL.
+static struct tactic_order*
+get_first_tactics(struct fuzz* t, uint8_t arg_i, uint32_t* first,
+		uint8_t* first_count)
+{
+	struct fuzz_type_info* ti = t->prop.type_info[arg_i];
+	*first_count              = 0;
+	if (ti->autoshrink_config.enable) {
+		return NULL;
+	}
+
+	struct tactic_order* order = get_tactic_order(t, ti);
+	for (uint8_t i = 0; i < order->count; i++) {
+		first[i] = order->tactics[i];
+	}
+	*first_count = order->count;
+	return order;
+}
+
+// Get the tactic order for a type, shared by all arguments of that type.
+static struct tactic_order*
+get_tactic_order(struct fuzz* t, const struct fuzz_type_info* ti)
+{
+	for (uint8_t i = 0; i < t->prop.arity; i++) {
+		struct tactic_order* order = &t->shrink.orders[i];
+		if (order->type_info == ti) {
+			return order;
+		} else if (order->type_info == NULL) {
+			order->type_info = ti;
+			return order;
+		}
+	}
+	assert(false); // there can't be more types than arguments
+	return NULL;
+}
+
+// Get the tactic to try on STEP: first the tactics in FIRST, then all
+// the others in order, using NEXT_TACTIC to track the next one.
+static uint32_t
+choose_tactic(const uint32_t* first, uint8_t first_count, uint32_t step,
+		uint32_t* next_tactic)
+{
+	if (step < first_count) {
+		return first[step];
+	}
+
+	for (;;) {
+		const uint32_t tactic = (*next_tactic)++;
+		bool           tried  = false;
+		for (uint8_t i = 0; i < first_count; i++) {
+			if (first[i] == tactic) {
+				tried = true;
+				break;
+			}
+		}
+		if (!tried) {
+			return tactic;
+		}
+	}
+}
+
+// Move a tactic that made progress to the front of the order, and move
+// a tracked tactic that didn't back one place, so tactics that keep
+// working, such as dropping half of a list, are tried first.
+static void
+update_tactic_order(struct tactic_order* order, uint32_t tactic, bool success)
+{
+	uint8_t pos = 0;
+	while (pos < order->count && order->tactics[pos] != tactic) {
+		pos++;
+	}
+
+	if (pos == order->count) {
+		if (!success) {
+			return; // only track tactics once they make progress
+		}
+		if (order->count < TACTIC_ORDER_CEIL) {
+			order->count++;
+		}
+		// If full, replace the tactic that made progress least
+		// recently.
+		pos = order->count - 1;
+	}
+
+	if (success) {
+		memmove(&order->tactics[1], &order->tactics[0],
+				pos * sizeof(order->tactics[0]));
+		order->tactics[0] = tactic;
+	} else if (pos + 1 < order->count) {
+		order->tactics[pos]     = order->tactics[pos + 1];
+		order->tactics[pos + 1] = tactic;
+	}
+}
+
+// Has shrinking used up the time or property call budget from
+// `fuzz_run_config.shrink`?
+static bool
+reached_shrink_limit(struct fuzz* t)
+{
+	if (t->shrink.max_calls != 0 &&
+			t->trial.shrink_calls >= t->shrink.max_calls) {
+		return true;
+	}
+	if (t->shrink.max_time_ms != 0) {
+		const uint64_t elapsed =
+				fuzz_monotonic_msec() - t->trial.shrink_start_ms;
+		return elapsed >= t->shrink.max_time_ms;
+	}
+	return false;
+}
+
+// Get the memo table key for an argument's current instance. This uses
+// the autoshrink bit pool when autoshrinking, otherwise the hash
+// callback. Returns false if the argument can't be memoized.
+static bool
+get_memo_key(struct fuzz* t, uint8_t arg_i, struct fuzz_memo_key* key)
+{
+	if (t->trial.memo == NULL) {
+		return false;
+	}
+
+	struct fuzz_type_info* ti = t->prop.type_info[arg_i];
+	struct arg_info*       ai = &t->trial.args[arg_i];
+	*key = (struct fuzz_memo_key){
+			.context = t->trial.memo_context[arg_i],
+			.arg_i   = arg_i,
+	};
+
+	if (ai->type == ARG_AUTOSHRINK) {
+		const struct autoshrink_bit_pool* pool =
+				ai->u.as.env->bit_pool;
+		key->hash = fuzz_autoshrink_bit_pool_hash(pool);
+		key->size = pool->consumed;
+		return true;
+	} else if (ti->hash != NULL) {
+		key->hash = ti->hash(ai->instance, ti->env);
+		return true;
+	}
+	return false;
+}
+
 static int
 shrink_pre_hook(struct fuzz* t, uint8_t arg_index, void* arg, uint32_t tactic)
 {
@@ -0,0 +1,532 @@
+// SPDX-License-Identifier: ISC
+// SPDX-FileCopyrightText: 2014-19 Scott Vokes <vokes.s@gmail.com>
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#endif
+
+#if !defined(_WIN32)
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "fuzz.h"
+#include "polyfill.h"
+#include "types_internal.h"
+
+// Driver for a table of properties: select them by name, run the
+// longest ones first (by their saved timings), on several processes at
+// once when fork is available, and print a combined summary.
+//
+// Each forked property writes its output to a temporary file, which is
+// copied to stdout once it finishes, so output from properties running
+// at the same time isn't interleaved.
+
+// Longest line in a timings file.
+#define TIMING_LINE_MAX 1024
+
+// Most -p options accepted.
+#define MAX_PATTERNS 32
+
+// Timing for properties that haven't been timed yet, so they run first.
+#define UNKNOWN_MSEC UINT64_MAX
+
+// Exit statuses for forked properties.
+enum job_status {
+	JOB_OK    = 0,
+	JOB_FAIL  = 1,
+	JOB_SKIP  = 2,
+	JOB_ERROR = 3,
+};
+
+struct suite_options {
+	bool        list;
+	size_t      jobs;
+	const char* timings_path;
+	size_t      pattern_count;
+	const char* patterns[MAX_PATTERNS];
+};
+
+struct suite_entry {
+	size_t   prop_i; // index into the property table
+	uint64_t msec;   // saved or measured timing
+	int      res;    // FUZZ_RESULT_*
+};
+
+struct job {
+	pid_t    pid;
+	size_t   entry_i;
+	FILE*    out;
+	uint64_t start_ms;
+};
+
+#define LOG_SUITE 0
+
+static bool parse_options(int argc, char** argv, struct suite_options* opts);
+static void print_usage(FILE* f, const char* prog);
+static bool glob_match(const char* pattern, const char* name);
+static bool is_selected(const struct suite_options* opts, const char* name);
+static void load_timings(const char* path,
+		const struct fuzz_run_config* props, size_t prop_count,
+		uint64_t* msec);
+static bool save_timings(const char* path,
+		const struct fuzz_run_config* props, size_t prop_count,
+		const uint64_t* msec);
+static int cmp_entries(const void* a, const void* b);
+static void run_serially(const struct fuzz_run_config* props,
+		struct suite_entry* entries, size_t count);
+static bool run_forked(const struct fuzz_run_config* props,
+		struct suite_entry* entries, size_t count, size_t jobs);
+static size_t default_job_count(void);
+
+int
+fuzz_suite_main(int argc, char** argv, const struct fuzz_run_config* props,
+		size_t prop_count)
+{
+	struct suite_options opts = {.jobs = 0};
+	if (!parse_options(argc, argv, &opts)) {
+		print_usage(stderr, argc > 0 ? argv[0] : "suite");
+		return 2;
+	}
+
+	uint64_t* msec = malloc(prop_count * sizeof(*msec));
+	struct suite_entry* entries = malloc(prop_count * sizeof(*entries));
+	if ((msec == NULL || entries == NULL) && prop_count > 0) {
+		free(msec);
+		free(entries);
+		return 2;
+	}
+	for (size_t i = 0; i < prop_count; i++) {
+		msec[i] = UNKNOWN_MSEC;
+	}
+	if (opts.timings_path != NULL) {
+		load_timings(opts.timings_path, props, prop_count, msec);
+	}
+
+	size_t count = 0;
+	for (size_t i = 0; i < prop_count; i++) {
+		const char* name = props[i].name;
+		if (name == NULL || !is_selected(&opts, name)) {
+			continue;
+		}
+		entries[count++] = (struct suite_entry){
+				.prop_i = i,
+				.msec   = msec[i],
+				.res    = FUZZ_RESULT_ERROR,
+		};
+	}
+
+	if (opts.list) {
+		for (size_t i = 0; i < count; i++) {
+			printf("%s\n", props[entries[i].prop_i].name);
+		}
+		free(msec);
+		free(entries);
+		return 0;
+	}
+
+	// Longest first, so the slowest property isn't started last.
+	qsort(entries, count, sizeof(entries[0]), cmp_entries);
+
+	const uint64_t start_ms = fuzz_monotonic_msec();
+	size_t jobs = (opts.jobs == 0 ? default_job_count() : opts.jobs);
+	if (jobs > count) {
+		jobs = count;
+	}
+	if (jobs <= 1 || !FUZZ_POLYFILL_HAVE_FORK ||
+			!run_forked(props, entries, count, jobs)) {
+		run_serially(props, entries, count);
+	}
+	const uint64_t elapsed_ms = fuzz_monotonic_msec() - start_ms;
+
+	struct fuzz_run_report report = {.pass = 0};
+	size_t                 errors = 0;
+	for (size_t i = 0; i < count; i++) {
+		const struct suite_entry* e = &entries[i];
+		msec[e->prop_i]             = e->msec;
+		switch (e->res) {
+		case FUZZ_RESULT_OK:
+			report.pass++;
+			break;
+		case FUZZ_RESULT_FAIL:
+			report.fail++;
+			break;
+		case FUZZ_RESULT_SKIP:
+			report.skip++;
+			break;
+		default:
+			errors++;
+			break;
+		}
+	}
+
+	printf("\n== SUITE: %zd properties in %" PRIu64
+	       " msec: pass %zd, fail %zd, skip %zd, error %zd\n",
+			count, elapsed_ms, report.pass, report.fail,
+			report.skip, errors);
+	for (size_t i = 0; i < count; i++) {
+		const struct suite_entry* e = &entries[i];
+		if (e->res != FUZZ_RESULT_OK && e->res != FUZZ_RESULT_SKIP) {
+			printf(" -- %s: %s\n", props[e->prop_i].name,
+					fuzz_result_str(e->res));
+		}
+	}
+
+	if (opts.timings_path != NULL &&
+			!save_timings(opts.timings_path, props, prop_count,
+					msec)) {
+		fprintf(stderr, "failed to save timings to %s\n",
+				opts.timings_path);
+	}
+
+	free(msec);
+	free(entries);
+	return (report.fail > 0 || errors > 0) ? 1 : 0;
+}
+
+static bool
+parse_options(int argc, char** argv, struct suite_options* opts)
+{
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		if (0 == strcmp(arg, "-l")) {
+			opts->list = true;
+			continue;
+		}
+		if (arg[0] != '-' || arg[1] == '\0' || arg[2] != '\0' ||
+				i + 1 == argc) {
+			return false; // unknown, or missing its value
+		}
+
+		const char* value = argv[++i];
+		switch (arg[1]) {
+		case 'p':
+			if (opts->pattern_count == MAX_PATTERNS) {
+				return false;
+			}
+			opts->patterns[opts->pattern_count++] = value;
+			break;
+		case 'j': {
+			char*               end  = NULL;
+			const unsigned long jobs = strtoul(value, &end, 10);
+			if (end == value || *end != '\0' || jobs == 0) {
+				return false;
+			}
+			opts->jobs = (size_t)jobs;
+			break;
+		}
+		case 't':
+			opts->timings_path = value;
+			break;
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+static void
+print_usage(FILE* f, const char* prog)
+{
+	fprintf(f,
+			"Usage: %s [-l] [-p PATTERN]... [-j JOBS] "
+			"[-t TIMINGS]\n"
+			"  -l          list the selected properties\n"
+			"  -p PATTERN  only run properties whose name matches "
+			"PATTERN,\n"
+			"              where '*' matches any characters and "
+			"'?' one\n"
+			"  -j JOBS     run up to JOBS properties at once\n"
+			"  -t TIMINGS  load and save property timings in the "
+			"file\n"
+			"              TIMINGS, to run the longest first\n",
+			prog);
+}
+
+// Match NAME against PATTERN, where '*' matches any run of characters
+// and '?' matches any one character.
+static bool
+glob_match(const char* pattern, const char* name)
+{
+	const char* star  = NULL; // last '*' seen, to backtrack to
+	const char* retry = NULL; // where its match would resume
+	while (*name != '\0') {
+		if (*pattern == '*') {
+			star  = pattern++;
+			retry = name;
+		} else if (*pattern == '?' || *pattern == *name) {
+			pattern++;
+			name++;
+		} else if (star != NULL) {
+			pattern = star + 1;
+			name    = ++retry;
+		} else {
+			return false;
+		}
+	}
+	while (*pattern == '*') {
+		pattern++;
+	}
+	return *pattern == '\0';
+}
+
+static bool
+is_selected(const struct suite_options* opts, const char* name)
+{
+	if (opts->pattern_count == 0) {
+		return true;
+	}
+	for (size_t i = 0; i < opts->pattern_count; i++) {
+		if (glob_match(opts->patterns[i], name)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Read the timings saved in PATH, one "MSEC NAME" line per property.
+// A missing or malformed file just means they get timed this time.
+static void
+load_timings(const char* path, const struct fuzz_run_config* props,
+		size_t prop_count, uint64_t* msec)
+{
+	FILE* f = fopen(path, "r");
+	if (f == NULL) {
+		return;
+	}
+
+	char line[TIMING_LINE_MAX];
+	while (fgets(line, sizeof(line), f) != NULL) {
+		char*          name = NULL;
+		const uint64_t ms   = strtoull(line, &name, 10);
+		if (name == line || *name != ' ') {
+			continue;
+		}
+		name++;
+		name[strcspn(name, "\n")] = '\0';
+		for (size_t i = 0; i < prop_count; i++) {
+			if (props[i].name != NULL &&
+					0 == strcmp(props[i].name, name)) {
+				msec[i] = ms;
+				break;
+			}
+		}
+	}
+	fclose(f);
+}
+
+static bool
+save_timings(const char* path, const struct fuzz_run_config* props,
+		size_t prop_count, const uint64_t* msec)
+{
+	FILE* f = fopen(path, "w");
+	if (f == NULL) {
+		return false;
+	}
+	bool ok = true;
+	for (size_t i = 0; i < prop_count && ok; i++) {
+		if (msec[i] != UNKNOWN_MSEC &&
+				fprintf(f, "%" PRIu64 " %s\n", msec[i],
+						props[i].name) < 0) {
+			ok = false;
+		}
+	}
+	if (fclose(f) != 0) {
+		ok = false;
+	}
+	return ok;
+}
+
+// Sort by timing, longest first, keeping the table's order for ties.
+static int
+cmp_entries(const void* a, const void* b)
+{
+	const struct suite_entry* ea = (const struct suite_entry*)a;
+	const struct suite_entry* eb = (const struct suite_entry*)b;
+	if (ea->msec != eb->msec) {
+		return ea->msec > eb->msec ? -1 : 1;
+	}
+	return ea->prop_i < eb->prop_i ? -1 : ea->prop_i > eb->prop_i;
+}
+
+static void
+run_serially(const struct fuzz_run_config* props, struct suite_entry* entries,
+		size_t count)
+{
+	struct fuzz_runner* runner = fuzz_runner_new();
+	for (size_t i = 0; i < count; i++) {
+		struct suite_entry*           e     = &entries[i];
+		const struct fuzz_run_config* cfg   = &props[e->prop_i];
+		const uint64_t                start = fuzz_monotonic_msec();
+		e->res  = (runner != NULL ? fuzz_runner_run(runner, cfg)
+					  : fuzz_run(cfg));
+		e->msec = fuzz_monotonic_msec() - start;
+	}
+	fuzz_runner_free(runner);
+}
+
+static enum job_status
+job_status_of_result(int res)
+{
+	switch (res) {
+	case FUZZ_RESULT_OK:
+		return JOB_OK;
+	case FUZZ_RESULT_FAIL:
+		return JOB_FAIL;
+	case FUZZ_RESULT_SKIP:
+		return JOB_SKIP;
+	default:
+		return JOB_ERROR;
+	}
+}
+
+static int
+result_of_wstatus(int wstatus)
+{
+	if (!WIFEXITED(wstatus)) {
+		return FUZZ_RESULT_ERROR; // crashed or killed
+	}
+	switch (WEXITSTATUS(wstatus)) {
+	case JOB_OK:
+		return FUZZ_RESULT_OK;
+	case JOB_FAIL:
+		return FUZZ_RESULT_FAIL;
+	case JOB_SKIP:
+		return FUZZ_RESULT_SKIP;
+	default:
+		return FUZZ_RESULT_ERROR;
+	}
+}
+
+// Start a process running ENTRY's property, with its output going to a
+// temporary file.
+static bool
+start_job(const struct fuzz_run_config* props, struct suite_entry* entry,
+		size_t entry_i, struct job* job)
+{
+	FILE* out = tmpfile();
+	if (out == NULL) {
+		return false;
+	}
+
+	fflush(NULL); // don't let the child repeat buffered output
+	const uint64_t start_ms = fuzz_monotonic_msec();
+	const pid_t    pid      = fork();
+	if (pid == -1) {
+		fclose(out);
+		return false;
+	}
+
+	if (pid == 0) { // child
+		int res = FUZZ_RESULT_ERROR;
+		if (-1 != dup2(fileno(out), fileno(stdout))) {
+			res = fuzz_run(&props[entry->prop_i]);
+		}
+		fflush(stdout);
+		_exit(job_status_of_result(res));
+	}
+
+	LOG(2 - LOG_SUITE, "%s: started %s as %d\n", __func__,
+			props[entry->prop_i].name, (int)pid);
+	*job = (struct job){
+			.pid      = pid,
+			.entry_i  = entry_i,
+			.out      = out,
+			.start_ms = start_ms,
+	};
+	return true;
+}
+
+// Copy a finished job's output to stdout, and free its file.
+static void
+finish_job(struct job* job)
+{
+	char buf[4096];
+	rewind(job->out);
+	size_t rd = 0;
+	while ((rd = fread(buf, 1, sizeof(buf), job->out)) > 0) {
+		fwrite(buf, 1, rd, stdout);
+	}
+	fflush(stdout);
+	fclose(job->out);
+	job->out = NULL;
+}
+
+// Run the entries on up to JOBS processes at once, starting them in
+// order. Returns false if no process could be started at all, so they
+// should be run in this process instead.
+static bool
+run_forked(const struct fuzz_run_config* props, struct suite_entry* entries,
+		size_t count, size_t jobs)
+{
+	struct job* running = calloc(jobs, sizeof(*running));
+	if (running == NULL) {
+		return false;
+	}
+
+	size_t next   = 0;
+	size_t active = 0;
+	while (next < count || active > 0) {
+		while (active < jobs && next < count) {
+			if (!start_job(props, &entries[next], next,
+					    &running[active])) {
+				break;
+			}
+			next++;
+			active++;
+		}
+		if (active == 0) {
+			break; // can't start any
+		}
+
+		int         wstatus = 0;
+		const pid_t pid     = waitpid(-1, &wstatus, 0);
+		if (pid == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		for (size_t i = 0; i < active; i++) {
+			struct job* job = &running[i];
+			if (job->pid != pid) {
+				continue;
+			}
+			struct suite_entry* e = &entries[job->entry_i];
+			e->msec = fuzz_monotonic_msec() - job->start_ms;
+			e->res  = result_of_wstatus(wstatus);
+			finish_job(job);
+			running[i] = running[--active];
+			break;
+		}
+	}
+
+	// Only if nothing could be started is the whole run retried.
+	const bool started = next > 0;
+	for (size_t i = 0; i < active; i++) { // only on waitpid errors
+		finish_job(&running[i]);
+	}
+	for (size_t i = next; i < count && started; i++) {
+		entries[i].res = FUZZ_RESULT_ERROR;
+	}
+	free(running);
+	return started;
+}
+
+static size_t
+default_job_count(void)
+{
+#if defined(_SC_NPROCESSORS_ONLN)
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus > 0) {
+		return (size_t)cpus;
+	}
+#endif
+	return 1;
+}
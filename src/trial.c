@@ -5,6 +5,9 @@
 
 #include "autoshrink.h"
 #include "call.h"
+#include "corpus.h"
+#include "coverage.h"
+#include "dictionary.h"
 #include "fuzz.h"
 #include "shrink.h"
 #include "trial.h"
@@ -37,6 +40,12 @@ fuzz_trial_run(struct fuzz* t, int* tpres)
 						? t->print_trial_result_env
 						: t->hooks.env);
 
+	// Shrinking replays a failure's random bits, which could choose a
+	// different value if the dictionary changed, so leave it as it was.
+	if (t->dictionary != NULL && tres != FUZZ_RESULT_FAIL) {
+		fuzz_dictionary_update(t);
+	}
+
 	struct fuzz_post_trial_info hook_info = {
 			.t            = t,
 			.prop_name    = t->prop.name,
@@ -55,6 +64,9 @@ fuzz_trial_run(struct fuzz* t, int* tpres)
 			t->counters.pass++;
 		}
 		*tpres = trial_post(&hook_info, trial_post_env);
+		if (t->coverage != NULL) {
+			fuzz_coverage_update(t);
+		}
 		break;
 	case FUZZ_RESULT_FAIL:
 		if (!fuzz_shrink(t)) {
@@ -71,6 +83,10 @@ fuzz_trial_run(struct fuzz* t, int* tpres)
 		if (!repeated) {
 			t->counters.fail++;
 		}
+		if (t->seeds.corpus_dir != NULL && !fuzz_corpus_save(t)) {
+			LOG(1, "%s: failed to save failure to %s\n", __func__,
+					t->seeds.corpus_dir);
+		}
 
 		fuzz_trial_get_args(t, hook_info.args);
 		*tpres = report_on_failure(
@@ -99,16 +115,59 @@ fuzz_trial_run(struct fuzz* t, int* tpres)
 void
 fuzz_trial_free_args(struct fuzz* t)
 {
-	for (size_t i = 0; i < t->prop.arity; i++) {
-		struct fuzz_type_info* ti = t->prop.type_info[i];
-
+	for (uint8_t i = 0; i < t->prop.arity; i++) {
 		struct arg_info* ai = &t->trial.args[i];
 		if (ai->type == ARG_AUTOSHRINK) {
 			fuzz_autoshrink_free_env(t, ai->u.as.env);
 		}
-		if (ai->instance != NULL && ti->free != NULL) {
-			ti->free(t->trial.args[i].instance, ti->env);
+		fuzz_trial_release_instance(t, i, ai->instance);
+	}
+}
+
+int
+fuzz_trial_alloc_instance(struct fuzz* t, uint8_t arg_i, void** output)
+{
+	struct fuzz_type_info* ti = t->prop.type_info[arg_i];
+	if (ti->realloc_into == NULL || t->spare_count[arg_i] == 0) {
+		return ti->alloc(t, ti->env, output);
+	}
+
+	// The spare is the callback's now, whether it reuses it or not.
+	void* spare = t->spares[arg_i][--t->spare_count[arg_i]];
+	void* res   = NULL;
+	int   ares  = ti->realloc_into(t, ti->env, spare, &res);
+	if (ares == FUZZ_RESULT_OK) {
+		*output = res;
+	}
+	return ares;
+}
+
+void
+fuzz_trial_release_instance(struct fuzz* t, uint8_t arg_i, void* instance)
+{
+	if (instance == NULL) {
+		return;
+	}
+	struct fuzz_type_info* ti = t->prop.type_info[arg_i];
+	if (ti->realloc_into != NULL &&
+			t->spare_count[arg_i] < SPARE_INSTANCES) {
+		t->spares[arg_i][t->spare_count[arg_i]++] = instance;
+	} else if (ti->free != NULL) {
+		ti->free(instance, ti->env);
+	}
+}
+
+void
+fuzz_trial_free_spares(struct fuzz* t)
+{
+	for (uint8_t i = 0; i < t->prop.arity; i++) {
+		struct fuzz_type_info* ti = t->prop.type_info[i];
+		for (uint8_t s = 0; s < t->spare_count[i]; s++) {
+			if (ti->free != NULL) {
+				ti->free(t->spares[i][s], ti->env);
+			}
 		}
+		t->spare_count[i] = 0;
 	}
 }
 
@@ -136,6 +195,7 @@ report_on_failure(struct fuzz* t, struct fuzz_post_trial_info* hook_info,
 				.arity        = t->prop.arity,
 				.type_info    = t->prop.type_info,
 				.args         = hook_info->args,
+				.incomplete   = t->trial.shrink_incomplete,
 		};
 
 		if (counterexample(&counterexample_hook_info, t->hooks.env) !=
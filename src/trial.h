@@ -4,6 +4,7 @@
 #define FUZZ_TRIAL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 struct fuzz;
 
@@ -13,4 +14,18 @@ void fuzz_trial_get_args(struct fuzz* t, void** args);
 
 void fuzz_trial_free_args(struct fuzz* t);
 
+// Allocate an instance for argument ARG_I. If its type has a
+// realloc_into callback and a spare instance was kept, rebuild one,
+// handing the spare over to the callback.
+int fuzz_trial_alloc_instance(struct fuzz* t, uint8_t arg_i, void** output);
+
+// Release an instance of argument ARG_I, which can be NULL. It's kept
+// as a spare if its type has a realloc_into callback and there is room
+// for it, otherwise it's freed.
+void fuzz_trial_release_instance(
+		struct fuzz* t, uint8_t arg_i, void* instance);
+
+// Free the spare instances at the end of the run.
+void fuzz_trial_free_spares(struct fuzz* t);
+
 #endif
@@ -15,6 +15,9 @@
 #include <sys/types.h>
 #endif
 
+#include "autoshrink.h"
+#include "fuzz.h"
+
 #if !defined(FUZZ_PUBLIC)
 #define FUZZ_PUBLIC
 #endif
@@ -43,6 +46,11 @@
 #define FUZZ_MAX_ARITY 7
 #endif
 
+// How many unused instances of each argument to keep for its type's
+// realloc_into callback: enough for the current instance and a shrink
+// candidate.
+#define SPARE_INSTANCES 2
+
 struct fuzz;
 struct fuzz_pre_run_info;
 struct fuzz_post_run_info;
@@ -55,7 +63,9 @@ struct fuzz_pre_shrink_info;
 struct fuzz_post_shrink_info;
 struct fuzz_post_shrink_trial_info;
 
+struct fuzz_arena; // arena allocator for instances
 struct fuzz_bloom; // bloom filter
+struct fuzz_memo;  // shrinking memo table
 struct fuzz_rng;   // pseudorandom number generator
 
 struct seed_info {
@@ -65,6 +75,9 @@ struct seed_info {
 	// Can be used for regression tests.
 	const size_t    always_seed_count; // number of seeds
 	const uint64_t* always_seeds;      // seeds to always run
+
+	// Directory of saved failures to replay and save to, or NULL.
+	const char* corpus_dir;
 };
 
 struct fork_info {
@@ -72,6 +85,35 @@ struct fork_info {
 	const size_t timeout;
 	const int    signal;
 	const size_t exit_timeout;
+	const size_t workers; // shrink candidates to run at once
+};
+
+// How many tactics to track for each type with a shrink callback.
+#define TACTIC_ORDER_CEIL 8
+
+// Tactics that have made progress for a type's shrink callback, in the
+// order they should be tried. They are tried before walking the rest
+// of the tactics in numeric order.
+struct tactic_order {
+	const struct fuzz_type_info* type_info;
+	uint8_t                      count;
+	uint32_t                     tactics[TACTIC_ORDER_CEIL];
+};
+
+struct shrink_info {
+	const size_t max_time_ms;
+	const size_t max_calls;
+	const size_t restarts;
+
+	// Adaptive tactic order, for each distinct argument type.
+	struct tactic_order orders[FUZZ_MAX_ARITY];
+
+	// Autoshrink mutation weights learned for each argument, kept for
+	// the whole run so later failures start from them. If model_path
+	// is set, they are loaded from and saved to it.
+	const char* model_path;
+	bool        model_set[FUZZ_MAX_ARITY];
+	uint8_t     model_weights[FUZZ_MAX_ARITY][AUTOSHRINK_WEIGHT_COUNT];
 };
 
 struct prop_info {
@@ -92,7 +134,8 @@ struct prop_info {
 				void* arg4, void* arg5, void* arg6,
 				void* arg7);
 	} u;
-	const size_t trial_count;
+	const size_t   trial_count; // SIZE_MAX if only bounded by time
+	const uint64_t max_duration_ms;
 
 	// Type info for ARITY arguments.
 	const uint8_t          arity; // number of arguments
@@ -140,6 +183,10 @@ struct counter_info {
 	size_t fail;
 	size_t skip;
 	size_t dup;
+
+	// Set once the run's trials are done, for fuzz_run_report.
+	uint64_t elapsed_ms;
+	size_t   trials_per_sec;
 };
 
 struct prng_info {
@@ -148,6 +195,11 @@ struct prng_info {
 	uint8_t          bits_available;
 	// Bit pool, only used during autoshrinking.
 	struct autoshrink_bit_pool* bit_pool;
+
+	// Decaying high-water marks of the bits and requests each
+	// autoshrinking argument has used, to size its new bit pools.
+	size_t pool_bits[FUZZ_MAX_ARITY];
+	size_t pool_requests[FUZZ_MAX_ARITY];
 };
 
 enum arg_type {
@@ -170,10 +222,23 @@ struct arg_info {
 struct trial_info {
 	const int       trial; // N'th trial
 	uint64_t        seed;  // Seed used
+	// Saved failure being replayed, or NULL.
+	const struct corpus_record* replay;
 	size_t          shrink_count;
 	size_t          successful_shrinks;
 	size_t          failed_shrinks;
 	struct arg_info args[FUZZ_MAX_ARITY];
+
+	// Results for candidates already tried while shrinking. Each
+	// argument's memo context changes when another argument does.
+	struct fuzz_memo* memo;
+	uint32_t          memo_context[FUZZ_MAX_ARITY];
+	uint32_t          memo_contexts; // last memo context handed out
+
+	// Shrinking budget, see struct shrink_info.
+	uint64_t shrink_start_ms;   // when shrinking started
+	size_t   shrink_calls;      // property calls while shrinking
+	bool     shrink_incomplete; // stopped by the budget?
 };
 
 enum worker_state {
@@ -193,16 +258,36 @@ struct worker_info {
 struct fuzz {
 	FILE*                               out;
 	struct fuzz_bloom*                  bloom; // bloom filter
+	struct fuzz_arena*                  arena; // for fuzz_arena_alloc
 	struct fuzz_print_trial_result_env* print_trial_result_env;
+	struct fuzz_coverage*               coverage;   // or NULL
+	struct fuzz_dictionary*             dictionary; // or NULL
 
 	struct prng_info    prng;
 	struct prop_info    prop;
 	struct seed_info    seeds;
 	struct fork_info    fork;
+	struct shrink_info  shrink;
 	struct hook_info    hooks;
 	struct counter_info counters;
 	struct trial_info   trial;
-	struct worker_info  workers[1];
+	struct worker_info  workers[FUZZ_MAX_WORKERS];
+
+	// Instances of each argument kept after they were no longer
+	// needed, for its type's realloc_into callback to rebuild.
+	uint8_t spare_count[FUZZ_MAX_ARITY];
+	void*   spares[FUZZ_MAX_ARITY][SPARE_INSTANCES];
+};
+
+// Resources kept between runs by fuzz_runner_run, already reset for the
+// next run. Each is NULL until a run has used it, and while a run is
+// using it.
+struct fuzz_runner {
+	struct fuzz*                        t;
+	struct fuzz_rng*                    rng;
+	struct fuzz_bloom*                  bloom;
+	struct fuzz_arena*                  arena;
+	struct fuzz_print_trial_result_env* print_env;
 };
 
 #endif
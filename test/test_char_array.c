@@ -37,7 +37,113 @@ char_fail_shrinkage(void)
 	PASS();
 }
 
+static int
+prop_char_not_long_or_large(struct fuzz* t, void* arg1)
+{
+	(void)t;
+	const char* s = arg1;
+	return (strlen(s) >= 3 && s[0] >= 'A') ? FUZZ_RESULT_FAIL
+					       : FUZZ_RESULT_OK;
+}
+
+static int
+halt_after_first_failure(const struct fuzz_pre_trial_info* info, void* env)
+{
+	(void)env;
+	return (info->failures > 0) ? FUZZ_HOOK_RUN_HALT
+				    : FUZZ_HOOK_RUN_CONTINUE;
+}
+
+static int
+save_last_failure(const struct fuzz_post_trial_info* info, void* env)
+{
+	if (info->result == FUZZ_RESULT_FAIL) {
+		strncpy((char*)env, info->args[0], 15);
+	}
+	return FUZZ_HOOK_RUN_CONTINUE;
+}
+
+// Reducing the length should drop the bytes past it, and the rest
+// should shrink to the smallest bytes that still fail (1, since 0 ends
+// the string).
+TEST
+char_array_shrinks_length_first(void)
+{
+	char                   last[16] = {0};
+	struct fuzz_run_config cfg      = {
+			     .name  = __func__,
+			     .prop1 = prop_char_not_long_or_large,
+			     .type_info =
+					{
+							fuzz_get_builtin_type_info(
+									FUZZ_BUILTIN_char_ARRAY),
+					},
+			     .hooks =
+					{
+							.pre_trial  = halt_after_first_failure,
+							.post_trial = save_last_failure,
+							.env        = last,
+					},
+			     .seed = 1,
+	};
+
+	ASSERT_EQ(FUZZ_RESULT_FAIL, fuzz_run(&cfg));
+	ASSERT_STR_EQ("A\x01\x01", last);
+	PASS();
+}
+
+static int
+prop_char_any(struct fuzz* t, void* arg1)
+{
+	(void)t;
+	(void)arg1;
+	return FUZZ_RESULT_OK;
+}
+
+static int
+save_longest(const struct fuzz_post_trial_info* info, void* env)
+{
+	size_t*      longest = env;
+	const size_t length  = strlen(info->args[0]);
+	if (length > *longest) {
+		*longest = length;
+	}
+	return FUZZ_HOOK_RUN_CONTINUE;
+}
+
+// The length should be drawn with enough bits to reach max_length,
+// rather than being capped by a single byte.
+TEST
+char_array_uses_max_length(void)
+{
+	size_t                max_length = 4096;
+	struct fuzz_type_info info =
+			*fuzz_get_builtin_type_info(FUZZ_BUILTIN_char_ARRAY);
+	info.env = &max_length;
+
+	size_t                 longest = 0;
+	struct fuzz_run_config cfg     = {
+			    .name      = __func__,
+			    .prop1     = prop_char_any,
+			    .type_info = {&info},
+			    .hooks =
+					{
+							.post_trial = save_longest,
+							.env        = &longest,
+					},
+			    .seed   = 1,
+			    .trials = 50,
+	};
+
+	ASSERT_EQ(FUZZ_RESULT_OK, fuzz_run(&cfg));
+	ASSERT(longest > 255);
+	ASSERT(longest < max_length);
+	PASS();
+}
+
 SUITE(char_array)
 {
 	RUN_TEST(char_fail_shrinkage);
+	RUN_TEST(char_array_shrinks_length_first);
+	RUN_TEST(char_array_uses_max_length);
 }
@@ -3,6 +3,11 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <stdbool.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
 
 #include "autoshrink.h"
 #include "fuzz.h"
@@ -102,7 +107,7 @@ static struct greatest_type_info bit_pool_info = {
 static uint8_t test_pool_bits[] = {
 		0x01, 0x48, 0x40, 0x00, 0x32, 0x10, 0x00, 0x00};
 #define TEST_POOL_BIT_COUNT (5 * (3 + 8) + 3)
-static uint32_t test_pool_requests[] = {3, 8, 3, 8, 3, 8, 3, 8, 3, 8, 3};
+static uint8_t test_pool_requests[] = {3, 8, 3, 8, 3, 8, 3, 8, 3, 8, 3};
 static struct autoshrink_bit_pool test_pool = {
 		.bits          = test_pool_bits,
 		.bits_filled   = TEST_POOL_BIT_COUNT,
@@ -210,7 +215,7 @@ ll_drop_nothing(void)
 	ASSERT_EQ_FMT(FUZZ_SHRINK_OK, res, "%d");
 
 	uint8_t  exp_bits[] = {0x01, 0x48, 0x40, 0x00, 0x32, 0x10, 0x00, 0x00};
-	uint32_t exp_requests[] = {
+	uint8_t exp_requests[] = {
 			3,
 			8,
 			3,
@@ -243,6 +248,57 @@ ll_drop_nothing(void)
 	PASS();
 }
 
+// Without an action scheduled, a candidate that isn't smaller than the
+// original bit pool should be rejected before it's allocated.
+TEST
+ll_drop_nothing_is_rejected(void)
+{
+	struct fuzz* t = init();
+	ASSERT(t);
+
+	struct fake_prng_info prng_info = {
+			.pairs =
+					{
+							{8, 0}, // drop
+							{32, DO_NOT_DROP},
+							{5, 31}, // don't drop anything
+							{5, 31},
+							{5, 31},
+							{5, 31},
+							{5, 31},
+							{5, 31},
+							{5, 31},
+							{5, 31},
+							{5, 31},
+							{5, 31},
+							{5, 31},
+					},
+	};
+	struct autoshrink_env env = {
+			.prng                  = fake_prng,
+			.udata                 = &prng_info,
+			.leave_trailing_zeroes = true,
+			.bit_pool              = &test_pool,
+			.passes                = {.pass = PASS_DONE},
+			.model =
+					{
+							.ready   = true,
+							.weights = {[WEIGHT_DROP] = DROPS_MAX},
+					},
+	};
+
+	void*                       output   = NULL;
+	struct autoshrink_bit_pool* out_pool = NULL;
+	int                         res;
+	res = fuzz_autoshrink_shrink(t, &env, 0, &output, &out_pool);
+	ASSERT_EQ_FMT(FUZZ_SHRINK_DEAD_END, res, "%d");
+	ASSERT_EQ(NULL, output);
+	ASSERT_EQ(NULL, out_pool);
+
+	fuzz_run_free(t);
+	PASS();
+}
+
 TEST
 ll_drop_nothing_but_do_truncate(void)
 {
@@ -321,7 +377,7 @@ ll_drop_nothing_but_do_truncate(void)
 			0x32,
 			0x10,
 	};
-	uint32_t exp_requests[] = {
+	uint8_t exp_requests[] = {
 			3, 8, 3, 8, 3, 8, 3, 8, 3,
 			1, // last request is truncated
 	};
@@ -428,7 +484,7 @@ ll_drop_first(void)
 	// 0010 0000 -- 0x20
 	// _000 0000 -- 0x00
 	uint8_t  shrunk_bits[] = {0x09, 0x08, 0x40, 0x06, 0x02, 0x00, 0x00};
-	uint32_t shrunk_requests[] = {
+	uint8_t shrunk_requests[] = {
 			3,
 			8,
 			3,
@@ -533,7 +589,7 @@ ll_drop_third_and_fourth(void)
 	// 0b001, 0b00000000,
 	// 0b000 (end of list), 36 bits total
 	uint8_t  exp_bits[]     = {0x01, 0x48, 0x40, 0x00, 0x00, 0x00};
-	uint32_t exp_requests[] = {
+	uint8_t exp_requests[] = {
 			3,
 			8,
 			3,
@@ -644,7 +700,7 @@ ll_drop_last(void)
 			0x32,
 			0x00,
 	};
-	uint32_t exp_requests[] = {
+	uint8_t exp_requests[] = {
 			3,
 			8,
 			3,
@@ -728,7 +784,7 @@ ll_mutate_shift(void)
 	// 0b000, 0b00000000,  (continue bits are right-shifted 1)
 	// 0b000 (end of list) -- 58 bits
 	uint8_t  exp_bits[] = {0x01, 0x08, 0x40, 0x00, 0x12, 0x00, 0x00, 0x00};
-	uint32_t exp_requests[] = {
+	uint8_t exp_requests[] = {
 			3,
 			8,
 			3,
@@ -804,7 +860,7 @@ ll_mutate_mask(void)
 	// 0b001, 0b00000000,
 	// 0b000 (end of list) -- 58 bits
 	uint8_t  exp_bits[] = {0x01, 0x48, 0x40, 0x00, 0x22, 0x10, 0x00, 0x00};
-	uint32_t exp_requests[] = {
+	uint8_t exp_requests[] = {
 			3,
 			8,
 			3,
@@ -880,7 +936,7 @@ ll_mutate_swap(void)
 	// 0b001, 0b00000010,
 	// 0b000 (end of list) -- 58 bits
 	uint8_t  exp_bits[] = {0x01, 0x48, 0x40, 0x00, 0x02, 0x90, 0x01, 0x00};
-	uint32_t exp_requests[] = {
+	uint8_t exp_requests[] = {
 			3,
 			8,
 			3,
@@ -957,7 +1013,7 @@ ll_mutate_sub(void)
 	// 0b001, 0b00000000,
 	// 0b000 (end of list) -- 58 bits
 	uint8_t  exp_bits[] = {0x01, 0x48, 0x40, 0x00, 0x22, 0x10, 0x00, 0x00};
-	uint32_t exp_requests[] = {
+	uint8_t exp_requests[] = {
 			3,
 			8,
 			3,
@@ -1036,7 +1092,7 @@ ll_mutate_retries_when_change_has_no_effect(void)
 	// 0b001, 0b00000010,
 	// 0b000 (end of list) -- 58 bits
 	uint8_t  exp_bits[] = {0x01, 0x48, 0x40, 0x00, 0x02, 0x90, 0x01, 0x00};
-	uint32_t exp_requests[] = {
+	uint8_t exp_requests[] = {
 			3,
 			8,
 			3,
@@ -1282,6 +1338,872 @@ ia_prop(const char* name, int (*prop)(struct fuzz* t, void* arg1))
 	PASS();
 }
 
+static int
+prop_no_value_at_least_100(struct fuzz* t, void* arg1)
+{
+	uint8_t* ia = (uint8_t*)arg1;
+	(void)t;
+	for (size_t i = 0; ia[i] != 0; i++) {
+		if (ia[i] >= 100) {
+			return FUZZ_RESULT_FAIL;
+		}
+	}
+	return FUZZ_RESULT_OK;
+}
+
+static int
+ia_minimal_trial_post_hook(const struct fuzz_post_trial_info* info, void* penv)
+{
+	struct hook_env* env = (struct hook_env*)penv;
+	if (info->result == FUZZ_RESULT_FAIL) {
+		const uint8_t* ia = info->args[0];
+		if (ia[0] == 100 && ia[1] == 0) {
+			env->minimal = true;
+		}
+	}
+
+	fuzz_print_trial_result(&env->print_env, info);
+	return FUZZ_HOOK_RUN_CONTINUE;
+}
+
+static int
+halt_after_first_failure(const struct fuzz_pre_trial_info* info, void* penv)
+{
+	(void)penv;
+	return (info->failures > 0) ? FUZZ_HOOK_RUN_HALT
+				    : FUZZ_HOOK_RUN_CONTINUE;
+}
+
+// The deterministic passes should drop every other value and then
+// binary search the remaining one down to exactly 100.
+TEST
+ia_passes_shrink_to_minimal(void)
+{
+	uint64_t seed = fuzz_seed_of_time();
+	int      res;
+
+	struct hook_env env = {.tag = 'E', .minimal = false};
+
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop1     = prop_no_value_at_least_100,
+			.type_info = {&ia_info},
+			.hooks =
+					{
+							.pre_trial = halt_after_first_failure,
+							.post_trial = ia_minimal_trial_post_hook,
+							.env = &env,
+					},
+			.trials = 1000,
+			.seed   = seed,
+	};
+
+	res = fuzz_run(&cfg);
+	ASSERT_EQm("should find counter-examples", FUZZ_RESULT_FAIL, res);
+	ASSERTm("should shrink to [100]", env.minimal);
+	PASS();
+}
+
+// A type without hash or shrink callbacks, which keeps fuzz from
+// using the bloom filter.
+static int
+unhashable_alloc(struct fuzz* t, void* env, void** output)
+{
+	(void)env;
+	uint8_t* res = malloc(sizeof(*res));
+	if (res == NULL) {
+		return FUZZ_RESULT_ERROR_MEMORY;
+	}
+	*res    = (uint8_t)fuzz_random_bits(t, 8);
+	*output = res;
+	return FUZZ_RESULT_OK;
+}
+
+static struct fuzz_type_info unhashable_info = {
+		.alloc = unhashable_alloc,
+		.free  = fuzz_generic_free_cb,
+};
+
+static int
+prop_first_has_no_value_at_least_100(struct fuzz* t, void* arg1, void* arg2)
+{
+	(void)arg2;
+	return prop_no_value_at_least_100(t, arg1);
+}
+
+#define MAX_SEEN 1024
+#define SEEN_LEN 16
+
+struct seen_env {
+	struct hook_env hook_env;
+	size_t          count;
+	uint8_t         seen[MAX_SEEN][SEEN_LEN];
+	bool            repeated;
+};
+
+static int
+record_shrink_trial_post(
+		const struct fuzz_post_shrink_trial_info* info, void* penv)
+{
+	struct seen_env* env = (struct seen_env*)penv;
+	const uint8_t*   ia  = info->args[0];
+
+	uint8_t buf[SEEN_LEN] = {0};
+	for (size_t i = 0; i < SEEN_LEN && ia[i] != 0; i++) {
+		buf[i] = ia[i];
+	}
+
+	for (size_t i = 0; i < env->count; i++) {
+		if (0 == memcmp(env->seen[i], buf, SEEN_LEN)) {
+			env->repeated = true;
+		}
+	}
+	if (env->count < MAX_SEEN) {
+		memcpy(env->seen[env->count], buf, SEEN_LEN);
+		env->count++;
+	}
+	return FUZZ_HOOK_RUN_CONTINUE;
+}
+
+// Even without the bloom filter, shrinking shouldn't run the property
+// on the same autoshrink candidate twice.
+TEST
+shrinking_does_not_repeat_candidates(void)
+{
+	uint64_t seed = fuzz_seed_of_time();
+	int      res;
+
+	struct seen_env env = {
+			.hook_env = {.tag = 'E'},
+	};
+
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop2     = prop_first_has_no_value_at_least_100,
+			.type_info = {&ia_info, &unhashable_info},
+			.hooks =
+					{
+							.pre_trial = halt_after_first_failure,
+							.post_shrink_trial = record_shrink_trial_post,
+							.env = &env,
+					},
+			.trials = 1000,
+			.seed   = seed,
+	};
+
+	res = fuzz_run(&cfg);
+	ASSERT_EQm("should find counter-examples", FUZZ_RESULT_FAIL, res);
+	ASSERT(env.count > 0);
+	ASSERT_FALSEm("should not repeat candidates", env.repeated);
+	PASS();
+}
+
+// A list whose length is generated before its elements, each marked as
+// a span, followed by another value after the elements.
+struct tagged_list {
+	uint8_t length;
+	uint8_t values[15];
+	uint8_t trailer;
+};
+
+static int
+tagged_list_alloc(struct fuzz* t, void* env, void** output)
+{
+	(void)env;
+	struct tagged_list* tl = calloc(1, sizeof(*tl));
+	if (tl == NULL) {
+		return FUZZ_RESULT_ERROR_MEMORY;
+	}
+	tl->length = (uint8_t)fuzz_random_bits_tagged(t, 4, FUZZ_REQ_LENGTH);
+	for (uint8_t i = 0; i < tl->length; i++) {
+		fuzz_autoshrink_span_begin(t);
+		tl->values[i] = (uint8_t)fuzz_random_bits_tagged(
+				t, 8, FUZZ_REQ_INT);
+		fuzz_autoshrink_span_end(t);
+	}
+	tl->trailer = (uint8_t)fuzz_random_bits_tagged(t, 8, FUZZ_REQ_INT);
+	*output     = tl;
+	return FUZZ_RESULT_OK;
+}
+
+static void
+tagged_list_print(FILE* f, const void* instance, void* env)
+{
+	const struct tagged_list* tl = (const struct tagged_list*)instance;
+	(void)env;
+	fprintf(f, "[");
+	for (uint8_t i = 0; i < tl->length; i++) {
+		fprintf(f, "%s%u", (i > 0 ? " " : ""), tl->values[i]);
+	}
+	fprintf(f, "] %u\n", tl->trailer);
+}
+
+static struct fuzz_type_info tagged_list_info = {
+		.alloc = tagged_list_alloc,
+		.free  = fuzz_generic_free_cb,
+		.print = tagged_list_print,
+		.autoshrink_config =
+				{
+						.enable = true,
+				},
+};
+
+static int
+prop_not_long_with_large_trailer(struct fuzz* t, void* arg1)
+{
+	const struct tagged_list* tl = (const struct tagged_list*)arg1;
+	(void)t;
+	return (tl->length >= 3 && tl->trailer >= 5) ? FUZZ_RESULT_FAIL
+						     : FUZZ_RESULT_OK;
+}
+
+static int
+tagged_list_minimal_trial_post_hook(
+		const struct fuzz_post_trial_info* info, void* penv)
+{
+	struct hook_env* env = (struct hook_env*)penv;
+	if (info->result == FUZZ_RESULT_FAIL) {
+		const struct tagged_list* tl = info->args[0];
+		if (tl->length == 3 && tl->values[0] == 0 &&
+				tl->values[1] == 0 && tl->values[2] == 0 &&
+				tl->trailer == 5) {
+			env->minimal = true;
+		}
+	}
+
+	fuzz_print_trial_result(&env->print_env, info);
+	return FUZZ_HOOK_RUN_CONTINUE;
+}
+
+// When the length is reduced, the elements past it should be dropped
+// along with it, so the trailer stays aligned.
+TEST
+tagged_requests_shrink_to_minimal(void)
+{
+	uint64_t seed = fuzz_seed_of_time();
+	int      res;
+
+	struct hook_env env = {.tag = 'E', .minimal = false};
+
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop1     = prop_not_long_with_large_trailer,
+			.type_info = {&tagged_list_info},
+			.hooks =
+					{
+							.pre_trial = halt_after_first_failure,
+							.post_trial = tagged_list_minimal_trial_post_hook,
+							.env = &env,
+					},
+			.trials = 1000,
+			.seed   = seed,
+	};
+
+	res = fuzz_run(&cfg);
+	ASSERT_EQm("should find counter-examples", FUZZ_RESULT_FAIL, res);
+	ASSERTm("should shrink to [0 0 0] 5", env.minimal);
+	PASS();
+}
+
+// A list of key/value pairs, with each pair marked as a span.
+struct pair_list {
+	uint8_t count;
+	uint8_t keys[16];
+	uint8_t values[16];
+};
+
+static int
+pair_list_alloc(struct fuzz* t, void* env, void** output)
+{
+	(void)env;
+	struct pair_list* pl = calloc(1, sizeof(*pl));
+	if (pl == NULL) {
+		return FUZZ_RESULT_ERROR_MEMORY;
+	}
+	while (pl->count < 16) {
+		fuzz_autoshrink_span_begin(t);
+		if (fuzz_random_bits(t, 1) == 0) {
+			fuzz_autoshrink_span_end(t);
+			break;
+		}
+		pl->keys[pl->count]   = (uint8_t)fuzz_random_bits(t, 8);
+		pl->values[pl->count] = (uint8_t)fuzz_random_bits(t, 8);
+		pl->count++;
+		fuzz_autoshrink_span_end(t);
+	}
+	*output = pl;
+	return FUZZ_RESULT_OK;
+}
+
+static void
+pair_list_print(FILE* f, const void* instance, void* env)
+{
+	const struct pair_list* pl = (const struct pair_list*)instance;
+	(void)env;
+	for (uint8_t i = 0; i < pl->count; i++) {
+		fprintf(f, "%u:%u ", pl->keys[i], pl->values[i]);
+	}
+	fprintf(f, "\n");
+}
+
+static struct fuzz_type_info pair_list_info = {
+		.alloc = pair_list_alloc,
+		.free  = fuzz_generic_free_cb,
+		.print = pair_list_print,
+		.autoshrink_config =
+				{
+						.enable = true,
+				},
+};
+
+static int
+prop_fewer_than_two_values_at_least_10(struct fuzz* t, void* arg1)
+{
+	const struct pair_list* pl = (const struct pair_list*)arg1;
+	(void)t;
+	uint8_t found = 0;
+	for (uint8_t i = 0; i < pl->count; i++) {
+		if (pl->values[i] >= 10) {
+			found++;
+		}
+	}
+	return (found >= 2 ? FUZZ_RESULT_FAIL : FUZZ_RESULT_OK);
+}
+
+static int
+pair_list_minimal_trial_post_hook(
+		const struct fuzz_post_trial_info* info, void* penv)
+{
+	struct hook_env* env = (struct hook_env*)penv;
+	if (info->result == FUZZ_RESULT_FAIL) {
+		const struct pair_list* pl = info->args[0];
+		if (pl->count == 2 && pl->keys[0] == 0 && pl->keys[1] == 0 &&
+				pl->values[0] == 10 && pl->values[1] == 10) {
+			env->minimal = true;
+		}
+	}
+
+	fuzz_print_trial_result(&env->print_env, info);
+	return FUZZ_HOOK_RUN_CONTINUE;
+}
+
+// Whole pairs should be dropped, rather than leaving the rest of the
+// list misaligned.
+TEST
+spans_shrink_to_minimal(void)
+{
+	uint64_t seed = fuzz_seed_of_time();
+	int      res;
+
+	struct hook_env env = {.tag = 'E', .minimal = false};
+
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop1     = prop_fewer_than_two_values_at_least_10,
+			.type_info = {&pair_list_info},
+			.hooks =
+					{
+							.pre_trial = halt_after_first_failure,
+							.post_trial = pair_list_minimal_trial_post_hook,
+							.env = &env,
+					},
+			.trials = 1000,
+			.seed   = seed,
+	};
+
+	res = fuzz_run(&cfg);
+	ASSERT_EQm("should find counter-examples", FUZZ_RESULT_FAIL, res);
+	ASSERTm("should shrink to 0:10 0:10", env.minimal);
+	PASS();
+}
+
+static int
+prop_fewer_than_two_near_pairs(struct fuzz* t, void* arg1)
+{
+	const struct pair_list* pl = (const struct pair_list*)arg1;
+	(void)t;
+	uint8_t found = 0;
+	for (uint8_t i = 0; i < pl->count; i++) {
+		// key and value only differ in the low 3 bits
+		if ((pl->keys[i] ^ pl->values[i]) < 8) {
+			found++;
+		}
+	}
+	return (found >= 2 ? FUZZ_RESULT_FAIL : FUZZ_RESULT_OK);
+}
+
+struct restart_env {
+	size_t shrink_calls;
+	size_t count;
+};
+
+static int
+count_restart_shrink_trial_post(
+		const struct fuzz_post_shrink_trial_info* info, void* venv)
+{
+	(void)info;
+	struct restart_env* env = (struct restart_env*)venv;
+	env->shrink_calls++;
+	return FUZZ_HOOK_RUN_CONTINUE;
+}
+
+static int
+save_restart_counterexample(
+		const struct fuzz_counterexample_info* info, void* venv)
+{
+	struct restart_env*     env = (struct restart_env*)venv;
+	const struct pair_list* pl  = info->args[0];
+	env->count                  = pl->count;
+	return FUZZ_HOOK_RUN_CONTINUE;
+}
+
+static struct restart_env
+shrink_pairs_with_restarts(uint64_t seed, size_t restarts)
+{
+	struct restart_env env = {.shrink_calls = 0};
+
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop1     = prop_fewer_than_two_near_pairs,
+			.type_info = {&pair_list_info},
+			.hooks =
+					{
+							.pre_trial = halt_after_first_failure,
+							.post_shrink_trial =
+									count_restart_shrink_trial_post,
+							.counterexample = save_restart_counterexample,
+							.env = &env,
+					},
+			.trials = 100000,
+			.seed   = seed,
+			.shrink = {.restarts = restarts},
+	};
+
+	(void)fuzz_run(&cfg);
+	return env;
+}
+
+// Restarting from the same failure and keeping the smallest result
+// should never report anything larger than shrinking once.
+TEST
+restarts_keep_smallest_result(void)
+{
+	for (uint64_t seed = 1; seed <= 10; seed++) {
+		struct restart_env once = shrink_pairs_with_restarts(seed, 0);
+		struct restart_env best = shrink_pairs_with_restarts(seed, 4);
+		ASSERT(once.count >= 2);
+		ASSERT(best.count >= 2);
+		ASSERT(best.count <= once.count);
+		ASSERTm("should shrink again from the start",
+				best.shrink_calls > once.shrink_calls);
+	}
+	PASS();
+}
+
+#if !defined(_WIN32)
+struct forked_restart_env {
+	pid_t  parent;
+	size_t count;
+};
+
+// Stop shrinking right away, but only in the process that started the
+// run, so only restarts in forked workers can shrink anything.
+static int
+halt_shrinking_in_parent(const struct fuzz_pre_shrink_info* info, void* venv)
+{
+	(void)info;
+	const struct forked_restart_env* env = venv;
+	return (getpid() == env->parent ? FUZZ_HOOK_RUN_HALT
+					: FUZZ_HOOK_RUN_CONTINUE);
+}
+
+static int
+save_forked_restart_counterexample(
+		const struct fuzz_counterexample_info* info, void* venv)
+{
+	struct forked_restart_env* env = venv;
+	const struct pair_list*    pl  = info->args[0];
+	env->count                     = pl->count;
+	return FUZZ_HOOK_RUN_CONTINUE;
+}
+
+static size_t
+shrink_pairs_in_workers_only(uint64_t seed, size_t restarts)
+{
+	struct forked_restart_env env = {.parent = getpid()};
+
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop1     = prop_fewer_than_two_near_pairs,
+			.type_info = {&pair_list_info},
+			.hooks =
+					{
+							.pre_trial = halt_after_first_failure,
+							.pre_shrink = halt_shrinking_in_parent,
+							.counterexample = save_forked_restart_counterexample,
+							.env = &env,
+					},
+			.fork =
+					{
+							.enable  = true,
+							.workers = 2,
+					},
+			.trials = 100000,
+			.seed   = seed,
+			.shrink = {.restarts = restarts},
+	};
+
+	(void)fuzz_run(&cfg);
+	return env.count;
+}
+#endif
+
+// With forking, the restarts run in forked workers at the same time as
+// the first run, and their results come back to be compared with it.
+TEST
+restarts_run_in_forked_workers(void)
+{
+#if defined(_WIN32)
+	SKIP();
+#else
+	bool smaller = false;
+	for (uint64_t seed = 1; seed <= 5; seed++) {
+		const size_t unshrunk = shrink_pairs_in_workers_only(seed, 0);
+		const size_t shrunk   = shrink_pairs_in_workers_only(seed, 2);
+		ASSERT(shrunk >= 2);
+		ASSERT(shrunk <= unshrunk);
+		if (shrunk < unshrunk) {
+			smaller = true;
+		}
+	}
+	ASSERTm("restarts in workers should shrink", smaller);
+	PASS();
+#endif
+}
+
+// A long run of 1-bit requests, followed by one too wide to store its
+// size in a byte.
+#define FLAGS_TAIL_BITS 300
+
+struct flags {
+	size_t   count;
+	size_t   set;
+	uint64_t tail[FLAGS_TAIL_BITS / 64 + 1];
+};
+
+static int
+flags_alloc(struct fuzz* t, void* env, void** output)
+{
+	(void)env;
+	struct flags* res = calloc(1, sizeof(*res));
+	if (res == NULL) {
+		return FUZZ_RESULT_ERROR_MEMORY;
+	}
+	res->count = fuzz_random_bits(t, 12);
+	for (size_t i = 0; i < res->count; i++) {
+		res->set += fuzz_random_bits(t, 1);
+	}
+	fuzz_random_bits_bulk(t, FLAGS_TAIL_BITS, res->tail);
+	*output = res;
+	return FUZZ_RESULT_OK;
+}
+
+static void
+flags_print(FILE* f, const void* instance, void* env)
+{
+	(void)env;
+	const struct flags* fl = (const struct flags*)instance;
+	fprintf(f, "%zu of %zu set, tail", fl->set, fl->count);
+	for (size_t i = 0; i < FLAGS_TAIL_BITS / 64 + 1; i++) {
+		fprintf(f, " %016" PRIx64, fl->tail[i]);
+	}
+}
+
+static struct fuzz_type_info flags_info = {
+		.alloc = flags_alloc,
+		.free  = fuzz_generic_free_cb,
+		.print = flags_print,
+		.autoshrink_config =
+				{
+						.enable = true,
+				},
+};
+
+static size_t
+tail_bits_set(const struct flags* fl)
+{
+	size_t res = 0;
+	for (size_t i = 0; i < FLAGS_TAIL_BITS / 64 + 1; i++) {
+		for (uint64_t w = fl->tail[i]; w != 0; w &= w - 1) {
+			res++;
+		}
+	}
+	return res;
+}
+
+static int
+prop_fewer_than_20_set_or_empty_tail(struct fuzz* t, void* arg1)
+{
+	const struct flags* fl = (const struct flags*)arg1;
+	(void)t;
+	return (fl->set >= 20 && tail_bits_set(fl) > 0) ? FUZZ_RESULT_FAIL
+							: FUZZ_RESULT_OK;
+}
+
+static int
+flags_minimal_trial_post_hook(
+		const struct fuzz_post_trial_info* info, void* penv)
+{
+	struct hook_env* env = (struct hook_env*)penv;
+	if (info->result == FUZZ_RESULT_FAIL) {
+		const struct flags* fl = info->args[0];
+		if (fl->set == 20 && tail_bits_set(fl) == 1) {
+			env->minimal = true;
+		}
+	}
+
+	fuzz_print_trial_result(&env->print_env, info);
+	return FUZZ_HOOK_RUN_CONTINUE;
+}
+
+// Pools with thousands of 1-bit requests and a wide one after them
+// should still find every request's offset while shrinking.
+TEST
+tiny_and_wide_requests_shrink_to_minimal(void)
+{
+	uint64_t seed = fuzz_seed_of_time();
+	int      res;
+
+	struct hook_env env = {.tag = 'E', .minimal = false};
+
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop1     = prop_fewer_than_20_set_or_empty_tail,
+			.type_info = {&flags_info},
+			.hooks =
+					{
+							.pre_trial = halt_after_first_failure,
+							.post_trial = flags_minimal_trial_post_hook,
+							.env = &env,
+					},
+			.trials = 1000,
+			.seed   = seed,
+	};
+
+	res = fuzz_run(&cfg);
+	ASSERT_EQm("should find counter-examples", FUZZ_RESULT_FAIL, res);
+	ASSERTm("should shrink to 20 set flags and one tail bit", env.minimal);
+	PASS();
+}
+
+// Draw as many bits as the type env says.
+static int
+sized_alloc(struct fuzz* t, void* env, void** output)
+{
+	const size_t bits = *(const size_t*)env;
+	uint64_t*    res  = calloc(bits / 64 + 1, sizeof(uint64_t));
+	if (res == NULL) {
+		return FUZZ_RESULT_ERROR_MEMORY;
+	}
+	fuzz_random_bits_bulk(t, (uint32_t)bits, res);
+	*output = res;
+	return FUZZ_RESULT_OK;
+}
+
+// A pool for an argument that drew lots of bits in an earlier trial
+// should start out large enough, and the size hint should decay.
+TEST
+bit_pools_are_sized_from_earlier_trials(void)
+{
+	size_t                bits      = 100000;
+	struct fuzz_type_info sized_info = {
+			.alloc = sized_alloc,
+			.free  = fuzz_generic_free_cb,
+			.env   = &bits,
+			.autoshrink_config =
+					{
+							.enable = true,
+					},
+	};
+	struct fuzz*           t   = NULL;
+	struct fuzz_run_config cfg = {
+			.prop1     = unused,
+			.type_info = {&sized_info},
+	};
+	ASSERT_EQ(FUZZ_RUN_INIT_OK, fuzz_run_init(&cfg, &t));
+
+	struct autoshrink_env* env =
+			fuzz_autoshrink_alloc_env(t, 0, &sized_info);
+	ASSERT(env);
+	void* instance = NULL;
+	ASSERT_EQ(FUZZ_RESULT_OK, fuzz_autoshrink_alloc(t, env, &instance));
+	free(instance);
+	fuzz_autoshrink_free_env(t, env);
+	ASSERT_EQ_FMT((size_t)100000, t->prng.pool_bits[0], "%zu");
+
+	bits = 8;
+	env  = fuzz_autoshrink_alloc_env(t, 0, &sized_info);
+	ASSERT(env);
+	ASSERT_EQ(FUZZ_RESULT_OK, fuzz_autoshrink_alloc(t, env, &instance));
+	ASSERTm("should presize the pool", env->bit_pool->bits_ceil >= 100000);
+	ASSERT_EQ_FMT((size_t)64, env->bit_pool->bits_filled, "%zu");
+	free(instance);
+	fuzz_autoshrink_free_env(t, env);
+	ASSERT_EQ_FMT((size_t)100000 - 100000 / 8, t->prng.pool_bits[0],
+			"%zu");
+
+	fuzz_run_free(t);
+	PASS();
+}
+
+#define MODEL_PATH "test_fuzz_autoshrink_model.txt"
+
+// The weights learned while shrinking should be saved under the
+// property's name, keeping other properties' lines, and loaded by the
+// next run of the same property.
+TEST
+learned_model_is_saved_and_loaded(void)
+{
+	FILE* f = fopen(MODEL_PATH, "w");
+	ASSERT(f != NULL);
+	fprintf(f, "0 80 40 40 30 40 other property\n");
+	fclose(f);
+
+	struct restart_env     env = {.shrink_calls = 0};
+	struct fuzz_run_config cfg = {
+			.name      = "saved model",
+			.prop1     = prop_fewer_than_two_near_pairs,
+			.type_info = {&pair_list_info},
+			.hooks =
+					{
+							.pre_trial = halt_after_first_failure,
+							.counterexample = save_restart_counterexample,
+							.env = &env,
+					},
+			.trials = 100000,
+			.seed   = 1,
+			.shrink = {.model_path = MODEL_PATH},
+	};
+	ASSERT_EQ_FMT(FUZZ_RESULT_FAIL, fuzz_run(&cfg), "%d");
+
+	f = fopen(MODEL_PATH, "r");
+	ASSERT(f != NULL);
+	char     line[256];
+	bool     other = false;
+	bool     saved = false;
+	unsigned w[5];
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (strcmp(line, "0 80 40 40 30 40 other property\n") == 0) {
+			other = true;
+		} else if (sscanf(line, "0 %x %x %x %x %x saved model",
+					   &w[0], &w[1], &w[2], &w[3],
+					   &w[4]) == 5) {
+			saved = true;
+		}
+	}
+	fclose(f);
+	ASSERTm("should keep other properties' weights", other);
+	ASSERTm("should save learned weights", saved);
+
+	struct fuzz* t = NULL;
+	ASSERT_EQ(FUZZ_RUN_INIT_OK, fuzz_run_init(&cfg, &t));
+	ASSERTm("should load saved weights", t->shrink.model_set[0]);
+	for (size_t i = 0; i < 5; i++) {
+		ASSERT_EQ_FMT(w[i], (unsigned)t->shrink.model_weights[0][i],
+				"%u");
+	}
+	fuzz_run_free(t);
+
+	remove(MODEL_PATH);
+	PASS();
+}
+
+static int
+nibble_alloc(struct fuzz* t, void* env, void** output)
+{
+	(void)env;
+	uint8_t* res = malloc(sizeof(*res));
+	if (res == NULL) {
+		return FUZZ_RESULT_ERROR_MEMORY;
+	}
+	*res    = (uint8_t)fuzz_random_bits_tagged(t, 4, FUZZ_REQ_INT);
+	*output = res;
+	return FUZZ_RESULT_OK;
+}
+
+static void
+nibble_print(FILE* f, const void* instance, void* env)
+{
+	(void)env;
+	fprintf(f, "%u", *(const uint8_t*)instance);
+}
+
+static struct fuzz_type_info nibble_info = {
+		.alloc = nibble_alloc,
+		.free  = fuzz_generic_free_cb,
+		.print = nibble_print,
+		.autoshrink_config =
+				{
+						.enable = true,
+				},
+};
+
+static int
+prop_not_equal_and_at_least_3(struct fuzz* t, void* arg1, void* arg2)
+{
+	const uint8_t x = *(const uint8_t*)arg1;
+	const uint8_t y = *(const uint8_t*)arg2;
+	(void)t;
+	return (x == y && x >= 3) ? FUZZ_RESULT_FAIL : FUZZ_RESULT_OK;
+}
+
+static int
+nibble_pair_minimal_trial_post_hook(
+		const struct fuzz_post_trial_info* info, void* penv)
+{
+	struct hook_env* env = (struct hook_env*)penv;
+	if (info->result == FUZZ_RESULT_FAIL) {
+		const uint8_t x = *(const uint8_t*)info->args[0];
+		const uint8_t y = *(const uint8_t*)info->args[1];
+		if (x == 3 && y == 3) {
+			env->minimal = true;
+		}
+	}
+
+	fuzz_print_trial_result(&env->print_env, info);
+	return FUZZ_HOOK_RUN_CONTINUE;
+}
+
+// Changing either argument on its own makes the property pass, so
+// they can only shrink by changing both at once.
+TEST
+dependent_args_shrink_together(void)
+{
+	uint64_t seed = fuzz_seed_of_time();
+	int      res;
+
+	struct hook_env env = {.tag = 'E', .minimal = false};
+
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop2     = prop_not_equal_and_at_least_3,
+			.type_info = {&nibble_info, &nibble_info},
+			.hooks =
+					{
+							.pre_trial = halt_after_first_failure,
+							.post_trial = nibble_pair_minimal_trial_post_hook,
+							.env = &env,
+					},
+			.trials = 1000,
+			.seed   = seed,
+	};
+
+	res = fuzz_run(&cfg);
+	ASSERT_EQm("should find counter-examples", FUZZ_RESULT_FAIL, res);
+	ASSERTm("should shrink to 3, 3", env.minimal);
+	PASS();
+}
+
 static int
 random_bulk_bits_contains_23(struct fuzz* t, void* arg1)
 {
@@ -1439,6 +2361,7 @@ SUITE(autoshrink)
 
 	// Various tests for single autoshrinking steps, with an injected PRNG
 	RUN_TEST(ll_drop_nothing);
+	RUN_TEST(ll_drop_nothing_is_rejected);
 	RUN_TEST(ll_drop_nothing_but_do_truncate);
 	RUN_TEST(ll_drop_first);
 	RUN_TEST(ll_drop_third_and_fourth);
@@ -1464,6 +2387,16 @@ SUITE(autoshrink)
 			prop_no_seq_of_3);
 
 	RUN_TESTp(ia_prop, "not starting with 9", prop_not_start_with_9);
+	RUN_TEST(ia_passes_shrink_to_minimal);
+	RUN_TEST(tagged_requests_shrink_to_minimal);
+	RUN_TEST(spans_shrink_to_minimal);
+	RUN_TEST(dependent_args_shrink_together);
+	RUN_TEST(restarts_keep_smallest_result);
+	RUN_TEST(restarts_run_in_forked_workers);
+	RUN_TEST(learned_model_is_saved_and_loaded);
+	RUN_TEST(tiny_and_wide_requests_shrink_to_minimal);
+	RUN_TEST(bit_pools_are_sized_from_earlier_trials);
+	RUN_TEST(shrinking_does_not_repeat_candidates);
 
 	RUN_TEST(bulk_random_bits);
 
@@ -343,11 +343,72 @@ gen_and_print(void)
 	PASS();
 }
 
+// Property: a + b + c + d < 1000, for inline uint32_t arguments.
+static int
+prop_inline_sum_lt_1000(struct fuzz* t, void* arg1, void* arg2, void* arg3,
+		void* arg4)
+{
+	(void)t;
+	const uint64_t sum = (uint64_t)FUZZ_INLINE_VALUE(uint32_t, arg1) +
+			     FUZZ_INLINE_VALUE(uint32_t, arg2) +
+			     FUZZ_INLINE_VALUE(uint32_t, arg3) +
+			     FUZZ_INLINE_VALUE(uint32_t, arg4);
+	return sum < 1000 ? FUZZ_RESULT_OK : FUZZ_RESULT_FAIL;
+}
+
+static int
+inline_sum_trial_post(const struct fuzz_post_trial_info* info, void* env)
+{
+	uint64_t* sum = (uint64_t*)env;
+	if (info->result == FUZZ_RESULT_FAIL && *sum == 0) { // first only
+		for (uint8_t i = 0; i < info->arity; i++) {
+			*sum += FUZZ_INLINE_VALUE(uint32_t, info->args[i]);
+		}
+	}
+	return FUZZ_HOOK_RUN_CONTINUE;
+}
+
+TEST
+inline_builtins_shrink_to_minimal(void)
+{
+	const struct fuzz_type_info* u32 = fuzz_get_builtin_inline_type_info(
+			FUZZ_BUILTIN_uint32_t);
+	ASSERT(u32 != NULL);
+	ASSERT_EQ(NULL, u32->free);
+
+	uint64_t               sum = 0;
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop4     = prop_inline_sum_lt_1000,
+			.type_info = {u32, u32, u32, u32},
+			.seed      = 1,
+			.hooks =
+					{
+							.post_trial = inline_sum_trial_post,
+							.env        = &sum,
+					},
+	};
+
+	ASSERT_EQ_FMT(FUZZ_RESULT_FAIL, fuzz_run(&cfg), "%d");
+	ASSERT_EQ_FMT((uint64_t)1000, sum, "%" PRIu64);
+
+	// Values round-trip through the argument pointer.
+	void* arg = FUZZ_INLINE_ARG(int8_t, -3);
+	ASSERT_EQ_FMT(-3, FUZZ_INLINE_VALUE(int8_t, arg), "%d");
+	arg = FUZZ_INLINE_ARG(float, 1.5f);
+	ASSERT_EQ(1.5f, FUZZ_INLINE_VALUE(float, arg));
+
+	ASSERT_EQ(NULL, fuzz_get_builtin_inline_type_info(
+				FUZZ_BUILTIN_char_ARRAY));
+	PASS();
+}
+
 SUITE(aux)
 {
 	// builtins
 	RUN_TEST(a_squared_lte_fixed);
 	RUN_TEST(a_squared_lt_b);
+	RUN_TEST(inline_builtins_shrink_to_minimal);
 
 	// Tests for other misc. aux stuff
 	RUN_TEST(pass_autoscaling);
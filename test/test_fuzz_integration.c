@@ -3,18 +3,22 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <signal.h>
+#include <time.h>
 
 #if !defined(_WIN32)
+#include <dirent.h>
 #include <poll.h>
 #include <sys/resource.h>
 #include <sys/time.h>
 #include <sys/wait.h>
+#include <unistd.h>
 #endif
 
 #include "fuzz.h"
 #include "greatest.h"
 #include "polyfill.h"
 #include "rng.h"
+#include "run.h"
 #include "types_internal.h"
 
 #define COUNT(X) (sizeof(X) / sizeof(X[0]))
@@ -1048,6 +1052,248 @@ save_local_minimum_and_re_run(void)
 	PASS();
 }
 
+struct shrink_limit_env {
+	size_t   shrink_calls;
+	bool     reported;
+	bool     incomplete;
+	uint32_t counterexample;
+};
+
+static int
+count_shrink_calls_shrink_trial_post(
+		const struct fuzz_post_shrink_trial_info* info, void* venv)
+{
+	(void)info;
+	struct shrink_limit_env* env = (struct shrink_limit_env*)venv;
+	env->shrink_calls++;
+	return FUZZ_HOOK_RUN_CONTINUE;
+}
+
+static int
+save_shrink_limit_counterexample(
+		const struct fuzz_counterexample_info* info, void* venv)
+{
+	struct shrink_limit_env* env = (struct shrink_limit_env*)venv;
+	env->reported                = true;
+	env->incomplete              = info->incomplete;
+	env->counterexample          = *(uint32_t*)info->args[0];
+	return fuzz_print_counterexample(info, NULL);
+}
+
+TEST
+stop_shrinking_after_max_calls(void)
+{
+	struct shrink_limit_env env = {.reported = false};
+
+	struct fuzz_run_config cfg = {
+			.prop1     = prop_uint_is_lte_12345,
+			.type_info = {&shrink_test_uint_type_info},
+			.shrink    = {.max_calls = 10},
+			.hooks =
+					{
+							.post_shrink_trial =
+									count_shrink_calls_shrink_trial_post,
+							.counterexample = save_shrink_limit_counterexample,
+							.env = (void*)&env,
+					},
+			.trials = 1,
+	};
+
+	int res = fuzz_run(&cfg);
+
+	ASSERT_EQ(FUZZ_RESULT_FAIL, res);
+	ASSERT(env.reported);
+	ASSERTm("should be marked as not fully shrunk", env.incomplete);
+	ASSERT_EQ_FMT((size_t)10, env.shrink_calls, "%zd");
+	ASSERTm("should report a failing counterexample",
+			env.counterexample > 12345);
+	PASS();
+}
+
+static int
+slow_prop_uint_is_lte_12345(struct fuzz* t, void* arg1)
+{
+	const struct timespec one_msec = {.tv_nsec = 1000000};
+	nanosleep(&one_msec, NULL);
+	return prop_uint_is_lte_12345(t, arg1);
+}
+
+TEST
+stop_shrinking_after_max_time(void)
+{
+	struct shrink_limit_env env = {.reported = false};
+
+	struct fuzz_run_config cfg = {
+			.prop1     = slow_prop_uint_is_lte_12345,
+			.type_info = {&shrink_test_uint_type_info},
+			.shrink    = {.max_time_ms = 50},
+			.hooks =
+					{
+							.post_shrink_trial =
+									count_shrink_calls_shrink_trial_post,
+							.counterexample = save_shrink_limit_counterexample,
+							.env = (void*)&env,
+					},
+			.trials = 1,
+	};
+
+	int res = fuzz_run(&cfg);
+
+	ASSERT_EQ(FUZZ_RESULT_FAIL, res);
+	ASSERT(env.reported);
+	ASSERTm("should be marked as not fully shrunk", env.incomplete);
+	ASSERTm("should stop long before shrinking all the way",
+			env.shrink_calls < 1000);
+	ASSERTm("should report a failing counterexample",
+			env.counterexample > 12345);
+	PASS();
+}
+
+// A list of 42s, whose shrink callback's first tactics only change the
+// first value, and whose last tactic drops half of the list.
+#define FORTY_TWOS_LENGTH 1024
+
+struct forty_twos {
+	size_t   length;
+	uint32_t values[FORTY_TWOS_LENGTH];
+};
+
+static int
+forty_twos_alloc(struct fuzz* t, void* env, void** output)
+{
+	(void)t;
+	(void)env;
+	struct forty_twos* ft = malloc(sizeof(*ft));
+	if (ft == NULL) {
+		return FUZZ_RESULT_ERROR_MEMORY;
+	}
+	ft->length = FORTY_TWOS_LENGTH;
+	for (size_t i = 0; i < ft->length; i++) {
+		ft->values[i] = 42;
+	}
+	*output = ft;
+	return FUZZ_RESULT_OK;
+}
+
+static int
+forty_twos_shrink(struct fuzz* t, const void* instance, uint32_t tactic,
+		void* env, void** output)
+{
+	(void)t;
+	(void)env;
+	const struct forty_twos* ft = (const struct forty_twos*)instance;
+	if (tactic > 4) {
+		return FUZZ_SHRINK_NO_MORE_TACTICS;
+	} else if (tactic == 4 && ft->length == 1) {
+		return FUZZ_SHRINK_DEAD_END;
+	}
+
+	struct forty_twos* res = malloc(sizeof(*res));
+	if (res == NULL) {
+		return FUZZ_SHRINK_ERROR;
+	}
+	memcpy(res, ft, sizeof(*res));
+	switch (tactic) {
+	case 0:
+		res->values[0]++;
+		break;
+	case 1:
+		res->values[0]--;
+		break;
+	case 2:
+		res->values[0] *= 2;
+		break;
+	case 3:
+		res->values[0] /= 2;
+		break;
+	case 4: // drop the second half
+		res->length /= 2;
+		break;
+	}
+	*output = res;
+	return FUZZ_SHRINK_OK;
+}
+
+static void
+forty_twos_print(FILE* f, const void* instance, void* env)
+{
+	(void)env;
+	const struct forty_twos* ft = (const struct forty_twos*)instance;
+	fprintf(f, "%zd values, starting with %u", ft->length, ft->values[0]);
+}
+
+static struct fuzz_type_info forty_twos_info = {
+		.alloc  = forty_twos_alloc,
+		.free   = fuzz_generic_free_cb,
+		.print  = forty_twos_print,
+		.shrink = forty_twos_shrink,
+};
+
+static int
+prop_does_not_start_with_42(struct fuzz* t, void* arg1)
+{
+	(void)t;
+	const struct forty_twos* ft = (const struct forty_twos*)arg1;
+	return (ft->length > 0 && ft->values[0] == 42) ? FUZZ_RESULT_FAIL
+						       : FUZZ_RESULT_OK;
+}
+
+struct forty_twos_env {
+	size_t shrink_calls;
+	size_t length;
+};
+
+static int
+count_forty_twos_shrink_trial_post(
+		const struct fuzz_post_shrink_trial_info* info, void* venv)
+{
+	(void)info;
+	struct forty_twos_env* env = (struct forty_twos_env*)venv;
+	env->shrink_calls++;
+	return FUZZ_HOOK_RUN_CONTINUE;
+}
+
+static int
+save_forty_twos_counterexample(
+		const struct fuzz_counterexample_info* info, void* venv)
+{
+	struct forty_twos_env*   env = (struct forty_twos_env*)venv;
+	const struct forty_twos* ft  = info->args[0];
+	env->length                  = ft->length;
+	return fuzz_print_counterexample(info, NULL);
+}
+
+// Once dropping half of the list has made progress, it should be tried
+// first, rather than trying the tactics before it every time.
+TEST
+shrink_tries_successful_tactics_first(void)
+{
+	struct forty_twos_env env = {.shrink_calls = 0};
+
+	struct fuzz_run_config cfg = {
+			.prop1     = prop_does_not_start_with_42,
+			.type_info = {&forty_twos_info},
+			.hooks =
+					{
+							.post_shrink_trial =
+									count_forty_twos_shrink_trial_post,
+							.counterexample = save_forty_twos_counterexample,
+							.env = (void*)&env,
+					},
+			.trials = 1,
+	};
+
+	int res = fuzz_run(&cfg);
+
+	ASSERT_EQ(FUZZ_RESULT_FAIL, res);
+	ASSERT_EQ_FMT((size_t)1, env.length, "%zd");
+	// 5 calls to find the tactic that works, 9 more halvings, and 4
+	// for each of the two rounds at the local minimum. Going in order
+	// every time would take 58.
+	ASSERT_EQ_FMT((size_t)22, env.shrink_calls, "%zd");
+	PASS();
+}
+
 struct repeat_once_env {
 	uint8_t local_minimum_runs;
 	bool    fail;
@@ -1271,6 +1517,58 @@ shrink_crash(void)
 	PASS();
 }
 
+static int
+prop_crash_when_starting_with_42(struct fuzz* t, void* arg1)
+{
+	(void)t;
+	const struct forty_twos* ft = (const struct forty_twos*)arg1;
+	if (ft->length > 0 && ft->values[0] == 42) {
+		abort();
+	}
+	return FUZZ_RESULT_OK;
+}
+
+// With several workers, all five tactics are run at once, and the
+// failing one is kept. Each of the 10 halvings takes one batch of 5
+// calls, then each of the two rounds at the local minimum takes one
+// batch of 4.
+TEST
+shrink_crash_with_parallel_workers(void)
+{
+	if (!FUZZ_POLYFILL_HAVE_FORK) {
+		SKIP();
+	}
+
+	struct forty_twos_env env = {.shrink_calls = 0};
+
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop1     = prop_crash_when_starting_with_42,
+			.type_info = {&forty_twos_info},
+			.fork =
+					{
+							.enable  = true,
+							.timeout = 10000,
+							.workers = 5,
+					},
+			.hooks =
+					{
+							.post_shrink_trial =
+									count_forty_twos_shrink_trial_post,
+							.counterexample = save_forty_twos_counterexample,
+							.env = (void*)&env,
+					},
+			.trials = 1,
+	};
+
+	int res = fuzz_run(&cfg);
+
+	ASSERT_EQ(FUZZ_RESULT_FAIL, res);
+	ASSERT_EQ_FMT((size_t)1, env.length, "%zd");
+	ASSERT_EQ_FMT((size_t)58, env.shrink_calls, "%zd");
+	PASS();
+}
+
 static int
 prop_just_abort(struct fuzz* t, void* arg1)
 {
@@ -1850,6 +2148,921 @@ free_callback_should_be_optional(void)
 	PASS();
 }
 
+struct instance_counts {
+	size_t allocs;
+	size_t reuses;
+	size_t frees;
+};
+
+static int
+counted_uint_alloc(struct fuzz* t, void* env, void** output)
+{
+	struct instance_counts* counts = (struct instance_counts*)env;
+	uint32_t*               res    = malloc(sizeof(*res));
+	if (res == NULL) {
+		return FUZZ_RESULT_ERROR_MEMORY;
+	}
+	counts->allocs++;
+	*res    = (uint32_t)fuzz_random_bits(t, 32);
+	*output = res;
+	return FUZZ_RESULT_OK;
+}
+
+static int
+counted_uint_realloc_into(
+		struct fuzz* t, void* env, void* previous, void** output)
+{
+	struct instance_counts* counts = (struct instance_counts*)env;
+	uint32_t*               res    = (uint32_t*)previous;
+	counts->reuses++;
+	*res    = (uint32_t)fuzz_random_bits(t, 32);
+	*output = res;
+	return FUZZ_RESULT_OK;
+}
+
+static void
+counted_uint_free(void* instance, void* env)
+{
+	struct instance_counts* counts = (struct instance_counts*)env;
+	counts->frees++;
+	free(instance);
+}
+
+// With a realloc_into callback, instances should be rebuilt in place
+// across trials and shrinking, and all freed by the end of the run.
+TEST
+realloc_into_reuses_instances(void)
+{
+	struct instance_counts counts = {.allocs = 0};
+	struct fuzz_type_info  info   = {
+			.alloc        = counted_uint_alloc,
+			.realloc_into = counted_uint_realloc_into,
+			.free         = counted_uint_free,
+			.print        = uint_print,
+			.env          = &counts,
+			.autoshrink_config =
+					{
+							.enable = true,
+					},
+	};
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop1     = prop_triskaidekaphobia,
+			.type_info = {&info},
+			.trials    = 1000,
+			.seed      = 1,
+	};
+
+	int res = fuzz_run(&cfg);
+	ASSERT_EQ_FMT(FUZZ_RESULT_FAIL, res, "%d");
+	ASSERTm("should only allocate a few instances", counts.allocs <= 2);
+	ASSERTm("should rebuild instances in place", counts.reuses > 1000);
+	ASSERT_EQ_FMT(counts.allocs, counts.frees, "%zu");
+	PASS();
+}
+
+struct counted_vec {
+	size_t   count;
+	uint32_t values[];
+};
+
+// Resize the vector to a new random length, which can move it.
+static int
+counted_vec_realloc_into(
+		struct fuzz* t, void* env, void* previous, void** output)
+{
+	struct instance_counts* counts = (struct instance_counts*)env;
+	const size_t            count  = 1 + fuzz_random_bits(t, 5);
+	const size_t            size   = sizeof(struct counted_vec) +
+				count * sizeof(uint32_t);
+	struct counted_vec*     res    = realloc(previous, size);
+	if (res == NULL) {
+		counted_uint_free(previous, env);
+		return FUZZ_RESULT_ERROR_MEMORY;
+	}
+	counts->reuses++;
+	res->count = count;
+	for (size_t i = 0; i < count; i++) {
+		res->values[i] = (uint32_t)fuzz_random_bits(t, 32);
+	}
+	*output = res;
+	return FUZZ_RESULT_OK;
+}
+
+static int
+counted_vec_alloc(struct fuzz* t, void* env, void** output)
+{
+	struct instance_counts* counts = (struct instance_counts*)env;
+	counts->allocs++;
+	return counted_vec_realloc_into(t, env, NULL, output);
+}
+
+static void
+counted_vec_print(FILE* f, const void* instance, void* env)
+{
+	(void)env;
+	fprintf(f, "%zu values", ((const struct counted_vec*)instance)->count);
+}
+
+static int
+prop_counted_vec_short(struct fuzz* t, void* arg1)
+{
+	(void)t;
+	const struct counted_vec* v = (const struct counted_vec*)arg1;
+	return v->count < 24 ? FUZZ_RESULT_OK : FUZZ_RESULT_FAIL;
+}
+
+// A realloc_into callback that resizes the previous instance may move
+// it, and then fuzz must not free it again.
+TEST
+realloc_into_may_move_instances(void)
+{
+	struct instance_counts counts = {.allocs = 0};
+	struct fuzz_type_info  info   = {
+			.alloc        = counted_vec_alloc,
+			.realloc_into = counted_vec_realloc_into,
+			.free         = counted_uint_free,
+			.print        = counted_vec_print,
+			.env          = &counts,
+			.autoshrink_config =
+					{
+							.enable = true,
+					},
+	};
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop1     = prop_counted_vec_short,
+			.type_info = {&info},
+			.trials    = 1000,
+			.seed      = 1,
+	};
+
+	int res = fuzz_run(&cfg);
+	ASSERT_EQ_FMT(FUZZ_RESULT_FAIL, res, "%d");
+	ASSERTm("should rebuild instances", counts.reuses > 1000);
+	ASSERT_EQ_FMT(counts.allocs, counts.frees, "%zu");
+	PASS();
+}
+
+struct arena_list {
+	size_t    count;
+	uint64_t* values;
+};
+
+struct arena_list_env {
+	size_t   allocs;
+	size_t   misaligned;
+	size_t   fail_count; // last failure's count and sum
+	uint64_t fail_sum;
+};
+
+static int
+arena_list_alloc(struct fuzz* t, void* env, void** output)
+{
+	struct arena_list_env* e = (struct arena_list_env*)env;
+	struct arena_list*     l = fuzz_arena_alloc(t, sizeof(*l), 0);
+	if (l == NULL) {
+		return FUZZ_RESULT_ERROR_MEMORY;
+	}
+	l->count  = (size_t)fuzz_random_bits(t, 5);
+	l->values = fuzz_arena_alloc(t, l->count * sizeof(uint64_t), 64);
+	if (l->values == NULL && l->count > 0) {
+		return FUZZ_RESULT_ERROR_MEMORY;
+	}
+	e->allocs++;
+	if ((uintptr_t)l % 16 != 0 || (uintptr_t)l->values % 64 != 0) {
+		e->misaligned++;
+	}
+	for (size_t i = 0; i < l->count; i++) {
+		l->values[i] = fuzz_random_bits(t, 10);
+	}
+	*output = l;
+	return FUZZ_RESULT_OK;
+}
+
+static uint64_t
+arena_list_sum(const struct arena_list* l)
+{
+	uint64_t sum = 0;
+	for (size_t i = 0; i < l->count; i++) {
+		sum += l->values[i];
+	}
+	return sum;
+}
+
+static int
+prop_arena_list_sum_is_small(struct fuzz* t, void* arg1)
+{
+	(void)t;
+	struct arena_list* l = (struct arena_list*)arg1;
+	return arena_list_sum(l) < 1000 ? FUZZ_RESULT_OK : FUZZ_RESULT_FAIL;
+}
+
+// The instance is gone once the trial ends, so save what's needed.
+static int
+arena_list_trial_post(const struct fuzz_post_trial_info* info, void* env)
+{
+	struct arena_list_env* e = (struct arena_list_env*)env;
+	if (info->result == FUZZ_RESULT_FAIL) {
+		const struct arena_list* l = (struct arena_list*)info->args[0];
+		e->fail_count              = l->count;
+		e->fail_sum                = arena_list_sum(l);
+	}
+	return FUZZ_HOOK_RUN_CONTINUE;
+}
+
+// Instances allocated from the arena should be generated and shrunk
+// without a free callback, and keep the requested alignment.
+TEST
+arena_instances_need_no_free(void)
+{
+	struct arena_list_env env  = {.allocs = 0};
+	struct fuzz_type_info info = {
+			.alloc = arena_list_alloc,
+			.env   = &env,
+			.autoshrink_config =
+					{
+							.enable = true,
+					},
+	};
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop1     = prop_arena_list_sum_is_small,
+			.type_info = {&info},
+			.trials    = 100,
+			.seed      = 1,
+			.hooks =
+					{
+							.post_trial = arena_list_trial_post,
+							.env        = &env,
+					},
+	};
+
+	int res = fuzz_run(&cfg);
+	ASSERT_EQ_FMT(FUZZ_RESULT_FAIL, res, "%d");
+	ASSERT(env.allocs > 100);
+	ASSERT_EQ_FMT((size_t)0, env.misaligned, "%zu");
+	ASSERT(env.fail_sum >= 1000);
+	ASSERT(env.fail_count <= 2);
+	PASS();
+}
+
+// A runner should give each run a clean bloom filter and RNG, so
+// repeated runs get the same results as separate calls to fuzz_run.
+TEST
+runner_resets_state_between_runs(void)
+{
+	struct fuzz_runner* runner = fuzz_runner_new();
+	ASSERT(runner != NULL);
+
+	struct fuzz_run_report report = {.pass = 0};
+	struct fuzz_run_config cfg    = {
+			.prop1     = prop_bool_tautology,
+			.type_info = {&bool_info},
+			.trials    = 100,
+			.hooks =
+					{
+							.post_run = save_report_run_post,
+							.env = (void*)&report,
+					},
+	};
+	struct fuzz_run_config other = {
+			.name      = __func__,
+			.prop1     = prop_triskaidekaphobia,
+			.type_info = {&uint_type_info_no_free},
+			.trials    = 1000,
+			.seed      = 1,
+	};
+
+	for (size_t i = 0; i < 3; i++) {
+		memset(&report, 0x00, sizeof(report));
+		ASSERT_EQ(FUZZ_RESULT_FAIL, fuzz_runner_run(runner, &cfg));
+		ASSERT_EQ(2, report.fail);
+		ASSERT_EQ(98, report.dup);
+
+		ASSERT_EQ_FMT(fuzz_run(&other),
+				fuzz_runner_run(runner, &other), "%d");
+	}
+
+	fuzz_runner_free(runner);
+	PASS();
+}
+
+static int
+prop_suite_ok(struct fuzz* t, void* arg1)
+{
+	(void)t;
+	(void)arg1;
+	return FUZZ_RESULT_OK;
+}
+
+#define SUITE_TIMINGS_PATH "test_fuzz_suite_timings.txt"
+
+// fuzz_suite_main should run the selected properties, report failures
+// in its exit status, and save timings for the ones it ran.
+TEST
+suite_runs_selected_properties(void)
+{
+	struct fuzz_run_config props[] = {
+			{
+					.name      = "suite_ok",
+					.prop1     = prop_suite_ok,
+					.type_info = {&uint_type_info_no_free},
+			},
+			{
+					.name      = "suite_fail",
+					.prop1     = prop_triskaidekaphobia,
+					.type_info = {&uint_type_info_no_free},
+					.seed      = 1,
+			},
+			{
+					.name      = "not_selected",
+					.prop1     = prop_triskaidekaphobia,
+					.type_info = {&uint_type_info_no_free},
+			},
+	};
+	const size_t count = sizeof(props) / sizeof(props[0]);
+	remove(SUITE_TIMINGS_PATH);
+
+	char* ok_argv[] = {"suite", "-p", "*_ok", "-j", "1"};
+	ASSERT_EQ(0, fuzz_suite_main(5, ok_argv, props, count));
+
+	char* all_argv[] = {"suite", "-p", "suite_*", "-j", "2", "-t",
+			SUITE_TIMINGS_PATH};
+	ASSERT_EQ(1, fuzz_suite_main(7, all_argv, props, count));
+
+	FILE* f = fopen(SUITE_TIMINGS_PATH, "r");
+	ASSERT(f != NULL);
+	char   line[256];
+	size_t lines = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		ASSERT(strstr(line, " suite_") != NULL);
+		lines++;
+	}
+	fclose(f);
+	remove(SUITE_TIMINGS_PATH);
+	ASSERT_EQ_FMT((size_t)2, lines, "%zu");
+
+	char* bad_argv[] = {"suite", "-j"};
+	ASSERT_EQ(2, fuzz_suite_main(2, bad_argv, props, count));
+	PASS();
+}
+
+// Without a trial count, a run with a time budget should keep going
+// until the time is up, rather than stopping at the default count.
+TEST
+max_duration_limits_trials(void)
+{
+	struct fuzz_run_report report = {.pass = 0};
+	struct fuzz_run_config cfg    = {
+			.prop1           = prop_suite_ok,
+			.type_info       = {&uint_type_info_no_free},
+			.max_duration_ms = 50,
+			.hooks =
+					{
+							.post_run = save_report_run_post,
+							.env = (void*)&report,
+					},
+	};
+
+	ASSERT_EQ(FUZZ_RESULT_OK, fuzz_run(&cfg));
+	ASSERT(report.pass > 0);
+	ASSERT_EQ(0, report.fail);
+	ASSERT(report.elapsed_ms >= 50);
+	// It should stop soon after, but leave room for a slow or busy
+	// machine.
+	ASSERT(report.elapsed_ms < 4000);
+	ASSERT(report.trials_per_sec > 0);
+
+	// With both, the run stops at whichever limit it reaches first,
+	// here the trial count.
+	cfg.trials = 10;
+	memset(&report, 0x00, sizeof(report));
+	ASSERT_EQ(FUZZ_RESULT_OK, fuzz_run(&cfg));
+	ASSERT_EQ(10, report.pass + report.dup);
+
+	// The report from fuzz_run_reporting has the timing too.
+	struct fuzz_run_report direct = {.pass = 0};
+	cfg.trials                    = 0;
+	ASSERT_EQ(FUZZ_RESULT_OK, fuzz_run_reporting(NULL, &cfg, &direct));
+	ASSERT(direct.elapsed_ms >= 50);
+	ASSERT(direct.trials_per_sec > 0);
+	PASS();
+}
+
+static int
+prop_campaign_fails(struct fuzz* t, void* arg1)
+{
+	(void)t;
+	return (*(uint32_t*)arg1 % 4 == 0) ? FUZZ_RESULT_FAIL
+					   : FUZZ_RESULT_OK;
+}
+
+#define CAMPAIGN_STATS_PATH "test_fuzz_campaign_stats.txt"
+
+// A campaign should give most of its time to the property that keeps
+// finding new inputs, stop running one once it fails, and carry its
+// statistics over to the next campaign.
+TEST
+campaign_favors_productive_properties(void)
+{
+	const struct fuzz_run_config props[] = {
+			{
+					.name      = "wide",
+					.prop1     = prop_suite_ok,
+					.type_info = {&uint_type_info_no_free},
+			},
+			{
+					.name      = "narrow",
+					.prop1     = prop_suite_ok,
+					.type_info = {&bool_info},
+			},
+			{
+					.name      = "fails",
+					.prop1     = prop_campaign_fails,
+					.type_info = {&uint_type_info_no_free},
+			},
+	};
+	struct fuzz_campaign_stats  stats[3];
+	struct fuzz_campaign_config cfg = {
+			.props      = props,
+			.prop_count = 3,
+			.budget_ms  = 300,
+			.slice_ms   = 5,
+			.stats_path = CAMPAIGN_STATS_PATH,
+			.stats      = stats,
+	};
+	remove(CAMPAIGN_STATS_PATH);
+
+	ASSERT_EQ(FUZZ_RESULT_FAIL, fuzz_campaign_run(&cfg));
+	ASSERT_EQ(1, stats[2].slices);
+	ASSERT_EQ(1, stats[2].failures);
+	ASSERT(stats[0].slices > 2 * stats[1].slices);
+	ASSERT(stats[0].score > stats[1].score);
+	ASSERT(stats[1].unique < stats[1].trials);
+
+	// Stats for properties that aren't in this table are kept.
+	FILE* f = fopen(CAMPAIGN_STATS_PATH, "a");
+	ASSERT(f != NULL);
+	fputs("3 30 300 200 0 0.250000 other\n", f);
+	fclose(f);
+
+	const uint64_t wide_slices = stats[0].slices;
+	cfg.budget_ms              = 50;
+	ASSERT_EQ(FUZZ_RESULT_FAIL, fuzz_campaign_run(&cfg));
+	ASSERT(stats[0].slices > wide_slices);
+	ASSERT_EQ(2, stats[2].failures);
+
+	f = fopen(CAMPAIGN_STATS_PATH, "r");
+	ASSERT(f != NULL);
+	char line[256];
+	bool kept = false;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (0 == strcmp(line, "3 30 300 200 0 0.250000 other\n")) {
+			kept = true;
+		}
+	}
+	fclose(f);
+	ASSERT(kept);
+
+	remove(CAMPAIGN_STATS_PATH);
+	PASS();
+}
+
+static int
+prop_corpus_rare_failure(struct fuzz* t, void* arg1)
+{
+	(void)t;
+	return (*(uint32_t*)arg1 >= 4000000000U) ? FUZZ_RESULT_FAIL
+						 : FUZZ_RESULT_OK;
+}
+
+struct corpus_env {
+	size_t   fails;
+	uint32_t first_failure;
+};
+
+static int
+corpus_count_failures(const struct fuzz_post_trial_info* info, void* env)
+{
+	struct corpus_env* e = (struct corpus_env*)env;
+	if (info->result == FUZZ_RESULT_FAIL) {
+		if (e->fails++ == 0) {
+			e->first_failure = *(uint32_t*)info->args[0];
+		}
+	}
+	return FUZZ_HOOK_RUN_CONTINUE;
+}
+
+#define CORPUS_DIR "test_fuzz_corpus"
+
+#if !defined(_WIN32)
+// Remove the files in the corpus directory PATH, and return how many
+// there were.
+static size_t
+clear_corpus_dir(const char* path)
+{
+	size_t count = 0;
+	DIR*   dir   = opendir(path);
+	if (dir == NULL) {
+		return 0;
+	}
+	struct dirent* de = NULL;
+	while ((de = readdir(dir)) != NULL) {
+		if (de->d_name[0] == '.') {
+			continue;
+		}
+		char file[512];
+		snprintf(file, sizeof(file), "%s/%s", path, de->d_name);
+		remove(file);
+		count++;
+	}
+	closedir(dir);
+	rmdir(path);
+	return count;
+}
+#endif
+
+// Failures should be saved to the corpus once shrunk, and replayed by
+// later runs before any random trials, even if they would never find
+// them on their own.
+TEST
+corpus_replays_saved_failures(void)
+{
+#if defined(_WIN32)
+	SKIP(); // failures are saved, but not replayed
+#else
+	struct corpus_env      env = {.fails = 0};
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop1     = prop_corpus_rare_failure,
+			.type_info = {fuzz_get_builtin_type_info(
+					FUZZ_BUILTIN_uint32_t)},
+			.trials     = 100,
+			.corpus_dir = CORPUS_DIR,
+			.hooks =
+					{
+							.post_trial = corpus_count_failures,
+							.env = (void*)&env,
+					},
+	};
+	clear_corpus_dir(CORPUS_DIR);
+
+	ASSERT_EQ(FUZZ_RESULT_FAIL, fuzz_run(&cfg));
+	const size_t found = env.fails;
+	ASSERT(found > 0);
+
+	// One trial with another seed doesn't find any...
+	cfg.trials     = 1;
+	cfg.seed       = 12345;
+	cfg.corpus_dir = NULL;
+	env            = (struct corpus_env){.fails = 0};
+	ASSERT_EQ(FUZZ_RESULT_OK, fuzz_run(&cfg));
+
+	// ...but the saved failures are replayed first, already shrunk.
+	cfg.corpus_dir = CORPUS_DIR;
+	ASSERT_EQ(FUZZ_RESULT_FAIL, fuzz_run(&cfg));
+	const size_t saved = clear_corpus_dir(CORPUS_DIR);
+	ASSERT(saved > 0 && saved <= found);
+	ASSERT_EQ_FMT(saved, env.fails, "%zu");
+	ASSERT(env.first_failure >= 4000000000U);
+	PASS();
+#endif
+}
+
+static int
+prop_corpus_value_is_large(struct fuzz* t, void* arg1)
+{
+	(void)t;
+	return (*(uint32_t*)arg1 >= 4000000000U) ? FUZZ_RESULT_OK
+						 : FUZZ_RESULT_FAIL;
+}
+
+#define PACKED_CORPUS_PATH "test_fuzz_corpus.pack"
+
+static long
+packed_corpus_size(void)
+{
+	FILE* f = fopen(PACKED_CORPUS_PATH, "rb");
+	if (f == NULL) {
+		return -1;
+	}
+	long size = -1;
+	if (fseek(f, 0, SEEK_END) == 0) {
+		size = ftell(f);
+	}
+	fclose(f);
+	return size;
+}
+
+static int
+halt_every_trial_pre(const struct fuzz_pre_trial_info* info, void* env)
+{
+	(void)info;
+	(void)env;
+	return FUZZ_HOOK_RUN_HALT;
+}
+
+// Saved failures should be packed into one file once, and replaying it
+// should generate the same arguments, with or without forked workers.
+TEST
+packed_corpus_replays_records(void)
+{
+#if defined(_WIN32)
+	SKIP(); // the corpus directory isn't replayed
+#else
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop1     = prop_corpus_rare_failure,
+			.type_info = {fuzz_get_builtin_type_info(
+					FUZZ_BUILTIN_uint32_t)},
+			.trials     = 100,
+			.corpus_dir = CORPUS_DIR,
+	};
+	clear_corpus_dir(CORPUS_DIR);
+	remove(PACKED_CORPUS_PATH);
+	ASSERT_EQ(FUZZ_RESULT_FAIL, fuzz_run(&cfg));
+
+	// Packing twice doesn't add anything the second time.
+	ASSERT_EQ(FUZZ_RESULT_OK, fuzz_corpus_pack(&cfg, PACKED_CORPUS_PATH));
+	const long packed_size = packed_corpus_size();
+	ASSERT(packed_size > 0);
+	ASSERT_EQ(FUZZ_RESULT_OK, fuzz_corpus_pack(&cfg, PACKED_CORPUS_PATH));
+	ASSERT_EQ_FMT(packed_size, packed_corpus_size(), "%ld");
+	const size_t saved = clear_corpus_dir(CORPUS_DIR);
+	ASSERT(saved > 0);
+
+	// Every record still generates a failing value...
+	struct fuzz_run_report report = {.pass = 0};
+	cfg.corpus_dir                = NULL;
+	cfg.prop1                     = prop_corpus_value_is_large;
+	ASSERT_EQ(FUZZ_RESULT_OK, fuzz_corpus_replay_packed(&cfg,
+						  PACKED_CORPUS_PATH, &report));
+	ASSERT_EQ_FMT(saved, report.pass, "%zu");
+
+	// ...which fails, in forked workers too.
+	cfg.prop1        = prop_corpus_rare_failure;
+	cfg.fork.enable  = true;
+	cfg.fork.workers = 2;
+	ASSERT_EQ(FUZZ_RESULT_FAIL,
+			fuzz_corpus_replay_packed(
+					&cfg, PACKED_CORPUS_PATH, &report));
+	ASSERT_EQ_FMT(saved, report.fail, "%zu");
+	ASSERT_EQ_FMT((size_t)0, report.pass, "%zu");
+
+	// A hook halting the failures' full trials ends the replay, and
+	// isn't an error.
+	cfg.hooks.pre_trial = halt_every_trial_pre;
+	ASSERT_EQ(FUZZ_RESULT_OK, fuzz_corpus_replay_packed(&cfg,
+						  PACKED_CORPUS_PATH, &report));
+	ASSERT_EQ_FMT((size_t)0, report.fail, "%zu");
+	cfg.hooks.pre_trial = NULL;
+
+	// A missing file is an empty corpus.
+	remove(PACKED_CORPUS_PATH);
+	ASSERT_EQ(FUZZ_RESULT_OK, fuzz_corpus_replay_packed(&cfg,
+						  PACKED_CORPUS_PATH, &report));
+	ASSERT_EQ_FMT((size_t)0, report.fail, "%zu");
+	PASS();
+#endif
+}
+
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(_WIN32)
+#define HAVE_COVERAGE_COUNTERS 1
+// Stand-ins for the counters clang adds with inline-8bit-counters,
+// registered the same way its module constructors do.
+void           __sanitizer_cov_8bit_counters_init(char* start, char* end);
+static uint8_t coverage_counters[8];
+#endif
+
+#define COVERAGE_BYTES 4
+
+static int
+coverage_bytes_alloc(struct fuzz* t, void* env, void** instance)
+{
+	(void)env;
+	uint8_t* bytes = malloc(COVERAGE_BYTES);
+	if (bytes == NULL) {
+		return FUZZ_RESULT_ERROR;
+	}
+	for (size_t i = 0; i < COVERAGE_BYTES; i++) {
+		bytes[i] = (uint8_t)fuzz_random_bits(t, 8);
+	}
+	*instance = bytes;
+	return FUZZ_RESULT_OK;
+}
+
+static struct fuzz_type_info coverage_bytes_info = {
+		.alloc             = coverage_bytes_alloc,
+		.free              = fuzz_generic_free_cb,
+		.autoshrink_config = {.enable = true},
+};
+
+// Fails only when every byte is large, checking them one at a time
+// like a parser checking a magic number, with an edge for each.
+static int
+prop_coverage_magic_prefix(struct fuzz* t, void* arg1)
+{
+	(void)t;
+	const uint8_t* bytes = (const uint8_t*)arg1;
+	for (size_t i = 0; i < COVERAGE_BYTES; i++) {
+		if (bytes[i] < 0xF0) {
+			return FUZZ_RESULT_OK;
+		}
+#if HAVE_COVERAGE_COUNTERS
+		coverage_counters[i]++;
+#endif
+	}
+	return FUZZ_RESULT_FAIL;
+}
+
+// Random generation has odds of 1 in 65536 of finding the failure, but
+// once coverage shows each byte being passed, it can be found one byte
+// at a time.
+TEST
+coverage_guides_generation(void)
+{
+#if !HAVE_COVERAGE_COUNTERS
+	SKIP(); // no weak symbols
+#else
+	__sanitizer_cov_8bit_counters_init((char*)coverage_counters,
+			(char*)&coverage_counters[sizeof(coverage_counters)]);
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop1     = prop_coverage_magic_prefix,
+			.type_info = {&coverage_bytes_info},
+			.trials    = 1500,
+			.seed      = 0x5eed,
+	};
+	ASSERT_EQ(FUZZ_RESULT_OK, fuzz_run(&cfg));
+
+	cfg.coverage.enable = true;
+	ASSERT_EQ(FUZZ_RESULT_FAIL, fuzz_run(&cfg));
+
+	// The counters get back from forked workers too.
+	cfg.fork.enable = true;
+	ASSERT_EQ(FUZZ_RESULT_FAIL, fuzz_run(&cfg));
+	PASS();
+#endif
+}
+
+#if HAVE_COVERAGE_COUNTERS
+// Stand-in for the hook clang calls before comparing against a
+// constant, with trace-cmp.
+void __sanitizer_cov_trace_const_cmp4(uint32_t a, uint32_t b);
+#endif
+
+#define DICTIONARY_MAGIC 0xfeedfaceU
+
+static int
+prop_dictionary_magic_tag(struct fuzz* t, void* arg1)
+{
+	(void)t;
+	const uint32_t tag = *(uint32_t*)arg1;
+#if HAVE_COVERAGE_COUNTERS
+	__sanitizer_cov_trace_const_cmp4(DICTIONARY_MAGIC, tag);
+#endif
+	return (tag == DICTIONARY_MAGIC ? FUZZ_RESULT_FAIL : FUZZ_RESULT_OK);
+}
+
+// Random uint32_ts practically never hit the magic number, but once the
+// first trial's comparison adds it to the dictionary, the builtin uses
+// it.
+TEST
+dictionary_finds_compared_constants(void)
+{
+#if !HAVE_COVERAGE_COUNTERS
+	SKIP(); // no weak symbols
+#else
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop1     = prop_dictionary_magic_tag,
+			.type_info = {fuzz_get_builtin_type_info(
+					FUZZ_BUILTIN_uint32_t)},
+			.trials    = 500,
+			.seed      = 0x5eed,
+	};
+	ASSERT_EQ(FUZZ_RESULT_OK, fuzz_run(&cfg));
+
+	cfg.dictionary.enable = true;
+	ASSERT_EQ(FUZZ_RESULT_FAIL, fuzz_run(&cfg));
+
+	// The values get back from forked workers too.
+	cfg.fork.enable = true;
+	ASSERT_EQ(FUZZ_RESULT_FAIL, fuzz_run(&cfg));
+	PASS();
+#endif
+}
+
+static uint8_t libfuzzer_args[2][COVERAGE_BYTES];
+
+static int
+prop_libfuzzer_save_args(struct fuzz* t, void* arg1, void* arg2)
+{
+	(void)t;
+	memcpy(libfuzzer_args[0], arg1, COVERAGE_BYTES);
+	memcpy(libfuzzer_args[1], arg2, COVERAGE_BYTES);
+	return (libfuzzer_args[0][0] == 0xFF ? FUZZ_RESULT_SKIP
+					     : FUZZ_RESULT_OK);
+}
+
+// An engine's input should be split evenly between the arguments, each
+// generated from its part's bytes, with zeroes past the end.
+TEST
+libfuzzer_adapter_maps_bytes_to_args(void)
+{
+	struct fuzz_run_config cfg = {
+			.name      = __func__,
+			.prop2     = prop_libfuzzer_save_args,
+			.type_info =
+					{
+							&coverage_bytes_info,
+							&coverage_bytes_info,
+					},
+	};
+	const uint8_t input[] = {1, 2, 3, 4, 5, 6, 7, 8};
+	ASSERT_EQ(0, fuzz_libfuzzer_adapter(&cfg, input, sizeof(input)));
+	ASSERT_MEM_EQ(&input[0], libfuzzer_args[0], COVERAGE_BYTES);
+	ASSERT_MEM_EQ(&input[4], libfuzzer_args[1], COVERAGE_BYTES);
+
+	const uint8_t exp0[COVERAGE_BYTES] = {1, 2, 3, 0};
+	const uint8_t exp1[COVERAGE_BYTES] = {4, 5, 0, 0};
+	ASSERT_EQ(0, fuzz_libfuzzer_adapter(&cfg, input, 5));
+	ASSERT_MEM_EQ(exp0, libfuzzer_args[0], COVERAGE_BYTES);
+	ASSERT_MEM_EQ(exp1, libfuzzer_args[1], COVERAGE_BYTES);
+
+	// Skipped inputs are kept out of the engine's corpus.
+	const uint8_t skipped[] = {0xFF, 0, 0, 0, 0};
+	ASSERT_EQ(-1, fuzz_libfuzzer_adapter(&cfg, skipped, sizeof(skipped)));
+	fuzz_libfuzzer_adapter_reset();
+	PASS();
+}
+
+#define LIBFUZZER_CORPUS_DIR "test_fuzz_libfuzzer_corpus"
+
+// A failing input should crash the process, once it's been shrunk and
+// saved, and the saved failure should export as an input that generates
+// the same arguments.
+TEST
+libfuzzer_adapter_shares_corpus(void)
+{
+#if defined(_WIN32)
+	SKIP(); // no fork, and failures aren't replayed
+#else
+	struct fuzz_run_config cfg = {
+			.name       = __func__,
+			.prop1      = prop_coverage_magic_prefix,
+			.type_info  = {&coverage_bytes_info},
+			.corpus_dir = CORPUS_DIR,
+	};
+	clear_corpus_dir(CORPUS_DIR);
+	clear_corpus_dir(LIBFUZZER_CORPUS_DIR);
+
+	const uint8_t input[] = {0xFF, 0xFE, 0xFD, 0xFC};
+	fflush(NULL);
+	const pid_t pid = fork();
+	ASSERT(pid != -1);
+	if (pid == 0) {
+		fuzz_libfuzzer_adapter(&cfg, input, sizeof(input));
+		_exit(EXIT_SUCCESS); // not reached
+	}
+	int status = 0;
+	ASSERT_EQ(pid, waitpid(pid, &status, 0));
+	ASSERT(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+
+	ASSERT_EQ(FUZZ_RESULT_OK,
+			fuzz_libfuzzer_export(&cfg, LIBFUZZER_CORPUS_DIR));
+	DIR* dir = opendir(LIBFUZZER_CORPUS_DIR);
+	ASSERT(dir != NULL);
+	struct dirent* de = NULL;
+	uint8_t        exported[2 * COVERAGE_BYTES];
+	size_t         size = 0;
+	while ((de = readdir(dir)) != NULL) {
+		if (de->d_name[0] != '.') {
+			char path[512];
+			snprintf(path, sizeof(path), "%s/%s",
+					LIBFUZZER_CORPUS_DIR, de->d_name);
+			FILE* f = fopen(path, "rb");
+			ASSERT(f != NULL);
+			size = fread(exported, 1, sizeof(exported), f);
+			fclose(f);
+		}
+	}
+	closedir(dir);
+	ASSERT_EQ_FMT((size_t)1, clear_corpus_dir(CORPUS_DIR), "%zu");
+	ASSERT_EQ_FMT((size_t)1, clear_corpus_dir(LIBFUZZER_CORPUS_DIR),
+			"%zu");
+
+	// It's shrunk, but still fails.
+	ASSERT_EQ_FMT((size_t)COVERAGE_BYTES, size, "%zu");
+	for (size_t i = 0; i < COVERAGE_BYTES; i++) {
+		ASSERT(exported[i] >= 0xF0);
+	}
+	ASSERT(memcmp(input, exported, COVERAGE_BYTES) != 0);
+	PASS();
+#endif
+}
+
 SUITE(integration)
 {
 	RUN_TEST(generated_unsigned_ints_are_positive);
@@ -1864,11 +3077,15 @@ SUITE(integration)
 	RUN_TEST(gen_pre_halt);
 	RUN_TEST(only_shrink_three_times);
 	RUN_TEST(save_local_minimum_and_re_run);
+	RUN_TEST(stop_shrinking_after_max_calls);
+	RUN_TEST(stop_shrinking_after_max_time);
+	RUN_TEST(shrink_tries_successful_tactics_first);
 	RUN_TEST(repeat_local_minimum_once);
 	RUN_TEST(repeat_first_successful_shrink_once_then_halt);
 
 	// Tests for forking/timeouts
 	RUN_TEST(shrink_crash);
+	RUN_TEST(shrink_crash_with_parallel_workers);
 	RUN_TEST(shrink_infinite_loop);
 	RUN_TEST(shrink_abort_immediately_to_stress_forking__slow);
 	RUN_TEST(shrink_and_SIGUSR1_on_timeout);
@@ -1882,4 +3099,17 @@ SUITE(integration)
 	RUN_TEST(expected_seed_should_be_used_first);
 	RUN_TEST(trial_post_hook_gets_correct_args);
 	RUN_TEST(free_callback_should_be_optional);
+	RUN_TEST(realloc_into_reuses_instances);
+	RUN_TEST(realloc_into_may_move_instances);
+	RUN_TEST(arena_instances_need_no_free);
+	RUN_TEST(runner_resets_state_between_runs);
+	RUN_TEST(suite_runs_selected_properties);
+	RUN_TEST(max_duration_limits_trials);
+	RUN_TEST(campaign_favors_productive_properties);
+	RUN_TEST(corpus_replays_saved_failures);
+	RUN_TEST(packed_corpus_replays_records);
+	RUN_TEST(coverage_guides_generation);
+	RUN_TEST(dictionary_finds_compared_constants);
+	RUN_TEST(libfuzzer_adapter_maps_bytes_to_args);
+	RUN_TEST(libfuzzer_adapter_shares_corpus);
 }
@@ -20,18 +20,27 @@
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 
 static const char* c_files[] = {
+		"arena.c",
 		"autoshrink.c",
 		"aux_builtin.c",
 		"aux.c",
+		"campaign.c",
+		"corpus.c",
+		"coverage.c",
+		"dictionary.c",
 		"bloom.c",
 		"call.c",
 		"hash.c",
+		"libfuzzer.c",
+		"memo.c",
+		"pack.c",
 		"poll_windows.c",
 		"polyfill.c",
 		"random.c",
 		"rng.c",
 		"run.c",
 		"shrink.c",
+		"suite.c",
 		"fuzz.c",
 		"trial.c",
 };